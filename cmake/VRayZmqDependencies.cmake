@@ -0,0 +1,59 @@
+# Finds libzmq and the cppzmq header and defines the imported targets vray::libzmq and vray::cppzmq
+# Used by the build and by the installed package config, so both resolve the dependencies the same way
+#
+# libzmq is searched as ZeroMQ CMake package, then with pkg-config, then as plain library and header
+# zmq.hpp is searched in VRAY_CPPZMQ_HINT first, the cppzmq submodule or the installed headers, then as cppzmq package
+
+include_guard(GLOBAL)
+
+if(NOT TARGET vray::libzmq)
+	add_library(vray::libzmq INTERFACE IMPORTED)
+
+	find_package(ZeroMQ CONFIG QUIET)
+	if(TARGET libzmq)
+		set_target_properties(vray::libzmq PROPERTIES INTERFACE_LINK_LIBRARIES libzmq)
+	elseif(TARGET libzmq-static)
+		set_target_properties(vray::libzmq PROPERTIES INTERFACE_LINK_LIBRARIES libzmq-static)
+	else()
+		find_package(PkgConfig QUIET)
+		if(PKG_CONFIG_FOUND)
+			pkg_check_modules(VRAY_LIBZMQ QUIET IMPORTED_TARGET libzmq)
+		endif()
+
+		if(TARGET PkgConfig::VRAY_LIBZMQ)
+			set_target_properties(vray::libzmq PROPERTIES INTERFACE_LINK_LIBRARIES PkgConfig::VRAY_LIBZMQ)
+		else()
+			find_path(VRAY_LIBZMQ_INCLUDE_DIR zmq.h)
+			find_library(VRAY_LIBZMQ_LIBRARY NAMES zmq libzmq)
+			if(NOT VRAY_LIBZMQ_INCLUDE_DIR OR NOT VRAY_LIBZMQ_LIBRARY)
+				message(FATAL_ERROR "libzmq not found, add it's install prefix to CMAKE_PREFIX_PATH")
+			endif()
+			set_target_properties(vray::libzmq PROPERTIES
+				INTERFACE_INCLUDE_DIRECTORIES "${VRAY_LIBZMQ_INCLUDE_DIR}"
+				INTERFACE_LINK_LIBRARIES "${VRAY_LIBZMQ_LIBRARY}"
+			)
+		endif()
+	endif()
+endif()
+
+if(NOT TARGET vray::cppzmq)
+	add_library(vray::cppzmq INTERFACE IMPORTED)
+
+	find_path(VRAY_CPPZMQ_INCLUDE_DIR zmq.hpp HINTS ${VRAY_CPPZMQ_HINT} NO_DEFAULT_PATH)
+	if(NOT VRAY_CPPZMQ_INCLUDE_DIR)
+		find_package(cppzmq CONFIG QUIET)
+	endif()
+
+	if(NOT VRAY_CPPZMQ_INCLUDE_DIR AND TARGET cppzmq)
+		set_target_properties(vray::cppzmq PROPERTIES INTERFACE_LINK_LIBRARIES "cppzmq;vray::libzmq")
+	else()
+		find_path(VRAY_CPPZMQ_INCLUDE_DIR zmq.hpp)
+		if(NOT VRAY_CPPZMQ_INCLUDE_DIR)
+			message(FATAL_ERROR "zmq.hpp not found, run git submodule update --init or install cppzmq")
+		endif()
+		set_target_properties(vray::cppzmq PROPERTIES
+			INTERFACE_INCLUDE_DIRECTORIES "${VRAY_CPPZMQ_INCLUDE_DIR}"
+			INTERFACE_LINK_LIBRARIES vray::libzmq
+		)
+	endif()
+endif()
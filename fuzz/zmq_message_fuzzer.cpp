@@ -0,0 +1,65 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "zmq_message.hpp"
+#include "zmq_test_values.hpp"
+
+/// libFuzzer target feeding arbitrary bytes to VRayMessage and DeserializerStream
+/// Values that read without error are written back and read again, and must read equal
+/// Build with -fsanitize=fuzzer,address, or define ZMQ_FUZZ_STANDALONE to run saved inputs without libFuzzer
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+	const char * bytes = reinterpret_cast<const char *>(data);
+
+	VRayMessage::Header header;
+	VRayMessage::peekHeader(bytes, size, header);
+
+	zmq::message_t message(data, size);
+	VRayMessage::fromZmqMessage(message);
+
+	DeserializerStream stream(bytes, size);
+	VRayBaseTypes::AttrValue value;
+	stream >> value;
+	if (!stream.good()) {
+		return 0;
+	}
+
+	SerializerStream out;
+	out << value;
+	DeserializerStream in(out.getData(), out.getSize());
+	VRayBaseTypes::AttrValue result;
+	in >> result;
+	if (!in.good() || in.hasMore() || !zmqTestEqual(value, result)) {
+		fprintf(stderr, "Value of type %s does not read back equal\n", value.getTypeAsString());
+		abort();
+	}
+	return 0;
+}
+
+#ifdef ZMQ_FUZZ_STANDALONE
+
+/// Run the target on saved inputs, e.g. crashes found by libFuzzer, or on stdin
+/// Usage: zmq_message_fuzzer [input-file...]
+int main(int argc, char * argv[]) {
+	if (argc < 2) {
+		const std::vector<char> input((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+		return LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+	}
+	for (int c = 1; c < argc; ++c) {
+		std::ifstream file(argv[c], std::ios::binary);
+		if (!file) {
+			printf("Failed to open %s\n", argv[c]);
+			return 1;
+		}
+		const std::vector<char> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+	}
+	printf("Ran %d inputs\n", argc - 1);
+	return 0;
+}
+
+#endif // ZMQ_FUZZ_STANDALONE
@@ -74,7 +74,7 @@ enum RenderMode {
 };
 
 // Values must match VRay::RenderElement::Type
-enum RenderChannelType {
+enum RenderChannelType : int {
 	RenderChannelTypeNone = -1,
 	RenderChannelTypeFragColor = 1,
 	RenderChannelTypeFragTransp,
@@ -253,7 +253,7 @@ typedef AttrSimpleType<double> AttrDouble;
 typedef AttrSimpleType<bool> AttrBool;
 
 struct AttrImage {
-	enum ImageType {
+	enum ImageType : int {
 		NONE = 0,
 		RGBA_REAL,
 		RGB_REAL,
@@ -288,7 +288,7 @@ struct AttrImage {
 	}
 
 	void set(const void * data, size_t size) {
-		this->data.reset(new char[size]);
+		this->data.reset(new char[size], std::default_delete<char[]>());
 		this->size = size;
 		::memcpy(this->data.get(), data, size);
 	}
@@ -302,7 +302,7 @@ struct AttrImage {
 	ImageType imageType; ///< The format of the image data (JPG, RGBA, etc.)
 };
 
-enum ImageSourceType {
+enum ImageSourceType : int {
 	ImageSourceInvalid,
 	RtImageUpdate,
 	ImageReady,
@@ -574,12 +574,12 @@ struct AttrList {
 		m_Ptr.get()->insert(0, value);
 	}
 
-	int getCount() const {
-		return static_cast<int>(m_Ptr.get()->size());
+	size_t getCount() const {
+		return m_Ptr.get()->size();
 	}
 
 	// NOTE: Won't work for AttrList<std::string>
-	int getBytesCount() const {
+	size_t getBytesCount() const {
 		return getCount() * sizeof(T);
 	}
 
@@ -668,6 +668,85 @@ inline ValueType AttrListTransform::getType() const {
 }
 
 
+/// Non owning view of an array in the host application's memory, serialized the same as AttrList<T> so the array
+/// does not have to be copied into an AttrList first. Only for the POD item types, the ones written as one block
+/// Items can be interleaved with other data, e.g. the positions in a vertex buffer with normals and uvs
+template <typename T>
+struct AttrListSpan {
+	/// @data - the first item
+	/// @count - number of items
+	/// @stride - bytes from the start of one item to the start of the next, 0 if the items are packed
+	AttrListSpan(const T * data, size_t count, size_t stride = 0)
+	    : data(data)
+	    , count(count)
+	    , stride(stride ? stride : sizeof(T))
+	{}
+
+	ValueType getType() const ;
+
+	size_t getCount() const {
+		return count;
+	}
+
+	/// Check if the items are next to each other, so they can be copied as one block
+	bool isPacked() const {
+		return stride == sizeof(T);
+	}
+
+	const T & operator[](size_t index) const {
+		return *reinterpret_cast<const T *>(reinterpret_cast<const char *>(data) + index * stride);
+	}
+
+	const T * data; ///< The first item
+	size_t count; ///< Number of items
+	size_t stride; ///< Bytes from the start of one item to the start of the next
+};
+
+typedef AttrListSpan<int>           AttrListSpanInt;
+typedef AttrListSpan<float>         AttrListSpanFloat;
+typedef AttrListSpan<AttrColor>     AttrListSpanColor;
+typedef AttrListSpan<AttrVector>    AttrListSpanVector;
+typedef AttrListSpan<AttrVector2>   AttrListSpanVector2;
+typedef AttrListSpan<AttrMatrix>    AttrListSpanMatrix;
+typedef AttrListSpan<AttrTransform> AttrListSpanTransform;
+
+
+template <>
+inline ValueType AttrListSpanInt::getType() const {
+	return ValueType::ValueTypeListInt;
+}
+
+template <>
+inline ValueType AttrListSpanFloat::getType() const {
+	return ValueType::ValueTypeListFloat;
+}
+
+template <>
+inline ValueType AttrListSpanColor::getType() const {
+	return ValueType::ValueTypeListColor;
+}
+
+template <>
+inline ValueType AttrListSpanVector::getType() const {
+	return ValueType::ValueTypeListVector;
+}
+
+template <>
+inline ValueType AttrListSpanVector2::getType() const {
+	return ValueType::ValueTypeListVector2;
+}
+
+template <>
+inline ValueType AttrListSpanMatrix::getType() const {
+	return ValueType::ValueTypeListMatrix;
+}
+
+template <>
+inline ValueType AttrListSpanTransform::getType() const {
+	return ValueType::ValueTypeListTransform;
+}
+
+
 struct AttrMapChannels {
 
 	ValueType getType() const {
@@ -874,7 +953,7 @@ struct AttrValue {
 	}
 
 	ValueType type;
-	uint8_t data[ATTR_DATA_SIZE];
+	alignas(double) alignas(void *) uint8_t data[ATTR_DATA_SIZE]; ///< Storage for all value types, aligned for each of them
 
 	const char *getTypeAsString() const {
 		switch (type) {
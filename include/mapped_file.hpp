@@ -0,0 +1,280 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <cstdio>
+
+/// Thin cross platform wrapper over a memory mapped file
+/// In Write mode the file is created (or truncated) and can be grown with ::resize, the mapping is moved on resize
+/// so pointers into the data must not be cached across calls to ::resize
+/// In Read mode the whole file is mapped read only
+class MappedFile {
+public:
+	enum class Mode {
+		Read,
+		Write,
+	};
+
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	/// Open and map file
+	/// @path - the file path
+	/// @mode - Read to map existing file, Write to create new file
+	/// @initialSize - initial size of the file in Write mode, ignored in Read mode
+	/// @return - true on success
+	bool open(const char * path, Mode mode, size_t initialSize = 0);
+
+	/// Change the size of the file and remap it, only valid in Write mode
+	/// @size - the new size in bytes
+	/// @return - true on success, on failure the file is closed
+	bool resize(size_t size);
+
+	/// Unmap and close the file, in Write mode the file is truncated to @finalSize
+	/// @finalSize - the size to truncate the file to, pass size() to keep it as is
+	void close(size_t finalSize);
+
+	/// Unmap and close the file keeping it's current size
+	void close();
+
+	/// Check if the file is opened and mapped
+	bool good() const;
+
+	/// Get the size in bytes of the mapping
+	size_t size() const;
+
+	/// Get pointer to the mapped bytes
+	char * data();
+	const char * data() const;
+
+private:
+	/// Map the current file with the requested size
+	bool map(size_t size);
+	/// Unmap the current mapping if any
+	void unmap();
+
+	Mode mode; ///< Mode the file was opened with
+	char * mapping; ///< Pointer to the start of the mapping
+	size_t mappingSize; ///< Size of the current mapping
+
+#ifdef _WIN32
+	HANDLE file; ///< Handle of the opened file
+	HANDLE fileMapping; ///< Handle of the file mapping object
+#else
+	int file; ///< Descriptor of the opened file
+#endif
+};
+
+
+inline MappedFile::MappedFile()
+    : mode(Mode::Read)
+    , mapping(nullptr)
+    , mappingSize(0)
+#ifdef _WIN32
+    , file(INVALID_HANDLE_VALUE)
+    , fileMapping(nullptr)
+#else
+    , file(-1)
+#endif
+{}
+
+inline MappedFile::~MappedFile() {
+	close();
+}
+
+inline bool MappedFile::open(const char * path, Mode mode, size_t initialSize) {
+	close();
+	this->mode = mode;
+
+#ifdef _WIN32
+	if (mode == Mode::Write) {
+		file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	} else {
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	}
+	if (file == INVALID_HANDLE_VALUE) {
+		printf("MappedFile failed to open [%s]\n", path);
+		return false;
+	}
+
+	if (mode == Mode::Read) {
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize)) {
+			close();
+			return false;
+		}
+		initialSize = static_cast<size_t>(fileSize.QuadPart);
+	}
+#else
+	if (mode == Mode::Write) {
+		file = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	} else {
+		file = ::open(path, O_RDONLY);
+	}
+	if (file == -1) {
+		printf("MappedFile failed to open [%s]\n", path);
+		return false;
+	}
+
+	if (mode == Mode::Read) {
+		struct stat info;
+		if (fstat(file, &info) != 0) {
+			close();
+			return false;
+		}
+		initialSize = static_cast<size_t>(info.st_size);
+	}
+#endif
+
+	if (!map(initialSize)) {
+		printf("MappedFile failed to map [%s] with size %llu\n", path, static_cast<unsigned long long>(initialSize));
+		close();
+		return false;
+	}
+	return true;
+}
+
+inline bool MappedFile::resize(size_t size) {
+	if (mode != Mode::Write || !good()) {
+		return false;
+	}
+	unmap();
+	if (!map(size)) {
+		printf("MappedFile failed to resize to %llu\n", static_cast<unsigned long long>(size));
+		close();
+		return false;
+	}
+	return true;
+}
+
+inline bool MappedFile::map(size_t size) {
+#ifdef _WIN32
+	if (mode == Mode::Write) {
+		LARGE_INTEGER newSize;
+		newSize.QuadPart = static_cast<LONGLONG>(size);
+		if (!SetFilePointerEx(file, newSize, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+			return false;
+		}
+	}
+
+	mappingSize = size;
+	if (size == 0) {
+		// windows can't map empty file, leave it unmapped
+		return true;
+	}
+
+	const DWORD protect = mode == Mode::Write ? PAGE_READWRITE : PAGE_READONLY;
+	fileMapping = CreateFileMappingA(file, nullptr, protect, static_cast<DWORD>(static_cast<unsigned long long>(size) >> 32), static_cast<DWORD>(size), nullptr);
+	if (!fileMapping) {
+		return false;
+	}
+
+	const DWORD access = mode == Mode::Write ? FILE_MAP_WRITE : FILE_MAP_READ;
+	mapping = reinterpret_cast<char *>(MapViewOfFile(fileMapping, access, 0, 0, size));
+	return mapping != nullptr;
+#else
+	if (mode == Mode::Write && ftruncate(file, static_cast<off_t>(size)) != 0) {
+		return false;
+	}
+
+	mappingSize = size;
+	if (size == 0) {
+		// mmap does not accept zero length
+		return true;
+	}
+
+	const int protect = mode == Mode::Write ? PROT_READ | PROT_WRITE : PROT_READ;
+	void * ptr = mmap(nullptr, size, protect, MAP_SHARED, file, 0);
+	if (ptr == MAP_FAILED) {
+		return false;
+	}
+	mapping = reinterpret_cast<char *>(ptr);
+	return true;
+#endif
+}
+
+inline void MappedFile::unmap() {
+#ifdef _WIN32
+	if (mapping) {
+		UnmapViewOfFile(mapping);
+	}
+	if (fileMapping) {
+		CloseHandle(fileMapping);
+		fileMapping = nullptr;
+	}
+#else
+	if (mapping) {
+		munmap(mapping, mappingSize);
+	}
+#endif
+	mapping = nullptr;
+	mappingSize = 0;
+}
+
+inline void MappedFile::close(size_t finalSize) {
+	if (mode == Mode::Write && good() && finalSize != mappingSize) {
+		unmap();
+#ifdef _WIN32
+		LARGE_INTEGER newSize;
+		newSize.QuadPart = static_cast<LONGLONG>(finalSize);
+		SetFilePointerEx(file, newSize, nullptr, FILE_BEGIN);
+		SetEndOfFile(file);
+#else
+		if (ftruncate(file, static_cast<off_t>(finalSize)) != 0) {
+			puts("MappedFile failed to truncate file on close");
+		}
+#endif
+	}
+	unmap();
+
+#ifdef _WIN32
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (file != -1) {
+		::close(file);
+		file = -1;
+	}
+#endif
+}
+
+inline void MappedFile::close() {
+	close(mappingSize);
+}
+
+inline bool MappedFile::good() const {
+#ifdef _WIN32
+	return file != INVALID_HANDLE_VALUE && (mapping || !mappingSize);
+#else
+	return file != -1 && (mapping || !mappingSize);
+#endif
+}
+
+inline size_t MappedFile::size() const {
+	return mappingSize;
+}
+
+inline char * MappedFile::data() {
+	return mapping;
+}
+
+inline const char * MappedFile::data() const {
+	return mapping;
+}
+
+#endif // _MAPPED_FILE_H_
@@ -0,0 +1,226 @@
+#ifndef _SHARED_MEMORY_H_
+#define _SHARED_MEMORY_H_
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+/// Thin cross platform wrapper over named shared memory segment, mapped read write
+/// The process that creates the segment owns the name, it is removed when the owner closes it
+class SharedMemory {
+public:
+	SharedMemory();
+	~SharedMemory();
+
+	SharedMemory(const SharedMemory &) = delete;
+	SharedMemory &operator=(const SharedMemory &) = delete;
+
+	/// Create new segment, fails if segment with this name exists
+	/// @name - the segment name, without leading slash
+	/// @size - size in bytes
+	/// @return - true on success
+	bool create(const char * name, size_t size);
+
+	/// Open segment created by another process
+	/// @name - the segment name, without leading slash
+	/// @return - true on success
+	bool open(const char * name);
+
+	/// Unmap the segment, remove the name if we created it
+	void close();
+
+	/// Check if the segment is mapped
+	bool good() const;
+
+	/// Get the size in bytes of the mapping
+	size_t size() const;
+
+	/// Get pointer to the mapped bytes
+	char * data();
+	const char * data() const;
+
+private:
+	/// Map the opened segment with the given size
+	bool map(size_t size);
+
+	std::string name; ///< Name of the segment as passed to the OS
+	bool owner; ///< True if we created the segment
+	char * mapping; ///< Pointer to the start of the mapping
+	size_t mappingSize; ///< Size of the mapping
+
+#ifdef _WIN32
+	HANDLE segment; ///< Handle of the file mapping object
+#else
+	int segment; ///< Descriptor of the shared memory object
+#endif
+};
+
+
+inline SharedMemory::SharedMemory()
+    : owner(false)
+    , mapping(nullptr)
+    , mappingSize(0)
+#ifdef _WIN32
+    , segment(nullptr)
+#else
+    , segment(-1)
+#endif
+{}
+
+inline SharedMemory::~SharedMemory() {
+	close();
+}
+
+inline bool SharedMemory::create(const char * name, size_t size) {
+	close();
+	owner = true;
+
+#ifdef _WIN32
+	this->name = std::string("Local\\") + name;
+	segment = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+	                             static_cast<DWORD>(static_cast<unsigned long long>(size) >> 32), static_cast<DWORD>(size),
+	                             this->name.c_str());
+	if (!segment || GetLastError() == ERROR_ALREADY_EXISTS) {
+		printf("SharedMemory failed to create [%s]\n", name);
+		close();
+		return false;
+	}
+#else
+	this->name = std::string("/") + name;
+	segment = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (segment == -1) {
+		printf("SharedMemory failed to create [%s]\n", name);
+		owner = false;
+		return false;
+	}
+	if (ftruncate(segment, static_cast<off_t>(size)) != 0) {
+		printf("SharedMemory failed to resize [%s] to %llu\n", name, static_cast<unsigned long long>(size));
+		close();
+		return false;
+	}
+#endif
+
+	if (!map(size)) {
+		printf("SharedMemory failed to map [%s]\n", name);
+		close();
+		return false;
+	}
+	return true;
+}
+
+inline bool SharedMemory::open(const char * name) {
+	close();
+	owner = false;
+
+#ifdef _WIN32
+	this->name = std::string("Local\\") + name;
+	segment = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, this->name.c_str());
+	if (!segment) {
+		printf("SharedMemory failed to open [%s]\n", name);
+		return false;
+	}
+	// size of the mapping object is not available, map all of it and ask the view for it's size
+	size_t size = 0;
+#else
+	this->name = std::string("/") + name;
+	segment = shm_open(this->name.c_str(), O_RDWR, 0600);
+	if (segment == -1) {
+		printf("SharedMemory failed to open [%s]\n", name);
+		return false;
+	}
+	struct stat info;
+	if (fstat(segment, &info) != 0) {
+		close();
+		return false;
+	}
+	const size_t size = static_cast<size_t>(info.st_size);
+#endif
+
+	if (!map(size)) {
+		printf("SharedMemory failed to map [%s]\n", name);
+		close();
+		return false;
+	}
+	return true;
+}
+
+inline bool SharedMemory::map(size_t size) {
+#ifdef _WIN32
+	mapping = reinterpret_cast<char *>(MapViewOfFile(segment, FILE_MAP_ALL_ACCESS, 0, 0, size));
+	if (!mapping) {
+		return false;
+	}
+	MEMORY_BASIC_INFORMATION info;
+	if (!size && VirtualQuery(mapping, &info, sizeof(info))) {
+		size = info.RegionSize;
+	}
+	mappingSize = size;
+	return true;
+#else
+	if (size == 0) {
+		return false;
+	}
+	void * ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment, 0);
+	if (ptr == MAP_FAILED) {
+		return false;
+	}
+	mapping = reinterpret_cast<char *>(ptr);
+	mappingSize = size;
+	return true;
+#endif
+}
+
+inline void SharedMemory::close() {
+#ifdef _WIN32
+	if (mapping) {
+		UnmapViewOfFile(mapping);
+	}
+	if (segment) {
+		CloseHandle(segment);
+		segment = nullptr;
+	}
+#else
+	if (mapping) {
+		munmap(mapping, mappingSize);
+	}
+	if (segment != -1) {
+		::close(segment);
+		segment = -1;
+		// other processes keep their mapping, only the name is removed
+		if (owner) {
+			shm_unlink(name.c_str());
+		}
+	}
+#endif
+	mapping = nullptr;
+	mappingSize = 0;
+	owner = false;
+}
+
+inline bool SharedMemory::good() const {
+	return mapping != nullptr;
+}
+
+inline size_t SharedMemory::size() const {
+	return mappingSize;
+}
+
+inline char * SharedMemory::data() {
+	return mapping;
+}
+
+inline const char * SharedMemory::data() const {
+	return mapping;
+}
+
+#endif // _SHARED_MEMORY_H_
@@ -0,0 +1,480 @@
+#ifndef _ZMQ_ASYNC_CLIENT_H_
+#define _ZMQ_ASYNC_CLIENT_H_
+
+#include "zmq_wrapper.hpp"
+
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+/// Return type for coroutines using ZmqAsyncClient, the coroutine starts immediately and frees itself when it ends
+/// Note: exceptions escaping the coroutine terminate the process
+struct ZmqTask {
+	struct promise_type {
+		ZmqTask get_return_object() noexcept { return ZmqTask(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+
+/// C++20 coroutine interface over ZmqClient
+/// Suspended coroutines are resumed from the client's loop thread, so after the first suspension the coroutine runs
+/// between the loop's I/O, e.g. an exporter can traverse and serialize the scene while earlier messages are sent,
+/// without extra threads or waiting on condition variables
+/// Teardown: ::stop, also called by the destructor, stops the client first, so no response or message can arrive
+/// anymore, then resumes every coroutine still suspended on this object on the calling thread before it returns.
+/// They get an empty VRayMessage from ::request and ::receive, and from then on all awaiters complete without
+/// suspending, so the coroutines run to their end (or to an await on something else) before this object is gone and
+/// nothing is left to be resumed into a dead client later. Coroutines must check ZmqClient::good and stop looping
+/// once the client stopped
+/// Note: blocking calls like ZmqClient::waitForMessages or ZmqClient::syncStop must not be made from a coroutine
+/// running on the loop thread, they wait for the loop itself
+/// Note: takes over the raw callback and the queue callback of the client, the client must outlive this object
+class ZmqAsyncClient {
+public:
+	/// Awaiter for ::send, resumes when the message is admitted in the client's queue
+	class SendAwaiter {
+	public:
+		bool await_ready();
+		bool await_suspend(std::coroutine_handle<> handle);
+		void await_resume() noexcept {}
+
+	private:
+		friend class ZmqAsyncClient;
+		SendAwaiter(ZmqAsyncClient & owner, zmq::message_t && message);
+
+		ZmqAsyncClient & owner; ///< The client sending the message
+		zmq::message_t message; ///< The message, moved to the client's queue on admission
+	};
+
+	/// Awaiter for ::receive, resumes with the next received message
+	class ReceiveAwaiter {
+	public:
+		bool await_ready();
+		bool await_suspend(std::coroutine_handle<> handle);
+		VRayMessage await_resume();
+
+	private:
+		friend class ZmqAsyncClient;
+		explicit ReceiveAwaiter(ZmqAsyncClient & owner);
+
+		ZmqAsyncClient & owner; ///< The client receiving
+		std::optional<VRayMessage> message; ///< The received message
+	};
+
+	/// Awaiter for ::request, resumes with the response
+	class RequestAwaiter {
+	public:
+		bool await_ready();
+		bool await_suspend(std::coroutine_handle<> handle);
+		VRayMessage await_resume();
+
+	private:
+		friend class ZmqAsyncClient;
+		RequestAwaiter(ZmqAsyncClient & owner, zmq::message_t && message);
+
+		ZmqAsyncClient & owner; ///< The client sending the request
+		zmq::message_t message; ///< The request
+		std::optional<VRayMessage> response; ///< The response, empty message if the client stopped before it arrived
+	};
+
+	/// Awaiter for ::schedule, resumes on the loop thread
+	class ScheduleAwaiter {
+	public:
+		bool await_ready() const;
+		bool await_suspend(std::coroutine_handle<> handle);
+		void await_resume() noexcept {}
+
+	private:
+		friend class ZmqAsyncClient;
+		explicit ScheduleAwaiter(ZmqAsyncClient & owner);
+
+		ZmqAsyncClient & owner; ///< The client whose loop to run on
+	};
+
+	/// @client - the client to use, connected or not
+	/// @maxQueued - ::send suspends while the client has this many outstanding messages
+	explicit ZmqAsyncClient(ZmqClient & client, int maxQueued = 1000);
+
+	/// Stop, see ::stop
+	~ZmqAsyncClient();
+
+	ZmqAsyncClient(const ZmqAsyncClient &) = delete;
+	ZmqAsyncClient &operator=(const ZmqAsyncClient &) = delete;
+
+	/// co_await to queue message, suspends while the client's queue is full
+	SendAwaiter send(zmq::message_t && message);
+
+	/// co_await to get the next received message, messages received while nobody waits are buffered
+	ReceiveAwaiter receive();
+
+	/// co_await to send request and get it's response, see ZmqClient::request
+	RequestAwaiter request(zmq::message_t && message);
+
+	/// co_await to continue on the client's loop thread
+	ScheduleAwaiter schedule();
+
+	/// Get the client
+	ZmqClient & getClient();
+
+	/// Stop the client and resume all suspended coroutines on the calling thread, see the teardown order above
+	/// Note: must not be called from a coroutine of this object
+	void stop();
+
+private:
+	/// Coroutine waiting for it's message to be admitted
+	struct SendWaiter {
+		std::coroutine_handle<> handle; ///< The suspended coroutine
+		zmq::message_t * message; ///< The message in the coroutine's awaiter
+	};
+
+	/// Coroutine waiting for a received message
+	struct ReceiveWaiter {
+		std::coroutine_handle<> handle; ///< The suspended coroutine
+		std::optional<VRayMessage> * message; ///< Set to the received message
+	};
+
+	/// Coroutines ready to be resumed, shared with the tasks posted to the loop, so a task that runs after this
+	/// object is gone finds the queue empty instead of touching it
+	struct ResumeQueue {
+		ResumeQueue()
+		    : stopped(false)
+		    , resuming(0)
+		{}
+
+		/// Resume the queued coroutines on the calling thread until there are none
+		void resumeAll();
+
+		std::mutex mutex; ///< Mutex protecting the fields below
+		std::condition_variable cond; ///< Signaled when @resuming drops to 0
+		std::deque<std::coroutine_handle<>> handles; ///< The coroutines in the order they became ready
+		bool stopped; ///< Set by ::stop, coroutines are then resumed by ::stop instead of on the loop
+		int resuming; ///< Number of threads inside a coroutine resumed by ::resumeAll
+	};
+
+	/// Resume coroutine on the loop thread
+	void resume(std::coroutine_handle<> handle);
+	/// Check if the calling thread is the client's loop thread
+	bool inLoopThread() const;
+	/// Queue request with handler called with the response
+	void sendRequest(zmq::message_t && message, std::function<void(VRayMessage &&)> handler);
+	/// Admit waiting messages while there is space in the queue, called with @waitersMutex locked
+	void admit();
+	/// Check if the client's queue has space
+	bool hasSpace() const;
+	/// Take received message, from the raw callback
+	void onMessage(zmq::message_t & payload);
+
+	ZmqClient & client; ///< The client
+	const int maxQueued; ///< Max outstanding messages of the client before ::send suspends
+
+	std::deque<SendWaiter> sendWaiters; ///< Coroutines waiting in ::send, in order
+	std::deque<ReceiveWaiter> receiveWaiters; ///< Coroutines waiting in ::receive, in order
+	std::deque<VRayMessage> received; ///< Messages received while nobody waited
+	bool stopped; ///< Set by ::stop, awaiters complete without suspending from then on
+	std::mutex waitersMutex; ///< Mutex protecting @sendWaiters, @receiveWaiters, @received and @stopped
+	std::shared_ptr<ResumeQueue> resumeQueue; ///< Coroutines to be resumed
+};
+
+
+inline ZmqAsyncClient::SendAwaiter::SendAwaiter(ZmqAsyncClient & owner, zmq::message_t && message)
+    : owner(owner)
+{
+	this->message.move(&message);
+}
+
+inline bool ZmqAsyncClient::SendAwaiter::await_ready() {
+	std::lock_guard<std::mutex> lock(owner.waitersMutex);
+	if (owner.stopped) {
+		return true;
+	}
+	// messages of suspended coroutines go first, so the order of sends is kept
+	if (owner.sendWaiters.empty() && owner.hasSpace()) {
+		owner.client.send(std::move(message));
+		return true;
+	}
+	return false;
+}
+
+inline bool ZmqAsyncClient::SendAwaiter::await_suspend(std::coroutine_handle<> handle) {
+	std::lock_guard<std::mutex> lock(owner.waitersMutex);
+	if (owner.stopped) {
+		return false;
+	}
+	// the queue might have drained since ::await_ready
+	if (owner.sendWaiters.empty() && owner.hasSpace()) {
+		owner.client.send(std::move(message));
+		return false;
+	}
+	owner.sendWaiters.push_back(SendWaiter{handle, &message});
+	return true;
+}
+
+inline ZmqAsyncClient::ReceiveAwaiter::ReceiveAwaiter(ZmqAsyncClient & owner)
+    : owner(owner)
+{}
+
+inline bool ZmqAsyncClient::ReceiveAwaiter::await_ready() {
+	std::lock_guard<std::mutex> lock(owner.waitersMutex);
+	if (owner.stopped && owner.received.empty()) {
+		message.emplace();
+		return true;
+	}
+	if (owner.received.empty()) {
+		return false;
+	}
+	message.emplace(std::move(owner.received.front()));
+	owner.received.pop_front();
+	return true;
+}
+
+inline bool ZmqAsyncClient::ReceiveAwaiter::await_suspend(std::coroutine_handle<> handle) {
+	std::lock_guard<std::mutex> lock(owner.waitersMutex);
+	if (!owner.received.empty()) {
+		message.emplace(std::move(owner.received.front()));
+		owner.received.pop_front();
+		return false;
+	}
+	if (owner.stopped) {
+		message.emplace();
+		return false;
+	}
+	owner.receiveWaiters.push_back(ReceiveWaiter{handle, &message});
+	return true;
+}
+
+inline VRayMessage ZmqAsyncClient::ReceiveAwaiter::await_resume() {
+	return std::move(*message);
+}
+
+inline ZmqAsyncClient::RequestAwaiter::RequestAwaiter(ZmqAsyncClient & owner, zmq::message_t && message)
+    : owner(owner)
+{
+	this->message.move(&message);
+}
+
+inline bool ZmqAsyncClient::RequestAwaiter::await_ready() {
+	std::lock_guard<std::mutex> lock(owner.waitersMutex);
+	if (owner.stopped) {
+		response.emplace();
+		return true;
+	}
+	return false;
+}
+
+inline bool ZmqAsyncClient::RequestAwaiter::await_suspend(std::coroutine_handle<> handle) {
+	/// Resumes the coroutine when the handler is destroyed, called or not, so a stopped client does not leave it
+	/// suspended forever: ZmqClient::syncStop, called from ::stop, destroys the handlers of pending requests, and
+	/// ::stop resumes the coroutines queued by them before it returns
+	struct Resumer {
+		Resumer(RequestAwaiter & awaiter, std::coroutine_handle<> handle)
+		    : awaiter(awaiter)
+		    , handle(handle)
+		{}
+
+		~Resumer() {
+			if (!awaiter.response) {
+				awaiter.response.emplace();
+			}
+			awaiter.owner.resume(handle);
+		}
+
+		RequestAwaiter & awaiter;
+		std::coroutine_handle<> handle;
+	};
+
+	// checked under the lock, so the request is either sent before ::stop stops the client or not at all
+	std::lock_guard<std::mutex> lock(owner.waitersMutex);
+	if (owner.stopped) {
+		response.emplace();
+		return false;
+	}
+	std::shared_ptr<Resumer> resumer = std::make_shared<Resumer>(*this, handle);
+	owner.sendRequest(std::move(message), [resumer](VRayMessage && response) {
+		resumer->awaiter.response.emplace(std::move(response));
+	});
+	return true;
+}
+
+inline VRayMessage ZmqAsyncClient::RequestAwaiter::await_resume() {
+	return std::move(*response);
+}
+
+inline ZmqAsyncClient::ScheduleAwaiter::ScheduleAwaiter(ZmqAsyncClient & owner)
+    : owner(owner)
+{}
+
+inline bool ZmqAsyncClient::ScheduleAwaiter::await_ready() const {
+	std::lock_guard<std::mutex> lock(owner.waitersMutex);
+	// after ::stop the loop does not serve the client anymore, so the coroutine continues where it is
+	return owner.stopped || owner.inLoopThread();
+}
+
+inline bool ZmqAsyncClient::ScheduleAwaiter::await_suspend(std::coroutine_handle<> handle) {
+	std::lock_guard<std::mutex> lock(owner.waitersMutex);
+	if (owner.stopped) {
+		return false;
+	}
+	owner.resume(handle);
+	return true;
+}
+
+inline ZmqAsyncClient::ZmqAsyncClient(ZmqClient & client, int maxQueued)
+    : client(client)
+    , maxQueued(std::max(maxQueued, 1))
+    , stopped(false)
+    , resumeQueue(std::make_shared<ResumeQueue>())
+{
+	client.setRawCallback([this](zmq::message_t & payload, ZmqClient *) {
+		onMessage(payload);
+	});
+	// waiting messages are admitted in batches, not one for each sent message
+	client.setQueueCallback(this->maxQueued / 2, [this](ZmqClient *) {
+		std::lock_guard<std::mutex> lock(waitersMutex);
+		admit();
+	});
+}
+
+inline ZmqAsyncClient::~ZmqAsyncClient() {
+	stop();
+}
+
+inline void ZmqAsyncClient::stop() {
+	{
+		std::lock_guard<std::mutex> lock(waitersMutex);
+		if (stopped) {
+			return;
+		}
+		stopped = true;
+	}
+	{
+		std::lock_guard<std::mutex> lock(resumeQueue->mutex);
+		resumeQueue->stopped = true;
+	}
+
+	// destroys the handlers of the pending requests, their coroutines are queued for resuming here
+	client.syncStop();
+	client.setRawCallback(nullptr);
+	client.setQueueCallback(0, nullptr);
+
+	{
+		std::lock_guard<std::mutex> lock(waitersMutex);
+		for (SendWaiter & waiter : sendWaiters) {
+			resume(waiter.handle);
+		}
+		sendWaiters.clear();
+		for (ReceiveWaiter & waiter : receiveWaiters) {
+			waiter.message->emplace();
+			resume(waiter.handle);
+		}
+		receiveWaiters.clear();
+	}
+	resumeQueue->resumeAll();
+
+	// a task posted before the stop may still be inside a coroutine on the loop thread, unless that is this thread
+	if (!inLoopThread()) {
+		std::unique_lock<std::mutex> lock(resumeQueue->mutex);
+		resumeQueue->cond.wait(lock, [this]() {
+			return resumeQueue->resuming == 0;
+		});
+	}
+}
+
+inline void ZmqAsyncClient::ResumeQueue::resumeAll() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!handles.empty()) {
+		std::coroutine_handle<> handle = handles.front();
+		handles.pop_front();
+		++resuming;
+		lock.unlock();
+		handle.resume();
+		lock.lock();
+		--resuming;
+	}
+	if (!resuming) {
+		cond.notify_all();
+	}
+}
+
+inline ZmqAsyncClient::SendAwaiter ZmqAsyncClient::send(zmq::message_t && message) {
+	return SendAwaiter(*this, std::move(message));
+}
+
+inline ZmqAsyncClient::ReceiveAwaiter ZmqAsyncClient::receive() {
+	return ReceiveAwaiter(*this);
+}
+
+inline ZmqAsyncClient::RequestAwaiter ZmqAsyncClient::request(zmq::message_t && message) {
+	return RequestAwaiter(*this, std::move(message));
+}
+
+inline ZmqAsyncClient::ScheduleAwaiter ZmqAsyncClient::schedule() {
+	return ScheduleAwaiter(*this);
+}
+
+inline ZmqClient & ZmqAsyncClient::getClient() {
+	return client;
+}
+
+inline void ZmqAsyncClient::resume(std::coroutine_handle<> handle) {
+	// never resume inline, callers hold the client's locks
+	bool post;
+	{
+		std::lock_guard<std::mutex> lock(resumeQueue->mutex);
+		resumeQueue->handles.push_back(handle);
+		// one task resumes all coroutines queued before it runs, after the stop ::stop resumes them itself
+		post = !resumeQueue->stopped && resumeQueue->handles.size() == 1;
+	}
+	if (post) {
+		std::shared_ptr<ResumeQueue> queue = resumeQueue;
+		client.runtime->post([queue]() {
+			queue->resumeAll();
+		});
+	}
+}
+
+inline bool ZmqAsyncClient::inLoopThread() const {
+	return client.runtime->inLoopThread();
+}
+
+inline void ZmqAsyncClient::sendRequest(zmq::message_t && message, std::function<void(VRayMessage &&)> handler) {
+	client.sendRequest(std::move(message), handler);
+}
+
+inline bool ZmqAsyncClient::hasSpace() const {
+	return client.getOutstandingMessages() < maxQueued;
+}
+
+inline void ZmqAsyncClient::admit() {
+	while (!sendWaiters.empty() && hasSpace()) {
+		SendWaiter waiter = sendWaiters.front();
+		sendWaiters.pop_front();
+		client.send(std::move(*waiter.message));
+		resume(waiter.handle);
+	}
+}
+
+inline void ZmqAsyncClient::onMessage(zmq::message_t & payload) {
+	std::lock_guard<std::mutex> lock(waitersMutex);
+	if (receiveWaiters.empty()) {
+		received.push_back(VRayMessage::fromZmqMessage(payload));
+		return;
+	}
+	ReceiveWaiter waiter = receiveWaiters.front();
+	receiveWaiters.pop_front();
+	waiter.message->emplace(VRayMessage::fromZmqMessage(payload));
+	resume(waiter.handle);
+}
+
+#endif // C++20
+
+#endif // _ZMQ_ASYNC_CLIENT_H_
@@ -2,23 +2,45 @@
 #define _DESERIALIZER_HPP_
 
 #include "base_types.h"
+#include "zmq_serializer.hpp"
 
+/// Reads values written by SerializerStream
+/// The data is not trusted - sizes and counts are checked against the remaining bytes, and the first failed read
+/// fails the stream, so all following reads fail too and the values read from it are empty
 class DeserializerStream {
 public:
+	/// Max nesting of AttrListValue, deeper values fail the stream instead of overflowing the stack
+	static const int MAX_VALUE_DEPTH = 64;
+
 	DeserializerStream() = delete;
 
 	DeserializerStream(const char * data, size_t size)
 	    : first(data)
 	    , current(data)
 	    , last(data + size)
+	    , depth(0)
+	    , failed(false)
 	{}
 
 	bool hasMore() const {
 		return current < last;
 	}
 
+	/// Check if all reads so far succeeded
+	bool good() const {
+		return !failed;
+	}
+
+	/// Mark the data as malformed, nothing more can be read
+	void fail() {
+		failed = true;
+		current = last;
+	}
+
 	void rewind() {
 		current = first;
+		depth = 0;
+		failed = false;
 	}
 
 	size_t getSize() const {
@@ -29,7 +51,7 @@ public:
 		return last - current;
 	}
 
-	bool read(char * where, int size) {
+	bool read(char * where, size_t size) {
 		if (!forward(size)) {
 			return false;
 		}
@@ -42,31 +64,74 @@ public:
 	}
 
 	bool forward(size_t size) {
-		const char * newPtr = current + size;
-		if (newPtr > last || newPtr < first) {
+		if (size > getRemaining()) {
+			fail();
+			return false;
+		}
+		current += size;
+		return true;
+	}
+
+	/// Read the item count of a container, written with writeCount
+	/// @count - set to the count, 0 on failure
+	/// @itemSize - min number of bytes each item takes in the stream
+	/// @return - false if the count is negative or there are not enough bytes left for the items
+	bool readCount(size_t & count, size_t itemSize) {
+		count = 0;
+		int count32 = 0;
+		int64_t count64 = -1;
+		if (!read(reinterpret_cast<char *>(&count32), sizeof(count32))) {
+			return false;
+		}
+		if (count32 >= 0) {
+			count64 = count32;
+		} else if (count32 == SERIALIZER_COUNT_64) {
+			read(reinterpret_cast<char *>(&count64), sizeof(count64));
+		}
+		if (count64 < 0 || static_cast<uint64_t>(count64) > getRemaining() / itemSize) {
+			fail();
+			return false;
+		}
+		count = static_cast<size_t>(count64);
+		return true;
+	}
+
+	/// Enter nested value, must be matched with ::leaveNested if it succeeds
+	/// @return - false if the value is nested too deep
+	bool enterNested() {
+		if (depth >= MAX_VALUE_DEPTH) {
+			fail();
 			return false;
 		}
-		current = newPtr;
+		++depth;
 		return true;
 	}
 
+	void leaveNested() {
+		--depth;
+	}
+
 private:
 	const char *first;
 	const char *current;
 	const char *last;
+	int depth; ///< Number of values being read that contain the current one
+	bool failed; ///< Set by the first failed read
 };
 
 
 template <typename T>
 DeserializerStream & operator>>(DeserializerStream & stream, T & value) {
-	stream.read(reinterpret_cast<char*>(&value), sizeof(value));
+	if (!stream.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+		value = T();
+	}
 	return stream;
 }
 
 
 inline DeserializerStream & operator>>(DeserializerStream & stream, std::string & value) {
-	int size = 0;
-	stream >> size;
+	size_t size = 0;
+	stream.readCount(size, 1);
 
 	value.assign(stream.getCurrent(), size);
 	stream.forward(size);
@@ -88,24 +153,27 @@ inline DeserializerStream & operator>> (DeserializerStream & stream, VRayBaseTyp
 template <typename Q>
 inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseTypes::AttrList<Q> & list) {
 	list.init();
-	int size = 0;
-	stream >> size;
+	size_t size = 0;
+	stream.readCount(size, sizeof(Q));
 
 	list.getData()->resize(size);
-	memcpy(list.getData()->data(), stream.getCurrent(), size * sizeof(Q));
+	if (size) {
+		memcpy(list.getData()->data(), stream.getCurrent(), size * sizeof(Q));
+	}
 	stream.forward(size * sizeof(Q));
 
 	return stream;
 }
 
 
+/// @itemSize - min number of bytes each item takes in the stream
 template <typename T>
-inline void readListNonPOD(DeserializerStream & stream, VRayBaseTypes::AttrList<T> & list) {
+inline void readListNonPOD(DeserializerStream & stream, VRayBaseTypes::AttrList<T> & list, size_t itemSize) {
 	list.init();
-	int size = 0;
-	stream >> size;
+	size_t size = 0;
+	stream.readCount(size, itemSize);
 	list.getData()->reserve(size);
-	for (int c = 0; c < size; ++c) {
+	for (size_t c = 0; c < size && stream.good(); ++c) {
 		T item;
 		stream >> item;
 		list.append(std::move(item));
@@ -113,26 +181,32 @@ inline void readListNonPOD(DeserializerStream & stream, VRayBaseTypes::AttrList<
 }
 
 inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseTypes::AttrList<VRayBaseTypes::AttrPlugin> & list) {
-	readListNonPOD(stream, list);
+	readListNonPOD(stream, list, 2 * sizeof(int));
 	return stream;
 }
 
 
 inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseTypes::AttrList<std::string> & list) {
-	readListNonPOD(stream, list);
+	readListNonPOD(stream, list, sizeof(int));
 	return stream;
 }
 
 inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseTypes::AttrList<VRayBaseTypes::AttrValue> & list) {
-	readListNonPOD(stream, list);
+	if (!stream.enterNested()) {
+		list.init();
+		return stream;
+	}
+	readListNonPOD(stream, list, sizeof(VRayBaseTypes::ValueType));
+	stream.leaveNested();
 	return stream;
 }
 
 inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseTypes::AttrMapChannels & map) {
 	map.data.clear();
-	int size = 0;
-	stream >> size;
-	for (int c = 0; c < size; ++c) {
+	size_t size = 0;
+	// key, vertices, faces and name each start with a count
+	stream.readCount(size, 4 * sizeof(int));
+	for (size_t c = 0; c < size && stream.good(); ++c) {
 		std::string key;
 		VRayBaseTypes::AttrMapChannels::AttrMapChannel channel;
 		stream >> key >> channel.vertices >> channel.faces >> channel.name;
@@ -148,11 +222,12 @@ inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseType
 
 
 inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseTypes::AttrInstancer & inst) {
-	int size = 0;
-	stream >> inst.frameNumber >> size;
+	size_t size = 0;
+	stream >> inst.frameNumber;
+	stream.readCount(size, sizeof(int) + 2 * sizeof(VRayBaseTypes::AttrTransform) + 2 * sizeof(int));
 	inst.data.init();
 	inst.data.getData()->reserve(size);
-	for (int c = 0; c < size; ++c) {
+	for (size_t c = 0; c < size && stream.good(); ++c) {
 		VRayBaseTypes::AttrInstancer::Item item;
 		stream >> item;
 		inst.data.append(item);
@@ -163,6 +238,10 @@ inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseType
 
 inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseTypes::AttrImage & image) {
 	stream >> image.imageType >> image.size >> image.width >> image.height >> image.x >> image.y;
+	if (image.size > stream.getRemaining()) {
+		stream.fail();
+		image.size = 0;
+	}
 	image.set(stream.getCurrent(), image.size);
 	stream.forward(image.size);
 	return stream;
@@ -170,11 +249,12 @@ inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseType
 
 
 inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseTypes::AttrImageSet & set) {
-	int count;
-	stream >> set.sourceType >> count;
+	size_t count = 0;
+	stream >> set.sourceType;
+	stream.readCount(count, sizeof(VRayBaseTypes::RenderChannelType));
 	VRayBaseTypes::AttrImage img;
 	VRayBaseTypes::RenderChannelType type;
-	for (int c = 0; c < count; c++) {
+	for (size_t c = 0; c < count && stream.good(); c++) {
 		stream >> type >> img;
 		set.images.emplace(type, std::move(img));
 	}
@@ -183,12 +263,22 @@ inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseType
 
 
 inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseTypes::AttrValue & value) {
-	stream >> value.type;
-	value.defaultInitData();
 	using namespace VRayBaseTypes;
+	value.destroyData();
+	// read as int, so values out of the enum are never stored in ValueType
+	int type = ValueTypeUnknown;
+	static_assert(sizeof(type) == sizeof(ValueType), "ValueType is serialized as int");
+	stream >> type;
+	if (type <= ValueTypeUnknown || type > ValueTypeMapChannels) {
+		stream.fail();
+		return stream;
+	}
+	value.type = static_cast<ValueType>(type);
+	value.defaultInitData();
 	switch (value.type) {
 	case ValueTypeInt: stream >> value.as<AttrSimpleType<int>>(); break;
 	case ValueTypeFloat: stream >> value.as<AttrSimpleType<float>>(); break;
+	case ValueTypeDouble: stream >> value.as<AttrSimpleType<double>>(); break;
 	case ValueTypeString: stream >> value.as<AttrSimpleType<std::string>>(); break;
 	case ValueTypeColor: stream >> value.as<AttrColor>(); break;
 	case ValueTypeAColor: stream >> value.as<AttrAColor>(); break;
@@ -210,7 +300,13 @@ inline DeserializerStream & operator>>(DeserializerStream & stream, VRayBaseType
 	case ValueTypeListValue: stream >> value.as<AttrListValue>(); break;
 	case ValueTypeInstancer: stream >> value.as<AttrInstancer>(); break;
 	case ValueTypeMapChannels: stream >> value.as<AttrMapChannels>(); break;
-	default: assert(!"Missing DeserializerStream::operator>> for some ValueType"); break;
+	default:
+		// not a value type that can be sent
+		stream.fail();
+		break;
+	}
+	if (!stream.good()) {
+		value.destroyData();
 	}
 	return stream;
 }
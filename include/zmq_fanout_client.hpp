@@ -0,0 +1,352 @@
+#ifndef _ZMQ_FANOUT_CLIENT_H_
+#define _ZMQ_FANOUT_CLIENT_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "zmq_wrapper.hpp"
+
+/// What ZmqFanoutClient does when the queue of a host reaches the limit set with ZmqFanoutClient::setQueueLimit
+enum class ZmqFanoutPolicy {
+	Block, ///< Sending waits until all queues are down to half the limit, the stream goes at the pace of the slowest host
+	Detach, ///< Sending waits until the fastest host's queue is down to half the limit, connected hosts still over it are
+	        ///< stopped and reported to the detach callback, so the stream goes at the pace of the fastest host
+};
+
+/// Sends one scene stream to several render hosts, e.g. the hosts of a distributed render
+/// Each message is serialized once and every host gets a reference counted copy of it (zmq_msg_copy), so the payload
+/// is in memory once regardless of the number of hosts. Every host has it's own ZmqClient with it's own queue and all
+/// are served by one runtime, so a slow host only grows it's own queue while the others keep sending
+/// Note: add hosts and send from one thread, the host list is not synchronized
+class ZmqFanoutClient {
+public:
+	/// Called with the index of a host that was detached because it fell behind or lost the connection
+	typedef std::function<void(int host, ZmqClient * client)> OnDetachCallback;
+
+	/// Create client without hosts
+	/// @runtime - the runtime to serve the host clients, if null the client creates it's own
+	explicit ZmqFanoutClient(std::shared_ptr<ZmqClientRuntime> runtime = nullptr);
+
+	/// Stop all hosts, see ::syncStop
+	~ZmqFanoutClient();
+
+	ZmqFanoutClient(const ZmqFanoutClient &) = delete;
+	ZmqFanoutClient &operator=(const ZmqFanoutClient &) = delete;
+
+	/// Add host and start connecting to it, the host gets only the messages sent after this call
+	/// @addr - the address to connect to, see ZmqClient::connect
+	/// @return - index of the host
+	int addHost(const char * addr);
+
+	/// Get the number of hosts added, including the detached ones
+	int getHostCount() const;
+
+	/// Get the client of a host, e.g. to set it's callbacks
+	ZmqClient * getHost(int host);
+
+	/// Get the address the host was added with
+	const std::string & getHostAddress(int host) const;
+
+	/// Check if the host was detached, it gets no more messages
+	bool isDetached(int host) const;
+
+	/// Limit the number of queued messages per host
+	/// @messages - max messages waiting to be sent to one host, 0 for no limit (default)
+	/// @policy - what to do with a host that reaches the limit
+	void setQueueLimit(int messages, ZmqFanoutPolicy policy = ZmqFanoutPolicy::Block);
+
+	/// Set a callback to be called when a host is detached
+	void setDetachCallback(OnDetachCallback cb);
+
+	/// Send message to all hosts, the message is copied by reference so it's data is shared by all hosts
+	/// @message - the message to send, after the function returns, callee's message is empty
+	void send(zmq::message_t && message);
+
+	/// Send data to all hosts, the data is copied once and can be safely freed after the function returns
+	/// @data - pointer to bytes
+	/// @size - number of bytes in data
+	void send(const void * data, size_t size);
+
+	/// Start a transaction on all hosts, see ZmqClient::beginTransaction
+	void beginTransaction();
+
+	/// Close the transaction on all hosts, see ZmqClient::commitTransaction
+	void commitTransaction(VRayBaseTypes::CommitAction action = VRayBaseTypes::CommitNow);
+
+	/// Get the number of messages yet to be sent to the slowest host that is not detached
+	int getOutstandingMessages() const;
+
+	/// Block until all messages are sent to all hosts that are not detached or timeout has passed
+	/// Hosts that stop meanwhile, e.g. when their handshake times out, are detached
+	/// @timeout - timeout in milliseconds to wait max
+	/// @return - false if some host that is not detached still has messages in queue
+	bool waitForMessages(int timeout = 500);
+
+	/// Send 'stop' command to all servers as soon as possible
+	void stopServers();
+
+	/// Stop all hosts and wait until they are done
+	void syncStop();
+
+private:
+	/// Render host with it's client
+	struct Host {
+		std::string address; ///< Address passed to ::addHost
+		std::unique_ptr<ZmqClient> client; ///< Client connected to the host
+		bool detached; ///< Set when the host no longer gets messages
+	};
+
+	/// Set queue callback of the host's client that wakes ::throttle, or clear it if there is no limit
+	void watchQueue(ZmqClient & client);
+
+	/// Get the queue length the policy waits on, of the slowest host for Block and of the fastest for Detach
+	/// @return - -1 if no host is connected
+	int getPace() const;
+
+	/// Called after a message was queued for all hosts, detaches the stopped hosts and when a host reaches the limit
+	/// waits until the pace of the policy is down to half of it, then detaches the hosts still over it for Detach
+	void throttle();
+
+	/// Stop sending to host and report it
+	void detach(int host);
+
+	std::shared_ptr<ZmqClientRuntime> runtime; ///< The runtime serving all hosts
+	std::vector<Host> hosts; ///< All hosts added, in order of ::addHost
+
+	int queueLimit; ///< Max queued messages per host, 0 for no limit
+	ZmqFanoutPolicy policy; ///< What to do with a host over @queueLimit
+	OnDetachCallback detachCallback; ///< Callback to be called when a host is detached
+
+	std::mutex queueMutex; ///< Mutex for @queueCond
+	std::condition_variable queueCond; ///< Signaled when the queue of a host is down to half of @queueLimit
+};
+
+
+inline ZmqFanoutClient::ZmqFanoutClient(std::shared_ptr<ZmqClientRuntime> runtime)
+    : runtime(runtime ? runtime : std::make_shared<ZmqClientRuntime>())
+    , queueLimit(0)
+    , policy(ZmqFanoutPolicy::Block)
+{}
+
+inline ZmqFanoutClient::~ZmqFanoutClient() {
+	syncStop();
+}
+
+inline int ZmqFanoutClient::addHost(const char * addr) {
+	Host host = {addr, std::unique_ptr<ZmqClient>(new ZmqClient(false, runtime)), false};
+	watchQueue(*host.client);
+	host.client->connect(addr);
+	hosts.push_back(std::move(host));
+	return static_cast<int>(hosts.size()) - 1;
+}
+
+inline int ZmqFanoutClient::getHostCount() const {
+	return static_cast<int>(hosts.size());
+}
+
+inline ZmqClient * ZmqFanoutClient::getHost(int host) {
+	return hosts[host].client.get();
+}
+
+inline const std::string & ZmqFanoutClient::getHostAddress(int host) const {
+	return hosts[host].address;
+}
+
+inline bool ZmqFanoutClient::isDetached(int host) const {
+	return hosts[host].detached;
+}
+
+inline void ZmqFanoutClient::setQueueLimit(int messages, ZmqFanoutPolicy policy) {
+	queueLimit = std::max(messages, 0);
+	this->policy = policy;
+	for (Host & host : hosts) {
+		watchQueue(*host.client);
+	}
+}
+
+inline void ZmqFanoutClient::setDetachCallback(OnDetachCallback cb) {
+	detachCallback = cb;
+}
+
+inline void ZmqFanoutClient::send(zmq::message_t && message) {
+	int last = -1;
+	for (int c = 0; c < static_cast<int>(hosts.size()); ++c) {
+		if (!hosts[c].detached) {
+			last = c;
+		}
+	}
+
+	for (int c = 0; c <= last; ++c) {
+		if (hosts[c].detached) {
+			continue;
+		}
+		if (c == last) {
+			// the last host takes the original
+			hosts[c].client->send(std::move(message));
+		} else {
+			// large messages are reference counted, this does not copy the data
+			zmq::message_t copy;
+			copy.copy(&message);
+			hosts[c].client->send(std::move(copy));
+		}
+	}
+
+	// all hosts have the message before waiting on any of them
+	throttle();
+}
+
+inline void ZmqFanoutClient::send(const void * data, size_t size) {
+	send(zmq::message_t(data, size));
+}
+
+inline void ZmqFanoutClient::beginTransaction() {
+	for (Host & host : hosts) {
+		if (!host.detached) {
+			host.client->beginTransaction();
+		}
+	}
+}
+
+inline void ZmqFanoutClient::commitTransaction(VRayBaseTypes::CommitAction action) {
+	for (Host & host : hosts) {
+		if (!host.detached) {
+			host.client->commitTransaction(action);
+		}
+	}
+}
+
+inline int ZmqFanoutClient::getOutstandingMessages() const {
+	int outstanding = 0;
+	for (const Host & host : hosts) {
+		if (!host.detached) {
+			outstanding = std::max(outstanding, host.client->getOutstandingMessages());
+		}
+	}
+	return outstanding;
+}
+
+inline bool ZmqFanoutClient::waitForMessages(int timeout) {
+	using namespace std::chrono;
+	const auto deadline = steady_clock::now() + milliseconds(timeout);
+	bool sent = true;
+	for (int c = 0; c < static_cast<int>(hosts.size()); ++c) {
+		if (hosts[c].detached) {
+			continue;
+		}
+		const long left = static_cast<long>(duration_cast<milliseconds>(deadline - steady_clock::now()).count());
+		if (hosts[c].client->waitForMessages(static_cast<int>(std::max(left, 0L)))) {
+			continue;
+		}
+		if (hosts[c].client->good()) {
+			sent = false;
+		} else {
+			// the queue is left over because the host stopped, not because we did not wait long enough
+			printf("ZMQ host [%s] stopped, detaching it\n", hosts[c].address.c_str());
+			detach(c);
+		}
+	}
+	return sent;
+}
+
+inline void ZmqFanoutClient::stopServers() {
+	for (Host & host : hosts) {
+		if (!host.detached) {
+			host.client->stopServer();
+		}
+	}
+}
+
+inline void ZmqFanoutClient::syncStop() {
+	for (Host & host : hosts) {
+		host.client->syncStop();
+	}
+}
+
+inline void ZmqFanoutClient::watchQueue(ZmqClient & client) {
+	if (queueLimit <= 0) {
+		client.setQueueCallback(0, nullptr);
+		return;
+	}
+	client.setQueueCallback(queueLimit / 2, [this](ZmqClient *) {
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queueCond.notify_all();
+	});
+}
+
+inline int ZmqFanoutClient::getPace() const {
+	int pace = -1;
+	for (const Host & host : hosts) {
+		if (host.detached || !host.client->good()) {
+			continue;
+		}
+		const int outstanding = host.client->getOutstandingMessages();
+		if (pace < 0 || (policy == ZmqFanoutPolicy::Block ? outstanding > pace : outstanding < pace)) {
+			pace = outstanding;
+		}
+	}
+	return pace;
+}
+
+inline void ZmqFanoutClient::throttle() {
+	for (int c = 0; c < static_cast<int>(hosts.size()); ++c) {
+		if (!hosts[c].detached && !hosts[c].client->good()) {
+			printf("ZMQ host [%s] stopped, detaching it\n", hosts[c].address.c_str());
+			detach(c);
+		}
+	}
+	if (queueLimit <= 0) {
+		return;
+	}
+
+	bool overLimit = false;
+	for (const Host & host : hosts) {
+		overLimit = overLimit || (!host.detached && host.client->getOutstandingMessages() >= queueLimit);
+	}
+	if (!overLimit) {
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		while (getPace() > queueLimit / 2) {
+			// the queue callback signals the half way mark, the timeout covers a host that stops instead
+			queueCond.wait_for(lock, std::chrono::milliseconds(SOCKET_IO_TIMEOUT));
+		}
+	}
+
+	for (int c = 0; c < static_cast<int>(hosts.size()); ++c) {
+		if (hosts[c].detached) {
+			continue;
+		}
+		if (!hosts[c].client->good()) {
+			printf("ZMQ host [%s] stopped, detaching it\n", hosts[c].address.c_str());
+			detach(c);
+		} else if (policy == ZmqFanoutPolicy::Detach && hosts[c].client->isServing() &&
+		           hosts[c].client->getOutstandingMessages() >= queueLimit) {
+			// the fastest host sent half the limit meanwhile and this one did not get below it, hosts still in the
+			// handshake are not behind yet, they are detached if the handshake times out
+			printf("ZMQ host [%s] has %d messages queued, detaching it\n", hosts[c].address.c_str(), queueLimit);
+			detach(c);
+		}
+	}
+}
+
+inline void ZmqFanoutClient::detach(int index) {
+	Host & host = hosts[index];
+	host.detached = true;
+	// the scene of this host is incomplete from now on, flushing the queue would only delay the others
+	host.client->setFlushOnExit(false);
+	host.client->syncStop();
+	if (detachCallback) {
+		detachCallback(index, host.client.get());
+	}
+}
+
+#endif // _ZMQ_FANOUT_CLIENT_H_
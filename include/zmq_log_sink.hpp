@@ -0,0 +1,225 @@
+#ifndef _ZMQ_LOG_SINK_H_
+#define _ZMQ_LOG_SINK_H_
+
+#include <zmq.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "zmq_message.hpp"
+
+/// One or more identical consecutive log lines
+struct VRayLogEntry {
+	VRayLogEntry()
+	    : level(0)
+	    , repeat(0)
+	{}
+
+	int level; ///< The log level, lower is more important
+	int repeat; ///< Number of times the line was received in a row
+	std::string text; ///< The log line
+};
+
+
+/// Collects VRayLog messages received by a client into a ring buffer, so a verbose server does not flood the
+/// receiver with one callback per line
+/// Messages above the max level are dropped before they are parsed, identical consecutive lines are merged and when
+/// the buffer is full the oldest lines are overwritten
+/// Buffered lines are delivered to a callback at most once per interval or can be pulled with ::drain
+/// All methods are thread safe
+class VRayLogSink {
+public:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+	typedef std::function<void(const VRayLogEntry * entries, size_t count)> Callback;
+
+	/// @maxLevel - lines with higher level are dropped
+	/// @capacity - max number of lines buffered
+	explicit VRayLogSink(int maxLevel = 2, int capacity = 1024);
+
+	VRayLogSink(const VRayLogSink &) = delete;
+	VRayLogSink &operator=(const VRayLogSink &) = delete;
+
+	/// Set the max level of lines to keep
+	void setMaxLevel(int level);
+
+	/// Set callback called with buffered lines, pass nullptr to only use ::drain
+	/// @cb - called from the thread calling ::deliver, usually the loop thread of the client
+	/// @interval - min time in milliseconds between calls
+	void setCallback(Callback cb, int interval = 100);
+
+	/// Take the payload if it is a log message
+	/// @payload - received message payload, not modified
+	/// @return - true if the message was a log message, false if it should be passed on
+	bool consume(const zmq::message_t & payload);
+
+	/// Call the callback with all buffered lines if the interval since the last call has passed
+	/// Note: clients sharing the sink call it from their own loop threads, each line is delivered by one of them
+	void deliver(time_point now);
+
+	/// Get the time in milliseconds until ::deliver has lines to pass to the callback
+	/// @return - -1 if there is nothing to deliver
+	long getTimeout(time_point now) const;
+
+	/// Move all buffered lines to entries, in the order received
+	/// @return - number of lines added
+	size_t drain(std::vector<VRayLogEntry> & entries);
+
+	/// Get number of log messages received
+	uint64_t getReceived() const;
+
+	/// Get number of log messages dropped because of their level
+	uint64_t getFiltered() const;
+
+	/// Get number of lines overwritten before they were delivered
+	uint64_t getOverwritten() const;
+
+private:
+	/// Move buffered lines to entries, called with @sinkMutex locked
+	size_t take(std::vector<VRayLogEntry> & entries);
+
+	std::vector<VRayLogEntry> ring; ///< Buffered lines
+	size_t head; ///< Index of the oldest buffered line
+	size_t count; ///< Number of buffered lines
+	mutable std::mutex sinkMutex; ///< Mutex protecting the buffer and the callback
+
+	Callback callback; ///< Called with buffered lines
+	std::chrono::milliseconds interval; ///< Min time between callback calls
+	time_point lastDelivery; ///< Last time callback was called
+	std::vector<VRayLogEntry> spare; ///< Memory of the lines last passed to callback, reused by the next call
+
+	std::atomic<int> maxLevel; ///< Lines with higher level are dropped
+	std::atomic<uint64_t> received; ///< Number of log messages received
+	std::atomic<uint64_t> filtered; ///< Number of log messages dropped because of the level
+	std::atomic<uint64_t> overwritten; ///< Number of lines overwritten
+};
+
+
+inline VRayLogSink::VRayLogSink(int maxLevel, int capacity)
+    : ring(std::max(capacity, 1))
+    , head(0)
+    , count(0)
+    , interval(100)
+    , maxLevel(maxLevel)
+    , received(0)
+    , filtered(0)
+    , overwritten(0)
+{}
+
+inline void VRayLogSink::setMaxLevel(int level) {
+	maxLevel = level;
+}
+
+inline void VRayLogSink::setCallback(Callback cb, int interval) {
+	std::lock_guard<std::mutex> lock(sinkMutex);
+	this->callback = cb;
+	this->interval = std::chrono::milliseconds(std::max(interval, 0));
+}
+
+inline bool VRayLogSink::consume(const zmq::message_t & payload) {
+	VRayMessage::Header header;
+	if (!VRayMessage::peekHeader(reinterpret_cast<const char *>(payload.data()), payload.size(), header) ||
+	    header.type != VRayMessage::Type::VRayLog) {
+		return false;
+	}
+
+	++received;
+	if (header.logLevel > maxLevel) {
+		++filtered;
+		return true;
+	}
+
+	std::lock_guard<std::mutex> lock(sinkMutex);
+	if (count) {
+		VRayLogEntry & last = ring[(head + count - 1) % ring.size()];
+		if (last.level == header.logLevel && last.text.size() == header.valueSize &&
+		    !last.text.compare(0, last.text.size(), header.value, header.valueSize)) {
+			++last.repeat;
+			return true;
+		}
+	}
+
+	if (count == ring.size()) {
+		head = (head + 1) % ring.size();
+		--count;
+		++overwritten;
+	}
+
+	VRayLogEntry & entry = ring[(head + count) % ring.size()];
+	entry.level = header.logLevel;
+	entry.repeat = 1;
+	entry.text.assign(header.value, header.valueSize);
+	++count;
+	return true;
+}
+
+inline size_t VRayLogSink::take(std::vector<VRayLogEntry> & entries) {
+	const size_t taken = count;
+	for (; count; --count) {
+		VRayLogEntry & entry = ring[head];
+		entries.push_back(VRayLogEntry());
+		entries.back().level = entry.level;
+		entries.back().repeat = entry.repeat;
+		entries.back().text.swap(entry.text);
+		head = (head + 1) % ring.size();
+	}
+	head = 0;
+	return taken;
+}
+
+inline void VRayLogSink::deliver(time_point now) {
+	Callback cb;
+	std::vector<VRayLogEntry> delivering;
+	{
+		std::lock_guard<std::mutex> lock(sinkMutex);
+		if (!callback || !count || now - lastDelivery < interval) {
+			return;
+		}
+		lastDelivery = now;
+		// the lines are owned by this call, another thread delivering meanwhile gets it's own vector
+		delivering.swap(spare);
+		take(delivering);
+		cb = callback;
+	}
+	// the callback can take long, don't block receiving meanwhile
+	cb(delivering.data(), delivering.size());
+
+	delivering.clear();
+	std::lock_guard<std::mutex> lock(sinkMutex);
+	if (spare.capacity() < delivering.capacity()) {
+		spare.swap(delivering);
+	}
+}
+
+inline long VRayLogSink::getTimeout(time_point now) const {
+	std::lock_guard<std::mutex> lock(sinkMutex);
+	if (!callback || !count) {
+		return -1;
+	}
+	const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(lastDelivery + interval - now).count();
+	return left > 0 ? static_cast<long>(left) + 1 : 0;
+}
+
+inline size_t VRayLogSink::drain(std::vector<VRayLogEntry> & entries) {
+	std::lock_guard<std::mutex> lock(sinkMutex);
+	return take(entries);
+}
+
+inline uint64_t VRayLogSink::getReceived() const {
+	return received;
+}
+
+inline uint64_t VRayLogSink::getFiltered() const {
+	return filtered;
+}
+
+inline uint64_t VRayLogSink::getOverwritten() const {
+	return overwritten;
+}
+
+#endif // _ZMQ_LOG_SINK_H_
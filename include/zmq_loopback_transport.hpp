@@ -0,0 +1,182 @@
+#ifndef _ZMQ_LOOPBACK_TRANSPORT_H_
+#define _ZMQ_LOOPBACK_TRANSPORT_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "zmq_wrapper.hpp"
+
+/// Transport that passes messages to a handler in the same process instead of a server
+/// The handler is called from ::send on the loop thread and answers with ::reply, so there are no sockets, I/O threads
+/// or system calls between the client and the handler. Used to measure queueing, framing and dispatch of ZmqClient in
+/// isolation with deterministic timing, and to run the client without a server
+/// Without handler it behaves as minimal server - accepts the handshake, answers pings and drops everything else
+class ZmqLoopbackTransport: public ZmqTransport {
+public:
+	/// Called for each message the client sends, the frames can be moved out
+	typedef std::function<void(ZmqLoopbackTransport & transport, zmq::message_t & control, zmq::message_t & payload)> Handler;
+
+	/// @handler - called with sent messages, if null ::serve is used
+	explicit ZmqLoopbackTransport(Handler handler = nullptr);
+
+	/// Create factory for ZmqClient::setTransportFactory, each connection gets new transport with the same handler
+	static ZmqTransportFactory factory(Handler handler = nullptr);
+
+	/// Answer the handshake and pings as the server would, the shared memory ring is never accepted
+	/// @return - true if the message was answered, false for data and other messages
+	static bool serve(ZmqLoopbackTransport & transport, const zmq::message_t & control);
+
+	/// Queue message to be received by the client, can be called from any thread
+	void reply(zmq::message_t && control, zmq::message_t && payload);
+
+	/// Get number of messages passed to the handler
+	uint64_t getSentMessages() const;
+
+	/// Get number of payload bytes passed to the handler
+	uint64_t getSentBytes() const;
+
+	void connect(const std::string & endpoint, uint64_t identity) override;
+	void close() override;
+	bool send(zmq::message_t & control, zmq::message_t & payload) override;
+	bool recv(zmq::message_t & control, zmq::message_t & payload) override;
+	bool getPollItem(zmq::pollitem_t & item, short events) override;
+	short getReadyEvents(short events) override;
+	void setWake(std::function<void()> wake) override;
+
+private:
+	Handler handler; ///< Called with sent messages
+	std::function<void()> wake; ///< Wakes the runtime when ::reply is called from other thread
+
+	std::deque<std::pair<zmq::message_t, zmq::message_t>> inbound; ///< Messages waiting for ::recv
+	mutable std::mutex inboundMutex; ///< Mutex protecting @inbound and @loopThread
+	std::thread::id loopThread; ///< Thread that connected, replies from it don't need to wake the runtime
+
+	bool connected; ///< Set between ::connect and ::close, used only on the loop thread
+	std::atomic<uint64_t> sentMessages; ///< Number of messages passed to the handler
+	std::atomic<uint64_t> sentBytes; ///< Number of payload bytes passed to the handler
+};
+
+
+inline ZmqLoopbackTransport::ZmqLoopbackTransport(Handler handler)
+    : handler(handler)
+    , connected(false)
+    , sentMessages(0)
+    , sentBytes(0)
+{}
+
+inline ZmqTransportFactory ZmqLoopbackTransport::factory(Handler handler) {
+	return [handler](zmq::context_t &) {
+		return std::unique_ptr<ZmqTransport>(new ZmqLoopbackTransport(handler));
+	};
+}
+
+inline bool ZmqLoopbackTransport::serve(ZmqLoopbackTransport & transport, const zmq::message_t & control) {
+	ControlFrame frame(control);
+	if (!frame) {
+		return false;
+	}
+
+	ControlMessage response;
+	switch (frame.control) {
+	case ControlMessage::EXPORTER_CONNECT_MSG:
+		response = ControlMessage::RENDERER_CREATE_MSG;
+		break;
+	case ControlMessage::HEARTBEAT_CONNECT_MSG:
+		response = ControlMessage::HEARTBEAT_CREATE_MSG;
+		break;
+	case ControlMessage::PING_MSG:
+		response = ControlMessage::PONG_MSG;
+		break;
+	default:
+		return false;
+	}
+
+	transport.reply(ControlFrame::make(frame.type, response), zmq::message_t(0));
+	return true;
+}
+
+inline void ZmqLoopbackTransport::reply(zmq::message_t && control, zmq::message_t && payload) {
+	bool wakeNeeded;
+	{
+		std::lock_guard<std::mutex> lock(inboundMutex);
+		inbound.push_back(std::make_pair(std::move(control), std::move(payload)));
+		// the loop checks ::getReadyEvents before it sleeps, only other threads have to wake it
+		wakeNeeded = inbound.size() == 1 && std::this_thread::get_id() != loopThread;
+	}
+	if (wakeNeeded && wake) {
+		wake();
+	}
+}
+
+inline uint64_t ZmqLoopbackTransport::getSentMessages() const {
+	return sentMessages;
+}
+
+inline uint64_t ZmqLoopbackTransport::getSentBytes() const {
+	return sentBytes;
+}
+
+inline void ZmqLoopbackTransport::connect(const std::string &, uint64_t) {
+	std::lock_guard<std::mutex> lock(inboundMutex);
+	loopThread = std::this_thread::get_id();
+	connected = true;
+}
+
+inline void ZmqLoopbackTransport::close() {
+	connected = false;
+	std::lock_guard<std::mutex> lock(inboundMutex);
+	inbound.clear();
+}
+
+inline bool ZmqLoopbackTransport::send(zmq::message_t & control, zmq::message_t & payload) {
+	if (!connected) {
+		return false;
+	}
+	++sentMessages;
+	sentBytes += payload.size();
+	if (handler) {
+		handler(*this, control, payload);
+	} else {
+		serve(*this, control);
+	}
+	return true;
+}
+
+inline bool ZmqLoopbackTransport::recv(zmq::message_t & control, zmq::message_t & payload) {
+	std::lock_guard<std::mutex> lock(inboundMutex);
+	if (inbound.empty()) {
+		return false;
+	}
+	control.move(&inbound.front().first);
+	payload.move(&inbound.front().second);
+	inbound.pop_front();
+	return true;
+}
+
+inline bool ZmqLoopbackTransport::getPollItem(zmq::pollitem_t &, short) {
+	return false;
+}
+
+inline short ZmqLoopbackTransport::getReadyEvents(short events) {
+	if (!connected) {
+		return 0;
+	}
+	short ready = events & ZMQ_POLLOUT;
+	std::lock_guard<std::mutex> lock(inboundMutex);
+	if (!inbound.empty()) {
+		ready |= events & ZMQ_POLLIN;
+	}
+	return ready;
+}
+
+inline void ZmqLoopbackTransport::setWake(std::function<void()> wake) {
+	this->wake = wake;
+}
+
+#endif // _ZMQ_LOOPBACK_TRANSPORT_H_
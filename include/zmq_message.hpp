@@ -6,6 +6,11 @@
 #include "zmq_serializer.hpp"
 #include "zmq_deserializer.hpp"
 
+/// Serialized messages at least this large are handed to zmq without copying, smaller ones are cheaper to copy
+static const size_t MESSAGE_ZERO_COPY_MIN = 1 << 10;
+/// VRayMessage::fromVector shrinks vectors with more unused capacity than 1/MESSAGE_SLACK_DIVISOR of their size, queues
+/// and resend buffers count only the size, so the slack of grown vectors must not stay with the message
+static const size_t MESSAGE_SLACK_DIVISOR = 4;
 
 class VRayMessage {
 public:
@@ -86,6 +91,44 @@ public:
 		ProgressMessage,
 	};
 
+	/// Fields at the start of a serialized message that can be read without parsing the whole message
+	/// Strings point inside the serialized data and are valid as long as it is
+	struct Header {
+		Header()
+		    : type(Type::None)
+		    , pluginAction(PluginAction::None)
+		    , rendererAction(RendererAction::None)
+		    , plugin(nullptr)
+		    , pluginSize(0)
+		    , pluginType(nullptr)
+		    , pluginTypeSize(0)
+		    , property(nullptr)
+		    , propertySize(0)
+		    , valueSetter(ValueSetter::None)
+		    , value(nullptr)
+		    , valueSize(0)
+		    , rendererState(RendererState::None)
+		    , imageSourceType(VRayBaseTypes::ImageSourceInvalid)
+		    , logLevel(0)
+		{}
+
+		Type           type; ///< The message type
+		PluginAction   pluginAction; ///< If type == ChangePlugin the plugin action
+		RendererAction rendererAction; ///< If type == ChangeRenderer the renderer action
+		const char *   plugin; ///< If type == ChangePlugin the plugin name
+		size_t         pluginSize; ///< Number of bytes in @plugin
+		const char *   pluginType; ///< If pluginAction == Create the plugin type, can be null
+		size_t         pluginTypeSize; ///< Number of bytes in @pluginType
+		const char *   property; ///< If pluginAction == Update the property name
+		size_t         propertySize; ///< Number of bytes in @property
+		ValueSetter    valueSetter; ///< If pluginAction == Update the value setter
+		const char *   value; ///< If pluginAction == Update the serialized value (type followed by data), if type == VRayLog the log text
+		size_t         valueSize; ///< Number of bytes in @value
+		RendererState  rendererState; ///< If rendererAction == SetRendererState the renderer state
+		VRayBaseTypes::ImageSourceType imageSourceType; ///< If type == Image the source of the image set
+		int            logLevel; ///< If type == VRayLog the log level
+	};
+
 	VRayMessage()
 	    : type(Type::None)
 	    , rendererAction(RendererAction::None)
@@ -117,7 +160,7 @@ public:
 	}
 
 	/// Create message from data, usually to be sent
-	explicit VRayMessage(const char * data, int size)
+	explicit VRayMessage(const char * data, size_t size)
 	    : message(data, size)
 	    , rendererAction(RendererAction::None)
 	    , rendererType(RendererType::None)
@@ -135,10 +178,78 @@ public:
 		return msg;
 	}
 
-	static zmq::message_t fromData(const char * data, int size) {
+	/// Read the header of serialized message without parsing the value
+	/// @data - pointer to the serialized message
+	/// @size - number of bytes in data
+	/// @header - filled with the fields found in data
+	/// @return - false if the data is too short for the header it declares
+	static bool peekHeader(const char * data, size_t size, Header & header) {
+		header = Header();
+		DeserializerStream stream(data, size);
+		if (!stream.read(reinterpret_cast<char *>(&header.type), sizeof(header.type))) {
+			return false;
+		}
+
+		if (header.type == Type::ChangePlugin) {
+			if (!peekString(stream, header.plugin, header.pluginSize) ||
+			    !stream.read(reinterpret_cast<char *>(&header.pluginAction), sizeof(header.pluginAction))) {
+				return false;
+			}
+			if (header.pluginAction == PluginAction::Create && stream.hasMore()) {
+				return peekString(stream, header.pluginType, header.pluginTypeSize);
+			} else if (header.pluginAction == PluginAction::Update) {
+				if (!peekString(stream, header.property, header.propertySize) ||
+				    !stream.read(reinterpret_cast<char *>(&header.valueSetter), sizeof(header.valueSetter))) {
+					return false;
+				}
+				header.value = stream.getCurrent();
+				header.valueSize = stream.getRemaining();
+			}
+		} else if (header.type == Type::ChangeRenderer) {
+			if (!stream.read(reinterpret_cast<char *>(&header.rendererAction), sizeof(header.rendererAction))) {
+				return false;
+			}
+			if (header.rendererAction == RendererAction::SetRendererState) {
+				return stream.read(reinterpret_cast<char *>(&header.rendererState), sizeof(header.rendererState));
+			}
+		} else if (header.type == Type::Image) {
+			VRayBaseTypes::ValueType valueType;
+			return stream.read(reinterpret_cast<char *>(&valueType), sizeof(valueType)) &&
+			       stream.read(reinterpret_cast<char *>(&header.imageSourceType), sizeof(header.imageSourceType));
+		} else if (header.type == Type::VRayLog) {
+			VRayBaseTypes::ValueType valueType;
+			const char * text = nullptr;
+			size_t textSize = 0;
+			if (!stream.read(reinterpret_cast<char *>(&header.logLevel), sizeof(header.logLevel)) ||
+			    !stream.read(reinterpret_cast<char *>(&valueType), sizeof(valueType)) ||
+			    !peekString(stream, text, textSize)) {
+				return false;
+			}
+			header.value = text;
+			header.valueSize = textSize;
+		}
+		return true;
+	}
+
+	static zmq::message_t fromData(const char * data, size_t size) {
 		return zmq::message_t(data, size);
 	}
 
+	/// Create message taking over the memory of data, without copying it unless it has lots of unused capacity
+	/// @data - the serialized message, empty after the function returns
+	static zmq::message_t fromVector(std::vector<char> && data) {
+		if (data.empty()) {
+			return zmq::message_t(0);
+		}
+		if (data.capacity() - data.size() > data.size() / MESSAGE_SLACK_DIVISOR) {
+			data.shrink_to_fit();
+		}
+		std::vector<char> * owned = new std::vector<char>(std::move(data));
+		return zmq::message_t(owned->data(), owned->size(), [](void *, void * hint) {
+			delete static_cast<std::vector<char> *>(hint);
+		}, owned);
+	}
+
 	zmq::message_t & getInternalMessage() {
 		return this->message;
 	}
@@ -167,7 +278,7 @@ public:
 		return pluginType;
 	}
 
-	/// Get the message type
+	/// Get the message type, Type::None if the data is malformed
 	Type getType() const {
 		return type;
 	}
@@ -254,19 +365,41 @@ public:
 	/// Creates message to control a plugin property
 	template <typename T>
 	static zmq::message_t msgPluginSetProperty(const std::string & plugin, const std::string & property, const T & value) {
-		using namespace std;
 		SerializerStream strm;
-		strm << VRayMessage::Type::ChangePlugin << plugin << PluginAction::Update << property << ValueSetter::Default << value.getType() << value;
+		writePluginSetProperty(strm, plugin, property, value);
 		return fromStream(strm);
 	}
 
 	static zmq::message_t msgPluginSetProperty(const std::string & plugin, const std::string & property, const VRayBaseTypes::AttrValue & value) {
-		using namespace std;
 		SerializerStream strm;
-		strm << VRayMessage::Type::ChangePlugin << plugin << PluginAction::Update << property << ValueSetter::Default << value;
+		writePluginSetProperty(strm, plugin, property, value);
 		return fromStream(strm);
 	}
 
+	/// Creates message to set a list property straight from an array of the host application, see AttrListSpan
+	/// @data - the first item, one of the POD list item types, e.g. AttrVector
+	/// @count - number of items
+	/// @stride - bytes from the start of one item to the start of the next, 0 if the items are packed
+	template <typename T>
+	static zmq::message_t msgPluginSetProperty(const std::string & plugin, const std::string & property, const T * data, size_t count, size_t stride = 0) {
+		const VRayBaseTypes::AttrListSpan<T> list(data, count, stride);
+		SerializerStream strm;
+		// header is type, action and setter bytes, the sizes of the strings and of the list, and the value type
+		strm.reserve(plugin.size() + property.size() + 3 + 3 * sizeof(int) + sizeof(list.getType()) + count * sizeof(T));
+		writePluginSetProperty(strm, plugin, property, list);
+		return fromStream(strm);
+	}
+
+	/// Serialize the message of ::msgPluginSetProperty into stream, e.g. the one ZmqClient::sendChunked writes to
+	template <typename T>
+	static void writePluginSetProperty(SerializerStream & strm, const std::string & plugin, const std::string & property, const T & value) {
+		strm << VRayMessage::Type::ChangePlugin << plugin << PluginAction::Update << property << ValueSetter::Default << value.getType() << value;
+	}
+
+	static void writePluginSetProperty(SerializerStream & strm, const std::string & plugin, const std::string & property, const VRayBaseTypes::AttrValue & value) {
+		strm << VRayMessage::Type::ChangePlugin << plugin << PluginAction::Update << property << ValueSetter::Default << value;
+	}
+
 	static zmq::message_t msgPluginSetPropertyString(const std::string & plugin, const std::string & property, const std::string & value) {
 		using namespace std;
 		SerializerStream strm;
@@ -335,7 +468,19 @@ public:
 
 private:
 	static zmq::message_t fromStream(SerializerStream & strm) {
-		return fromData(strm.getData(), strm.getSize());
+		if (strm.getSize() < MESSAGE_ZERO_COPY_MIN) {
+			return fromData(strm.getData(), strm.getSize());
+		}
+		return fromVector(strm.takeData());
+	}
+
+	/// Get pointer and size of serialized string without copying it
+	static bool peekString(DeserializerStream & stream, const char *& str, size_t & size) {
+		if (!stream.readCount(size, 1)) {
+			return false;
+		}
+		str = stream.getCurrent();
+		return stream.forward(size);
 	}
 
 	void parse() {
@@ -353,29 +498,41 @@ private:
 					stream >> pluginType;
 				}
 			} else if (pluginAction == PluginAction::Replace) {
-				assert(stream.hasMore() && "Missing new plugin for replace plugin");
+				// missing new plugin fails the stream
 				stream >> value;
 			}
 		} else if (type == Type::Image) {
 			stream >> value;
 		} else if (type == Type::VRayLog) {
 			stream >> logLevel >> value;
-			assert(value.type == VRayBaseTypes::ValueTypeString && "Type::VRayLog must be a string value");
+			if (value.type != VRayBaseTypes::ValueTypeString) {
+				stream.fail();
+			}
 		} else if (type == Type::ChangeRenderer) {
 			stream >> rendererAction;
 			if (rendererAction == RendererAction::Resize) {
 				stream >> rendererWidth >> rendererHeight;
 			} else if (rendererAction == RendererAction::Init) {
 				stream >> value;
-				const int val = value.as<AttrSimpleType<int>>().value;
-				drFlags = static_cast<DRFlags>((val >> static_cast<int>(DRFlags::_SerializationShift)) & 0xff);
-				rendererType = static_cast<RendererType>((val >> static_cast<int>(RendererType::_SerializationShift)) & 0xff);
+				// the value is read as int only once it's type is checked
+				if (value.type != VRayBaseTypes::ValueTypeInt) {
+					stream.fail();
+				} else {
+					const int val = value.as<AttrSimpleType<int>>().value;
+					drFlags = static_cast<DRFlags>((val >> static_cast<int>(DRFlags::_SerializationShift)) & 0xff);
+					rendererType = static_cast<RendererType>((val >> static_cast<int>(RendererType::_SerializationShift)) & 0xff);
+				}
 			} else if (rendererAction == RendererAction::SetRendererState) {
 				stream >> rendererState >> value;
 			} else if (rendererAction > RendererAction::_ArgumentRenderAction) {
 				stream >> value;
 			}
 		}
+
+		if (!stream.good()) {
+			// malformed data, e.g. truncated message or unknown value type
+			type = Type::None;
+		}
 	}
 
 
@@ -0,0 +1,175 @@
+#ifndef _ZMQ_PROPERTY_CACHE_H_
+#define _ZMQ_PROPERTY_CACHE_H_
+
+#include <zmq.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "zmq_message.hpp"
+
+/// 64 bit non cryptographic hash of a byte buffer, reads 8 bytes per step so large lists hash near memory speed
+inline uint64_t vrayHash64(const void * data, size_t size, uint64_t seed = 0) {
+	const uint64_t k1 = 0x87c37b91114253d5ULL;
+	const uint64_t k2 = 0x4cf5ad432745937fULL;
+	const unsigned char * bytes = reinterpret_cast<const unsigned char *>(data);
+
+	uint64_t hash = seed ^ (size * k1);
+	const size_t words = size / sizeof(uint64_t);
+	for (size_t c = 0; c < words; ++c) {
+		uint64_t word;
+		memcpy(&word, bytes + c * sizeof(uint64_t), sizeof(word));
+		word *= k1;
+		word = (word << 31) | (word >> 33);
+		word *= k2;
+		hash ^= word;
+		hash = ((hash << 27) | (hash >> 37)) * 5 + 0x52dce729;
+	}
+
+	uint64_t tail = 0;
+	memcpy(&tail, bytes + words * sizeof(uint64_t), size % sizeof(uint64_t));
+	hash ^= tail * k2;
+
+	// final avalanche so all input bits affect all output bits
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+
+/// Remembers hash of the last value sent for each (plugin, property) pair and filters out updates
+/// setting the same value again
+/// Plugin remove and replace invalidate all properties of the plugin, renderer actions that reset the scene
+/// invalidate the whole cache
+/// All methods are thread safe
+class VRayPropertyCache {
+public:
+	VRayPropertyCache();
+
+	VRayPropertyCache(const VRayPropertyCache &) = delete;
+	VRayPropertyCache &operator=(const VRayPropertyCache &) = delete;
+
+	/// Check if a message needs to be sent and update the cache with it
+	/// @data - serialized message
+	/// @size - number of bytes in data
+	/// @return - false if the message sets property to the value it already has
+	bool filter(const char * data, size_t size);
+
+	/// Check if a message needs to be sent and update the cache with it
+	bool filter(const zmq::message_t & message);
+
+	/// Forget all values, next update for any property will be sent
+	void clear();
+
+	/// Get number of property updates that were filtered out
+	uint64_t getHits() const;
+
+	/// Get number of property updates that had to be sent
+	uint64_t getMisses() const;
+
+	/// Reset hit and miss counters
+	void resetCounters();
+
+private:
+	typedef std::unordered_map<std::string, uint64_t> PropertyMap;
+	typedef std::unordered_map<std::string, PropertyMap> PluginMap;
+
+	PluginMap plugins; ///< Maps plugin name to map of property name to value hash
+	std::mutex cacheMutex; ///< Mutex protecting @plugins
+
+	std::atomic<uint64_t> hits; ///< Number of updates filtered out
+	std::atomic<uint64_t> misses; ///< Number of updates passed
+};
+
+
+inline VRayPropertyCache::VRayPropertyCache()
+    : hits(0)
+    , misses(0)
+{}
+
+inline bool VRayPropertyCache::filter(const zmq::message_t & message) {
+	return filter(reinterpret_cast<const char *>(message.data()), message.size());
+}
+
+inline bool VRayPropertyCache::filter(const char * data, size_t size) {
+	typedef VRayMessage::Type Type;
+	typedef VRayMessage::PluginAction PluginAction;
+	typedef VRayMessage::RendererAction RendererAction;
+
+	VRayMessage::Header header;
+	if (!VRayMessage::peekHeader(data, size, header)) {
+		return true;
+	}
+
+	if (header.type == Type::ChangeRenderer) {
+		switch (header.rendererAction) {
+		case RendererAction::Free:
+		case RendererAction::Reset:
+		case RendererAction::Init:
+		case RendererAction::LoadScene:
+		case RendererAction::AppendScene:
+		case RendererAction::ClearFrameValues:
+			clear();
+			break;
+		default:
+			break;
+		}
+		return true;
+	}
+
+	if (header.type != Type::ChangePlugin) {
+		return true;
+	}
+
+	const std::string plugin(header.plugin, header.pluginSize);
+
+	if (header.pluginAction == PluginAction::Remove || header.pluginAction == PluginAction::Replace) {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		plugins.erase(plugin);
+		return true;
+	} else if (header.pluginAction != PluginAction::Update) {
+		// create is sent on each export for existing plugins too, it does not change property values
+		return true;
+	}
+
+	// setter is part of the hash since the same bytes mean different things when set as string
+	const uint64_t valueHash = vrayHash64(header.value, header.valueSize, static_cast<uint64_t>(header.valueSetter));
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	uint64_t & cached = plugins[plugin][std::string(header.property, header.propertySize)];
+	// zero is used for missing entries, so it never matches
+	if (cached == valueHash && valueHash != 0) {
+		++hits;
+		return false;
+	}
+	cached = valueHash;
+	++misses;
+	return true;
+}
+
+inline void VRayPropertyCache::clear() {
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	plugins.clear();
+}
+
+inline uint64_t VRayPropertyCache::getHits() const {
+	return hits;
+}
+
+inline uint64_t VRayPropertyCache::getMisses() const {
+	return misses;
+}
+
+inline void VRayPropertyCache::resetCounters() {
+	hits = 0;
+	misses = 0;
+}
+
+#endif // _ZMQ_PROPERTY_CACHE_H_
@@ -0,0 +1,171 @@
+#ifndef _ZMQ_ROUTER_H_
+#define _ZMQ_ROUTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+#include "zmq_wrapper.hpp"
+
+/// Dispatches received messages to handlers registered per message type, renderer action, renderer state or image
+/// source type. The route is decided from the message header only, messages without handler are never parsed
+/// Handlers are kept in flat tables indexed by the enum values
+/// Note: register all handlers before ::attach, the tables are not synchronized with the worker thread
+class VRayMessageRouter {
+public:
+	typedef ZmqClient::ZmqOnMessageCallback Handler;
+
+	VRayMessageRouter();
+
+	/// Set handler for all messages of a type not handled by more specific handler
+	void onType(VRayMessage::Type type, Handler handler);
+
+	/// Set handler for ChangeRenderer messages with this action
+	void onRendererAction(VRayMessage::RendererAction action, Handler handler);
+
+	/// Set handler for SetRendererState messages with this state
+	void onRendererState(VRayMessage::RendererState state, Handler handler);
+
+	/// Set handler for Image messages with this source type
+	void onImage(VRayBaseTypes::ImageSourceType sourceType, Handler handler);
+
+	/// Set handler for messages that have no other handler
+	void onDefault(Handler handler);
+
+	/// Install the router as the raw callback of the client, the router must outlive the client or be detached
+	void attach(ZmqClient & client);
+
+	/// Remove the router from the client
+	void detach(ZmqClient & client);
+
+	/// Find the handler for a message and call it with the parsed message
+	/// @payload - the received payload, moved into the parsed message if there is a handler
+	/// @client - the client that received the message
+	/// @return - true if there was a handler
+	bool route(zmq::message_t & payload, ZmqClient * client);
+
+	/// Get number of messages that were parsed and passed to a handler
+	uint64_t getRoutedCount() const;
+
+	/// Get number of messages dropped without parsing since there was no handler
+	uint64_t getDroppedCount() const;
+
+private:
+	/// Find the most specific handler for message header
+	const Handler * findHandler(const VRayMessage::Header & header) const;
+
+	static const int TYPE_COUNT = static_cast<int>(VRayMessage::Type::VRayLog) + 1;
+	static const int RENDERER_ACTION_COUNT = static_cast<int>(VRayMessage::RendererAction::SetCropRegion) + 1;
+	static const int RENDERER_STATE_COUNT = static_cast<int>(VRayMessage::RendererState::ProgressMessage) + 1;
+	static const int IMAGE_SOURCE_COUNT = static_cast<int>(VRayBaseTypes::BucketImageReady) + 1;
+
+	Handler typeHandlers[TYPE_COUNT]; ///< Handlers indexed by VRayMessage::Type
+	Handler rendererActionHandlers[RENDERER_ACTION_COUNT]; ///< Handlers indexed by VRayMessage::RendererAction
+	Handler rendererStateHandlers[RENDERER_STATE_COUNT]; ///< Handlers indexed by VRayMessage::RendererState
+	Handler imageHandlers[IMAGE_SOURCE_COUNT]; ///< Handlers indexed by VRayBaseTypes::ImageSourceType
+	Handler defaultHandler; ///< Handler for messages not matching any other
+
+	std::atomic<uint64_t> routedCount; ///< Number of messages passed to handler
+	std::atomic<uint64_t> droppedCount; ///< Number of messages without handler
+};
+
+
+inline VRayMessageRouter::VRayMessageRouter()
+    : routedCount(0)
+    , droppedCount(0)
+{}
+
+inline void VRayMessageRouter::onType(VRayMessage::Type type, Handler handler) {
+	const int idx = static_cast<int>(type);
+	assert(idx >= 0 && idx < TYPE_COUNT && "VRayMessageRouter::onType type out of range");
+	typeHandlers[idx] = handler;
+}
+
+inline void VRayMessageRouter::onRendererAction(VRayMessage::RendererAction action, Handler handler) {
+	const int idx = static_cast<int>(action);
+	assert(idx >= 0 && idx < RENDERER_ACTION_COUNT && "VRayMessageRouter::onRendererAction action out of range");
+	rendererActionHandlers[idx] = handler;
+}
+
+inline void VRayMessageRouter::onRendererState(VRayMessage::RendererState state, Handler handler) {
+	const int idx = static_cast<int>(state);
+	assert(idx >= 0 && idx < RENDERER_STATE_COUNT && "VRayMessageRouter::onRendererState state out of range");
+	rendererStateHandlers[idx] = handler;
+}
+
+inline void VRayMessageRouter::onImage(VRayBaseTypes::ImageSourceType sourceType, Handler handler) {
+	const int idx = static_cast<int>(sourceType);
+	assert(idx >= 0 && idx < IMAGE_SOURCE_COUNT && "VRayMessageRouter::onImage source type out of range");
+	imageHandlers[idx] = handler;
+}
+
+inline void VRayMessageRouter::onDefault(Handler handler) {
+	defaultHandler = handler;
+}
+
+inline void VRayMessageRouter::attach(ZmqClient & client) {
+	client.setRawCallback([this](zmq::message_t & payload, ZmqClient * client) {
+		route(payload, client);
+	});
+}
+
+inline void VRayMessageRouter::detach(ZmqClient & client) {
+	client.setRawCallback(nullptr);
+}
+
+inline const VRayMessageRouter::Handler * VRayMessageRouter::findHandler(const VRayMessage::Header & header) const {
+	typedef VRayMessage::Type Type;
+
+	if (header.type == Type::ChangeRenderer) {
+		const int state = static_cast<int>(header.rendererState);
+		if (header.rendererAction == VRayMessage::RendererAction::SetRendererState &&
+		    state >= 0 && state < RENDERER_STATE_COUNT && rendererStateHandlers[state]) {
+			return &rendererStateHandlers[state];
+		}
+		const int action = static_cast<int>(header.rendererAction);
+		if (action >= 0 && action < RENDERER_ACTION_COUNT && rendererActionHandlers[action]) {
+			return &rendererActionHandlers[action];
+		}
+	} else if (header.type == Type::Image) {
+		const int source = static_cast<int>(header.imageSourceType);
+		if (source >= 0 && source < IMAGE_SOURCE_COUNT && imageHandlers[source]) {
+			return &imageHandlers[source];
+		}
+	}
+
+	const int type = static_cast<int>(header.type);
+	if (type >= 0 && type < TYPE_COUNT && typeHandlers[type]) {
+		return &typeHandlers[type];
+	}
+
+	return defaultHandler ? &defaultHandler : nullptr;
+}
+
+inline bool VRayMessageRouter::route(zmq::message_t & payload, ZmqClient * client) {
+	VRayMessage::Header header;
+	const Handler * handler = nullptr;
+	if (VRayMessage::peekHeader(reinterpret_cast<const char *>(payload.data()), payload.size(), header)) {
+		handler = findHandler(header);
+	} else if (defaultHandler) {
+		handler = &defaultHandler;
+	}
+
+	if (!handler) {
+		++droppedCount;
+		return false;
+	}
+
+	++routedCount;
+	(*handler)(VRayMessage::fromZmqMessage(payload), client);
+	return true;
+}
+
+inline uint64_t VRayMessageRouter::getRoutedCount() const {
+	return routedCount;
+}
+
+inline uint64_t VRayMessageRouter::getDroppedCount() const {
+	return droppedCount;
+}
+
+#endif // _ZMQ_ROUTER_H_
@@ -0,0 +1,525 @@
+#ifndef _ZMQ_SCENE_FILE_H_
+#define _ZMQ_SCENE_FILE_H_
+
+#include <zmq.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "zmq_message.hpp"
+
+/// Scene file layout:
+/// VRaySceneFileHeader
+/// serialized message payloads, each aligned to 8 bytes
+/// VRaySceneMessageEntry[messageCount] - in the order messages were appended
+/// VRayScenePluginEntry[pluginCount] - sorted by plugin name
+/// uint32_t[] - message indices for each plugin, in append order
+/// char[] - strings with plugin names and types
+struct VRaySceneFileHeader {
+	enum : uint32_t {
+		MAGIC = 0x43535a56, // "VZSC"
+		FORMAT_VERSION = 1,
+	};
+
+	uint32_t magic; ///< Must be MAGIC
+	uint32_t formatVersion; ///< Must be FORMAT_VERSION
+	uint64_t messageCount; ///< Number of messages in the file
+	uint64_t messageTableOffset; ///< Offset of the VRaySceneMessageEntry table
+	uint64_t pluginCount; ///< Number of plugins in the index
+	uint64_t pluginTableOffset; ///< Offset of the VRayScenePluginEntry table
+	uint64_t indexOffset; ///< Offset of the message index lists
+	uint64_t stringsOffset; ///< Offset of the string table
+	uint64_t stringsSize; ///< Size of the string table in bytes
+};
+
+struct VRaySceneMessageEntry {
+	enum : uint32_t {
+		NO_PLUGIN = 0xffffffff, ///< Value of @plugin for messages not related to any plugin
+	};
+
+	uint64_t offset; ///< Offset of the payload in the file
+	uint64_t size; ///< Size of the payload in bytes
+	uint32_t plugin; ///< Index in the plugin table or NO_PLUGIN
+	uint32_t reserved;
+};
+
+struct VRayScenePluginEntry {
+	uint64_t nameOffset; ///< Offset of the plugin name in the string table
+	uint64_t nameSize; ///< Size of the plugin name
+	uint64_t typeOffset; ///< Offset of the plugin type in the string table
+	uint64_t typeSize; ///< Size of the plugin type, 0 if it was never created in the stream
+	uint64_t firstIndex; ///< Offset in the index lists of the first message for this plugin
+	uint64_t indexCount; ///< Number of messages for this plugin
+};
+
+
+/// Writes stream of serialized VRayMessage payloads into a scene file indexed by plugin name and type
+class VRaySceneWriter {
+public:
+	VRaySceneWriter();
+	~VRaySceneWriter();
+
+	VRaySceneWriter(const VRaySceneWriter &) = delete;
+	VRaySceneWriter &operator=(const VRaySceneWriter &) = delete;
+
+	/// Create the scene file
+	/// @path - path to the file, will be overwritten if it exists
+	/// @return - true on success
+	bool open(const char * path);
+
+	/// Append a serialized message to the file
+	/// @data - pointer to the message payload, as created by VRayMessage::msg* methods
+	/// @size - number of bytes in data
+	/// @return - false if the message could not be parsed or written
+	bool append(const char * data, size_t size);
+
+	/// Append a serialized message to the file, the message is not modified
+	bool append(const zmq::message_t & message);
+
+	/// Write the index and close the file, the file is not valid until this is called
+	/// @return - true if the index was written
+	bool close();
+
+private:
+	struct PluginInfo {
+		std::string name; ///< The plugin name
+		std::string type; ///< The plugin type if create message was seen
+		std::vector<uint32_t> messages; ///< Indices of all messages for this plugin
+	};
+
+	/// Make sure there are at least @size bytes after @writeOffset
+	bool reserve(size_t size);
+
+	static const size_t INITIAL_SIZE = 64 << 20;
+	static const size_t MAX_GROW_SIZE = 1 << 30;
+
+	MappedFile file; ///< The mapped scene file
+	size_t writeOffset; ///< Offset where the next payload will be written
+	std::vector<VRaySceneMessageEntry> messages; ///< Entry for each appended message
+	std::vector<PluginInfo> plugins; ///< All plugins seen so far
+	std::unordered_map<std::string, uint32_t> pluginIndex; ///< Maps plugin name to index in @plugins
+};
+
+
+/// Read only view of a scene file written by VRaySceneWriter
+/// The file is memory mapped and messages returned point directly into the mapping
+class VRaySceneFile {
+public:
+	VRaySceneFile() = default;
+
+	VRaySceneFile(const VRaySceneFile &) = delete;
+	VRaySceneFile &operator=(const VRaySceneFile &) = delete;
+
+	/// Map scene file and check that all tables and entries point inside it, so the getters can trust them
+	/// @path - path to the file
+	/// @return - true if the file is valid scene file
+	bool open(const char * path);
+
+	/// Unmap the file, messages already returned stay valid
+	void close();
+
+	/// Get the number of messages in the file
+	size_t getMessageCount() const;
+
+	/// Get message payload without copying it, the returned message keeps the mapping alive and is read only
+	/// Can be passed directly to ZmqClient::send
+	/// @index - index of the message in [0, getMessageCount())
+	zmq::message_t getPayload(size_t index) const;
+
+	/// Parse message
+	/// @index - index of the message in [0, getMessageCount())
+	VRayMessage getMessage(size_t index) const;
+
+	/// Get the number of plugins in the index
+	size_t getPluginCount() const;
+
+	/// Get the name of plugin
+	/// @index - index of the plugin in [0, getPluginCount()), plugins are sorted by name
+	std::string getPluginName(size_t index) const;
+
+	/// Get the type of plugin, empty if no create message for the plugin was written
+	/// @index - index of the plugin in [0, getPluginCount()), plugins are sorted by name
+	std::string getPluginType(size_t index) const;
+
+	/// Get the indices of all messages for a plugin in the order they were written
+	/// @plugin - the plugin name
+	/// @indices - message indices are appended here
+	/// @return - false if the plugin is not in the file
+	bool getPluginMessages(const std::string & plugin, std::vector<size_t> & indices) const;
+
+	/// Get the indices of all messages for all plugins of some type in the order they were written
+	/// @pluginType - the plugin type
+	/// @indices - message indices are appended here
+	void getPluginTypeMessages(const std::string & pluginType, std::vector<size_t> & indices) const;
+
+private:
+	/// Check that @count items of @itemSize starting at @offset end at or before @limit, without overflowing
+	static bool fits(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t limit);
+	/// Check the header against the file size
+	bool validHeader(uint64_t fileSize) const;
+	/// Check all message and plugin entries against the tables they point in
+	bool validEntries() const;
+
+	const VRaySceneFileHeader & header() const;
+	const VRaySceneMessageEntry & messageEntry(size_t index) const;
+	const VRayScenePluginEntry & pluginEntry(size_t index) const;
+	const uint32_t * pluginIndices(const VRayScenePluginEntry & plugin) const;
+	const char * getString(uint64_t offset) const;
+
+	/// Free function for zmq::message_t pointing inside the mapping, @hint is heap allocated pointer to the mapping
+	static void releaseMapping(void *, void * hint);
+
+	std::shared_ptr<MappedFile> file; ///< The mapped file, shared with all messages returned from ::getPayload
+};
+
+
+inline VRaySceneWriter::VRaySceneWriter()
+    : writeOffset(0)
+{}
+
+inline VRaySceneWriter::~VRaySceneWriter() {
+	close();
+}
+
+inline bool VRaySceneWriter::open(const char * path) {
+	close();
+	messages.clear();
+	plugins.clear();
+	pluginIndex.clear();
+
+	if (!file.open(path, MappedFile::Mode::Write, INITIAL_SIZE)) {
+		return false;
+	}
+	writeOffset = sizeof(VRaySceneFileHeader);
+	memset(file.data(), 0, sizeof(VRaySceneFileHeader));
+	return true;
+}
+
+inline bool VRaySceneWriter::reserve(size_t size) {
+	if (writeOffset + size <= file.size()) {
+		return true;
+	}
+	size_t newSize = file.size();
+	while (writeOffset + size > newSize) {
+		if (newSize < MAX_GROW_SIZE) {
+			newSize *= 2;
+		} else {
+			newSize += MAX_GROW_SIZE;
+		}
+	}
+	return file.resize(newSize);
+}
+
+inline bool VRaySceneWriter::append(const zmq::message_t & message) {
+	return append(reinterpret_cast<const char *>(message.data()), message.size());
+}
+
+inline bool VRaySceneWriter::append(const char * data, size_t size) {
+	if (!file.good()) {
+		return false;
+	}
+
+	VRayMessage::Header msgHeader;
+	if (!VRayMessage::peekHeader(data, size, msgHeader)) {
+		puts("VRaySceneWriter failed to parse message header, skipping message");
+		return false;
+	}
+
+	const size_t alignedSize = (size + 7) & ~static_cast<size_t>(7);
+	if (!reserve(alignedSize)) {
+		puts("VRaySceneWriter failed to grow file");
+		return false;
+	}
+
+	VRaySceneMessageEntry entry;
+	entry.offset = writeOffset;
+	entry.size = size;
+	entry.plugin = VRaySceneMessageEntry::NO_PLUGIN;
+	entry.reserved = 0;
+
+	if (msgHeader.type == VRayMessage::Type::ChangePlugin) {
+		const std::string name(msgHeader.plugin, msgHeader.pluginSize);
+		auto iter = pluginIndex.find(name);
+		if (iter == pluginIndex.end()) {
+			iter = pluginIndex.emplace(name, static_cast<uint32_t>(plugins.size())).first;
+			plugins.push_back(PluginInfo());
+			plugins.back().name = name;
+		}
+
+		PluginInfo & plugin = plugins[iter->second];
+		if (msgHeader.pluginType) {
+			plugin.type.assign(msgHeader.pluginType, msgHeader.pluginTypeSize);
+		}
+		plugin.messages.push_back(static_cast<uint32_t>(messages.size()));
+		entry.plugin = iter->second;
+	}
+
+	memcpy(file.data() + writeOffset, data, size);
+	writeOffset += alignedSize;
+	messages.push_back(entry);
+	return true;
+}
+
+inline bool VRaySceneWriter::close() {
+	if (!file.good()) {
+		return false;
+	}
+
+	// plugins are written sorted by name, so remap the indices stored in message entries
+	std::vector<uint32_t> order(plugins.size());
+	for (uint32_t c = 0; c < order.size(); ++c) {
+		order[c] = c;
+	}
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return plugins[a].name < plugins[b].name;
+	});
+	std::vector<uint32_t> sortedIndex(plugins.size());
+	for (uint32_t c = 0; c < order.size(); ++c) {
+		sortedIndex[order[c]] = c;
+	}
+	for (auto & entry : messages) {
+		if (entry.plugin != VRaySceneMessageEntry::NO_PLUGIN) {
+			entry.plugin = sortedIndex[entry.plugin];
+		}
+	}
+
+	std::vector<VRayScenePluginEntry> pluginTable;
+	std::vector<uint32_t> indexLists;
+	std::string strings;
+	pluginTable.reserve(plugins.size());
+	indexLists.reserve(messages.size());
+
+	for (uint32_t pluginIdx : order) {
+		const PluginInfo & plugin = plugins[pluginIdx];
+		VRayScenePluginEntry entry;
+		entry.nameOffset = strings.size();
+		entry.nameSize = plugin.name.size();
+		strings += plugin.name;
+		entry.typeOffset = strings.size();
+		entry.typeSize = plugin.type.size();
+		strings += plugin.type;
+		entry.firstIndex = indexLists.size();
+		entry.indexCount = plugin.messages.size();
+		indexLists.insert(indexLists.end(), plugin.messages.begin(), plugin.messages.end());
+		pluginTable.push_back(entry);
+	}
+
+	VRaySceneFileHeader header;
+	header.magic = VRaySceneFileHeader::MAGIC;
+	header.formatVersion = VRaySceneFileHeader::FORMAT_VERSION;
+	header.messageCount = messages.size();
+	header.messageTableOffset = writeOffset;
+	header.pluginCount = pluginTable.size();
+	header.pluginTableOffset = header.messageTableOffset + messages.size() * sizeof(VRaySceneMessageEntry);
+	header.indexOffset = header.pluginTableOffset + pluginTable.size() * sizeof(VRayScenePluginEntry);
+	header.stringsOffset = header.indexOffset + indexLists.size() * sizeof(uint32_t);
+	header.stringsSize = strings.size();
+
+	const size_t fileSize = static_cast<size_t>(header.stringsOffset + header.stringsSize);
+	if (!reserve(fileSize - writeOffset)) {
+		puts("VRaySceneWriter failed to grow file for the index");
+		file.close(0);
+		return false;
+	}
+
+	char * base = file.data();
+	if (!messages.empty()) {
+		memcpy(base + header.messageTableOffset, messages.data(), messages.size() * sizeof(VRaySceneMessageEntry));
+	}
+	if (!pluginTable.empty()) {
+		memcpy(base + header.pluginTableOffset, pluginTable.data(), pluginTable.size() * sizeof(VRayScenePluginEntry));
+	}
+	if (!indexLists.empty()) {
+		memcpy(base + header.indexOffset, indexLists.data(), indexLists.size() * sizeof(uint32_t));
+	}
+	memcpy(base + header.stringsOffset, strings.data(), strings.size());
+	memcpy(base, &header, sizeof(header));
+
+	file.close(fileSize);
+	return true;
+}
+
+
+inline bool VRaySceneFile::open(const char * path) {
+	close();
+	file = std::make_shared<MappedFile>();
+	if (!file->open(path, MappedFile::Mode::Read)) {
+		close();
+		return false;
+	}
+
+	const uint64_t fileSize = file->size();
+	if (fileSize < sizeof(VRaySceneFileHeader)) {
+		printf("VRaySceneFile [%s] is too small\n", path);
+		close();
+		return false;
+	}
+
+	if (!validHeader(fileSize)) {
+		printf("VRaySceneFile [%s] has invalid header\n", path);
+		close();
+		return false;
+	}
+	if (!validEntries()) {
+		printf("VRaySceneFile [%s] has invalid index\n", path);
+		close();
+		return false;
+	}
+	return true;
+}
+
+inline bool VRaySceneFile::fits(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t limit) {
+	return offset <= limit && count <= (limit - offset) / itemSize;
+}
+
+inline bool VRaySceneFile::validHeader(uint64_t fileSize) const {
+	const VRaySceneFileHeader & hdr = header();
+	// tables are read in place, so they must be aligned for their entries
+	return hdr.magic == VRaySceneFileHeader::MAGIC &&
+	       hdr.formatVersion == VRaySceneFileHeader::FORMAT_VERSION &&
+	       hdr.messageTableOffset >= sizeof(VRaySceneFileHeader) && hdr.messageTableOffset % 8 == 0 &&
+	       hdr.pluginTableOffset % 8 == 0 && hdr.indexOffset % 4 == 0 &&
+	       fits(hdr.messageTableOffset, hdr.messageCount, sizeof(VRaySceneMessageEntry), hdr.pluginTableOffset) &&
+	       fits(hdr.pluginTableOffset, hdr.pluginCount, sizeof(VRayScenePluginEntry), hdr.indexOffset) &&
+	       hdr.indexOffset <= hdr.stringsOffset &&
+	       fits(hdr.stringsOffset, hdr.stringsSize, 1, fileSize);
+}
+
+inline bool VRaySceneFile::validEntries() const {
+	const VRaySceneFileHeader & hdr = header();
+	// payloads are written before the tables
+	for (uint64_t c = 0; c < hdr.messageCount; ++c) {
+		const VRaySceneMessageEntry & entry = messageEntry(static_cast<size_t>(c));
+		if (entry.offset < sizeof(VRaySceneFileHeader) || !fits(entry.offset, entry.size, 1, hdr.messageTableOffset) ||
+		    (entry.plugin != VRaySceneMessageEntry::NO_PLUGIN && entry.plugin >= hdr.pluginCount)) {
+			return false;
+		}
+	}
+
+	const uint64_t indexCount = (hdr.stringsOffset - hdr.indexOffset) / sizeof(uint32_t);
+	const uint32_t * indexLists = reinterpret_cast<const uint32_t *>(file->data() + hdr.indexOffset);
+	for (uint64_t c = 0; c < hdr.pluginCount; ++c) {
+		const VRayScenePluginEntry & entry = pluginEntry(static_cast<size_t>(c));
+		if (!fits(entry.nameOffset, entry.nameSize, 1, hdr.stringsSize) ||
+		    !fits(entry.typeOffset, entry.typeSize, 1, hdr.stringsSize) ||
+		    !fits(entry.firstIndex, entry.indexCount, 1, indexCount)) {
+			return false;
+		}
+		for (uint64_t i = 0; i < entry.indexCount; ++i) {
+			if (indexLists[entry.firstIndex + i] >= hdr.messageCount) {
+				return false;
+			}
+		}
+		// ::getPluginMessages relies on the order
+		if (c > 0) {
+			const VRayScenePluginEntry & previous = pluginEntry(static_cast<size_t>(c - 1));
+			const std::string name(getString(entry.nameOffset), static_cast<size_t>(entry.nameSize));
+			if (name.compare(0, std::string::npos, getString(previous.nameOffset), static_cast<size_t>(previous.nameSize)) <= 0) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+inline void VRaySceneFile::close() {
+	// messages returned by getPayload hold their own reference to the mapping
+	file.reset();
+}
+
+inline const VRaySceneFileHeader & VRaySceneFile::header() const {
+	return *reinterpret_cast<const VRaySceneFileHeader *>(file->data());
+}
+
+inline const VRaySceneMessageEntry & VRaySceneFile::messageEntry(size_t index) const {
+	return reinterpret_cast<const VRaySceneMessageEntry *>(file->data() + header().messageTableOffset)[index];
+}
+
+inline const VRayScenePluginEntry & VRaySceneFile::pluginEntry(size_t index) const {
+	return reinterpret_cast<const VRayScenePluginEntry *>(file->data() + header().pluginTableOffset)[index];
+}
+
+inline const uint32_t * VRaySceneFile::pluginIndices(const VRayScenePluginEntry & plugin) const {
+	return reinterpret_cast<const uint32_t *>(file->data() + header().indexOffset) + plugin.firstIndex;
+}
+
+inline const char * VRaySceneFile::getString(uint64_t offset) const {
+	return file->data() + header().stringsOffset + offset;
+}
+
+inline size_t VRaySceneFile::getMessageCount() const {
+	return file ? static_cast<size_t>(header().messageCount) : 0;
+}
+
+inline void VRaySceneFile::releaseMapping(void *, void * hint) {
+	delete reinterpret_cast<std::shared_ptr<MappedFile> *>(hint);
+}
+
+inline zmq::message_t VRaySceneFile::getPayload(size_t index) const {
+	assert(index < getMessageCount() && "VRaySceneFile::getPayload index out of range");
+	const VRaySceneMessageEntry & entry = messageEntry(index);
+	char * data = const_cast<char *>(file->data()) + entry.offset;
+	return zmq::message_t(data, static_cast<size_t>(entry.size), &VRaySceneFile::releaseMapping, new std::shared_ptr<MappedFile>(file));
+}
+
+inline VRayMessage VRaySceneFile::getMessage(size_t index) const {
+	zmq::message_t payload = getPayload(index);
+	return VRayMessage::fromZmqMessage(payload);
+}
+
+inline size_t VRaySceneFile::getPluginCount() const {
+	return file ? static_cast<size_t>(header().pluginCount) : 0;
+}
+
+inline std::string VRaySceneFile::getPluginName(size_t index) const {
+	const VRayScenePluginEntry & entry = pluginEntry(index);
+	return std::string(getString(entry.nameOffset), static_cast<size_t>(entry.nameSize));
+}
+
+inline std::string VRaySceneFile::getPluginType(size_t index) const {
+	const VRayScenePluginEntry & entry = pluginEntry(index);
+	return std::string(getString(entry.typeOffset), static_cast<size_t>(entry.typeSize));
+}
+
+inline bool VRaySceneFile::getPluginMessages(const std::string & plugin, std::vector<size_t> & indices) const {
+	size_t low = 0;
+	size_t high = getPluginCount();
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+		const VRayScenePluginEntry & entry = pluginEntry(mid);
+		const size_t nameSize = static_cast<size_t>(entry.nameSize);
+		const int cmp = plugin.compare(0, std::string::npos, getString(entry.nameOffset), nameSize);
+		if (cmp == 0) {
+			const uint32_t * list = pluginIndices(entry);
+			indices.insert(indices.end(), list, list + entry.indexCount);
+			return true;
+		} else if (cmp < 0) {
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
+	}
+	return false;
+}
+
+inline void VRaySceneFile::getPluginTypeMessages(const std::string & pluginType, std::vector<size_t> & indices) const {
+	const size_t firstNew = indices.size();
+	for (size_t c = 0; c < getPluginCount(); ++c) {
+		const VRayScenePluginEntry & entry = pluginEntry(c);
+		if (pluginType.compare(0, std::string::npos, getString(entry.typeOffset), static_cast<size_t>(entry.typeSize)) == 0) {
+			const uint32_t * list = pluginIndices(entry);
+			indices.insert(indices.end(), list, list + entry.indexCount);
+		}
+	}
+	// keep the original stream order so messages can be re-sent as they are
+	std::sort(indices.begin() + firstNew, indices.end());
+}
+
+#endif // _ZMQ_SCENE_FILE_H_
@@ -0,0 +1,394 @@
+#ifndef _ZMQ_SCENE_SCHEDULER_H_
+#define _ZMQ_SCENE_SCHEDULER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "zmq_wrapper.hpp"
+
+/// Geometry plugins whose messages add up to this many bytes are sent after the render is started
+static const size_t SCHEDULER_HEAVY_PLUGIN_SIZE = 1 << 20;
+
+/// Classes of plugins, in the order ZmqSceneScheduler sends them
+enum class ZmqSceneClass {
+	Settings, ///< Settings plugins, filters and outputs
+	Camera, ///< Render view and camera plugins
+	Light, ///< Lights
+	Material, ///< Materials, BRDFs, textures and UVW generators
+	Other, ///< Plugins of other types, and plugins only updated and never created through the scheduler
+	Geometry, ///< Geometry, nodes and instancers, the heavy ones are sent after the render is started
+};
+
+/// Sends the first export of a scene in the order that gets the first image soonest instead of traversal order
+/// Messages are kept, grouped by plugin, until the render is started with msgRendererAction(RendererAction::Start).
+/// Then the kept renderer messages are sent in their order, followed by the plugins by class: settings, camera,
+/// lights, materials, the rest, and the geometry that is not heavy. The start goes next, and after it the heavy
+/// geometry with the plugins using it, e.g. the node of a large mesh, so the renderer starts with what it needs
+/// while the large meshes stream in. Messages of one plugin keep their order, and plugins referenced by a plugin's
+/// properties are sent before it. After the start messages pass straight through until ::reset
+/// Renderer actions the plugin messages depend on, e.g. SetCurrentTime, Free or LoadScene, are barriers: the plugins
+/// kept before a barrier are sent in scheduled order, without deferring any, and the barrier right after them.
+/// Only plugins between the last barrier and the start are scheduled around the start, see ::isBarrier
+/// The time from the start to the first image received after it is measured, see ::getTimeToFirstImage
+/// Note: takes over the message callback of the client, set it with ::setCallback, and don't set raw or batch
+/// callbacks on the client. Send from one thread, the client must outlive this object
+class ZmqSceneScheduler {
+public:
+	/// Get the class of a plugin from it's type
+	typedef std::function<ZmqSceneClass(const std::string & pluginType)> Classifier;
+
+	/// @client - the client to send through, connected or not
+	explicit ZmqSceneScheduler(ZmqClient & client);
+	~ZmqSceneScheduler();
+
+	ZmqSceneScheduler(const ZmqSceneScheduler &) = delete;
+	ZmqSceneScheduler &operator=(const ZmqSceneScheduler &) = delete;
+
+	/// Set function classifying plugins by type, pass nullptr for ::classify
+	/// Note: applies to plugins created after the call
+	void setClassifier(Classifier classifier);
+
+	/// Set the size from which geometry plugins are sent after the start
+	/// @bytes - total bytes of the messages of one plugin, 0 to send all geometry before the start
+	void setHeavySize(size_t bytes);
+
+	/// Set a callback to be called on message received by the client, see ZmqClient::setCallback
+	void setCallback(ZmqClient::ZmqOnMessageCallback cb);
+
+	/// Keep the message until the start or the next barrier, or send it if the render is already started
+	/// @message - the message to send, after the function returns, callee's message is empty
+	void send(zmq::message_t && message);
+
+	/// Send the kept messages in scheduled order without starting the render, heavy geometry last
+	/// Messages sent after this are kept again until the start
+	void flush();
+
+	/// Keep messages until the next start again, e.g. before exporting a new scene
+	void reset();
+
+	/// Check if the render was started, so messages are not kept
+	bool isStarted() const;
+
+	/// Get the time in microseconds from sending the last start to the first image received after it
+	/// @return - -1 if no image was received since the last start
+	int64_t getTimeToFirstImage() const;
+
+	/// Get the number of plugins sent after the last start
+	int getDeferredPlugins() const;
+
+	/// Classify V-Ray plugin by the prefix of it's type, e.g. Geom, Mtl or Light
+	static ZmqSceneClass classify(const std::string & pluginType);
+
+	/// Check if plugin messages can't be moved over the message, true for renderer actions except the ones changing
+	/// only the output, like Resize or SetQuality, and for messages that can't be parsed
+	/// @header - header of the message, null if it could not be parsed
+	static bool isBarrier(const VRayMessage::Header * header);
+
+private:
+	/// Kept messages of one plugin
+	struct Plugin {
+		ZmqSceneClass sceneClass; ///< Class from the plugin type, Other until the plugin is created
+		size_t bytes; ///< Bytes in @messages
+		std::vector<std::string> references; ///< Plugins set as values of this plugin's properties
+		std::vector<zmq::message_t> messages; ///< Messages in the order they were sent
+		bool deferred; ///< Set when the plugin is sent after the start
+		bool sent; ///< Set when @messages are sent
+	};
+
+	/// Add message to the plugin it belongs to
+	void keep(zmq::message_t && message, const VRayMessage::Header & header);
+	/// Add the plugins referenced by property update to @references
+	void addReferences(Plugin & plugin, const VRayMessage::Header & header);
+	/// Send all kept messages in scheduled order followed by the barrier
+	/// @barrier - message to send after the kept ones, null if there is none
+	/// @start - set if @barrier is the start, heavy geometry is sent after the start, and last when there is no barrier
+	void schedule(zmq::message_t * barrier, bool start);
+	/// Send the messages of plugin after the plugins it references, except the deferred ones if @deferred is false
+	void sendPlugin(size_t index, bool deferred);
+	/// Measure time to first image, then call the callback
+	void onMessage(const VRayMessage & message, ZmqClient * client);
+
+	/// Get the steady clock time in microseconds
+	static int64_t now();
+
+	ZmqClient & client; ///< The client sending the messages
+	Classifier classifier; ///< Classifier for plugin types, null for ::classify
+	size_t heavySize; ///< Size from which geometry is deferred, 0 to never defer
+	bool started; ///< Set on start, cleared by ::reset
+
+	std::vector<zmq::message_t> rendererMessages; ///< Kept renderer messages that are not barriers
+	std::vector<Plugin> plugins; ///< Plugins kept since the last barrier, in order of their first message
+	std::unordered_map<std::string, size_t> pluginIndex; ///< Maps plugin name to it's index in @plugins
+	int deferredPlugins; ///< Number of plugins sent after the last start
+
+	ZmqClient::ZmqOnMessageCallback callback; ///< Callback to be called on received message
+	std::mutex callbackMutex; ///< Mutex protecting @callback
+	std::atomic<int64_t> startTime; ///< Time of the last start in microseconds, 0 before the first one
+	std::atomic<int64_t> timeToFirstImage; ///< Time from the last start to the first image, -1 until it arrives
+};
+
+
+inline ZmqSceneScheduler::ZmqSceneScheduler(ZmqClient & client)
+    : client(client)
+    , heavySize(SCHEDULER_HEAVY_PLUGIN_SIZE)
+    , started(false)
+    , deferredPlugins(0)
+    , startTime(0)
+    , timeToFirstImage(-1)
+{
+	client.setCallback([this](const VRayMessage & message, ZmqClient * client) {
+		onMessage(message, client);
+	});
+}
+
+inline ZmqSceneScheduler::~ZmqSceneScheduler() {
+	client.setCallback(nullptr);
+}
+
+inline void ZmqSceneScheduler::setClassifier(Classifier classifier) {
+	this->classifier = classifier;
+}
+
+inline void ZmqSceneScheduler::setHeavySize(size_t bytes) {
+	heavySize = bytes;
+}
+
+inline void ZmqSceneScheduler::setCallback(ZmqClient::ZmqOnMessageCallback cb) {
+	std::lock_guard<std::mutex> lock(callbackMutex);
+	callback = cb;
+}
+
+inline void ZmqSceneScheduler::send(zmq::message_t && message) {
+	if (started) {
+		client.send(std::move(message));
+		return;
+	}
+
+	VRayMessage::Header header;
+	// malformed messages are not ours to drop, nothing is moved over them
+	const bool parsed = VRayMessage::peekHeader(reinterpret_cast<const char *>(message.data()), message.size(), header);
+	if (parsed && header.type == VRayMessage::Type::ChangeRenderer &&
+	    header.rendererAction == VRayMessage::RendererAction::Start) {
+		schedule(&message, true);
+		started = true;
+	} else if (isBarrier(parsed ? &header : nullptr)) {
+		schedule(&message, false);
+	} else {
+		keep(std::move(message), header);
+	}
+}
+
+inline void ZmqSceneScheduler::flush() {
+	schedule(nullptr, false);
+}
+
+inline void ZmqSceneScheduler::reset() {
+	started = false;
+}
+
+inline bool ZmqSceneScheduler::isStarted() const {
+	return started;
+}
+
+inline int64_t ZmqSceneScheduler::getTimeToFirstImage() const {
+	return timeToFirstImage;
+}
+
+inline int ZmqSceneScheduler::getDeferredPlugins() const {
+	return deferredPlugins;
+}
+
+inline ZmqSceneClass ZmqSceneScheduler::classify(const std::string & pluginType) {
+	auto startsWith = [&pluginType](const char * prefix) {
+		return !pluginType.compare(0, strlen(prefix), prefix);
+	};
+	auto endsWith = [&pluginType](const char * suffix) {
+		const size_t size = strlen(suffix);
+		return pluginType.size() >= size && !pluginType.compare(pluginType.size() - size, size, suffix);
+	};
+
+	// SettingsCamera is a camera, so cameras are checked before settings
+	if (startsWith("Camera") || startsWith("SettingsCamera") || startsWith("RenderView")) {
+		return ZmqSceneClass::Camera;
+	} else if (startsWith("Settings") || startsWith("Filter") || startsWith("Output") || startsWith("RTEngine")) {
+		return ZmqSceneClass::Settings;
+	} else if (startsWith("Light") || endsWith("Light")) {
+		return ZmqSceneClass::Light;
+	} else if (startsWith("Mtl") || startsWith("BRDF") || startsWith("Brdf") || startsWith("Tex") || startsWith("UVW")) {
+		return ZmqSceneClass::Material;
+	} else if (startsWith("Geom") || startsWith("Node") || startsWith("Instancer") || startsWith("Mesh")) {
+		return ZmqSceneClass::Geometry;
+	}
+	return ZmqSceneClass::Other;
+}
+
+inline bool ZmqSceneScheduler::isBarrier(const VRayMessage::Header * header) {
+	if (!header) {
+		return true;
+	}
+	if (header->type != VRayMessage::Type::ChangeRenderer) {
+		return false;
+	}
+	switch (header->rendererAction) {
+	case VRayMessage::RendererAction::Resize:
+	case VRayMessage::RendererAction::SetQuality:
+	case VRayMessage::RendererAction::SetVfbShow:
+	case VRayMessage::RendererAction::SetViewportImageFormat:
+	case VRayMessage::RendererAction::SetRenderRegion:
+	case VRayMessage::RendererAction::SetCropRegion:
+		return false;
+	default:
+		return true;
+	}
+}
+
+inline void ZmqSceneScheduler::keep(zmq::message_t && message, const VRayMessage::Header & header) {
+	if (header.type != VRayMessage::Type::ChangePlugin) {
+		rendererMessages.push_back(std::move(message));
+		return;
+	}
+
+	const std::string name(header.plugin, header.pluginSize);
+	auto iter = pluginIndex.find(name);
+	if (iter == pluginIndex.end()) {
+		Plugin plugin = {ZmqSceneClass::Other, 0, {}, {}, false, false};
+		plugins.push_back(std::move(plugin));
+		iter = pluginIndex.emplace(name, plugins.size() - 1).first;
+	}
+	Plugin & plugin = plugins[iter->second];
+
+	if (header.pluginAction == VRayMessage::PluginAction::Create && header.pluginType) {
+		const std::string type(header.pluginType, header.pluginTypeSize);
+		plugin.sceneClass = classifier ? classifier(type) : classify(type);
+	} else if (header.pluginAction == VRayMessage::PluginAction::Update) {
+		addReferences(plugin, header);
+	}
+	plugin.bytes += message.size();
+	plugin.messages.push_back(std::move(message));
+}
+
+inline void ZmqSceneScheduler::addReferences(Plugin & plugin, const VRayMessage::Header & header) {
+	using namespace VRayBaseTypes;
+	int type = ValueTypeUnknown;
+	if (header.valueSize < sizeof(type)) {
+		return;
+	}
+	memcpy(&type, header.value, sizeof(type));
+	if (type != ValueTypePlugin && type != ValueTypeListPlugin) {
+		// only plugin values are parsed, the large lists are skipped
+		return;
+	}
+
+	DeserializerStream stream(header.value, header.valueSize);
+	AttrValue value;
+	stream >> value;
+	if (value.type == ValueTypePlugin) {
+		plugin.references.push_back(value.as<AttrPlugin>().plugin);
+	} else if (value.type == ValueTypeListPlugin && !value.as<AttrListPlugin>().empty()) {
+		for (const AttrPlugin & item : *value.as<AttrListPlugin>().getData()) {
+			plugin.references.push_back(item.plugin);
+		}
+	}
+}
+
+inline void ZmqSceneScheduler::schedule(zmq::message_t * barrier, bool start) {
+	// heavy geometry is deferred, and so is everything using deferred plugins, until nothing changes
+	// other barriers need all plugins before them, as does the server for the state they change
+	const bool defer = start || !barrier;
+	for (Plugin & plugin : plugins) {
+		plugin.deferred = defer && heavySize && plugin.sceneClass == ZmqSceneClass::Geometry && plugin.bytes >= heavySize;
+	}
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (Plugin & plugin : plugins) {
+			for (size_t c = 0; c < plugin.references.size() && !plugin.deferred; ++c) {
+				auto iter = pluginIndex.find(plugin.references[c]);
+				if (iter != pluginIndex.end() && plugins[iter->second].deferred) {
+					plugin.deferred = true;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	for (zmq::message_t & message : rendererMessages) {
+		client.send(std::move(message));
+	}
+
+	const ZmqSceneClass order[] = {ZmqSceneClass::Settings, ZmqSceneClass::Camera, ZmqSceneClass::Light,
+	                               ZmqSceneClass::Material, ZmqSceneClass::Other, ZmqSceneClass::Geometry};
+	for (ZmqSceneClass sceneClass : order) {
+		for (size_t c = 0; c < plugins.size(); ++c) {
+			if (plugins[c].sceneClass == sceneClass && !plugins[c].deferred) {
+				sendPlugin(c, false);
+			}
+		}
+	}
+
+	if (start) {
+		timeToFirstImage = -1;
+		startTime = now();
+	}
+	if (barrier) {
+		client.send(std::move(*barrier));
+	}
+
+	if (defer) {
+		deferredPlugins = 0;
+		for (size_t c = 0; c < plugins.size(); ++c) {
+			if (plugins[c].deferred) {
+				++deferredPlugins;
+				sendPlugin(c, true);
+			}
+		}
+	}
+
+	rendererMessages.clear();
+	plugins.clear();
+	pluginIndex.clear();
+}
+
+inline void ZmqSceneScheduler::sendPlugin(size_t index, bool deferred) {
+	Plugin & plugin = plugins[index];
+	if (plugin.sent || (plugin.deferred && !deferred)) {
+		return;
+	}
+	// marked first, so references in a cycle don't recurse forever
+	plugin.sent = true;
+	for (const std::string & reference : plugin.references) {
+		auto iter = pluginIndex.find(reference);
+		if (iter != pluginIndex.end()) {
+			sendPlugin(iter->second, deferred);
+		}
+	}
+	for (zmq::message_t & message : plugin.messages) {
+		client.send(std::move(message));
+	}
+}
+
+inline void ZmqSceneScheduler::onMessage(const VRayMessage & message, ZmqClient * client) {
+	const int64_t start = startTime;
+	int64_t none = -1;
+	if (message.getType() == VRayMessage::Type::Image && start) {
+		timeToFirstImage.compare_exchange_strong(none, now() - start);
+	}
+
+	std::lock_guard<std::mutex> lock(callbackMutex);
+	if (callback) {
+		callback(message, client);
+	}
+}
+
+inline int64_t ZmqSceneScheduler::now() {
+	using namespace std::chrono;
+	return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // _ZMQ_SCENE_SCHEDULER_H_
@@ -1,35 +1,102 @@
 #ifndef _SERIALIZER_HPP_
 #define _SERIALIZER_HPP_
 
+#include <climits>
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <string>
 #include "base_types.h"
 
+/// Counts and sizes that don't fit in int are written as this marker followed by the count as int64_t
+static const int SERIALIZER_COUNT_64 = -1;
+/// Bytes of strided items gathered before they are written to the stream at once
+static const size_t SERIALIZER_GATHER_SIZE = 4 << 10;
+
 class SerializerStream {
 public:
-
-	SerializerStream() {
+	/// Called with each chunk of a stream created with a chunk size, the data is valid until the function returns
+	typedef std::function<void(const char * data, size_t size)> ChunkSink;
+
+	SerializerStream()
+	    : chunkSize(0)
+	    , flushed(0)
+	{}
+
+	/// Create stream passing the data to @sink in chunks as it is written, instead of keeping all of it
+	/// Only the current chunk is in memory, so messages larger than the available memory can be serialized
+	/// @chunkSize - max bytes passed to the sink at once, every chunk but the last has exactly this many
+	/// @sink - called with each full chunk while writing, and with the rest on ::flush
+	SerializerStream(size_t chunkSize, ChunkSink sink)
+	    : chunkSize(chunkSize)
+	    , flushed(0)
+	    , sink(sink)
+	{
+		stream.reserve(chunkSize);
 	}
 
-	void write(const char * data, int size) {
+	void write(const char * data, size_t size) {
+		while (chunkSize && size && stream.size() + size >= chunkSize) {
+			// fill the chunk and pass it on, large blocks are never buffered whole
+			const size_t part = chunkSize - stream.size();
+			stream.insert(stream.end(), data, data + part);
+			data += part;
+			size -= part;
+			flush();
+		}
 		if (size == 0) {
 			return;
 		}
-		const int prevSize = stream.size();
+		const size_t prevSize = stream.size();
 		stream.resize(size + stream.size());
 		memcpy(&stream[prevSize], data, size);
 	}
 
-	int getSize() const {
+	/// Pass the buffered data to the chunk sink, does nothing for stream created without one
+	void flush() {
+		if (!sink || stream.empty()) {
+			return;
+		}
+		sink(stream.data(), stream.size());
+		flushed += stream.size();
+		stream.clear();
+	}
+
+	/// Get the number of bytes buffered, not yet passed to the chunk sink
+	size_t getSize() const {
 		return stream.size();
 	}
 
+	/// Get the number of bytes written, including the ones passed to the chunk sink
+	uint64_t getWritten() const {
+		return flushed + stream.size();
+	}
+
 	char * getData() {
 		return stream.data();
 	}
 
+	/// Make room for size more bytes, so writing them does not grow the buffer several times
+	/// Does nothing for stream with a chunk sink, it never keeps more than a chunk
+	void reserve(size_t size) {
+		if (!sink) {
+			stream.reserve(stream.size() + size);
+		}
+	}
+
+	/// Move the buffered data out of the stream, e.g. to send it without copying, the stream is empty after this
+	std::vector<char> takeData() {
+		std::vector<char> data;
+		data.swap(stream);
+		flushed += data.size();
+		return data;
+	}
+
 private:
 	std::vector<char> stream;
+	size_t chunkSize; ///< Size of the chunks passed to @sink, 0 to keep all data
+	uint64_t flushed; ///< Number of bytes passed to @sink
+	ChunkSink sink; ///< Sink for the chunks, null to keep all data
 };
 
 
@@ -40,10 +107,19 @@ inline SerializerStream & operator<<(SerializerStream & stream, const T & value)
 }
 
 
+/// Write count of a container or size of a string, counts not fitting in int take 12 bytes
+inline void writeCount(SerializerStream & stream, size_t count) {
+	if (count < static_cast<size_t>(INT_MAX)) {
+		stream << static_cast<int>(count);
+	} else {
+		stream << SERIALIZER_COUNT_64 << static_cast<int64_t>(count);
+	}
+}
+
+
 inline SerializerStream & operator<<(SerializerStream & stream, const std::string & value) {
-	const int size = value.size();
-	stream << size;
-	stream.write(value.c_str(), size);
+	writeCount(stream, value.size());
+	stream.write(value.c_str(), value.size());
 	return stream;
 }
 
@@ -60,14 +136,39 @@ inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTy
 
 template <typename Q>
 inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTypes::AttrList<Q> & list) {
-	stream << list.getCount();
-	stream.write(reinterpret_cast<const char *>(list.getData()->data()), list.getCount() * sizeof(Q));
+	writeCount(stream, list.getCount());
+	stream.write(reinterpret_cast<const char *>(list.getData()->data()), list.getBytesCount());
+	return stream;
+}
+
+/// Written the same as AttrList<Q>, straight from the memory of the span
+template <typename Q>
+inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTypes::AttrListSpan<Q> & list) {
+	writeCount(stream, list.getCount());
+	if (list.isPacked()) {
+		stream.write(reinterpret_cast<const char *>(list.data), list.getCount() * sizeof(Q));
+		return stream;
+	}
+
+	// gather the items in batches, so the stream grows once per batch and not per item
+	static_assert(sizeof(Q) <= SERIALIZER_GATHER_SIZE, "Item does not fit in the gather buffer");
+	char batch[SERIALIZER_GATHER_SIZE];
+	size_t batchSize = 0;
+	for (size_t c = 0; c < list.getCount(); ++c) {
+		if (batchSize + sizeof(Q) > sizeof(batch)) {
+			stream.write(batch, batchSize);
+			batchSize = 0;
+		}
+		memcpy(batch + batchSize, &list[c], sizeof(Q));
+		batchSize += sizeof(Q);
+	}
+	stream.write(batch, batchSize);
 	return stream;
 }
 
 template <typename T>
 inline void writeListNonPOD(SerializerStream & stream, const VRayBaseTypes::AttrList<T> & list) {
-	stream << list.getCount();
+	writeCount(stream, list.getCount());
 	if (!list.empty()) {
 		for (auto & item : *(list.getData())) {
 			stream << item;
@@ -97,7 +198,7 @@ inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTy
 
 
 inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTypes::AttrMapChannels & map) {
-	stream << static_cast<int>(map.data.size());
+	writeCount(stream, map.data.size());
 	for (auto & pair : map.data) {
 		stream << pair.first << pair.second.vertices << pair.second.faces << pair.second.name;
 	}
@@ -111,7 +212,8 @@ inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTy
 
 
 inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTypes::AttrInstancer & inst) {
-	stream << inst.frameNumber << inst.data.getCount();
+	stream << inst.frameNumber;
+	writeCount(stream, inst.data.getCount());
 	if (!inst.data.empty()) {
 		for (auto & item : *(inst.data.getData())) {
 			stream << item;
@@ -129,7 +231,8 @@ inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTy
 
 
 inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTypes::AttrImageSet & set) {
-	stream << set.sourceType << static_cast<int>(set.images.size());
+	stream << set.sourceType;
+	writeCount(stream, set.images.size());
 	for (const auto &img : set.images) {
 		stream << img.first << img.second;
 	}
@@ -143,6 +246,7 @@ inline SerializerStream & operator<<(SerializerStream & stream, const VRayBaseTy
 	switch(value.type) {
 	case ValueTypeInt: stream << value.as<AttrSimpleType<int>>(); break;
 	case ValueTypeFloat: stream << value.as<AttrSimpleType<float>>(); break;
+	case ValueTypeDouble: stream << value.as<AttrSimpleType<double>>(); break;
 	case ValueTypeString: stream << value.as<AttrSimpleType<std::string>>(); break;
 	case ValueTypeColor: stream << value.as<AttrColor>(); break;
 	case ValueTypeAColor: stream << value.as<AttrAColor>(); break;
@@ -0,0 +1,1267 @@
+#ifndef _ZMQ_SERVER_H_
+#define _ZMQ_SERVER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "zmq_stream.hpp"
+#include "zmq_wrapper.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif // __linux__
+
+/// Sessions without any message from their client for this long in milliseconds are closed
+/// Idle clients ping at least every CLIENT_PING_INTERVAL_MAX, so this allows for a few lost pings
+static const int SERVER_SESSION_TIMEOUT = CLIENT_PING_INTERVAL_MAX * 3;
+/// Max messages received from the socket before the replies are sent and the sessions checked
+static const int SERVER_RECEIVE_BURST = 256;
+/// Bytes read from a stream connection at once
+static const size_t SERVER_STREAM_READ_SIZE = 256 << 10;
+/// Messages to a stream client are dropped while this many bytes wait to be written to it, like ROUTER does at it's
+/// high water mark
+static const size_t SERVER_STREAM_OUTBOUND_MAX = 64 << 20;
+
+
+/// Unbounded single producer, single consumer queue
+/// Nodes are linked in a list and recycled by the producer once the consumer is past them, so after warm up push and
+/// pop don't allocate and each side writes only it's own pointer
+template <typename T>
+class ZmqSpscQueue {
+public:
+	ZmqSpscQueue();
+	~ZmqSpscQueue();
+
+	ZmqSpscQueue(const ZmqSpscQueue &) = delete;
+	ZmqSpscQueue &operator=(const ZmqSpscQueue &) = delete;
+
+	/// Producer: add item at the back
+	void push(T && item);
+
+	/// Consumer: take the item at the front
+	/// @return - false if the queue is empty
+	bool pop(T & item);
+
+	/// Consumer: check if there is nothing to pop
+	bool empty() const;
+
+private:
+	struct Node {
+		std::atomic<Node *> next; ///< Next pushed node, null for the last one
+		T item; ///< The item, moved out when popped
+	};
+
+	/// Producer: get node consumed earlier or allocate new one
+	Node * allocNode();
+
+	std::atomic<Node *> tail; ///< Last popped node, the front item is in the node after it, written by the consumer
+	char padding[64 - sizeof(std::atomic<Node *>)]; ///< Keep the consumer and producer fields on different cache lines
+	Node * head; ///< Last pushed node, producer only
+	Node * first; ///< Oldest node, nodes from it up to @tailCopy can be reused, producer only
+	Node * tailCopy; ///< Value of @tail last read by the producer
+};
+
+
+class ZmqServer;
+
+/// Events in the life of a session, passed to ZmqServer::OnSessionCallback
+enum class ZmqServerEvent {
+	Connected, ///< The client sent the handshake, sent again after each reconnect of the client
+	Stop, ///< The client asked the server to stop with ZmqClient::stopServer
+	Closed, ///< The client was silent for longer than the session timeout, or the server is stopping
+};
+
+/// Connection with one client, identified by the socket identity of the client so it survives the client reconnecting
+/// All callbacks for a session are called in order from the same worker thread
+class ZmqServerSession {
+public:
+	ZmqServerSession(const ZmqServerSession &) = delete;
+	ZmqServerSession &operator=(const ZmqServerSession &) = delete;
+
+	/// Send message to the client, can be called from any thread, messages to a closed session are dropped
+	/// @payload - the message, after the function returns, callee's message is empty
+	/// @requestId - id of the request this is response to, see ::getRequestId
+	void send(zmq::message_t && payload, int requestId = 0);
+
+	/// Send response to the message passed to the current callback, call only from the message callback
+	/// @payload - the response, after the function returns, callee's message is empty
+	void reply(zmq::message_t && payload);
+
+	/// Get the request id of the message passed to the current callback, 0 if it was not sent with ZmqClient::request
+	int getRequestId() const;
+
+	/// Get the type of the client from it's handshake
+	ClientType getType() const;
+
+	/// Get the socket identity of the client
+	const std::string & getIdentity() const;
+
+	/// Check if the client sends large messages through shared memory, call only from the callbacks
+	bool usesSharedMemory() const;
+
+	/// Check if the session was closed, see ZmqServerEvent::Closed
+	bool isClosed() const;
+
+	/// Set object keeping the state of the owner of the server for this client, e.g. the scene of an exporter
+	/// Note: set and get only from the callbacks, so all access is on the session's worker thread
+	void setUserData(std::shared_ptr<void> data);
+
+	/// Get the object set with ::setUserData, null if not set
+	const std::shared_ptr<void> & getUserData() const;
+
+private:
+	friend class ZmqServer;
+
+	/// Data message of an open transaction
+	struct BufferedMessage {
+		int requestId; ///< Request id of the message
+		zmq::message_t payload; ///< The message, already copied out of shared memory
+	};
+
+	ZmqServerSession(ZmqServer & server, const std::string & identity);
+
+	ZmqServer & server; ///< The server the session belongs to
+	const std::string identity; ///< Socket identity of the client
+	std::atomic<ClientType> type; ///< Client type from the last handshake
+	std::atomic<bool> closed; ///< Set when the session is closed
+
+	std::chrono::high_resolution_clock::time_point lastReceived; ///< Time of the last message, I/O thread only
+
+	/// Fields below are used only on the session's worker thread
+	std::unique_ptr<ZmqShmRing> shmRing; ///< Ring named in the handshake, null if the client does not use one
+	std::vector<BufferedMessage> transaction; ///< Data messages of the open transaction
+	std::unordered_map<int, std::vector<char>> chunked; ///< Parts of chunked messages received so far by their id
+	bool inTransaction; ///< Set between TRANSACTION_BEGIN_MSG and TRANSACTION_COMMIT_MSG
+	uint32_t receivedSequence; ///< Number of data, chunk and transaction messages received, wraps around
+	uint32_t duplicates; ///< Messages resent after the last reconnect that were already received, they are dropped
+	int requestId; ///< Request id of the message passed to the current callback
+	std::shared_ptr<void> userData; ///< Object set with ::setUserData
+};
+
+
+/// Server side of the protocol, serves any number of ZmqClient objects on one ROUTER socket
+/// The I/O thread owns the socket and answers pings itself, everything else is handed to a pool of worker threads
+/// Each session is pinned to one worker by it's identity, so messages of a client are handled in the order they were
+/// sent while different clients are handled in parallel. The hand off to a worker is a lock free queue, messages sent
+/// to clients go back through a queue drained by the I/O thread, since zmq sockets can't be shared between threads
+/// Clients using ZmqUringTransport connect to a TCP listener of their own, see ::setStreamAddress, the I/O thread
+/// polls their connections together with the socket and they get the same sessions as the zmq clients
+/// Note: set all callbacks and options before ::bind, they are not synchronized with the worker threads
+class ZmqServer {
+public:
+	typedef std::function<void(const VRayMessage &, ZmqServerSession &)> OnMessageCallback;
+	typedef std::function<void(zmq::message_t &, ZmqServerSession &)> OnRawMessageCallback;
+	typedef std::function<void(VRayBaseTypes::CommitAction, ZmqServerSession &)> OnCommitCallback;
+	typedef std::function<void(ZmqServerEvent, ZmqServerSession &)> OnSessionCallback;
+
+	/// Create the context, the threads are started by ::bind
+	/// @workers - number of worker threads handling the sessions, 0 for one per hardware thread
+	/// @ioThreads - number of zmq I/O threads in the context
+	explicit ZmqServer(int workers = 0, int ioThreads = 1);
+
+	/// Stop the server, see ::stop
+	~ZmqServer();
+
+	ZmqServer(const ZmqServer &) = delete;
+	ZmqServer &operator=(const ZmqServer &) = delete;
+
+	/// Set a callback to be called with each data message received (messages discarded if not set)
+	void setCallback(OnMessageCallback cb);
+
+	/// Set a callback to be called with the payload of received messages before it is parsed
+	/// When set, the callback set with ::setCallback is not called
+	void setRawCallback(OnRawMessageCallback cb);
+
+	/// Set a callback to be called with the commit action of a transaction, after all it's messages were passed to
+	/// the message callback
+	void setCommitCallback(OnCommitCallback cb);
+
+	/// Set a callback to be called when a session connects, asks for stop or is closed
+	void setSessionCallback(OnSessionCallback cb);
+
+	/// Accept the shared memory rings offered by clients connected with shm://, enabled by default
+	void setSharedMemory(bool enable);
+
+	/// Close sessions whose client sent nothing for this long
+	/// @timeout - timeout in milliseconds, SERVER_SESSION_TIMEOUT by default, 0 keeps sessions until ::stop
+	void setSessionTimeout(int timeout);
+
+	/// Also accept clients sending with the stream framing of ZmqUringTransport, see ZmqStreamPreamble
+	/// The client is matched with it's session by the identity in the preamble, as zmq clients are by socket identity
+	/// Note: supported only on Linux
+	/// @addr - tcp://<host>:<port> to listen on from ::bind, * as host for all interfaces, empty to disable (default)
+	void setStreamAddress(const std::string & addr);
+
+	/// Bind the socket and start the I/O and worker threads
+	/// @addr - the address to bind to, ipc://<name> for clients connecting with shm://<name>
+	/// @return - false if the server is already running or the address or the stream address can't be bound
+	bool bind(const char * addr);
+
+	/// Close all sessions and stop the threads, waits for the callbacks in progress
+	void stop();
+
+	/// Check if the server is running
+	bool good() const;
+
+	/// Get number of open sessions
+	int getSessionCount() const;
+
+	/// Get number of data messages received from all clients
+	uint64_t getReceivedMessages() const;
+
+	/// Get number of payload bytes of the data messages received from all clients
+	uint64_t getReceivedBytes() const;
+
+	/// Get number of worker threads
+	int getWorkerCount() const;
+
+private:
+	friend class ZmqServerSession;
+
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// Message handed from the I/O thread to a worker
+	struct Inbound {
+		std::shared_ptr<ZmqServerSession> session; ///< The session the message belongs to
+		ClientType type; ///< Client type from the control frame
+		ControlMessage control; ///< Control message from the control frame
+		int requestId; ///< Request id from the control frame
+		bool closing; ///< Set for the last item of a session, there is no message then
+		zmq::message_t payload; ///< The payload frame
+	};
+
+	/// Message waiting for the I/O thread to send it
+	struct Outbound {
+		std::string identity; ///< Identity of the receiving client
+		ClientType type; ///< Client type for the control frame
+		ControlMessage control; ///< Control message for the control frame
+		int requestId; ///< Request id for the control frame
+		zmq::message_t payload; ///< The payload frame
+	};
+
+	/// Connection of a client using the stream framing, I/O thread only
+	struct StreamConnection {
+		explicit StreamConnection(int fd)
+		    : fd(fd)
+		    , parser(true)
+		    , sent(0)
+		{}
+
+		int fd; ///< The connected socket, -1 once closed
+		ZmqStreamParser parser; ///< Splits the received bytes into messages
+		std::string identity; ///< Identity from the preamble, empty until it is received
+		std::vector<char> outgoing; ///< Framed messages not yet written to the socket
+		size_t sent; ///< Bytes of @outgoing already written
+	};
+
+	/// Worker thread with it's queue
+	struct Worker {
+		Worker()
+		    : sleeping(false)
+		{}
+
+		ZmqSpscQueue<Inbound> queue; ///< Messages for sessions pinned to this worker, the I/O thread is the producer
+		std::mutex mutex; ///< Mutex for @cond
+		std::condition_variable cond; ///< Signaled when a message is pushed while the worker sleeps
+		std::atomic<bool> sleeping; ///< Set while the worker waits on @cond
+		std::thread thread; ///< The worker thread
+	};
+
+	/// Queue message to be sent by the I/O thread, can be called from any thread
+	void queueOutbound(Outbound && message);
+	/// Interrupt the poll of the I/O thread, multiple wakes before the loop runs are merged into one
+	void wake();
+	/// Hand message to the worker of the session
+	void handOff(const std::shared_ptr<ZmqServerSession> & session, const ControlFrame & frame, zmq::message_t && payload,
+	             bool closing = false);
+
+	/// Start listening on @streamAddress
+	/// @return - false on error
+	bool listenStream();
+	/// Close the stream listener and all stream connections
+	void closeStreams();
+
+	/// Functions below are called only from the I/O thread, or from ::stop after it exits
+
+	/// Start function for the I/O thread
+	void ioLoop();
+	/// Receive and handle up to SERVER_RECEIVE_BURST messages
+	/// @return - true if anything was received
+	bool ioReceive(time_point now);
+	/// Handle one message received from a client
+	void ioHandle(zmq::message_t & identity, zmq::message_t & control, zmq::message_t & payload, time_point now);
+	/// Find or create the session for identity
+	const std::shared_ptr<ZmqServerSession> & ioSession(const zmq::message_t & identity);
+	/// Send message to the client, over it's stream connection if it has one
+	void ioSend(const void * identity, size_t identitySize, zmq::message_t & control, zmq::message_t & payload);
+	/// Send all queued outbound messages
+	void ioSendOutbound();
+	/// Accept all pending stream connections
+	void ioAcceptStreams();
+	/// Read available bytes of the stream connection and handle the complete messages
+	void ioReceiveStream(StreamConnection & stream, time_point now);
+	/// Frame message for the stream connection and write as much as the socket takes
+	void ioWriteStream(StreamConnection & stream, zmq::message_t & control, zmq::message_t & payload);
+	/// Write the outgoing bytes of the stream connection until the socket is full
+	void ioFlushStream(StreamConnection & stream);
+	/// Close the stream connection, it's session stays open until it expires, like after a zmq client disconnects
+	void ioCloseStream(StreamConnection & stream);
+	/// Close sessions that timed out
+	void ioExpireSessions(time_point now);
+	/// Close the session and remove it from @sessions
+	void ioCloseSession(const std::shared_ptr<ZmqServerSession> & session);
+
+	/// Functions below are called only from the worker threads
+
+	/// Start function for a worker thread
+	void workerLoop(Worker & worker);
+	/// Handle message handed to the worker
+	void workerHandle(Inbound & item);
+	/// Open the shared memory ring offered by the client and answer the handshake
+	/// A reconnecting client keeps it's open transaction and chunked messages, see ControlFrame::requestId
+	void workerHandshake(ZmqServerSession & session, const Inbound & item);
+	/// Count message of the client's stream
+	/// @return - false if the message is a duplicate resent after reconnect and must be dropped
+	bool workerSequence(ZmqServerSession & session, const Inbound & item);
+	/// Pass data message to the callbacks, or keep it until the commit if a transaction is open
+	void workerData(ZmqServerSession & session, int requestId, zmq::message_t & payload);
+	/// Append part of a chunked message, the last part passes the whole message to ::workerData
+	void workerChunk(ZmqServerSession & session, const Inbound & item);
+	/// Pass data message to the callbacks
+	void workerDispatch(ZmqServerSession & session, int requestId, zmq::message_t & payload);
+	/// Call the session callback
+	void workerEvent(ZmqServerSession & session, ZmqServerEvent event);
+
+	zmq::context_t context; ///< The zmq context of the server
+	std::unique_ptr<zmq::socket_t> socket; ///< The ROUTER socket, used only on the I/O thread
+	std::string streamAddress; ///< Address for stream connections, empty if they are not accepted
+	int streamListener; ///< Listening socket for stream connections, -1 if none
+	std::unique_ptr<zmq::socket_t> wakeSender; ///< Socket used to interrupt the poll from other threads
+	std::unique_ptr<zmq::socket_t> wakeReceiver; ///< Socket polled by the I/O thread for wakeups
+	std::mutex wakeMutex; ///< Mutex protecting @wakeSender
+	std::atomic<bool> wakePending; ///< True if wakeup was sent but not yet received by the I/O thread
+
+	OnMessageCallback callback; ///< Callback to be called on received message
+	OnRawMessageCallback rawCallback; ///< Callback to be called with unparsed received message
+	OnCommitCallback commitCallback; ///< Callback to be called on transaction commit
+	OnSessionCallback sessionCallback; ///< Callback to be called on session events
+	bool sharedMemory; ///< Accept shared memory rings offered in the handshake
+	int sessionTimeout; ///< Time in milliseconds without messages after which a session is closed, 0 to disable
+
+	std::unordered_map<std::string, std::shared_ptr<ZmqServerSession>> sessions; ///< Open sessions by identity, I/O thread only
+	std::shared_ptr<ZmqServerSession> lastSession; ///< Session of the last received message, I/O thread only
+	std::string identityKey; ///< Buffer for looking up @sessions, I/O thread only
+	time_point lastExpireCheck; ///< Last time the sessions were checked for timeout, I/O thread only
+	std::vector<zmq::pollitem_t> pollItems; ///< Items polled by the I/O thread
+	std::vector<std::unique_ptr<StreamConnection>> streams; ///< Stream connections, I/O thread only
+	std::unordered_map<std::string, StreamConnection *> streamsByIdentity; ///< Stream connection by client identity, I/O thread
+	std::vector<char> streamBuffer; ///< Buffer for reading the stream connections, I/O thread only
+	std::atomic<int> sessionCount; ///< Number of items in @sessions
+
+	std::deque<Outbound> outbound; ///< Messages to be sent by the I/O thread
+	std::deque<Outbound> sending; ///< Messages being sent by the I/O thread, kept to reuse the memory
+	std::mutex outboundMutex; ///< Mutex protecting @outbound
+
+	std::vector<std::unique_ptr<Worker>> workers; ///< The worker pool
+	std::atomic<bool> workersRunning; ///< Cleared to stop the workers once their queues are empty
+	std::atomic<bool> running; ///< Cleared to stop the I/O thread
+	std::thread ioThread; ///< The I/O thread
+
+	std::atomic<uint64_t> receivedMessages; ///< Number of data messages received
+	std::atomic<uint64_t> receivedBytes; ///< Number of data payload bytes received
+};
+
+
+template <typename T>
+inline ZmqSpscQueue<T>::ZmqSpscQueue() {
+	Node * node = new Node();
+	node->next.store(nullptr, std::memory_order_relaxed);
+	tail.store(node, std::memory_order_relaxed);
+	head = first = tailCopy = node;
+}
+
+template <typename T>
+inline ZmqSpscQueue<T>::~ZmqSpscQueue() {
+	Node * node = first;
+	while (node) {
+		Node * next = node->next.load(std::memory_order_relaxed);
+		delete node;
+		node = next;
+	}
+}
+
+template <typename T>
+inline typename ZmqSpscQueue<T>::Node * ZmqSpscQueue<T>::allocNode() {
+	if (first == tailCopy) {
+		tailCopy = tail.load(std::memory_order_acquire);
+	}
+	if (first != tailCopy) {
+		Node * node = first;
+		first = first->next.load(std::memory_order_relaxed);
+		return node;
+	}
+	return new Node();
+}
+
+template <typename T>
+inline void ZmqSpscQueue<T>::push(T && item) {
+	Node * node = allocNode();
+	node->item = std::move(item);
+	node->next.store(nullptr, std::memory_order_relaxed);
+	head->next.store(node, std::memory_order_release);
+	head = node;
+}
+
+template <typename T>
+inline bool ZmqSpscQueue<T>::pop(T & item) {
+	Node * node = tail.load(std::memory_order_relaxed)->next.load(std::memory_order_acquire);
+	if (!node) {
+		return false;
+	}
+	item = std::move(node->item);
+	// the node becomes the new empty front, the producer can reuse the previous one
+	tail.store(node, std::memory_order_release);
+	return true;
+}
+
+template <typename T>
+inline bool ZmqSpscQueue<T>::empty() const {
+	return tail.load(std::memory_order_relaxed)->next.load(std::memory_order_acquire) == nullptr;
+}
+
+
+inline ZmqServerSession::ZmqServerSession(ZmqServer & server, const std::string & identity)
+    : server(server)
+    , identity(identity)
+    , type(ClientType::Exporter)
+    , closed(false)
+    , inTransaction(false)
+    , receivedSequence(0)
+    , duplicates(0)
+    , requestId(0)
+{}
+
+inline void ZmqServerSession::send(zmq::message_t && payload, int requestId) {
+	if (closed) {
+		return;
+	}
+	ZmqServer::Outbound message = {identity, type, ControlMessage::DATA_MSG, requestId, std::move(payload)};
+	server.queueOutbound(std::move(message));
+}
+
+inline void ZmqServerSession::reply(zmq::message_t && payload) {
+	send(std::move(payload), requestId);
+}
+
+inline int ZmqServerSession::getRequestId() const {
+	return requestId;
+}
+
+inline ClientType ZmqServerSession::getType() const {
+	return type;
+}
+
+inline const std::string & ZmqServerSession::getIdentity() const {
+	return identity;
+}
+
+inline bool ZmqServerSession::usesSharedMemory() const {
+	return shmRing != nullptr;
+}
+
+inline bool ZmqServerSession::isClosed() const {
+	return closed;
+}
+
+inline void ZmqServerSession::setUserData(std::shared_ptr<void> data) {
+	userData = std::move(data);
+}
+
+inline const std::shared_ptr<void> & ZmqServerSession::getUserData() const {
+	return userData;
+}
+
+
+inline ZmqServer::ZmqServer(int workerCount, int ioThreads)
+    : context(ioThreads)
+    , streamListener(-1)
+    , wakePending(false)
+    , sharedMemory(true)
+    , sessionTimeout(SERVER_SESSION_TIMEOUT)
+    , sessionCount(0)
+    , workersRunning(false)
+    , running(false)
+    , receivedMessages(0)
+    , receivedBytes(0)
+{
+	if (workerCount <= 0) {
+		workerCount = std::max<int>(std::thread::hardware_concurrency(), 1);
+	}
+	for (int c = 0; c < workerCount; ++c) {
+		workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	}
+}
+
+inline ZmqServer::~ZmqServer() {
+	stop();
+}
+
+inline void ZmqServer::setCallback(OnMessageCallback cb) {
+	callback = cb;
+}
+
+inline void ZmqServer::setRawCallback(OnRawMessageCallback cb) {
+	rawCallback = cb;
+}
+
+inline void ZmqServer::setCommitCallback(OnCommitCallback cb) {
+	commitCallback = cb;
+}
+
+inline void ZmqServer::setSessionCallback(OnSessionCallback cb) {
+	sessionCallback = cb;
+}
+
+inline void ZmqServer::setSharedMemory(bool enable) {
+	sharedMemory = enable;
+}
+
+inline void ZmqServer::setSessionTimeout(int timeout) {
+	sessionTimeout = std::max(timeout, 0);
+}
+
+inline void ZmqServer::setStreamAddress(const std::string & addr) {
+	streamAddress = addr;
+}
+
+inline bool ZmqServer::bind(const char * addr) {
+	if (running || ioThread.joinable()) {
+		puts("ZMQ server is already running");
+		return false;
+	}
+
+	try {
+		socket = std::unique_ptr<zmq::socket_t>(new zmq::socket_t(context, ZMQ_ROUTER));
+		int linger = 0;
+		socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+		// reconnecting clients keep their identity, the new connection must take it over from a stale one
+		int handover = 1;
+		socket->setsockopt(ZMQ_ROUTER_HANDOVER, &handover, sizeof(handover));
+		socket->bind(addr);
+
+		char wakeAddr[64];
+		snprintf(wakeAddr, sizeof(wakeAddr), "inproc://zmq-server-%p", static_cast<void *>(this));
+		wakeReceiver = std::unique_ptr<zmq::socket_t>(new zmq::socket_t(context, ZMQ_PAIR));
+		wakeReceiver->bind(wakeAddr);
+		wakeSender = std::unique_ptr<zmq::socket_t>(new zmq::socket_t(context, ZMQ_PAIR));
+		wakeSender->connect(wakeAddr);
+	} catch (zmq::error_t & ex) {
+		printf("ZMQ server failed to bind [%s] %s\n", addr, ex.what());
+		socket.reset();
+		wakeReceiver.reset();
+		wakeSender.reset();
+		return false;
+	}
+	if (!streamAddress.empty() && !listenStream()) {
+		socket.reset();
+		wakeReceiver.reset();
+		wakeSender.reset();
+		return false;
+	}
+
+	running = true;
+	workersRunning = true;
+	for (auto & worker : workers) {
+		worker->thread = std::thread(&ZmqServer::workerLoop, this, std::ref(*worker));
+	}
+	// sockets are created here and used only by the I/O thread from now on, starting it is a full barrier
+	ioThread = std::thread(&ZmqServer::ioLoop, this);
+	return true;
+}
+
+inline void ZmqServer::stop() {
+	if (!ioThread.joinable()) {
+		return;
+	}
+
+	running = false;
+	wake();
+	ioThread.join();
+	closeStreams();
+
+	// the I/O thread is done, so this thread takes over as producer for the worker queues
+	for (auto & item : sessions) {
+		ioCloseSession(item.second);
+	}
+	sessions.clear();
+	lastSession.reset();
+	sessionCount = 0;
+
+	workersRunning = false;
+	for (auto & worker : workers) {
+		{
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			worker->cond.notify_one();
+		}
+		worker->thread.join();
+	}
+
+	socket->close();
+	wakeSender->close();
+	wakeReceiver->close();
+	std::lock_guard<std::mutex> lock(outboundMutex);
+	outbound.clear();
+}
+
+inline bool ZmqServer::good() const {
+	return running;
+}
+
+inline int ZmqServer::getSessionCount() const {
+	return sessionCount;
+}
+
+inline uint64_t ZmqServer::getReceivedMessages() const {
+	return receivedMessages;
+}
+
+inline uint64_t ZmqServer::getReceivedBytes() const {
+	return receivedBytes;
+}
+
+inline int ZmqServer::getWorkerCount() const {
+	return static_cast<int>(workers.size());
+}
+
+inline void ZmqServer::queueOutbound(Outbound && message) {
+	bool wakeNeeded;
+	{
+		std::lock_guard<std::mutex> lock(outboundMutex);
+		outbound.push_back(std::move(message));
+		wakeNeeded = outbound.size() == 1;
+	}
+	// the I/O thread sends the whole queue after each poll, so only the first message of a burst needs to wake it
+	if (wakeNeeded) {
+		wake();
+	}
+}
+
+inline void ZmqServer::wake() {
+	if (wakePending.exchange(true)) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(wakeMutex);
+	try {
+		zmq::message_t msg(0);
+		wakeSender->send(msg, ZMQ_DONTWAIT);
+	} catch (zmq::error_t & ex) {
+		printf("ZMQ failed [%s] to wake server\n", ex.what());
+	}
+}
+
+inline void ZmqServer::handOff(const std::shared_ptr<ZmqServerSession> & session, const ControlFrame & frame,
+                               zmq::message_t && payload, bool closing) {
+	Worker & worker = *workers[std::hash<std::string>()(session->identity) % workers.size()];
+	Inbound item = {session, frame.type, frame.control, frame.requestId, closing, std::move(payload)};
+	worker.queue.push(std::move(item));
+
+	// pairs with the fence in ::workerLoop, either the worker sees the item or we see it sleeping
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (worker.sleeping.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.cond.notify_one();
+	}
+}
+
+inline void ZmqServer::ioLoop() {
+	lastExpireCheck = std::chrono::high_resolution_clock::now();
+
+	while (running) {
+		pollItems.clear();
+		pollItems.push_back({*socket, 0, ZMQ_POLLIN, 0});
+		pollItems.push_back({*wakeReceiver, 0, ZMQ_POLLIN, 0});
+		if (streamListener != -1) {
+			pollItems.push_back({nullptr, streamListener, ZMQ_POLLIN, 0});
+		}
+		const size_t firstStream = pollItems.size();
+		for (const auto & stream : streams) {
+			const short events = stream->sent < stream->outgoing.size() ? ZMQ_POLLIN | ZMQ_POLLOUT : ZMQ_POLLIN;
+			pollItems.push_back({nullptr, stream->fd, events, 0});
+		}
+		try {
+			zmq::poll(pollItems.data(), pollItems.size(), sessionTimeout ? CLIENT_PING_INTERVAL : -1);
+
+			if (pollItems[1].revents & ZMQ_POLLIN) {
+				wakePending = false;
+				zmq::message_t msg;
+				while (wakeReceiver->recv(&msg, ZMQ_DONTWAIT)) {}
+			}
+
+			const time_point now = std::chrono::high_resolution_clock::now();
+			if (pollItems[0].revents & ZMQ_POLLIN) {
+				// keep reading while messages keep coming, replies are sent between bursts
+				while (ioReceive(now) && running) {
+					ioSendOutbound();
+				}
+			}
+			// connections accepted here are appended to @streams, so the indices of the polled ones don't change
+			if (streamListener != -1 && (pollItems[firstStream - 1].revents & ZMQ_POLLIN)) {
+				ioAcceptStreams();
+			}
+			for (size_t c = firstStream; c < pollItems.size(); ++c) {
+				StreamConnection & stream = *streams[c - firstStream];
+				if (pollItems[c].revents & (ZMQ_POLLIN | ZMQ_POLLERR)) {
+					ioReceiveStream(stream, now);
+				}
+				if (stream.fd != -1 && (pollItems[c].revents & ZMQ_POLLOUT)) {
+					ioFlushStream(stream);
+				}
+			}
+			ioSendOutbound();
+			streams.erase(std::remove_if(streams.begin(), streams.end(), [](const std::unique_ptr<StreamConnection> & stream) {
+				return stream->fd == -1;
+			}), streams.end());
+			ioExpireSessions(now);
+		} catch (zmq::error_t & ex) {
+			printf("ZMQ server I/O thread error [%s]\n", ex.what());
+		}
+	}
+}
+
+inline bool ZmqServer::ioReceive(time_point now) {
+	int received = 0;
+	for (; received < SERVER_RECEIVE_BURST; ++received) {
+		zmq::message_t identity, control, payload;
+		if (!socket->recv(&identity, ZMQ_DONTWAIT)) {
+			break;
+		}
+		if (identity.more()) {
+			socket->recv(&control);
+		}
+		if (control.more()) {
+			socket->recv(&payload);
+		}
+		if (payload.more()) {
+			puts("ZMQ server received message with unexpected frames, dropping it");
+			zmq::message_t frame;
+			do {
+				socket->recv(&frame);
+			} while (frame.more());
+			continue;
+		}
+		ioHandle(identity, control, payload, now);
+	}
+	return received == SERVER_RECEIVE_BURST;
+}
+
+inline void ZmqServer::ioHandle(zmq::message_t & identity, zmq::message_t & control, zmq::message_t & payload,
+                                time_point now) {
+	const ControlFrame frame(control);
+	if (frame.version != ZMQ_PROTOCOL_VERSION) {
+		printf("ZMQ expected protocol version [%d], client speaks [%d], dropping message.\n", ZMQ_PROTOCOL_VERSION, frame.version);
+		return;
+	}
+
+	const std::shared_ptr<ZmqServerSession> & session = ioSession(identity);
+	session->lastReceived = now;
+
+	switch (frame.control) {
+	case ControlMessage::PING_MSG: {
+		// the pong confirms all messages sent before the ping, they are all in the worker queues by now
+		zmq::message_t pong = ControlFrame::make(frame.type, ControlMessage::PONG_MSG);
+		zmq::message_t emptyFrame(0);
+		ioSend(identity.data(), identity.size(), pong, emptyFrame);
+		return;
+	}
+	case ControlMessage::PONG_MSG:
+		return;
+	case ControlMessage::DATA_MSG:
+	case ControlMessage::SHM_DATA_MSG:
+	case ControlMessage::CHUNK_END_MSG:
+		++receivedMessages;
+		receivedBytes += payload.size();
+		break;
+	case ControlMessage::CHUNK_MSG:
+		receivedBytes += payload.size();
+		break;
+	default:
+		break;
+	}
+
+	handOff(session, frame, std::move(payload));
+}
+
+inline const std::shared_ptr<ZmqServerSession> & ZmqServer::ioSession(const zmq::message_t & identity) {
+	// clients send in bursts, so the session is usually the same as for the previous message
+	if (lastSession && lastSession->identity.size() == identity.size() &&
+	    !memcmp(lastSession->identity.data(), identity.data(), identity.size())) {
+		return lastSession;
+	}
+
+	identityKey.assign(reinterpret_cast<const char *>(identity.data()), identity.size());
+	std::shared_ptr<ZmqServerSession> & session = sessions[identityKey];
+	if (!session) {
+		session = std::shared_ptr<ZmqServerSession>(new ZmqServerSession(*this, identityKey));
+		sessionCount = static_cast<int>(sessions.size());
+	}
+	lastSession = session;
+	return lastSession;
+}
+
+inline void ZmqServer::ioSendOutbound() {
+	{
+		std::lock_guard<std::mutex> lock(outboundMutex);
+		if (outbound.empty()) {
+			return;
+		}
+		sending.swap(outbound);
+	}
+
+	for (Outbound & message : sending) {
+		zmq::message_t control = ControlFrame::make(message.type, message.control, message.requestId);
+		ioSend(message.identity.data(), message.identity.size(), control, message.payload);
+	}
+	sending.clear();
+}
+
+inline void ZmqServer::ioSend(const void * identity, size_t identitySize, zmq::message_t & control,
+                              zmq::message_t & payload) {
+	if (!streamsByIdentity.empty()) {
+		identityKey.assign(reinterpret_cast<const char *>(identity), identitySize);
+		auto iter = streamsByIdentity.find(identityKey);
+		if (iter != streamsByIdentity.end()) {
+			ioWriteStream(*iter->second, control, payload);
+			return;
+		}
+	}
+
+	zmq::message_t identityFrame(identity, identitySize);
+	// ROUTER drops messages to clients that are gone or have full queues instead of blocking
+	socket->send(identityFrame, ZMQ_SNDMORE);
+	socket->send(control, ZMQ_SNDMORE);
+	socket->send(payload);
+}
+
+inline void ZmqServer::ioWriteStream(StreamConnection & stream, zmq::message_t & control, zmq::message_t & payload) {
+	const size_t pending = stream.outgoing.size() - stream.sent;
+	if (pending && pending + payload.size() > SERVER_STREAM_OUTBOUND_MAX) {
+		return;
+	}
+	const ZmqStreamFrameHeader header = {static_cast<uint32_t>(control.size()), 0, static_cast<uint64_t>(payload.size())};
+	const char * headerBytes = reinterpret_cast<const char *>(&header);
+	const char * controlBytes = reinterpret_cast<const char *>(control.data());
+	const char * payloadBytes = reinterpret_cast<const char *>(payload.data());
+	stream.outgoing.insert(stream.outgoing.end(), headerBytes, headerBytes + sizeof(header));
+	stream.outgoing.insert(stream.outgoing.end(), controlBytes, controlBytes + control.size());
+	stream.outgoing.insert(stream.outgoing.end(), payloadBytes, payloadBytes + payload.size());
+	ioFlushStream(stream);
+}
+
+#ifdef __linux__
+
+inline bool ZmqServer::listenStream() {
+	const size_t colon = streamAddress.rfind(':');
+	if (streamAddress.compare(0, 6, "tcp://") != 0 || colon == std::string::npos || colon <= 6) {
+		printf("ZMQ server expects tcp://<host>:<port> for stream connections, got [%s]\n", streamAddress.c_str());
+		return false;
+	}
+	std::string host = streamAddress.substr(6, colon - 6);
+	const std::string port = streamAddress.substr(colon + 1);
+	if (host.size() > 2 && host[0] == '[' && host[host.size() - 1] == ']') {
+		host = host.substr(1, host.size() - 2);
+	}
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	addrinfo * addresses = nullptr;
+	const int status = getaddrinfo(host == "*" ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+	if (status != 0 || !addresses) {
+		printf("ZMQ server failed to resolve [%s]: %s\n", host.c_str(), gai_strerror(status));
+		return false;
+	}
+
+	const int reuse = 1;
+	streamListener = ::socket(addresses->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	const bool listening = streamListener != -1 &&
+		setsockopt(streamListener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0 &&
+		::bind(streamListener, addresses->ai_addr, addresses->ai_addrlen) == 0 && listen(streamListener, SOMAXCONN) == 0;
+	const int listenError = errno;
+	freeaddrinfo(addresses);
+	if (!listening) {
+		printf("ZMQ server failed to listen on [%s] %s\n", streamAddress.c_str(), strerror(listenError));
+		closeStreams();
+		return false;
+	}
+	return true;
+}
+
+inline void ZmqServer::closeStreams() {
+	for (auto & stream : streams) {
+		ioCloseStream(*stream);
+	}
+	streams.clear();
+	if (streamListener != -1) {
+		::close(streamListener);
+		streamListener = -1;
+	}
+}
+
+inline void ZmqServer::ioAcceptStreams() {
+	while (true) {
+		const int fd = accept4(streamListener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				printf("ZMQ server failed to accept stream connection [%s]\n", strerror(errno));
+			}
+			return;
+		}
+		int noDelay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+		streams.push_back(std::unique_ptr<StreamConnection>(new StreamConnection(fd)));
+	}
+}
+
+inline void ZmqServer::ioReceiveStream(StreamConnection & stream, time_point now) {
+	streamBuffer.resize(SERVER_STREAM_READ_SIZE);
+	const ssize_t received = ::recv(stream.fd, streamBuffer.data(), streamBuffer.size(), MSG_DONTWAIT);
+	if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+		return;
+	}
+	if (received <= 0) {
+		ioCloseStream(stream);
+		return;
+	}
+
+	const bool hadPreamble = stream.parser.hasPreamble();
+	if (!stream.parser.parse(streamBuffer.data(), static_cast<size_t>(received))) {
+		puts("ZMQ server received malformed stream, closing the connection");
+		ioCloseStream(stream);
+		return;
+	}
+	if (!hadPreamble && stream.parser.hasPreamble()) {
+		const uint64_t identity = stream.parser.getPreamble().identity;
+		stream.identity.assign(reinterpret_cast<const char *>(&identity), sizeof(identity));
+		// a reconnecting client can connect before the old connection is noticed to be gone, the new one gets replies
+		streamsByIdentity[stream.identity] = &stream;
+	}
+
+	zmq::message_t identity, control, payload;
+	while (stream.fd != -1 && stream.parser.pop(control, payload)) {
+		identity.rebuild(stream.identity.data(), stream.identity.size());
+		ioHandle(identity, control, payload, now);
+	}
+}
+
+inline void ZmqServer::ioFlushStream(StreamConnection & stream) {
+	while (stream.sent < stream.outgoing.size()) {
+		const ssize_t written = ::send(stream.fd, stream.outgoing.data() + stream.sent, stream.outgoing.size() - stream.sent,
+		                               MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			// the rest is written when the socket becomes writable
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				ioCloseStream(stream);
+			}
+			break;
+		}
+		stream.sent += static_cast<size_t>(written);
+	}
+
+	if (stream.sent == stream.outgoing.size()) {
+		stream.outgoing.clear();
+		stream.sent = 0;
+	} else if (stream.sent > stream.outgoing.size() / 2) {
+		stream.outgoing.erase(stream.outgoing.begin(), stream.outgoing.begin() + stream.sent);
+		stream.sent = 0;
+	}
+}
+
+inline void ZmqServer::ioCloseStream(StreamConnection & stream) {
+	if (stream.fd == -1) {
+		return;
+	}
+	::close(stream.fd);
+	stream.fd = -1;
+	stream.outgoing.clear();
+	stream.sent = 0;
+	auto iter = streamsByIdentity.find(stream.identity);
+	if (iter != streamsByIdentity.end() && iter->second == &stream) {
+		streamsByIdentity.erase(iter);
+	}
+}
+
+#else
+
+inline bool ZmqServer::listenStream() {
+	puts("ZMQ server accepts stream connections only on Linux");
+	return false;
+}
+
+inline void ZmqServer::closeStreams() {}
+
+inline void ZmqServer::ioAcceptStreams() {}
+
+inline void ZmqServer::ioReceiveStream(StreamConnection &, time_point) {}
+
+inline void ZmqServer::ioFlushStream(StreamConnection &) {}
+
+inline void ZmqServer::ioCloseStream(StreamConnection & stream) {
+	stream.fd = -1;
+}
+
+#endif // __linux__
+
+inline void ZmqServer::ioExpireSessions(time_point now) {
+	using namespace std::chrono;
+	if (!sessionTimeout || now - lastExpireCheck < milliseconds(CLIENT_PING_INTERVAL)) {
+		return;
+	}
+	lastExpireCheck = now;
+
+	for (auto iter = sessions.begin(); iter != sessions.end();) {
+		if (now - iter->second->lastReceived >= milliseconds(sessionTimeout)) {
+			ioCloseSession(iter->second);
+			iter = sessions.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+	lastSession.reset();
+	sessionCount = static_cast<int>(sessions.size());
+}
+
+inline void ZmqServer::ioCloseSession(const std::shared_ptr<ZmqServerSession> & session) {
+	handOff(session, ControlFrame(session->type), zmq::message_t(0), true);
+}
+
+inline void ZmqServer::workerLoop(Worker & worker) {
+	Inbound item;
+	while (true) {
+		if (worker.queue.pop(item)) {
+			workerHandle(item);
+			item.session.reset();
+			continue;
+		}
+		// items are pushed before the flag is cleared, so the queue is really empty
+		if (!workersRunning && worker.queue.empty()) {
+			break;
+		}
+
+		std::unique_lock<std::mutex> lock(worker.mutex);
+		worker.sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (worker.queue.empty() && workersRunning) {
+			worker.cond.wait_for(lock, std::chrono::milliseconds(SOCKET_IO_TIMEOUT));
+		}
+		worker.sleeping.store(false, std::memory_order_relaxed);
+	}
+}
+
+inline void ZmqServer::workerHandle(Inbound & item) {
+	ZmqServerSession & session = *item.session;
+
+	if (item.closing) {
+		session.closed = true;
+		session.transaction.clear();
+		session.inTransaction = false;
+		session.chunked.clear();
+		session.shmRing.reset();
+		workerEvent(session, ZmqServerEvent::Closed);
+		session.userData.reset();
+		return;
+	}
+
+	if (!workerSequence(session, item)) {
+		return;
+	}
+
+	switch (item.control) {
+	case ControlMessage::EXPORTER_CONNECT_MSG:
+	case ControlMessage::HEARTBEAT_CONNECT_MSG:
+		workerHandshake(session, item);
+		break;
+	case ControlMessage::DATA_MSG:
+	case ControlMessage::SHM_DATA_MSG: {
+		zmq::message_t payload;
+		if (item.control == ControlMessage::SHM_DATA_MSG) {
+			uint64_t size = 0;
+			const char * data = session.shmRing ? session.shmRing->read(item.payload, size) : nullptr;
+			if (!data) {
+				puts("ZMQ server received invalid shared memory descriptor, dropping message");
+				break;
+			}
+			// copied out so the block is released in order even when the message is kept for a transaction
+			payload.rebuild(data, size);
+			session.shmRing->release(item.payload);
+		} else {
+			payload.move(&item.payload);
+		}
+		workerData(session, item.requestId, payload);
+		break;
+	}
+	case ControlMessage::CHUNK_MSG:
+	case ControlMessage::CHUNK_END_MSG:
+		workerChunk(session, item);
+		break;
+	case ControlMessage::TRANSACTION_BEGIN_MSG:
+		session.inTransaction = true;
+		break;
+	case ControlMessage::TRANSACTION_COMMIT_MSG: {
+		session.inTransaction = false;
+		for (auto & buffered : session.transaction) {
+			workerDispatch(session, buffered.requestId, buffered.payload);
+		}
+		session.transaction.clear();
+
+		int action = VRayBaseTypes::CommitNow;
+		if (item.payload.size() == sizeof(action)) {
+			memcpy(&action, item.payload.data(), sizeof(action));
+		} else {
+			puts("ZMQ server received transaction commit without action, committing now");
+		}
+		if (commitCallback) {
+			commitCallback(static_cast<VRayBaseTypes::CommitAction>(action), session);
+		}
+		break;
+	}
+	case ControlMessage::STOP_MSG:
+		workerEvent(session, ZmqServerEvent::Stop);
+		break;
+	default:
+		printf("ZMQ server received unexpected control message [%d]\n", static_cast<int>(item.control));
+		break;
+	}
+}
+
+inline void ZmqServer::workerHandshake(ZmqServerSession & session, const Inbound & item) {
+	session.type = item.type;
+	// the client resends what we did not confirm, we may have got some of it already
+	const uint32_t resumeSequence = static_cast<uint32_t>(item.requestId);
+	const int32_t received = static_cast<int32_t>(session.receivedSequence - resumeSequence);
+	if (received >= 0) {
+		session.duplicates = static_cast<uint32_t>(received);
+	} else {
+		// messages confirmed to the client are missing, e.g. the session expired, so there is nothing to resume
+		printf("ZMQ server lost %d messages of reconnecting client, starting over\n", -received);
+		session.transaction.clear();
+		session.inTransaction = false;
+		session.chunked.clear();
+		session.receivedSequence = resumeSequence;
+		session.duplicates = 0;
+	}
+	// the client creates new ring for each connection
+	session.shmRing.reset();
+
+	zmq::message_t response(0);
+	if (item.payload.size() && sharedMemory) {
+		const std::string name(reinterpret_cast<const char *>(item.payload.data()), item.payload.size());
+		std::unique_ptr<ZmqShmRing> ring(new ZmqShmRing());
+		if (ring->open(name.c_str())) {
+			// sending the name back tells the client the ring is accepted
+			response.rebuild(name.data(), name.size());
+			session.shmRing = std::move(ring);
+		} else {
+			printf("ZMQ server failed to open shared memory [%s], client will send over the socket\n", name.c_str());
+		}
+	}
+
+	Outbound message = {session.identity, item.type, item.control == ControlMessage::EXPORTER_CONNECT_MSG
+	                    ? ControlMessage::RENDERER_CREATE_MSG
+	                    : ControlMessage::HEARTBEAT_CREATE_MSG, 0, std::move(response)};
+	queueOutbound(std::move(message));
+
+	workerEvent(session, ZmqServerEvent::Connected);
+}
+
+inline bool ZmqServer::workerSequence(ZmqServerSession & session, const Inbound & item) {
+	switch (item.control) {
+	case ControlMessage::DATA_MSG:
+	case ControlMessage::SHM_DATA_MSG:
+	case ControlMessage::CHUNK_MSG:
+	case ControlMessage::CHUNK_END_MSG:
+	case ControlMessage::TRANSACTION_BEGIN_MSG:
+	case ControlMessage::TRANSACTION_COMMIT_MSG:
+		break;
+	default:
+		return true;
+	}
+
+	if (!session.duplicates) {
+		++session.receivedSequence;
+		return true;
+	}
+	--session.duplicates;
+	if (item.control == ControlMessage::SHM_DATA_MSG && session.shmRing) {
+		session.shmRing->release(item.payload);
+	}
+	return false;
+}
+
+inline void ZmqServer::workerData(ZmqServerSession & session, int requestId, zmq::message_t & payload) {
+	if (session.inTransaction) {
+		ZmqServerSession::BufferedMessage buffered = {requestId, std::move(payload)};
+		session.transaction.push_back(std::move(buffered));
+	} else {
+		workerDispatch(session, requestId, payload);
+	}
+}
+
+inline void ZmqServer::workerChunk(ZmqServerSession & session, const Inbound & item) {
+	std::vector<char> & parts = session.chunked[item.requestId];
+	const char * data = reinterpret_cast<const char *>(item.payload.data());
+	parts.insert(parts.end(), data, data + item.payload.size());
+	if (item.control == ControlMessage::CHUNK_MSG) {
+		return;
+	}
+
+	// the message takes over the joined parts, so they are not copied again
+	zmq::message_t payload = VRayMessage::fromVector(std::move(parts));
+	session.chunked.erase(item.requestId);
+	// chunked messages can't be requests, the id in the control frame is the id of the chunks
+	workerData(session, 0, payload);
+}
+
+inline void ZmqServer::workerDispatch(ZmqServerSession & session, int requestId, zmq::message_t & payload) {
+	session.requestId = requestId;
+	if (rawCallback) {
+		rawCallback(payload, session);
+	} else if (callback) {
+		callback(VRayMessage::fromZmqMessage(payload), session);
+	}
+	session.requestId = 0;
+}
+
+inline void ZmqServer::workerEvent(ZmqServerSession & session, ZmqServerEvent event) {
+	if (sessionCallback) {
+		sessionCallback(event, session);
+	}
+}
+
+#endif // _ZMQ_SERVER_H_
@@ -0,0 +1,228 @@
+#ifndef _ZMQ_SHM_H_
+#define _ZMQ_SHM_H_
+
+#include <zmq.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "shared_memory.hpp"
+
+/// Header at the start of the shared segment
+struct ZmqShmRingHeader {
+	static const uint32_t MAGIC = 0x52485a56; // 'VZHR'
+
+	uint32_t magic; ///< Must be MAGIC
+	uint32_t formatVersion; ///< Version of the ring layout
+	uint64_t capacity; ///< Bytes of payload space after the header
+	std::atomic<uint64_t> head; ///< Total bytes written by the producer, written only by the producer
+	char padding[64 - 3 * sizeof(uint64_t)]; ///< Keep @head and @tail on different cache lines
+	std::atomic<uint64_t> tail; ///< Total bytes released by the consumer, written only by the consumer
+};
+
+/// Descriptor sent as payload of SHM_DATA_MSG in place of the message it points to
+struct ZmqShmDescriptor {
+	uint64_t offset; ///< Position of the message in the ring, not wrapped to the capacity
+	uint64_t size; ///< Size of the message in bytes
+};
+
+
+/// Single producer, single consumer ring of messages in shared memory
+/// The producer (client) writes each message in one contiguous block and sends the descriptor over the zmq socket,
+/// the consumer (server) reads the block and releases it, blocks must be released in the order they were written
+/// Both sides only touch their own counter, so no locking is needed across processes
+class ZmqShmRing {
+public:
+	static const uint32_t FORMAT_VERSION = 1;
+
+	ZmqShmRing();
+
+	ZmqShmRing(const ZmqShmRing &) = delete;
+	ZmqShmRing &operator=(const ZmqShmRing &) = delete;
+
+	/// Create the segment as producer
+	/// @name - segment name, unique on the machine
+	/// @capacity - bytes for messages
+	/// @return - true on success
+	bool create(const char * name, uint64_t capacity);
+
+	/// Open segment created by the producer as consumer
+	/// @name - segment name received from the producer
+	/// @return - true on success
+	bool open(const char * name);
+
+	/// Unmap the segment
+	void close();
+
+	/// Check if the segment is mapped
+	bool good() const;
+
+	/// Get the segment name
+	const std::string & getName() const;
+
+	/// Producer: copy data in the ring
+	/// @data - the message bytes
+	/// @size - number of bytes
+	/// @descriptor - filled with descriptor to send to the consumer
+	/// @return - false if there is not enough free space, the message should be sent inline
+	bool write(const void * data, uint64_t size, ZmqShmDescriptor & descriptor);
+
+	/// Producer: take back the last written block, when it's descriptor could not be sent to the consumer
+	/// @descriptor - descriptor filled by the last ::write
+	void unwrite(const ZmqShmDescriptor & descriptor);
+
+	/// Consumer: get the bytes of a message
+	/// @descriptor - payload of SHM_DATA_MSG
+	/// @return - pointer to the data, valid until the block is released, null if the descriptor is invalid
+	const char * read(const zmq::message_t & descriptor, uint64_t & size) const;
+
+	/// Consumer: release a block and all written before it
+	void release(const zmq::message_t & descriptor);
+
+	/// Producer: get bytes available for writing
+	uint64_t getFreeSpace() const;
+
+private:
+	/// Round size up so all blocks start 8 byte aligned
+	static uint64_t align(uint64_t size) {
+		return (size + 7) & ~uint64_t(7);
+	}
+
+	/// Parse descriptor message
+	bool getDescriptor(const zmq::message_t & message, ZmqShmDescriptor & descriptor) const;
+
+	SharedMemory segment; ///< The shared memory
+	ZmqShmRingHeader * header; ///< Header at the start of @segment
+	char * ring; ///< Payload space after the header
+	std::string name; ///< Name of the segment
+};
+
+
+inline ZmqShmRing::ZmqShmRing()
+    : header(nullptr)
+    , ring(nullptr)
+{}
+
+inline bool ZmqShmRing::create(const char * name, uint64_t capacity) {
+	close();
+	capacity = align(capacity);
+	if (!segment.create(name, sizeof(ZmqShmRingHeader) + capacity)) {
+		return false;
+	}
+
+	this->name = name;
+	header = new (segment.data()) ZmqShmRingHeader();
+	header->magic = ZmqShmRingHeader::MAGIC;
+	header->formatVersion = FORMAT_VERSION;
+	header->capacity = capacity;
+	header->head = 0;
+	header->tail = 0;
+	ring = segment.data() + sizeof(ZmqShmRingHeader);
+	return true;
+}
+
+inline bool ZmqShmRing::open(const char * name) {
+	close();
+	if (!segment.open(name)) {
+		return false;
+	}
+
+	header = reinterpret_cast<ZmqShmRingHeader *>(segment.data());
+	if (segment.size() < sizeof(ZmqShmRingHeader) || header->magic != ZmqShmRingHeader::MAGIC ||
+	    header->formatVersion != FORMAT_VERSION || segment.size() < sizeof(ZmqShmRingHeader) + header->capacity) {
+		printf("ZmqShmRing segment [%s] has unexpected format\n", name);
+		close();
+		return false;
+	}
+
+	this->name = name;
+	ring = segment.data() + sizeof(ZmqShmRingHeader);
+	return true;
+}
+
+inline void ZmqShmRing::close() {
+	segment.close();
+	header = nullptr;
+	ring = nullptr;
+	name.clear();
+}
+
+inline bool ZmqShmRing::good() const {
+	return header != nullptr;
+}
+
+inline const std::string & ZmqShmRing::getName() const {
+	return name;
+}
+
+inline uint64_t ZmqShmRing::getFreeSpace() const {
+	if (!header) {
+		return 0;
+	}
+	return header->capacity - (header->head.load(std::memory_order_relaxed) - header->tail.load(std::memory_order_acquire));
+}
+
+inline bool ZmqShmRing::write(const void * data, uint64_t size, ZmqShmDescriptor & descriptor) {
+	if (!header) {
+		return false;
+	}
+
+	const uint64_t capacity = header->capacity;
+	const uint64_t blockSize = align(size);
+	const uint64_t head = header->head.load(std::memory_order_relaxed);
+	const uint64_t tail = header->tail.load(std::memory_order_acquire);
+
+	uint64_t start = head;
+	// blocks are never split, skip the end of the ring if the block does not fit there
+	if (head % capacity + blockSize > capacity) {
+		start += capacity - head % capacity;
+	}
+	if (blockSize > capacity || start + blockSize - tail > capacity) {
+		return false;
+	}
+
+	memcpy(ring + start % capacity, data, static_cast<size_t>(size));
+	header->head.store(start + blockSize, std::memory_order_release);
+
+	descriptor.offset = start;
+	descriptor.size = size;
+	return true;
+}
+
+inline void ZmqShmRing::unwrite(const ZmqShmDescriptor & descriptor) {
+	// the consumer never saw the block, the space skipped at the end of the ring stays used until the next release
+	if (header && header->head.load(std::memory_order_relaxed) == descriptor.offset + align(descriptor.size)) {
+		header->head.store(descriptor.offset, std::memory_order_release);
+	}
+}
+
+inline bool ZmqShmRing::getDescriptor(const zmq::message_t & message, ZmqShmDescriptor & descriptor) const {
+	if (!header || message.size() != sizeof(descriptor)) {
+		return false;
+	}
+	memcpy(&descriptor, message.data(), sizeof(descriptor));
+	const uint64_t capacity = header->capacity;
+	return descriptor.size <= capacity && descriptor.offset % capacity + descriptor.size <= capacity &&
+	       descriptor.offset + descriptor.size <= header->head.load(std::memory_order_acquire);
+}
+
+inline const char * ZmqShmRing::read(const zmq::message_t & message, uint64_t & size) const {
+	ZmqShmDescriptor descriptor;
+	if (!getDescriptor(message, descriptor)) {
+		return nullptr;
+	}
+	size = descriptor.size;
+	return ring + descriptor.offset % header->capacity;
+}
+
+inline void ZmqShmRing::release(const zmq::message_t & message) {
+	ZmqShmDescriptor descriptor;
+	if (getDescriptor(message, descriptor)) {
+		header->tail.store(descriptor.offset + align(descriptor.size), std::memory_order_release);
+	}
+}
+
+#endif // _ZMQ_SHM_H_
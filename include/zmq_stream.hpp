@@ -0,0 +1,178 @@
+#ifndef _ZMQ_STREAM_H_
+#define _ZMQ_STREAM_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <utility>
+
+#include "zmq.hpp"
+
+/// Sent once at the start of a stream connection, before the first message
+struct ZmqStreamPreamble {
+	static const uint32_t MAGIC = 0x54535a56; // 'VZST'
+	static const uint32_t FORMAT_VERSION = 1;
+
+	uint32_t magic; ///< Must be MAGIC
+	uint32_t formatVersion; ///< Version of the stream framing
+	uint64_t identity; ///< Identity of the client, same as the zmq socket identity
+};
+
+/// Precedes each message on a stream connection, followed by the control and the payload bytes
+/// The control frame is the same ControlFrame sent over the zmq socket, so only the framing differs
+struct ZmqStreamFrameHeader {
+	/// Larger control frames are treated as corrupted stream
+	static const uint32_t MAX_CONTROL_SIZE = 256;
+	/// Larger payloads are treated as corrupted stream, the client sends bigger messages in chunks
+	static const uint64_t MAX_PAYLOAD_SIZE = 1ull << 30;
+
+	uint32_t controlSize; ///< Bytes of the control frame
+	uint32_t reserved; ///< Must be 0
+	uint64_t payloadSize; ///< Bytes of the payload frame
+};
+
+/// Splits the bytes received on a stream connection into control + payload messages
+/// The payload is copied straight into it's message, so memory used for a message is bounded by the size of it's
+/// header: frames over the limits in ZmqStreamFrameHeader are rejected before anything is allocated for them
+class ZmqStreamParser {
+public:
+	/// @preamble - true if the stream starts with ZmqStreamPreamble, the client to server direction
+	explicit ZmqStreamParser(bool preamble);
+
+	/// Parse received bytes, complete messages are available from ::pop
+	/// @return - false if the stream is malformed, nothing more can be parsed from it
+	bool parse(const char * data, size_t size);
+
+	/// Take the oldest complete message
+	/// @return - false if there is none
+	bool pop(zmq::message_t & control, zmq::message_t & payload);
+
+	/// Check if there is no complete message
+	bool empty() const;
+
+	/// Check if the preamble was received, always true if the stream has none
+	bool hasPreamble() const;
+
+	/// Get the preamble, valid if ::hasPreamble
+	const ZmqStreamPreamble & getPreamble() const;
+
+	/// Forget all parsed bytes, the next byte is the start of a new stream
+	void reset();
+
+private:
+	/// Copy bytes into @head until it has @needed bytes
+	/// @return - true if it has them
+	bool fillHead(const char *& data, size_t & size, size_t needed);
+
+	bool expectPreamble; ///< The stream starts with a preamble
+	bool preambleReceived; ///< Set once the whole preamble is parsed
+	bool malformed; ///< Set when invalid bytes are received
+	ZmqStreamPreamble preamble; ///< The received preamble
+	ZmqStreamFrameHeader header; ///< Header of the message being received, valid if @headSize is past it
+	char head[sizeof(ZmqStreamFrameHeader) + ZmqStreamFrameHeader::MAX_CONTROL_SIZE]; ///< Header and control bytes
+	size_t headSize; ///< Bytes in @head
+	zmq::message_t payload; ///< Payload of the message being received
+	size_t payloadReceived; ///< Bytes of @payload received so far
+	std::deque<std::pair<zmq::message_t, zmq::message_t>> messages; ///< Complete messages waiting for ::pop
+};
+
+
+inline ZmqStreamParser::ZmqStreamParser(bool preamble)
+    : expectPreamble(preamble)
+    , preambleReceived(!preamble)
+    , malformed(false)
+    , headSize(0)
+    , payloadReceived(0)
+{
+	memset(&this->preamble, 0, sizeof(this->preamble));
+	memset(&header, 0, sizeof(header));
+}
+
+inline bool ZmqStreamParser::fillHead(const char *& data, size_t & size, size_t needed) {
+	const size_t copied = std::min(needed - headSize, size);
+	memcpy(head + headSize, data, copied);
+	headSize += copied;
+	data += copied;
+	size -= copied;
+	return headSize == needed;
+}
+
+inline bool ZmqStreamParser::parse(const char * data, size_t size) {
+	while (size && !malformed) {
+		if (!preambleReceived) {
+			if (!fillHead(data, size, sizeof(preamble))) {
+				break;
+			}
+			memcpy(&preamble, head, sizeof(preamble));
+			headSize = 0;
+			preambleReceived = true;
+			malformed = preamble.magic != ZmqStreamPreamble::MAGIC || preamble.formatVersion != ZmqStreamPreamble::FORMAT_VERSION;
+			continue;
+		}
+
+		if (headSize < sizeof(header)) {
+			if (!fillHead(data, size, sizeof(header))) {
+				break;
+			}
+			memcpy(&header, head, sizeof(header));
+			if (header.reserved != 0 || header.controlSize > ZmqStreamFrameHeader::MAX_CONTROL_SIZE ||
+			    header.payloadSize > ZmqStreamFrameHeader::MAX_PAYLOAD_SIZE) {
+				malformed = true;
+				break;
+			}
+			payload.rebuild(static_cast<size_t>(header.payloadSize));
+			payloadReceived = 0;
+		}
+		if (!fillHead(data, size, sizeof(header) + header.controlSize)) {
+			break;
+		}
+
+		const size_t copied = std::min(payload.size() - payloadReceived, size);
+		memcpy(reinterpret_cast<char *>(payload.data()) + payloadReceived, data, copied);
+		payloadReceived += copied;
+		data += copied;
+		size -= copied;
+		if (payloadReceived < payload.size()) {
+			break;
+		}
+
+		messages.push_back(std::make_pair(zmq::message_t(head + sizeof(header), header.controlSize), zmq::message_t()));
+		messages.back().second.move(&payload);
+		headSize = 0;
+	}
+	return !malformed;
+}
+
+inline bool ZmqStreamParser::pop(zmq::message_t & control, zmq::message_t & payload) {
+	if (messages.empty()) {
+		return false;
+	}
+	control.move(&messages.front().first);
+	payload.move(&messages.front().second);
+	messages.pop_front();
+	return true;
+}
+
+inline bool ZmqStreamParser::empty() const {
+	return messages.empty();
+}
+
+inline bool ZmqStreamParser::hasPreamble() const {
+	return preambleReceived && !malformed;
+}
+
+inline const ZmqStreamPreamble & ZmqStreamParser::getPreamble() const {
+	return preamble;
+}
+
+inline void ZmqStreamParser::reset() {
+	preambleReceived = !expectPreamble;
+	malformed = false;
+	headSize = 0;
+	payload.rebuild();
+	payloadReceived = 0;
+	messages.clear();
+}
+
+#endif // _ZMQ_STREAM_H_
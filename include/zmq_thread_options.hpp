@@ -0,0 +1,179 @@
+#ifndef _ZMQ_THREAD_OPTIONS_H_
+#define _ZMQ_THREAD_OPTIONS_H_
+
+#include <zmq.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/// Scheduling options for threads serving ZmqClient objects
+/// Pinning the threads also keeps their memory local on NUMA machines - buffers and transports are allocated by the
+/// loop thread and received messages by the zmq I/O threads, so with the default first touch policy they come from
+/// the node of the pinned CPUs
+struct ZmqThreadOptions {
+	ZmqThreadOptions()
+	    : priority(0)
+	{}
+
+	std::vector<int> cpus; ///< CPUs the thread may run on, empty to not pin it
+	std::string name; ///< Name shown in top, perf and debuggers, Linux keeps 15 characters, empty for default
+	int priority; ///< Real time priority 1 - 99, SCHED_FIFO on Linux, 0 keeps the default scheduling
+};
+
+
+/// Check if a thread of this process may use real time priority
+inline bool zmqCanUseRealtimePriority(int priority) {
+#if defined(__linux__)
+	// try in a throw away thread, so the calling thread keeps it's scheduling
+	bool allowed = false;
+	std::thread probe([priority, &allowed]() {
+		sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = priority;
+		allowed = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+	});
+	probe.join();
+	return allowed;
+#else
+	(void)priority;
+	return false;
+#endif
+}
+
+/// Apply options to the calling thread
+/// @return - false if any option could not be applied, e.g. real time priority needs CAP_SYS_NICE on Linux
+inline bool zmqApplyThreadOptions(const ZmqThreadOptions & options) {
+	bool applied = true;
+
+#ifdef _WIN32
+	if (!options.cpus.empty()) {
+		DWORD_PTR mask = 0;
+		for (int cpu : options.cpus) {
+			if (cpu >= 0 && cpu < static_cast<int>(sizeof(mask) * 8)) {
+				mask |= DWORD_PTR(1) << cpu;
+			}
+		}
+		if (!mask || !SetThreadAffinityMask(GetCurrentThread(), mask)) {
+			puts("ZMQ failed to set thread affinity");
+			applied = false;
+		}
+	}
+	if (options.priority > 0) {
+		const int level = options.priority >= 90 ? THREAD_PRIORITY_TIME_CRITICAL
+		                : options.priority >= 50 ? THREAD_PRIORITY_HIGHEST
+		                : THREAD_PRIORITY_ABOVE_NORMAL;
+		if (!SetThreadPriority(GetCurrentThread(), level)) {
+			puts("ZMQ failed to set thread priority");
+			applied = false;
+		}
+	}
+#elif defined(__linux__)
+	if (!options.name.empty() && pthread_setname_np(pthread_self(), options.name.substr(0, 15).c_str()) != 0) {
+		printf("ZMQ failed to set thread name [%s]\n", options.name.c_str());
+		applied = false;
+	}
+	if (!options.cpus.empty()) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (int cpu : options.cpus) {
+			if (cpu >= 0 && cpu < CPU_SETSIZE) {
+				CPU_SET(cpu, &cpus);
+			}
+		}
+		const int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (result != 0) {
+			printf("ZMQ failed to set thread affinity: %s\n", strerror(result));
+			applied = false;
+		}
+	}
+	if (options.priority > 0) {
+		sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = options.priority;
+		const int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (result != 0) {
+			printf("ZMQ failed to set real time priority %d: %s\n", options.priority, strerror(result));
+			applied = false;
+		}
+	}
+#elif defined(__APPLE__)
+	if (!options.name.empty()) {
+		pthread_setname_np(options.name.c_str());
+	}
+	if (!options.cpus.empty() || options.priority > 0) {
+		puts("ZMQ thread affinity and priority are not supported on this platform");
+		applied = false;
+	}
+#endif
+
+	return applied;
+}
+
+/// Apply options to the I/O threads of zmq context, call before the first socket of the context is created
+/// libzmq takes only a number as name prefix, the threads are named <name>/ZMQbg/IO/<index>
+/// Options libzmq would fail on are skipped, since it aborts if it can't apply them
+/// @return - false if any option could not be applied
+inline bool zmqApplyContextThreadOptions(zmq::context_t & context, const ZmqThreadOptions & options) {
+	void * ctx = static_cast<void *>(context);
+	bool applied = true;
+
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+#endif
+	for (int cpu : options.cpus) {
+#ifdef __linux__
+		if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) {
+			printf("ZMQ CPU %d is not available for the I/O threads\n", cpu);
+			applied = false;
+			continue;
+		}
+#endif
+		applied = zmq_ctx_set(ctx, ZMQ_THREAD_AFFINITY_CPU_ADD, cpu) == 0 && applied;
+	}
+#else
+	applied = options.cpus.empty();
+#endif
+
+#ifdef ZMQ_THREAD_NAME_PREFIX
+	if (!options.name.empty()) {
+		if (options.name.find_first_not_of("0123456789") == std::string::npos && options.name.size() < 9) {
+			applied = zmq_ctx_set(ctx, ZMQ_THREAD_NAME_PREFIX, atoi(options.name.c_str())) == 0 && applied;
+		} else {
+			printf("ZMQ I/O thread name prefix must be a number, [%s] ignored\n", options.name.c_str());
+			applied = false;
+		}
+	}
+#endif
+
+#if defined(ZMQ_THREAD_PRIORITY) && defined(ZMQ_THREAD_SCHED_POLICY) && defined(__linux__)
+	if (options.priority > 0) {
+		if (zmqCanUseRealtimePriority(options.priority)) {
+			applied = zmq_ctx_set(ctx, ZMQ_THREAD_SCHED_POLICY, SCHED_FIFO) == 0 && applied;
+			applied = zmq_ctx_set(ctx, ZMQ_THREAD_PRIORITY, options.priority) == 0 && applied;
+		} else {
+			printf("ZMQ real time priority %d is not allowed for the I/O threads\n", options.priority);
+			applied = false;
+		}
+	}
+#else
+	applied = options.priority <= 0 && applied;
+#endif
+
+	return applied;
+}
+
+#endif // _ZMQ_THREAD_OPTIONS_H_
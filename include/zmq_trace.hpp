@@ -0,0 +1,317 @@
+#ifndef _ZMQ_TRACE_H_
+#define _ZMQ_TRACE_H_
+
+#include <zmq.hpp>
+
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include "mapped_file.hpp"
+
+/// Header at the start of every trace file
+struct ZmqTraceFileHeader {
+	enum : uint32_t {
+		MAGIC = 0x52545a56, // "VZTR"
+		FORMAT_VERSION = 1,
+	};
+
+	uint32_t magic; ///< Must be MAGIC
+	uint32_t formatVersion; ///< Must be FORMAT_VERSION
+	uint64_t dataSize; ///< Number of bytes of records following the header
+	uint64_t recordCount; ///< Number of records following the header
+};
+
+/// Header preceding each record, followed by the control bytes then payload bytes and padding to 8 bytes
+struct ZmqTraceRecordHeader {
+	uint64_t timestamp; ///< Nanoseconds since the trace was opened
+	uint32_t direction; ///< ZmqTraceDirection
+	uint32_t controlSize; ///< Number of bytes in the control frame
+	uint64_t payloadSize; ///< Number of bytes in the payload frame
+};
+
+enum class ZmqTraceDirection : uint32_t {
+	Outgoing = 0,
+	Incoming = 1,
+};
+
+/// View of one record inside mapped trace file
+struct ZmqTraceRecord {
+	uint64_t timestamp; ///< Nanoseconds since the trace was opened
+	ZmqTraceDirection direction; ///< If the message was sent or received by the client
+	const char * control; ///< Pointer to the control frame bytes
+	size_t controlSize; ///< Number of bytes in the control frame
+	const char * payload; ///< Pointer to the payload frame bytes
+	size_t payloadSize; ///< Number of bytes in the payload frame
+};
+
+
+/// Append only writer of (control, payload) frame pairs to a memory mapped file
+/// All methods are thread safe, records are written in the order ::record is called
+class ZmqTraceWriter {
+public:
+	ZmqTraceWriter();
+	~ZmqTraceWriter();
+
+	ZmqTraceWriter(const ZmqTraceWriter &) = delete;
+	ZmqTraceWriter &operator=(const ZmqTraceWriter &) = delete;
+
+	/// Create the trace file, the timestamps of records are relative to the time of this call
+	/// @path - path to the file, will be overwritten if it exists
+	/// @return - true on success
+	bool open(const char * path);
+
+	/// Close the file truncating it to the written records
+	void close();
+
+	/// Check if the trace is opened and writable
+	bool good() const;
+
+	/// Append a record to the trace, nop if the trace is not opened
+	/// @direction - if the frames were sent or received
+	/// @control - the control frame
+	/// @payload - the payload frame
+	void record(ZmqTraceDirection direction, const zmq::message_t & control, const zmq::message_t & payload);
+
+	/// Get the number of records written so far
+	uint64_t getRecordCount() const;
+
+private:
+	typedef std::chrono::high_resolution_clock::time_point time_point;
+
+	/// Get the header at the start of the mapping
+	ZmqTraceFileHeader & header();
+
+	static const size_t INITIAL_SIZE = 16 << 20;
+	static const size_t MAX_GROW_SIZE = 1 << 30;
+
+	MappedFile file; ///< The mapped trace file
+	size_t writeOffset; ///< Offset in the file where the next record will be written
+	time_point startTime; ///< Time the trace was opened
+	mutable std::mutex writeMutex; ///< Mutex protecting @file and @writeOffset
+};
+
+
+/// Sequential reader of trace files created by ZmqTraceWriter
+/// Records point directly into the mapped file and are valid until the reader is closed
+class ZmqTraceReader {
+public:
+	ZmqTraceReader();
+
+	ZmqTraceReader(const ZmqTraceReader &) = delete;
+	ZmqTraceReader &operator=(const ZmqTraceReader &) = delete;
+
+	/// Map an existing trace file
+	/// @path - path to the trace file
+	/// @return - true if the file was mapped and has valid header
+	bool open(const char * path);
+
+	/// Unmap the trace file
+	void close();
+
+	/// Get the next record
+	/// @record - filled with the next record
+	/// @return - false if there are no more records
+	bool next(ZmqTraceRecord & record);
+
+	/// Start reading records from the start of the trace
+	void rewind();
+
+	/// Get the number of records in the trace
+	uint64_t getRecordCount() const;
+
+private:
+	MappedFile file; ///< The mapped trace file
+	size_t readOffset; ///< Offset of the next record to be read
+	size_t endOffset; ///< Offset after the last record in the file
+	uint64_t recordCount; ///< Number of records in the file
+};
+
+
+/// Round up @size to multiple of 8 so record headers stay aligned
+inline size_t zmqTraceAlign(size_t size) {
+	return (size + 7) & ~static_cast<size_t>(7);
+}
+
+
+inline ZmqTraceWriter::ZmqTraceWriter()
+    : writeOffset(0)
+{}
+
+inline ZmqTraceWriter::~ZmqTraceWriter() {
+	close();
+}
+
+inline bool ZmqTraceWriter::open(const char * path) {
+	std::lock_guard<std::mutex> lock(writeMutex);
+	if (!file.open(path, MappedFile::Mode::Write, INITIAL_SIZE)) {
+		return false;
+	}
+
+	ZmqTraceFileHeader & fileHeader = header();
+	fileHeader.magic = ZmqTraceFileHeader::MAGIC;
+	fileHeader.formatVersion = ZmqTraceFileHeader::FORMAT_VERSION;
+	fileHeader.dataSize = 0;
+	fileHeader.recordCount = 0;
+
+	writeOffset = sizeof(ZmqTraceFileHeader);
+	startTime = std::chrono::high_resolution_clock::now();
+	return true;
+}
+
+inline void ZmqTraceWriter::close() {
+	std::lock_guard<std::mutex> lock(writeMutex);
+	if (file.good()) {
+		file.close(writeOffset);
+	}
+}
+
+inline bool ZmqTraceWriter::good() const {
+	std::lock_guard<std::mutex> lock(writeMutex);
+	return file.good();
+}
+
+inline uint64_t ZmqTraceWriter::getRecordCount() const {
+	std::lock_guard<std::mutex> lock(writeMutex);
+	if (!file.good()) {
+		return 0;
+	}
+	return reinterpret_cast<const ZmqTraceFileHeader *>(file.data())->recordCount;
+}
+
+inline ZmqTraceFileHeader & ZmqTraceWriter::header() {
+	return *reinterpret_cast<ZmqTraceFileHeader *>(file.data());
+}
+
+inline void ZmqTraceWriter::record(ZmqTraceDirection direction, const zmq::message_t & control, const zmq::message_t & payload) {
+	using namespace std::chrono;
+	std::lock_guard<std::mutex> lock(writeMutex);
+	if (!file.good()) {
+		return;
+	}
+	// taken under the lock so timestamps grow in the order records are written
+	const uint64_t timestamp = duration_cast<nanoseconds>(high_resolution_clock::now() - startTime).count();
+
+	const size_t recordSize = zmqTraceAlign(sizeof(ZmqTraceRecordHeader) + control.size() + payload.size());
+	if (writeOffset + recordSize > file.size()) {
+		size_t newSize = file.size();
+		while (writeOffset + recordSize > newSize) {
+			if (newSize < MAX_GROW_SIZE) {
+				newSize *= 2;
+			} else {
+				newSize += MAX_GROW_SIZE;
+			}
+		}
+		if (!file.resize(newSize)) {
+			puts("ZMQ trace failed to grow file, stopping trace");
+			return;
+		}
+	}
+
+	char * dest = file.data() + writeOffset;
+
+	ZmqTraceRecordHeader recordHeader;
+	recordHeader.timestamp = timestamp;
+	recordHeader.direction = static_cast<uint32_t>(direction);
+	recordHeader.controlSize = static_cast<uint32_t>(control.size());
+	recordHeader.payloadSize = payload.size();
+
+	memcpy(dest, &recordHeader, sizeof(recordHeader));
+	dest += sizeof(recordHeader);
+	memcpy(dest, control.data(), control.size());
+	dest += control.size();
+	memcpy(dest, payload.data(), payload.size());
+
+	writeOffset += recordSize;
+
+	// header is updated last so a partially written record is never visible to readers
+	ZmqTraceFileHeader & fileHeader = header();
+	fileHeader.dataSize = writeOffset - sizeof(ZmqTraceFileHeader);
+	++fileHeader.recordCount;
+}
+
+
+inline ZmqTraceReader::ZmqTraceReader()
+    : readOffset(0)
+    , endOffset(0)
+    , recordCount(0)
+{}
+
+inline bool ZmqTraceReader::open(const char * path) {
+	close();
+	if (!file.open(path, MappedFile::Mode::Read)) {
+		return false;
+	}
+
+	if (file.size() < sizeof(ZmqTraceFileHeader)) {
+		printf("ZMQ trace [%s] is too small\n", path);
+		close();
+		return false;
+	}
+
+	ZmqTraceFileHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != ZmqTraceFileHeader::MAGIC || header.formatVersion != ZmqTraceFileHeader::FORMAT_VERSION) {
+		printf("ZMQ trace [%s] has invalid header\n", path);
+		close();
+		return false;
+	}
+
+	if (header.dataSize > file.size() - sizeof(ZmqTraceFileHeader)) {
+		printf("ZMQ trace [%s] is truncated\n", path);
+		close();
+		return false;
+	}
+
+	recordCount = header.recordCount;
+	endOffset = sizeof(ZmqTraceFileHeader) + header.dataSize;
+	readOffset = sizeof(ZmqTraceFileHeader);
+	return true;
+}
+
+inline void ZmqTraceReader::close() {
+	file.close();
+	readOffset = endOffset = 0;
+	recordCount = 0;
+}
+
+inline bool ZmqTraceReader::next(ZmqTraceRecord & record) {
+	if (readOffset + sizeof(ZmqTraceRecordHeader) > endOffset) {
+		return false;
+	}
+
+	ZmqTraceRecordHeader header;
+	memcpy(&header, file.data() + readOffset, sizeof(header));
+
+	const uint64_t bodySize = static_cast<uint64_t>(header.controlSize) + header.payloadSize;
+	if (bodySize > endOffset - readOffset - sizeof(header)) {
+		puts("ZMQ trace record exceeds file size, stopping read");
+		readOffset = endOffset;
+		return false;
+	}
+
+	const char * body = file.data() + readOffset + sizeof(header);
+	record.timestamp = header.timestamp;
+	record.direction = static_cast<ZmqTraceDirection>(header.direction);
+	record.control = body;
+	record.controlSize = header.controlSize;
+	record.payload = body + header.controlSize;
+	record.payloadSize = static_cast<size_t>(header.payloadSize);
+
+	readOffset += zmqTraceAlign(sizeof(header) + static_cast<size_t>(bodySize));
+	return true;
+}
+
+inline void ZmqTraceReader::rewind() {
+	if (file.good()) {
+		readOffset = sizeof(ZmqTraceFileHeader);
+	}
+}
+
+inline uint64_t ZmqTraceReader::getRecordCount() const {
+	return recordCount;
+}
+
+#endif // _ZMQ_TRACE_H_
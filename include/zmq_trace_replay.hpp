@@ -0,0 +1,102 @@
+#ifndef _ZMQ_TRACE_REPLAY_H_
+#define _ZMQ_TRACE_REPLAY_H_
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "zmq_wrapper.hpp"
+#include "zmq_trace.hpp"
+
+enum class ZmqReplaySpeed {
+	Original, ///< Send messages with the same delays between them as when they were recorded
+	Maximum, ///< Send messages as fast as the client can queue them
+};
+
+/// Re-send all outgoing data messages from a trace through a client, with the transactions they were sent in
+/// Parts of a chunked message are collected until it's last part and sent with ZmqClient::sendChunked, split in chunks
+/// of the size of the first part. Handshake, ping and stop frames are not replayed since the client generates them itself
+/// A commit without begin, from a trace started in the middle of a transaction, is skipped, and a transaction the
+/// trace ends in is left open on the client as it was when recorded
+/// @client - connected client to send through
+/// @reader - opened trace reader, read from it's current position
+/// @speed - replay with the recorded timing or as fast as possible
+/// @return - number of messages queued for sending
+inline uint64_t zmqReplayTrace(ZmqClient & client, ZmqTraceReader & reader, ZmqReplaySpeed speed) {
+	using namespace std::chrono;
+
+	uint64_t replayed = 0;
+	bool haveFirst = false;
+	uint64_t firstTimestamp = 0;
+	const auto replayStart = high_resolution_clock::now();
+	// parts of chunked messages by their id, they point in the mapped trace so they are not copied
+	std::unordered_map<int, std::vector<std::pair<const char *, size_t>>> chunked;
+	bool inTransaction = false;
+
+	ZmqTraceRecord record;
+	while (reader.next(record) && client.good()) {
+		if (record.direction != ZmqTraceDirection::Outgoing) {
+			continue;
+		}
+
+		ControlFrame frame(zmq::message_t(record.control, record.controlSize));
+		const bool chunk = frame.control == ControlMessage::CHUNK_MSG || frame.control == ControlMessage::CHUNK_END_MSG;
+		const bool transaction = frame.control == ControlMessage::TRANSACTION_BEGIN_MSG ||
+		                         frame.control == ControlMessage::TRANSACTION_COMMIT_MSG;
+		if (!frame || (frame.control != ControlMessage::DATA_MSG && !chunk && !transaction)) {
+			continue;
+		}
+
+		if (speed == ZmqReplaySpeed::Original) {
+			if (!haveFirst) {
+				haveFirst = true;
+				firstTimestamp = record.timestamp;
+			}
+			const auto sendTime = replayStart + nanoseconds(record.timestamp - firstTimestamp);
+			std::this_thread::sleep_until(sendTime);
+		}
+
+		if (frame.control == ControlMessage::TRANSACTION_BEGIN_MSG) {
+			// the trace has only the outermost begin and commit, so there is no nesting
+			if (!inTransaction) {
+				inTransaction = true;
+				client.beginTransaction();
+			}
+			continue;
+		} else if (frame.control == ControlMessage::TRANSACTION_COMMIT_MSG) {
+			if (!inTransaction) {
+				continue;
+			}
+			inTransaction = false;
+			int action = VRayBaseTypes::CommitNow;
+			if (record.payloadSize == sizeof(action)) {
+				memcpy(&action, record.payload, sizeof(action));
+			}
+			client.commitTransaction(static_cast<VRayBaseTypes::CommitAction>(action));
+			continue;
+		} else if (chunk) {
+			std::vector<std::pair<const char *, size_t>> & parts = chunked[frame.requestId];
+			parts.push_back(std::make_pair(record.payload, record.payloadSize));
+			if (frame.control == ControlMessage::CHUNK_MSG) {
+				continue;
+			}
+			const size_t chunkSize = parts.front().second ? parts.front().second : CHUNK_SIZE;
+			client.sendChunked([&parts](SerializerStream & stream) {
+				for (const auto & part : parts) {
+					stream.write(part.first, part.second);
+				}
+			}, chunkSize);
+			chunked.erase(frame.requestId);
+		} else {
+			client.send(record.payload, record.payloadSize);
+		}
+		++replayed;
+	}
+
+	return replayed;
+}
+
+#endif // _ZMQ_TRACE_REPLAY_H_
@@ -0,0 +1,117 @@
+#ifndef _ZMQ_TRANSPORT_H_
+#define _ZMQ_TRANSPORT_H_
+
+#include <zmq.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+/// Connection used by ZmqClient to exchange messages with the server, each message is a control and a payload frame
+/// All methods are called only from the loop thread of the client's runtime, errors are reported by throwing
+/// zmq::error_t same as the zmq socket does
+/// A new transport is created for each connection, including reconnects
+class ZmqTransport {
+public:
+	virtual ~ZmqTransport() {}
+
+	/// Connect to the server, does not wait for it
+	/// @endpoint - address of the server
+	/// @identity - identity of the client, same for all connections of one client
+	virtual void connect(const std::string & endpoint, uint64_t identity) = 0;
+
+	/// Close the connection, discarding anything not sent yet
+	virtual void close() = 0;
+
+	/// Send control and payload frames as one message without blocking
+	/// @return - false if the message can't be sent now, the frames are not modified
+	virtual bool send(zmq::message_t & control, zmq::message_t & payload) = 0;
+
+	/// Receive one message without blocking
+	/// @payload - left empty if the message has only control frame
+	/// @return - false if there is no message
+	virtual bool recv(zmq::message_t & control, zmq::message_t & payload) = 0;
+
+	/// Fill item for the zmq::poll call of the runtime
+	/// @events - ZMQ_POLLIN and ZMQ_POLLOUT bits the client waits for
+	/// @return - false if there is nothing to poll, then readiness is reported only by ::getReadyEvents
+	virtual bool getPollItem(zmq::pollitem_t & item, short events) = 0;
+
+	/// Get events that are ready without polling, the runtime does not sleep while any are reported
+	/// @events - ZMQ_POLLIN and ZMQ_POLLOUT bits the client waits for
+	virtual short getReadyEvents(short events) = 0;
+
+	/// Set function that wakes the runtime, needed by transports that become ready from other threads
+	virtual void setWake(std::function<void()> /*wake*/) {}
+};
+
+/// Creates the transport for a connection, called on the loop thread
+typedef std::function<std::unique_ptr<ZmqTransport>(zmq::context_t & context)> ZmqTransportFactory;
+
+
+/// The default transport - zmq DEALER socket
+class ZmqSocketTransport: public ZmqTransport {
+public:
+	/// Create the socket
+	/// @context - the context of the client's runtime
+	explicit ZmqSocketTransport(zmq::context_t & context);
+
+	void connect(const std::string & endpoint, uint64_t identity) override;
+	void close() override;
+	bool send(zmq::message_t & control, zmq::message_t & payload) override;
+	bool recv(zmq::message_t & control, zmq::message_t & payload) override;
+	bool getPollItem(zmq::pollitem_t & item, short events) override;
+	short getReadyEvents(short events) override;
+
+private:
+	zmq::socket_t socket; ///< The DEALER socket
+};
+
+
+inline ZmqSocketTransport::ZmqSocketTransport(zmq::context_t & context)
+    : socket(context, ZMQ_DEALER)
+{
+	int linger = 0;
+	socket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+}
+
+inline void ZmqSocketTransport::connect(const std::string & endpoint, uint64_t identity) {
+	socket.setsockopt(ZMQ_IDENTITY, &identity, sizeof(identity));
+	socket.connect(endpoint.c_str());
+}
+
+inline void ZmqSocketTransport::close() {
+	socket.close();
+}
+
+inline bool ZmqSocketTransport::send(zmq::message_t & control, zmq::message_t & payload) {
+	if (!socket.send(control, ZMQ_SNDMORE | ZMQ_DONTWAIT)) {
+		return false;
+	}
+	// once the first part is accepted the rest of the message is accepted too
+	socket.send(payload, ZMQ_DONTWAIT);
+	return true;
+}
+
+inline bool ZmqSocketTransport::recv(zmq::message_t & control, zmq::message_t & payload) {
+	if (!socket.recv(&control, ZMQ_DONTWAIT)) {
+		return false;
+	}
+	if (control.more()) {
+		socket.recv(&payload);
+	}
+	return true;
+}
+
+inline bool ZmqSocketTransport::getPollItem(zmq::pollitem_t & item, short events) {
+	zmq::pollitem_t socketItem = {socket, 0, events, 0};
+	item = socketItem;
+	return true;
+}
+
+inline short ZmqSocketTransport::getReadyEvents(short) {
+	return 0;
+}
+
+#endif // _ZMQ_TRANSPORT_H_
@@ -0,0 +1,754 @@
+#ifndef _ZMQ_URING_TRANSPORT_H_
+#define _ZMQ_URING_TRANSPORT_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "zmq_stream.hpp"
+#include "zmq_transport.hpp"
+
+#ifdef __linux__
+
+#include <cerrno>
+
+#include <linux/io_uring.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/// Number of submission queue entries, only a few are used at a time
+static const unsigned URING_QUEUE_DEPTH = 32;
+/// Small messages are copied into registered staging buffers and sent together
+static const size_t URING_STAGING_SIZE = 1 << 20;
+static const int URING_STAGING_BUFFERS = 4;
+/// Larger payloads are sent directly from the message with zero copy send
+static const size_t URING_ZC_MIN_PAYLOAD = 64 << 10;
+/// ::send refuses messages while more than this many bytes are waiting to be sent
+static const size_t URING_MAX_PENDING = 64 << 20;
+/// Time in milliseconds ::close waits for the kernel to finish with the memory of operations in flight
+static const int URING_CLOSE_TIMEOUT = 1000;
+/// Size of the receive buffer, messages are parsed out of it after each receive
+static const size_t URING_RECV_BUFFER = 1 << 20;
+
+/// Transport sending ControlFrame + payload messages over plain TCP using io_uring, for bulk scene upload
+/// Small messages are batched into staging buffers registered with the ring, large payloads are sent with zero copy
+/// send straight from the zmq message, which is kept alive until the kernel is done with it
+/// Only one send is in flight at a time so the stream keeps the order of the messages, the kernel retries partial
+/// sends (MSG_WAITALL) and the batching keeps the syscall count low
+/// The runtime polls the ring's file descriptor, it becomes readable when any operation completes
+/// Address is tcp://<host>:<port>, the server must speak the ZmqStreamPreamble / ZmqStreamFrameHeader framing, as
+/// ZmqServer does on the address set with ZmqServer::setStreamAddress
+/// Note: requires Linux 6.0 for zero copy send, falls back to copying send if it is not supported or the server is
+/// on the loopback interface, unless zero copy is forced
+class ZmqUringTransport: public ZmqTransport {
+public:
+	/// @forceZeroCopy - use zero copy send even to loopback, where the kernel copies anyway, to measure it's overhead
+	explicit ZmqUringTransport(bool forceZeroCopy = false);
+	~ZmqUringTransport();
+
+	ZmqUringTransport(const ZmqUringTransport &) = delete;
+	ZmqUringTransport &operator=(const ZmqUringTransport &) = delete;
+
+	/// Create factory for ZmqClient::setTransportFactory
+	/// @forceZeroCopy - see the constructor
+	static ZmqTransportFactory factory(bool forceZeroCopy = false);
+
+	/// Get number of payload bytes sent with zero copy, can be called from any thread
+	uint64_t getZeroCopyBytes() const;
+
+	void connect(const std::string & endpoint, uint64_t identity) override;
+	void close() override;
+	bool send(zmq::message_t & control, zmq::message_t & payload) override;
+	bool recv(zmq::message_t & control, zmq::message_t & payload) override;
+	bool getPollItem(zmq::pollitem_t & item, short events) override;
+	short getReadyEvents(short events) override;
+
+private:
+	/// Kind of operation, stored in the low bits of the user data of the submission
+	enum Operation {
+		OpConnect = 1,
+		OpRecv = 2,
+		OpSend = 3,
+	};
+
+	/// Contiguous bytes sent with one or more send operations
+	struct Segment {
+		Segment()
+		    : sequence(0)
+		    , buffer(-1)
+		    , data(nullptr)
+		    , size(0)
+		    , sent(0)
+		    , notifications(0)
+		{}
+
+		uint64_t sequence; ///< Identifies the segment in the user data of it's sends
+		int buffer; ///< Index of the staging buffer, -1 if the bytes are in @message
+		zmq::message_t message; ///< Payload sent in place, kept until the kernel releases it
+		const char * data; ///< Start of the bytes
+		size_t size; ///< Number of bytes
+		size_t sent; ///< Bytes already sent
+		int notifications; ///< Zero copy notifications not yet received, the memory is in use until they arrive
+	};
+
+	/// Map the rings and register the staging buffers
+	/// @return - false on error, errno is set
+	bool setupRing();
+	/// Get a free submission entry, null if the queue is full
+	io_uring_sqe * getEntry();
+	/// Pass all prepared entries to the kernel
+	void submit();
+	/// Handle all completions
+	void reap();
+	/// Handle one completion
+	void complete(uint64_t userData, int result, unsigned flags);
+	/// Start sending the next segment if nothing is being sent
+	void pump();
+	/// Start receiving into @recvBuffer
+	void startRecv();
+	/// Queue the staging buffer being filled for sending
+	void flushStaging();
+	/// Reserve bytes in the staging buffer being filled
+	/// @return - null if there is no free staging buffer
+	char * reserveStaging(size_t size);
+	/// Release sent segments the kernel no longer uses
+	void releaseSegments();
+	/// Wait until no operation is in flight and all zero copy notifications arrived, or URING_CLOSE_TIMEOUT passes
+	/// @return - false on timeout, the kernel may still use the memory of the segments and @recvBuffer
+	bool waitForKernel();
+	/// Leak the memory of the segments and @recvBuffer, so it is neither freed nor reused while the kernel may use it
+	void abandonMemory();
+	/// Remember the first error, it is thrown from ::send and ::recv
+	void fail(int error);
+	/// Throw the remembered error if there is one
+	void checkError() const;
+
+	int ringFd; ///< The io_uring file descriptor
+	int socketFd; ///< The TCP socket
+	void * sqRing; ///< Mapping of the submission ring
+	void * cqRing; ///< Mapping of the completion ring, same as @sqRing with single mmap
+	size_t sqRingSize; ///< Size of @sqRing mapping
+	size_t cqRingSize; ///< Size of @cqRing mapping
+	io_uring_sqe * sqes; ///< Mapping of the submission entries
+	size_t sqesSize; ///< Size of @sqes mapping
+	unsigned * sqHead; ///< Submission ring head, advanced by the kernel
+	unsigned * sqTail; ///< Submission ring tail, advanced by us
+	unsigned sqMask; ///< Mask for submission ring indices
+	unsigned * sqArray; ///< Indices of the submitted entries
+	unsigned * sqFlags; ///< Submission ring flags, tell if completions overflowed
+	unsigned * cqHead; ///< Completion ring head, advanced by us
+	unsigned * cqTail; ///< Completion ring tail, advanced by the kernel
+	unsigned cqMask; ///< Mask for completion ring indices
+	io_uring_cqe * cqes; ///< The completion entries
+	unsigned toSubmit; ///< Entries prepared since the last submit
+
+	sockaddr_storage peerAddress; ///< Address being connected to, must live until the connect completes
+	socklen_t peerAddressSize; ///< Size of @peerAddress
+	bool connected; ///< Set when the connect completes
+	const bool forceZeroCopy; ///< Use zero copy send to loopback too
+	bool zeroCopySupported; ///< Cleared if the kernel does not support zero copy send
+	bool zeroCopy; ///< True if the sends of this connection use zero copy
+	bool buffersRegistered; ///< True if the staging buffers are registered with the ring
+	int error; ///< First error, 0 if none
+
+	std::vector<std::unique_ptr<char[]>> staging; ///< The staging buffers
+	std::vector<int> freeStaging; ///< Indices of staging buffers not in use
+	int fillBuffer; ///< Index of the staging buffer being filled, -1 if none
+	size_t fillSize; ///< Bytes in the staging buffer being filled
+
+	std::deque<Segment> outgoing; ///< Segments waiting to be sent, the front one is being sent if @sending
+	std::deque<Segment> inUse; ///< Sent segments waiting for zero copy notifications
+	uint64_t nextSequence; ///< Sequence for the next segment
+	bool sending; ///< True if a send operation is in flight
+	size_t pendingBytes; ///< Bytes queued and not yet sent
+	std::atomic<uint64_t> zeroCopyBytes; ///< Payload bytes sent with zero copy
+
+	std::vector<char> recvBuffer; ///< Buffer for the recv operation
+	bool receiving; ///< True if a recv operation is in flight
+	ZmqStreamParser parser; ///< Splits the received bytes into messages waiting for ::recv
+};
+
+
+inline ZmqUringTransport::ZmqUringTransport(bool forceZeroCopy)
+    : ringFd(-1)
+    , socketFd(-1)
+    , sqRing(MAP_FAILED)
+    , cqRing(MAP_FAILED)
+    , sqRingSize(0)
+    , cqRingSize(0)
+    , sqes(nullptr)
+    , sqesSize(0)
+    , sqHead(nullptr)
+    , sqTail(nullptr)
+    , sqMask(0)
+    , sqArray(nullptr)
+    , sqFlags(nullptr)
+    , cqHead(nullptr)
+    , cqTail(nullptr)
+    , cqMask(0)
+    , cqes(nullptr)
+    , toSubmit(0)
+    , peerAddressSize(0)
+    , connected(false)
+    , forceZeroCopy(forceZeroCopy)
+    , zeroCopySupported(true)
+    , zeroCopy(true)
+    , buffersRegistered(false)
+    , error(0)
+    , fillBuffer(-1)
+    , fillSize(0)
+    , nextSequence(0)
+    , sending(false)
+    , pendingBytes(0)
+    , zeroCopyBytes(0)
+    , recvBuffer(URING_RECV_BUFFER)
+    , receiving(false)
+    , parser(false)
+{
+	memset(&peerAddress, 0, sizeof(peerAddress));
+	for (int c = 0; c < URING_STAGING_BUFFERS; ++c) {
+		staging.push_back(std::unique_ptr<char[]>(new char[URING_STAGING_SIZE]));
+		freeStaging.push_back(c);
+	}
+}
+
+inline ZmqUringTransport::~ZmqUringTransport() {
+	close();
+}
+
+inline ZmqTransportFactory ZmqUringTransport::factory(bool forceZeroCopy) {
+	return [forceZeroCopy](zmq::context_t &) {
+		return std::unique_ptr<ZmqTransport>(new ZmqUringTransport(forceZeroCopy));
+	};
+}
+
+inline uint64_t ZmqUringTransport::getZeroCopyBytes() const {
+	return zeroCopyBytes;
+}
+
+inline bool ZmqUringTransport::setupRing() {
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	ringFd = static_cast<int>(syscall(__NR_io_uring_setup, URING_QUEUE_DEPTH, &params));
+	if (ringFd < 0) {
+		ringFd = -1;
+		return false;
+	}
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMap) {
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+	}
+
+	sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED) {
+		return false;
+	}
+	cqRing = singleMap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+	if (cqRing == MAP_FAILED) {
+		return false;
+	}
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void * entries = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (entries == MAP_FAILED) {
+		return false;
+	}
+	sqes = reinterpret_cast<io_uring_sqe *>(entries);
+
+	char * sq = reinterpret_cast<char *>(sqRing);
+	char * cq = reinterpret_cast<char *>(cqRing);
+	sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+	sqFlags = reinterpret_cast<unsigned *>(sq + params.sq_off.flags);
+	cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+	iovec buffers[URING_STAGING_BUFFERS];
+	for (int c = 0; c < URING_STAGING_BUFFERS; ++c) {
+		buffers[c].iov_base = staging[c].get();
+		buffers[c].iov_len = URING_STAGING_SIZE;
+	}
+	// pinning can fail when the locked memory limit is low, the buffers then work as plain memory
+	buffersRegistered = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers, URING_STAGING_BUFFERS) == 0;
+	if (!buffersRegistered) {
+		printf("ZMQ io_uring failed to register buffers [%s], sending without them\n", strerror(errno));
+	}
+	return true;
+}
+
+inline io_uring_sqe * ZmqUringTransport::getEntry() {
+	const unsigned tail = *sqTail + toSubmit;
+	if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > sqMask) {
+		return nullptr;
+	}
+	const unsigned index = tail & sqMask;
+	io_uring_sqe * entry = &sqes[index];
+	memset(entry, 0, sizeof(*entry));
+	sqArray[index] = index;
+	++toSubmit;
+	return entry;
+}
+
+inline void ZmqUringTransport::submit() {
+	if (!toSubmit) {
+		return;
+	}
+	__atomic_store_n(sqTail, *sqTail + toSubmit, __ATOMIC_RELEASE);
+	const unsigned count = toSubmit;
+	toSubmit = 0;
+	if (syscall(__NR_io_uring_enter, ringFd, count, 0, 0, nullptr, 0) < 0) {
+		fail(errno);
+	}
+}
+
+inline void ZmqUringTransport::reap() {
+	if (ringFd == -1) {
+		return;
+	}
+	// completions that did not fit the ring are kept by the kernel until we ask for them
+	if (__atomic_load_n(sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) {
+		syscall(__NR_io_uring_enter, ringFd, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+	}
+
+	unsigned head = *cqHead;
+	const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head) {
+		const io_uring_cqe & entry = cqes[head & cqMask];
+		const uint64_t userData = entry.user_data;
+		const int result = entry.res;
+		const unsigned flags = entry.flags;
+		__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+		complete(userData, result, flags);
+	}
+	submit();
+}
+
+inline void ZmqUringTransport::complete(uint64_t userData, int result, unsigned flags) {
+	const int operation = static_cast<int>(userData & 3);
+	if (operation == OpConnect) {
+		if (result < 0) {
+			fail(-result);
+			return;
+		}
+		connected = true;
+		startRecv();
+		pump();
+		return;
+	}
+
+	if (operation == OpRecv) {
+		receiving = false;
+		if (result <= 0) {
+			fail(result == 0 ? ECONNRESET : -result);
+			return;
+		}
+		if (!parser.parse(recvBuffer.data(), static_cast<size_t>(result))) {
+			puts("ZMQ io_uring received malformed frame");
+			fail(EPROTO);
+			return;
+		}
+		startRecv();
+		return;
+	}
+
+	const uint64_t sequence = userData >> 2;
+	if (flags & IORING_CQE_F_NOTIF) {
+		// the kernel is done with the memory of one send of the segment
+		for (auto * segments : {&inUse, &outgoing}) {
+			for (auto & segment : *segments) {
+				if (segment.sequence == sequence) {
+					--segment.notifications;
+				}
+			}
+		}
+		releaseSegments();
+		return;
+	}
+
+	sending = false;
+	if (outgoing.empty() || outgoing.front().sequence != sequence) {
+		return;
+	}
+	Segment & segment = outgoing.front();
+	if (flags & IORING_CQE_F_MORE) {
+		++segment.notifications;
+	}
+
+	if (result < 0) {
+		if (zeroCopy && (result == -EINVAL || result == -EOPNOTSUPP)) {
+			puts("ZMQ io_uring zero copy send is not supported, using copying send");
+			zeroCopy = zeroCopySupported = false;
+			pump();
+			return;
+		}
+		fail(-result);
+		return;
+	}
+
+	segment.sent += result;
+	pendingBytes -= result;
+	if (zeroCopy && segment.buffer == -1) {
+		zeroCopyBytes.fetch_add(result, std::memory_order_relaxed);
+	}
+	if (segment.sent == segment.size) {
+		inUse.push_back(std::move(segment));
+		outgoing.pop_front();
+		releaseSegments();
+	}
+	pump();
+}
+
+inline void ZmqUringTransport::pump() {
+	if (sending || !connected || error) {
+		return;
+	}
+	if (outgoing.empty()) {
+		// nothing else is being sent, don't wait for the staging buffer to fill
+		flushStaging();
+		if (outgoing.empty()) {
+			return;
+		}
+	}
+
+	io_uring_sqe * entry = getEntry();
+	if (!entry) {
+		return;
+	}
+	const Segment & segment = outgoing.front();
+	entry->opcode = zeroCopy ? IORING_OP_SEND_ZC : IORING_OP_SEND;
+	entry->fd = socketFd;
+	entry->addr = reinterpret_cast<uint64_t>(segment.data + segment.sent);
+	entry->len = static_cast<uint32_t>(std::min<size_t>(segment.size - segment.sent, 1u << 30));
+	entry->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+	if (zeroCopy && buffersRegistered && segment.buffer != -1) {
+		entry->ioprio = IORING_RECVSEND_FIXED_BUF;
+		entry->buf_index = static_cast<uint16_t>(segment.buffer);
+	}
+	entry->user_data = (segment.sequence << 2) | OpSend;
+	sending = true;
+}
+
+inline void ZmqUringTransport::startRecv() {
+	if (receiving || !connected || error) {
+		return;
+	}
+	io_uring_sqe * entry = getEntry();
+	if (!entry) {
+		return;
+	}
+	entry->opcode = IORING_OP_RECV;
+	entry->fd = socketFd;
+	entry->addr = reinterpret_cast<uint64_t>(recvBuffer.data());
+	entry->len = static_cast<uint32_t>(recvBuffer.size());
+	entry->user_data = OpRecv;
+	receiving = true;
+}
+
+inline char * ZmqUringTransport::reserveStaging(size_t size) {
+	if (fillBuffer != -1 && fillSize + size > URING_STAGING_SIZE) {
+		flushStaging();
+	}
+	if (fillBuffer == -1) {
+		if (freeStaging.empty()) {
+			return nullptr;
+		}
+		fillBuffer = freeStaging.back();
+		freeStaging.pop_back();
+		fillSize = 0;
+	}
+	char * dest = staging[fillBuffer].get() + fillSize;
+	fillSize += size;
+	return dest;
+}
+
+inline void ZmqUringTransport::flushStaging() {
+	if (fillBuffer == -1) {
+		return;
+	}
+	Segment segment;
+	segment.sequence = nextSequence++;
+	segment.buffer = fillBuffer;
+	segment.data = staging[fillBuffer].get();
+	segment.size = fillSize;
+	outgoing.push_back(std::move(segment));
+	fillBuffer = -1;
+	fillSize = 0;
+}
+
+inline void ZmqUringTransport::releaseSegments() {
+	while (!inUse.empty() && inUse.front().notifications <= 0) {
+		if (inUse.front().buffer != -1) {
+			freeStaging.push_back(inUse.front().buffer);
+		}
+		inUse.pop_front();
+	}
+}
+
+inline bool ZmqUringTransport::waitForKernel() {
+	using namespace std::chrono;
+	const steady_clock::time_point deadline = steady_clock::now() + milliseconds(URING_CLOSE_TIMEOUT);
+	while (true) {
+		reap();
+		bool busy = sending || receiving;
+		for (auto * segments : {&outgoing, &inUse}) {
+			for (const Segment & segment : *segments) {
+				busy = busy || segment.notifications > 0;
+			}
+		}
+		if (!busy) {
+			return true;
+		}
+		const int64_t timeout = duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+		if (timeout <= 0) {
+			return false;
+		}
+		// the ring is readable when more completions arrive
+		pollfd item = {ringFd, POLLIN, 0};
+		poll(&item, 1, static_cast<int>(timeout));
+	}
+}
+
+inline void ZmqUringTransport::abandonMemory() {
+	for (auto * segments : {&outgoing, &inUse}) {
+		for (Segment & segment : *segments) {
+			if (segment.buffer != -1) {
+				staging[segment.buffer].release();
+				staging[segment.buffer].reset(new char[URING_STAGING_SIZE]);
+			} else {
+				new zmq::message_t(std::move(segment.message));
+			}
+		}
+	}
+	if (receiving) {
+		new std::vector<char>(std::move(recvBuffer));
+		recvBuffer = std::vector<char>(URING_RECV_BUFFER);
+	}
+}
+
+inline void ZmqUringTransport::fail(int error) {
+	if (!this->error) {
+		this->error = error ? error : EIO;
+	}
+}
+
+inline void ZmqUringTransport::checkError() const {
+	if (error) {
+		errno = error;
+		throw zmq::error_t();
+	}
+}
+
+inline void ZmqUringTransport::connect(const std::string & endpoint, uint64_t identity) {
+	close();
+	error = 0;
+
+	const size_t colon = endpoint.rfind(':');
+	if (endpoint.compare(0, 6, "tcp://") != 0 || colon == std::string::npos || colon <= 6) {
+		printf("ZMQ io_uring transport expects tcp://<host>:<port>, got [%s]\n", endpoint.c_str());
+		errno = EINVAL;
+		throw zmq::error_t();
+	}
+	std::string host = endpoint.substr(6, colon - 6);
+	const std::string port = endpoint.substr(colon + 1);
+	if (host.size() > 2 && host[0] == '[' && host[host.size() - 1] == ']') {
+		host = host.substr(1, host.size() - 2);
+	}
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo * addresses = nullptr;
+	const int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+	if (status != 0 || !addresses) {
+		printf("ZMQ io_uring failed to resolve [%s]: %s\n", host.c_str(), gai_strerror(status));
+		errno = EHOSTUNREACH;
+		throw zmq::error_t();
+	}
+	memcpy(&peerAddress, addresses->ai_addr, addresses->ai_addrlen);
+	peerAddressSize = addresses->ai_addrlen;
+	const int family = addresses->ai_family;
+	freeaddrinfo(addresses);
+
+	// the kernel copies zero copy sends to loopback anyway, the notifications would only add overhead
+	const in6_addr loopback6 = IN6ADDR_LOOPBACK_INIT;
+	const bool loopback =
+		(family == AF_INET && (ntohl(reinterpret_cast<sockaddr_in &>(peerAddress).sin_addr.s_addr) >> 24) == 127) ||
+		(family == AF_INET6 && !memcmp(&reinterpret_cast<sockaddr_in6 &>(peerAddress).sin6_addr, &loopback6, sizeof(loopback6)));
+	zeroCopy = zeroCopySupported && (forceZeroCopy || !loopback);
+
+	socketFd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (socketFd == -1 || !setupRing()) {
+		const int setupError = errno;
+		close();
+		errno = setupError;
+		throw zmq::error_t();
+	}
+	int noDelay = 1;
+	setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+	// messages sent before the connect completes are queued after the preamble
+	const ZmqStreamPreamble preamble = {ZmqStreamPreamble::MAGIC, ZmqStreamPreamble::FORMAT_VERSION, identity};
+	memcpy(reserveStaging(sizeof(preamble)), &preamble, sizeof(preamble));
+	pendingBytes += sizeof(preamble);
+
+	io_uring_sqe * entry = getEntry();
+	entry->opcode = IORING_OP_CONNECT;
+	entry->fd = socketFd;
+	entry->addr = reinterpret_cast<uint64_t>(&peerAddress);
+	entry->off = peerAddressSize;
+	entry->user_data = OpConnect;
+	submit();
+	checkError();
+}
+
+inline void ZmqUringTransport::close() {
+	if (sqes) {
+		// completes the pending send and recv, the error keeps new ones from being started
+		if (socketFd != -1) {
+			shutdown(socketFd, SHUT_RDWR);
+		}
+		fail(ECONNABORTED);
+		// closing the ring only cancels the operations, the kernel can still read the sent memory until the zero copy
+		// notifications arrive and write the receive buffer until the recv completes
+		if (!waitForKernel()) {
+			puts("ZMQ io_uring operations did not finish while closing, leaking their memory");
+			abandonMemory();
+		}
+	}
+	if (socketFd != -1) {
+		::close(socketFd);
+		socketFd = -1;
+	}
+	if (sqes) {
+		munmap(sqes, sqesSize);
+		sqes = nullptr;
+	}
+	if (cqRing != MAP_FAILED && cqRing != sqRing) {
+		munmap(cqRing, cqRingSize);
+	}
+	if (sqRing != MAP_FAILED) {
+		munmap(sqRing, sqRingSize);
+	}
+	sqRing = cqRing = MAP_FAILED;
+	if (ringFd != -1) {
+		::close(ringFd);
+		ringFd = -1;
+	}
+
+	outgoing.clear();
+	inUse.clear();
+	parser.reset();
+	freeStaging.clear();
+	for (int c = 0; c < URING_STAGING_BUFFERS; ++c) {
+		freeStaging.push_back(c);
+	}
+	fillBuffer = -1;
+	fillSize = 0;
+	toSubmit = 0;
+	sending = receiving = connected = false;
+	pendingBytes = 0;
+}
+
+inline bool ZmqUringTransport::send(zmq::message_t & control, zmq::message_t & payload) {
+	checkError();
+	reap();
+	if (pendingBytes >= URING_MAX_PENDING) {
+		return false;
+	}
+
+	const bool inPlace = payload.size() >= URING_ZC_MIN_PAYLOAD;
+	const ZmqStreamFrameHeader header = {static_cast<uint32_t>(control.size()), 0, static_cast<uint64_t>(payload.size())};
+	const size_t staged = sizeof(header) + control.size() + (inPlace ? 0 : payload.size());
+	char * dest = reserveStaging(staged);
+	if (!dest) {
+		return false;
+	}
+
+	memcpy(dest, &header, sizeof(header));
+	memcpy(dest + sizeof(header), control.data(), control.size());
+	if (!inPlace) {
+		memcpy(dest + sizeof(header) + control.size(), payload.data(), payload.size());
+	}
+	pendingBytes += staged;
+
+	if (inPlace) {
+		flushStaging();
+		Segment segment;
+		segment.sequence = nextSequence++;
+		segment.message.move(&payload);
+		segment.data = reinterpret_cast<const char *>(segment.message.data());
+		segment.size = segment.message.size();
+		pendingBytes += segment.size;
+		outgoing.push_back(std::move(segment));
+	}
+
+	pump();
+	submit();
+	return true;
+}
+
+inline bool ZmqUringTransport::recv(zmq::message_t & control, zmq::message_t & payload) {
+	reap();
+	// messages received before an error are still delivered
+	if (!parser.pop(control, payload)) {
+		checkError();
+		return false;
+	}
+	return true;
+}
+
+inline bool ZmqUringTransport::getPollItem(zmq::pollitem_t & item, short) {
+	if (ringFd == -1) {
+		return false;
+	}
+	// the ring is readable when operations complete, it's always writable so only POLLIN is useful
+	zmq::pollitem_t ringItem = {nullptr, ringFd, ZMQ_POLLIN, 0};
+	item = ringItem;
+	return true;
+}
+
+inline short ZmqUringTransport::getReadyEvents(short events) {
+	if (ringFd == -1) {
+		return 0;
+	}
+	reap();
+	startRecv();
+	pump();
+	submit();
+
+	short ready = 0;
+	if (!parser.empty() || error) {
+		ready |= events & ZMQ_POLLIN;
+	}
+	if (!error && pendingBytes < URING_MAX_PENDING && (fillBuffer != -1 || !freeStaging.empty())) {
+		ready |= events & ZMQ_POLLOUT;
+	}
+	return ready;
+}
+
+#endif // __linux__
+
+#endif // _ZMQ_URING_TRANSPORT_H_
@@ -17,13 +17,28 @@
 #include <condition_variable>
 #include <random>
 #include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
 
 #include "base_types.h"
 #include "zmq_message.hpp"
+#include "zmq_trace.hpp"
+#include "zmq_property_cache.hpp"
+#include "zmq_log_sink.hpp"
+#include "zmq_shm.hpp"
+#include "zmq_transport.hpp"
+#include "zmq_thread_options.hpp"
 
-static const int ZMQ_PROTOCOL_VERSION = 1013;
+static const int ZMQ_PROTOCOL_VERSION = 1017;
 
 static const int CLIENT_PING_INTERVAL = 1000;
+static const int CLIENT_PING_INTERVAL_MAX = CLIENT_PING_INTERVAL * 8;
+/// Ping interval is at least this many times the smoothed round trip time, so pings are a small part of the traffic
+static const int CLIENT_PING_RTT_FACTOR = 16;
 static const int SOCKET_IO_TIMEOUT = 100;
 
 #ifdef _DEBUG
@@ -36,6 +51,29 @@ static const int HEARBEAT_TIMEOUT = CLIENT_PING_INTERVAL * 2;
 
 static const int MAX_CONSEQ_MESSAGES = 10;
 
+static const int RECONNECT_BACKOFF_MIN = 100;
+static const int RECONNECT_BACKOFF_MAX = CLIENT_PING_INTERVAL * 5;
+/// When reconnect is enabled, a ping confirming received messages is sent after this many messages or bytes
+static const int RESUME_ACK_MESSAGES = 1000;
+static const size_t RESUME_ACK_BYTES = 16 << 20;
+/// Max bytes of sent messages waiting for confirmation, sending pauses when reached
+static const size_t RESUME_BUFFER_MAX = 256 << 20;
+
+/// Size of the shared memory ring for clients connected with shm:// address
+static const uint64_t SHM_RING_SIZE = 128 << 20;
+/// Smaller messages are sent inline even when shared memory is used, the descriptor would not save anything
+static const size_t SHM_MIN_PAYLOAD = 32 << 10;
+
+/// Default size of the chunks ZmqClient::sendChunked splits a message into
+static const size_t CHUNK_SIZE = 4 << 20;
+/// ZmqClient::sendChunked waits for the queue to drain when this many messages are queued, so only a few chunks
+/// are in memory at once
+static const int CHUNK_QUEUE_MAX = 4;
+
+/// Time in microseconds the loop thread busy polls after activity, for ZmqLatencyMode::Latency and ::Balanced
+static const int LATENCY_MODE_SPIN = 20000;
+static const int BALANCED_MODE_SPIN = 50;
+
 enum class ClientType: int {
 	None,
 	Exporter,
@@ -55,6 +93,21 @@ enum class ControlMessage: int {
 	PONG_MSG = 3001,
 
 	STOP_MSG = 4000,
+
+	/// Server buffers all data messages after this one and applies them together on TRANSACTION_COMMIT_MSG
+	TRANSACTION_BEGIN_MSG = 5000,
+	/// Payload is int VRayBaseTypes::CommitAction the server applies after the buffered messages
+	TRANSACTION_COMMIT_MSG = 5001,
+
+	/// Same as DATA_MSG, but payload is ZmqShmDescriptor of the message in the shared memory ring named in the handshake
+	/// The server releases the block in the ring after it is done with the message
+	SHM_DATA_MSG = 6000,
+
+	/// Payload is the next part of a message sent with ZmqClient::sendChunked, the server appends it to the parts
+	/// received with the same id, other messages can be sent between the parts
+	CHUNK_MSG = 7000,
+	/// Payload is the last part of a chunked message, the server handles the whole message as DATA_MSG
+	CHUNK_END_MSG = 7001,
 };
 
 
@@ -62,11 +115,16 @@ struct ControlFrame {
 	int version;
 	ClientType type;
 	ControlMessage control;
+	int requestId; ///< Non zero for DATA_MSG sent with ZmqClient::request, the server sets the same id on the response,
+	               ///< id of the chunked message for CHUNK_MSG and CHUNK_END_MSG,
+	               ///< for EXPORTER_CONNECT_MSG the low 32 bits of the sequence number of the first message the client
+	               ///< sends after the handshake, so the server can drop the ones it already got before a reconnect
 
-	ControlFrame(ClientType type = ClientType::Exporter, ControlMessage ctrl = ControlMessage::DATA_MSG)
+	ControlFrame(ClientType type = ClientType::Exporter, ControlMessage ctrl = ControlMessage::DATA_MSG, int requestId = 0)
 		: version(ZMQ_PROTOCOL_VERSION)
 		, type(type)
-		, control(ctrl) {}
+		, control(ctrl)
+		, requestId(requestId) {}
 
 	explicit ControlFrame(const zmq::message_t & msg) {
 		if (msg.size() != sizeof(*this)) {
@@ -80,26 +138,113 @@ struct ControlFrame {
 		return version == ZMQ_PROTOCOL_VERSION;
 	}
 
-	static zmq::message_t make(ClientType type = ClientType::Exporter, ControlMessage ctrl = ControlMessage::DATA_MSG) {
+	static zmq::message_t make(ClientType type = ClientType::Exporter, ControlMessage ctrl = ControlMessage::DATA_MSG, int requestId = 0) {
 		zmq::message_t msg(sizeof(ControlFrame));
-		ControlFrame frame(type, ctrl);
+		ControlFrame frame(type, ctrl, requestId);
 		memcpy(msg.data(), &frame, msg.size());
 		return msg;
 	}
 };
 
 
+class ZmqClient;
+
+/// How the loop thread of ZmqClientRuntime waits for work
+/// Blocking in poll costs a wakeup of the loop thread for every message sent to an idle runtime, busy polling after
+/// activity saves it while messages keep coming and blocking again keeps idle CPU near zero
+enum class ZmqLatencyMode {
+	Latency, ///< Busy poll for LATENCY_MODE_SPIN after activity, for interactive sessions like slider drags
+	Balanced, ///< Busy poll for BALANCED_MODE_SPIN after activity, covers bursts and request round trips
+	PowerSaving, ///< Always block in poll
+};
+
+/// Event loop serving any number of ZmqClient objects from one thread
+/// Owns the zmq context and polls the sockets of all clients with a single zmq::poll call, so the number of threads
+/// and wakeups does not grow with the number of clients
+/// Callbacks of all clients are called from the loop thread, so slow callbacks delay all clients sharing the runtime
+class ZmqClientRuntime {
+public:
+	/// Create the context and start the loop thread
+	/// @ioThreads - number of zmq I/O threads in the context
+	/// @loopOptions - affinity, name and priority of the loop thread
+	/// @ioOptions - affinity, name and priority of the zmq I/O threads, see zmqApplyContextThreadOptions
+	explicit ZmqClientRuntime(int ioThreads = 1, const ZmqThreadOptions & loopOptions = ZmqThreadOptions(),
+	                          const ZmqThreadOptions & ioOptions = ZmqThreadOptions());
+
+	/// Stop the loop thread, all clients keep a reference to their runtime so it outlives them
+	~ZmqClientRuntime();
+
+	ZmqClientRuntime(const ZmqClientRuntime &) = delete;
+	ZmqClientRuntime &operator=(const ZmqClientRuntime &) = delete;
+
+	/// Get the number of clients served by this runtime
+	int getClientCount() const;
+
+	/// Call a function on the loop thread
+	/// @task - the function to call
+	/// @wait - if true block until the function returns, if called from the loop thread the function is called inline
+	void post(std::function<void()> task, bool wait = false);
+
+	/// Check if the calling thread is the loop thread
+	bool inLoopThread() const;
+
+	/// Interrupt the poll so the loop re-checks all clients, multiple wakes before the loop runs are merged into one
+	void wake();
+
+	/// Set how the loop thread waits for work, applies to all clients of the runtime
+	/// @mode - the policy, ZmqLatencyMode::Balanced by default
+	/// @spinMicroseconds - busy poll time after activity, negative for the mode's default
+	void setLatencyMode(ZmqLatencyMode mode, int spinMicroseconds = -1);
+
+private:
+	friend class ZmqClient;
+
+	/// Start function for the loop thread
+	void loop();
+	/// Call all posted tasks
+	void runTasks();
+	/// Start serving client, called on the loop thread
+	void addClient(ZmqClient * client);
+	/// Stop serving client, called on the loop thread
+	void removeClient(ZmqClient * client);
+
+	zmq::context_t context; ///< The zmq context shared by all clients
+	const ZmqThreadOptions loopOptions; ///< Options applied by the loop thread when it starts
+
+	std::unique_ptr<zmq::socket_t> wakeSender; ///< Socket used to interrupt the poll from other threads
+	std::unique_ptr<zmq::socket_t> wakeReceiver; ///< Socket polled by the loop thread for wakeups
+	std::mutex wakeMutex; ///< Mutex protecting @wakeSender
+	std::atomic<bool> wakePending; ///< True if wakeup was sent but not yet received by the loop
+	std::atomic<bool> spinning; ///< True while the loop busy polls, wakes are not needed then
+	std::chrono::microseconds spinTime; ///< Busy poll time after activity, loop thread only
+
+	std::vector<ZmqClient *> clients; ///< Clients served, null for clients removed while iterating, loop thread only
+	std::atomic<int> clientCount; ///< Number of non null items in @clients
+
+	std::deque<std::function<void()>> tasks; ///< Functions to call on the loop thread
+	std::mutex tasksMutex; ///< Mutex protecting @tasks
+
+	std::atomic<bool> running; ///< Cleared to stop the loop thread
+	std::thread worker; ///< The loop thread
+};
+
+
 /// Async wrapper for zmq::socket_t with callback on data received.
 /// Supports heartbeat mode which will create heartbeat connection with the server that will not be auto-terminated when
 /// there is no communication on it from the server side. Used to keep the server alive all the time
-/// Objects of this type will start a thread that will enable async send and recieve of data
+/// Objects of this type are served by a ZmqClientRuntime, either private one or shared with other clients
 class ZmqClient {
 public:
 	typedef std::function<void(const VRayMessage &, ZmqClient *)> ZmqOnMessageCallback;
+	typedef std::function<void(zmq::message_t &, ZmqClient *)> ZmqOnRawMessageCallback;
+	typedef std::function<void(VRayMessage * messages, size_t count, ZmqClient *)> ZmqOnBatchMessageCallback;
+	typedef std::function<void(ZmqClient *)> ZmqOnQueueCallback;
 
 	/// Create a new client - in unconnected state, call ::connect to initiate connection
+	/// Does not block, the transport is created on the runtime's loop thread when connecting
 	/// @param isHeartbeat create the client in heartbeat mode
-	ZmqClient(bool isHeartbeat = false);
+	/// @param runtime the runtime to serve this client, if null the client creates it's own
+	ZmqClient(bool isHeartbeat = false, std::shared_ptr<ZmqClientRuntime> runtime = nullptr);
 	~ZmqClient();
 
 	ZmqClient(const ZmqClient &) = delete;
@@ -108,15 +253,80 @@ public:
 	/// Send data with size, the data will be copied inside and can be safely freed after the function returns
 	/// @data - pointer to bytes
 	/// @size - number of bytes in data
-	void send(const void *data, int size);
+	void send(const void *data, size_t size);
 
 	/// Send message while also stealing it's content
 	/// @message - the message to send, after the function returns, callee's message is empty
 	void send(zmq::message_t && message);
 
+	/// Send message in chunks as it is serialized, for messages too large to build whole, e.g. meshes over 2GB
+	/// The server joins the chunks and handles the message as if it was sent with ::send, pings and messages sent
+	/// from other threads can go between the chunks. Waits while CHUNK_QUEUE_MAX messages are queued, so call only
+	/// after ::connect and not from the callbacks. The message is not filtered, the property cache is cleared instead
+	/// @write - serializes the message, e.g. with VRayMessage::writePluginSetProperty
+	/// @chunkSize - max bytes per chunk
+	void sendChunked(std::function<void(SerializerStream &)> write, size_t chunkSize = CHUNK_SIZE);
+
+	/// Send a message expecting a response from the server
+	/// The message carries request id which the server sets on the response, so any number of requests can be pending
+	/// The future is broken if the client stops before the response arrives
+	/// @message - the request message, e.g. VRayMessage::msgRendererAction(RendererAction::GetImage, channel)
+	/// @return - future that will be set to the response
+	std::future<VRayMessage> request(zmq::message_t && message);
+
+	/// Send a message expecting a response from the server
+	/// @message - the request message
+	/// @cb - called from the worker thread with the response, instead of the callback set with ::setCallback
+	void request(zmq::message_t && message, ZmqOnMessageCallback cb);
+
+	/// Start a transaction, all messages sent until ::commitTransaction are applied by the server at once
+	/// Transactions can be nested, only the outermost begin/commit pair is sent to the server
+	/// Note: messages sent from any thread while the transaction is open are part of it
+	void beginTransaction();
+
+	/// Close the transaction started with ::beginTransaction
+	/// @action - commit action for the server to apply after all messages in the transaction are applied
+	void commitTransaction(VRayBaseTypes::CommitAction action = VRayBaseTypes::CommitNow);
+
 	/// Set a callback to be called on message received (messages discarded if not set)
 	void setCallback(ZmqOnMessageCallback cb);
 
+	/// Set a callback to be called with the payload of received messages before it is parsed
+	/// When set, the callback set with ::setCallback is not called, pass nullptr to clear
+	void setRawCallback(ZmqOnRawMessageCallback cb);
+
+	/// Set a callback to be called once for all messages received in one burst, with the messages already parsed
+	/// When set, the callback set with ::setCallback is not called, the raw callback still takes precedence
+	/// The messages are valid until the callback returns, values can be moved out of them
+	void setBatchCallback(ZmqOnBatchMessageCallback cb);
+
+	/// Set max number of messages received in one burst, before other clients of the runtime are served
+	/// Larger bursts mean fewer calls of the batch callback when the server sends many messages
+	/// @count - messages per burst, MAX_CONSEQ_MESSAGES by default
+	void setReceiveBurst(int count);
+
+	/// Set how the loop thread waits for work, see ZmqClientRuntime::setLatencyMode
+	/// Note: applies to all clients sharing this client's runtime
+	void setLatencyMode(ZmqLatencyMode mode, int spinMicroseconds = -1);
+
+	/// Set callback called from the loop thread when sending brings the number of outstanding messages down to
+	/// lowWater, so producers can pause when the queue is long and continue without polling, pass nullptr to clear
+	/// @lowWater - number of outstanding messages at which the callback is called
+	void setQueueCallback(int lowWater, ZmqOnQueueCallback cb);
+
+	/// Set trace to record all sent and received frames into, pass nullptr to stop tracing
+	/// @trace - opened trace writer, can be shared between clients
+	void setTrace(std::shared_ptr<ZmqTraceWriter> trace);
+
+	/// Set sink to take all received VRayLog messages instead of the callbacks, pass nullptr to disable
+	/// The sink's callback is called from the loop thread at the rate set on the sink
+	/// @sink - the log sink, can be shared between clients
+	void setLogSink(std::shared_ptr<VRayLogSink> sink);
+
+	/// Set cache used to drop property updates that set the value last sent through this client, pass nullptr to disable
+	/// @cache - the cache, should not be shared between clients connected to different servers
+	void setPropertyCache(std::shared_ptr<VRayPropertyCache> cache);
+
 	/// Set or clear flag to flush outstanding messages on stop/exit
 	void setFlushOnExit(bool flag);
 	/// Check the flush on exit flag
@@ -125,20 +335,56 @@ public:
 	/// Get number of messages that are yet to be sent to server
 	int getOutstandingMessages() const;
 
+	/// Stop the client if nothing is received from the server for this long
+	/// Heartbeat clients default to HEARBEAT_TIMEOUT, exporter clients default to 0 which disables the check
+	/// With the check enabled an exporter client detects unresponsive server without separate heartbeat client
+	/// @timeout - timeout in milliseconds, 0 to disable, the client waits at least two ping intervals regardless
+	void setLivenessTimeout(int timeout);
+
+	/// Get the smoothed round trip time to the server in microseconds, measured from ping responses, 0 if unknown
+	int getRoundTripTime() const;
+
+	/// Get the current ping interval in milliseconds, it grows with the round trip time to the server
+	int getPingInterval() const;
+
+	/// Reconnect when the handshake times out or the connection is lost, waiting longer after each failed attempt
+	/// Sent messages are kept until a pong confirms the server received them and are sent again after reconnecting,
+	/// the socket identity is kept so the server can match the new connection with the old session
+	/// Note: call before ::connect so all messages can be resent
+	/// @attempts - max consecutive failed attempts, -1 for no limit, 0 disables reconnecting (default)
+	void setReconnect(int attempts);
+
+	/// Get number of times the connection was lost and the client started reconnecting
+	int getReconnectCount() const;
+
+	/// Get number of messages sent through shared memory
+	uint64_t getSharedMemoryMessages() const;
+
+	/// Set factory creating the transport for each connection, pass nullptr for the default ZmqSocketTransport
+	/// Note: call before ::connect, the factory is called on the loop thread
+	/// @factory - e.g. ZmqLoopbackTransport::factory() to exercise the client without a server
+	void setTransportFactory(ZmqTransportFactory factory);
+
 	/// Check if the worker is serving
 	bool good() const;
 
-	/// Check if currently the socket is connected
+	/// Check if currently the transport is connected
 	bool connected() const;
 
-	/// Connect to address
+	/// Check if the server accepted the handshake and the connection is not lost since
+	bool isServing() const;
+
+	/// Start connecting to address, does not wait for the server
+	/// Messages sent before the server responds to the handshake are queued and sent as soon as it does
+	/// Address shm://<name>[@<endpoint>] creates shared memory ring for large messages and connects to endpoint,
+	/// ipc://<name> by default, if the server does not accept the ring all messages are sent over the socket
 	/// @addr - the address to connect to
 	void connect(const char * addr);
 
 	/// Send 'stop' command to server as soon as possible
 	void stopServer();
 
-	/// Stop the server waiting for the worker thread to join
+	/// Stop the client, flushing messages or sending stop to the server if requested, and wait until it is done
 	void syncStop();
 
 	/// Block until all messages are sent or timeout has passed, if there are no messages, return immediately
@@ -147,350 +393,1214 @@ public:
 	bool waitForMessages(int timeout = 500);
 
 private:
+	friend class ZmqClientRuntime;
+	friend class ZmqAsyncClient;
 
 	typedef std::chrono::high_resolution_clock::time_point time_point;
 
-	/// Start function for the worker thread (sends and receives messages)
-	void workerThread(volatile bool & socketInit, std::mutex & mtx, std::condition_variable & workerReady);
+	/// Handler for the response of a request
+	typedef std::function<void(VRayMessage &&)> ResponseHandler;
+
+	/// States of the client as seen from the loop thread
+	enum class WorkerState {
+		Idle, ///< Waiting for ::connect
+		Handshake, ///< Handshake is sent, waiting for the server to respond
+		Serving, ///< Sending and receiving messages
+		Reconnecting, ///< Connection is lost, waiting before connecting again
+		Stopping, ///< Sending stop command or flushing messages before closing the transport
+		Stopped, ///< Transport is closed
+	};
+
+	/// Message waiting to be sent together with the control it is sent with
+	struct QueuedMessage {
+		QueuedMessage(ControlMessage control, zmq::message_t && payload, int requestId = 0)
+		    : control(control)
+		    , requestId(requestId)
+		    , payload(std::move(payload))
+		{}
+
+		QueuedMessage(QueuedMessage && other)
+		    : control(other.control)
+		    , requestId(other.requestId)
+		    , payload(std::move(other.payload))
+		{}
+
+		QueuedMessage & operator=(QueuedMessage && other) {
+			control = other.control;
+			requestId = other.requestId;
+			payload = std::move(other.payload);
+			return *this;
+		}
+
+		ControlMessage control; ///< Control message for the payload
+		int requestId; ///< Request id for the control frame, 0 if not a request
+		zmq::message_t payload; ///< The payload frame
+	};
+
+	/// Ping waiting for response
+	struct PendingPing {
+		time_point sent; ///< Time the ping was sent
+		uint64_t sequence; ///< Number of messages sent before the ping, the pong confirms all of them
+	};
+
+	/// Add message to the send queue and wake the loop if the queue was empty
+	void enqueue(QueuedMessage && message);
+	/// Register response handler and queue the request message
+	void sendRequest(zmq::message_t && message, ResponseHandler handler);
+	/// Call and remove the handler for response
+	/// @return - false if there is no pending request with this id
+	bool dispatchResponse(int requestId, zmq::message_t & payload);
+	/// Check if message should be sent according to the property cache
+	/// @return - false if the message can be dropped
+	bool filterMessage(const void * data, size_t size);
+	/// Check if there is a trace set, so frames must be kept for ::traceFrames
+	bool isTracing();
+	/// Record control and payload frames in the trace if there is one set
+	void traceFrames(ZmqTraceDirection direction, const zmq::message_t & control, const zmq::message_t & payload);
+
+	/// Functions below are called only from the loop thread
+
+	/// Create the transport, connect it and send the handshake
+	void workerConnect(const std::string & addr);
+	/// Fill the poll item for the transport
+	/// @ready - set to the events the transport has ready without polling
+	/// @return - false if there is nothing to poll
+	bool workerPollItem(zmq::pollitem_t & item, short & ready);
+	/// Get the time in milliseconds until the client needs to be serviced even if the transport has no events
+	long workerTimeout(time_point now);
+	/// Handle transport events and timers
+	/// @revents - events returned by the poll or reported ready by the transport
+	void workerService(short revents, time_point now);
+	/// Receive and dispatch available messages
+	/// @return - false if the connection was closed or lost
+	bool workerReceiveMessages(time_point now);
+	/// Call the callbacks for messages in @receivedPayloads
+	void workerDispatchReceived();
+	/// Get the log sink if set
+	std::shared_ptr<VRayLogSink> getLogSink();
+	/// Validate the server response to the handshake
+	/// @return - false if the server did not accept us
+	bool workerHandshake(const zmq::message_t & controlMsg, const zmq::message_t & payloadMsg);
 	/// Send any outstanding messages
-	bool workerSendoutMessages(time_point & lastHBSend);
+	/// @return - true if any message was sent
+	bool workerSendoutMessages();
+	/// Send ping if nothing was sent or received recently
+	void workerPing(time_point now);
+	/// Update round trip time and ping interval with response to our ping
+	void workerPong(time_point now);
+	/// Get the time in milliseconds without received messages after which the server is considered unresponsive
+	/// @return - 0 if the liveness check is disabled
+	int workerLivenessTimeout() const;
+	/// Send the stop command or flush the queue, then close the transport
+	void workerStop(time_point now);
+	/// Close the transport and wake up any waiting threads
+	void workerClose();
+	/// Start reconnecting if enabled, else close
+	void workerConnectionLost(time_point now);
+	/// Create new transport and connect it after the backoff has passed
+	void workerReconnect();
+	/// Check if sending should pause until the server confirms some of the messages sent
+	bool workerAckBlocked() const;
 
 	const ClientType clientType; ///< The type of this client (heartbeat or exporter)
 	ZmqOnMessageCallback callback; ///< Callback to be called on received message
-	std::mutex callbackMutex; ///< Mutex protecting @callback
-
-	std::thread worker; ///< Thread serving messages and calling the callback
-
-	zmq::context_t context; ///< The zmq context
-	std::deque<zmq::message_t> messageQue; ///< Queue with outstanding messages
-	std::mutex messageMutex; ///< Mutex protecting @messageQue
-
-	std::condition_variable startServingCond; ///< Cond var to signal the worker thread to start serving
-	std::mutex startServingMutex; ///< Mutex protecting @startServing flag
-	time_point lastHeartbeat; ///< Last time hartbeat was sent/received
-
-	std::atomic<bool> startServing; ///< Used to signal worker, the socket is connected and serving can start
-	std::atomic<bool> isWorking; ///< Flag set to true if the thread is serving requests
+	ZmqOnRawMessageCallback rawCallback; ///< Callback to be called with unparsed received message
+	ZmqOnBatchMessageCallback batchCallback; ///< Callback to be called with all messages of a burst
+	ZmqOnQueueCallback queueCallback; ///< Callback to be called when the queue gets down to @queueLowWater
+	std::atomic<int> queueLowWater; ///< Queue length for @queueCallback, -1 if not set
+	std::mutex callbackMutex; ///< Mutex protecting @callback, @rawCallback, @batchCallback and @queueCallback
+	std::atomic<int> receiveBurst; ///< Max number of messages received at once
+	std::vector<zmq::message_t> receivedPayloads; ///< Payloads received in current burst, used only on the loop thread
+	std::vector<VRayMessage> receivedMessages; ///< Parsed messages passed to @batchCallback, kept to reuse the memory
+
+	std::unordered_map<int, ResponseHandler> pendingRequests; ///< Maps request id to the handler of it's response
+	std::mutex requestsMutex; ///< Mutex protecting @pendingRequests
+	std::atomic<int> nextRequestId; ///< Id for the next request, never 0
+	std::atomic<int> nextChunkedId; ///< Id for the next message sent with ::sendChunked
+
+	std::shared_ptr<ZmqTraceWriter> trace; ///< Trace recording all frames, can be null
+	std::mutex traceMutex; ///< Mutex protecting @trace
+
+	std::shared_ptr<VRayLogSink> logSink; ///< Sink for received log messages, can be null
+	std::mutex logSinkMutex; ///< Mutex protecting @logSink
+
+	std::shared_ptr<VRayPropertyCache> propertyCache; ///< Cache filtering repeated property updates, can be null
+	std::mutex propertyCacheMutex; ///< Mutex protecting @propertyCache
+
+	std::shared_ptr<ZmqClientRuntime> runtime; ///< The runtime serving this client
+
+	std::deque<QueuedMessage> messageQue; ///< Queue with outstanding messages
+	mutable std::mutex messageMutex; ///< Mutex protecting @messageQue, @sendingMessage and @transactionDepth
+	std::condition_variable messageQueCond; ///< Signaled when all messages are sent or the client stops
+	bool sendingMessage; ///< Set while the worker sends message taken from @messageQue, it goes back if the send fails
+	int transactionDepth; ///< Number of nested open transactions
+	bool sendingTransaction; ///< Set by the worker while it is sending messages of a transaction
+
+	WorkerState state; ///< Current state, changed only on the loop thread
+	std::mutex stateMutex; ///< Mutex protecting changes of @state to Stopped
+	std::condition_variable stateCond; ///< Signaled when @state becomes Stopped
+	time_point stateDeadline; ///< Time when the handshake or stopping times out
+	time_point lastHBSend; ///< Last time anything was sent to the server
+	time_point lastHBRecv; ///< Last time anything was received from the server
+	std::deque<PendingPing> pendingPings; ///< Pings sent on the current connection in send order
+	int64_t rttVariance; ///< Mean deviation of the round trip time in microseconds
+	std::atomic<int> smoothedRtt; ///< Smoothed round trip time in microseconds, 0 until the first pong
+	std::atomic<int> pingInterval; ///< Current interval for pings in milliseconds
+	std::atomic<int> livenessTimeout; ///< Max time in milliseconds without received messages, 0 to disable
+
+	std::string address; ///< Address passed to ::connect, used to reconnect
+	uint64_t identity; ///< Socket identity, same for all connections of this client
+	std::deque<QueuedMessage> unackedMessages; ///< Sent messages not confirmed by the server, resent after reconnect
+	size_t unackedBytes; ///< Bytes of payload in @unackedMessages
+	uint64_t streamSequence; ///< Number of messages sent on all connections, not counting the resent ones twice
+	uint64_t sentSequence; ///< Number of messages sent on the current connection
+	uint64_t ackedSequence; ///< Number of messages on the current connection confirmed by the server
+	uint64_t pingSequence; ///< Value of @sentSequence when the last ping was sent
+	size_t pingBytes; ///< Bytes of payload sent since the last ping
+	int failedAttempts; ///< Consecutive failed reconnect attempts
+	int reconnectBackoff; ///< Time in milliseconds to wait before next reconnect attempt
+	std::atomic<int> reconnectAttempts; ///< Max consecutive failed reconnect attempts, -1 no limit, 0 disabled
+	std::atomic<int> reconnectCount; ///< Number of times reconnect was started
+
+	std::unique_ptr<ZmqShmRing> shmRing; ///< Ring for large messages, null if not used or server did not accept it
+	int shmGeneration; ///< Number of rings created, part of the ring name
+	std::atomic<uint64_t> shmMessages; ///< Number of messages sent through @shmRing
+	bool registered; ///< True while the runtime is serving this client
+
+	std::atomic<bool> startServing; ///< Set when ::connect was called
+	std::atomic<bool> serving; ///< Set while @state is WorkerState::Serving
+	std::atomic<bool> isWorking; ///< Flag set to true if the client is serving requests
 	std::atomic<bool> errorConnect; ///< Flag set to true if we could not connect
 	std::atomic<bool> flushOnExit; ///< If true when worker is stopping for any reason, outstanding messages will be sent
 	std::atomic<bool> serverStop; ///< If true will stop transmitting messages and send 'stop' command to server
 
-	std::unique_ptr<zmq::socket_t> frontend; ///< The zmq socket
+	ZmqTransportFactory transportFactory; ///< Creates @transport, null for ZmqSocketTransport, loop thread only
+	std::unique_ptr<ZmqTransport> transport; ///< Connection to the server, used only on the loop thread
 };
 
 
-inline ZmqClient::ZmqClient(bool isHeartbeat)
-    : clientType(isHeartbeat ? ClientType::Heartbeat : ClientType::Exporter)
-    , context(1)
-    , startServing(false)
-    , isWorking(true)
-    , errorConnect(false)
-    , flushOnExit(false)
-    , serverStop(false)
-    , frontend(nullptr)
+inline ZmqClientRuntime::ZmqClientRuntime(int ioThreads, const ZmqThreadOptions & loopOptions,
+                                          const ZmqThreadOptions & ioOptions)
+    : context(ioThreads)
+    , loopOptions(loopOptions)
+    , wakePending(false)
+    , spinning(false)
+    , spinTime(std::thread::hardware_concurrency() == 1 ? 0 : BALANCED_MODE_SPIN)
+    , clientCount(0)
+    , running(true)
 {
+	// the I/O threads are started with the first socket, so their options must be set before the wake sockets
+	zmqApplyContextThreadOptions(context, ioOptions);
+
+	char wakeAddr[64];
+	snprintf(wakeAddr, sizeof(wakeAddr), "inproc://zmq-client-runtime-%p", static_cast<void *>(this));
+
+	wakeReceiver = std::unique_ptr<zmq::socket_t>(new zmq::socket_t(context, ZMQ_PAIR));
+	wakeReceiver->bind(wakeAddr);
+	wakeSender = std::unique_ptr<zmq::socket_t>(new zmq::socket_t(context, ZMQ_PAIR));
+	wakeSender->connect(wakeAddr);
+
+	worker = std::thread(&ZmqClientRuntime::loop, this);
+}
+
+inline ZmqClientRuntime::~ZmqClientRuntime() {
+	running = false;
+	wake();
+	if (worker.joinable()) {
+		worker.join();
+	}
+	wakeSender->close();
+	wakeReceiver->close();
+}
+
+inline int ZmqClientRuntime::getClientCount() const {
+	return clientCount;
+}
+
+inline bool ZmqClientRuntime::inLoopThread() const {
+	return std::this_thread::get_id() == worker.get_id();
+}
 
-	bool socketInit = false;
-	std::condition_variable threadReady;
-	std::mutex threadMutex;
+inline void ZmqClientRuntime::post(std::function<void()> task, bool wait) {
+	if (wait && inLoopThread()) {
+		task();
+		return;
+	}
 
-	worker = std::thread(&ZmqClient::workerThread, this, std::ref(socketInit), std::ref(threadMutex), std::ref(threadReady));
+	std::shared_ptr<std::promise<void>> done;
+	std::future<void> doneFuture;
+	if (wait) {
+		done = std::make_shared<std::promise<void>>();
+		doneFuture = done->get_future();
+		task = [task, done]() {
+			task();
+			done->set_value();
+		};
+	}
 
 	{
-		std::unique_lock<std::mutex> lock(threadMutex);
-		// wait for the thread to finish initing the socket, else bind & connect might be called before init
-		threadReady.wait(lock, [&socketInit] { return socketInit; });
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		tasks.push_back(std::move(task));
+	}
+	wake();
+
+	if (wait) {
+		doneFuture.wait();
 	}
 }
 
-inline void ZmqClient::workerThread(volatile bool & socketInit, std::mutex & mtx, std::condition_variable & workerReady) {
+inline void ZmqClientRuntime::wake() {
+	// the spinning loop re-checks all clients on it's own
+	if (spinning || wakePending.exchange(true)) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(wakeMutex);
 	try {
+		zmq::message_t msg(0);
+		wakeSender->send(msg, ZMQ_DONTWAIT);
+	} catch (zmq::error_t & ex) {
+		printf("ZMQ failed [%s] to wake client runtime\n", ex.what());
+	}
+}
 
-		this->frontend = std::unique_ptr<zmq::socket_t>(new zmq::socket_t(context, ZMQ_DEALER));
-		int linger = 0;
-		this->frontend->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+inline void ZmqClientRuntime::setLatencyMode(ZmqLatencyMode mode, int spinMicroseconds) {
+	// busy polling on a single CPU only takes time from the threads it waits for
+	if (mode == ZmqLatencyMode::PowerSaving || std::thread::hardware_concurrency() == 1) {
+		spinMicroseconds = 0;
+	} else if (spinMicroseconds < 0) {
+		spinMicroseconds = mode == ZmqLatencyMode::Latency ? LATENCY_MODE_SPIN : BALANCED_MODE_SPIN;
+	}
+	post([this, spinMicroseconds]() {
+		spinTime = std::chrono::microseconds(spinMicroseconds);
+	});
+}
 
-		int wait = HEARBEAT_TIMEOUT;
-		this->frontend->setsockopt(ZMQ_SNDTIMEO, &wait, sizeof(wait));
+inline void ZmqClientRuntime::runTasks() {
+	std::deque<std::function<void()>> current;
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		current.swap(tasks);
+	}
+	for (auto & task : current) {
+		task();
+	}
+}
 
-		std::lock_guard<std::mutex> lock(mtx);
-		socketInit = true;
-	} catch (zmq::error_t & e) {
-		printf("ZMQ exception while worker initialization: %s\n", e.what());
-		this->isWorking = false;
-		workerReady.notify_all();
+inline void ZmqClientRuntime::addClient(ZmqClient * client) {
+	if (!client->isWorking && !client->flushOnExit && !client->serverStop) {
+		// stopped before the loop got to it with nothing to send, just release the waiting ::syncStop
+		client->workerClose();
 		return;
 	}
-	workerReady.notify_all();
+	clients.push_back(client);
+	++clientCount;
+}
 
-	if (!this->startServing) {
-		std::unique_lock<std::mutex> lock(this->startServingMutex);
-		if (!this->startServing) {
-			this->startServingCond.wait(lock, [this]() -> bool { return this->startServing; });
+inline void ZmqClientRuntime::removeClient(ZmqClient * client) {
+	// the loop might be iterating the clients, so only null the pointer and let the loop compact
+	for (auto & item : clients) {
+		if (item == client) {
+			item = nullptr;
+			--clientCount;
+			break;
 		}
 	}
+}
 
-	std::shared_ptr<void> atScopeExit(nullptr, [this] (void *) {
-		this->frontend->close();
-		this->isWorking = false;
+inline void ZmqClientRuntime::loop() {
+	// transports and buffers are created on this thread, so pinning it first also keeps them on it's NUMA node
+	zmqApplyThreadOptions(loopOptions);
+
+	std::vector<zmq::pollitem_t> pollItems;
+	std::vector<size_t> polledClients;
+	std::vector<short> readyEvents;
+	auto lastActivity = std::chrono::high_resolution_clock::now();
+
+	while (running) {
+		auto now = std::chrono::high_resolution_clock::now();
+		// decided before checking the clients, so work queued by wakes skipped while spinning is seen in this pass
+		const bool spin = now - lastActivity < spinTime;
+		const bool wasSpinning = spinning.exchange(spin);
+
+		runTasks();
+		clients.erase(std::remove(clients.begin(), clients.end(), nullptr), clients.end());
+
+		// with no deadline the loop sleeps until a socket has events or it is woken
+		long timeout = spin || wasSpinning ? 0 : -1;
+
+		pollItems.clear();
+		polledClients.clear();
+		zmq::pollitem_t wakeItem = {*wakeReceiver, 0, ZMQ_POLLIN, 0};
+		pollItems.push_back(wakeItem);
+
+		readyEvents.assign(clients.size(), 0);
+		for (size_t c = 0; c < clients.size(); ++c) {
+			zmq::pollitem_t item;
+			if (clients[c]->workerPollItem(item, readyEvents[c])) {
+				pollItems.push_back(item);
+				polledClients.push_back(c);
+			}
+			if (readyEvents[c]) {
+				// the transport has work without polling, don't sleep
+				timeout = 0;
+			}
+			const long clientTimeout = clients[c]->workerTimeout(now);
+			if (clientTimeout >= 0 && (timeout < 0 || clientTimeout < timeout)) {
+				timeout = clientTimeout;
+			}
+		}
+
+		int polled = 0;
+		try {
+			polled = zmq::poll(pollItems.data(), pollItems.size(), timeout);
+		} catch (zmq::error_t & ex) {
+			printf("ZMQ failed [%s] zmq::poll in client runtime\n", ex.what());
+			continue;
+		}
+
+		if (pollItems[0].revents & ZMQ_POLLIN) {
+			wakePending = false;
+			zmq::message_t msg;
+			while (wakeReceiver->recv(&msg, ZMQ_DONTWAIT)) {}
+		}
+
+		now = std::chrono::high_resolution_clock::now();
+		if (polled > 0 || std::any_of(readyEvents.begin(), readyEvents.end(), [](short events) { return events != 0; })) {
+			lastActivity = now;
+		} else if (spin) {
+			// let other threads of the process run on the same core, e.g. the one producing messages
+			std::this_thread::yield();
+		}
+
+		size_t nextPolled = 0;
+		const size_t clientsToService = clients.size();
+		for (size_t c = 0; c < clientsToService; ++c) {
+			short revents = readyEvents[c];
+			if (nextPolled < polledClients.size() && polledClients[nextPolled] == c) {
+				revents |= pollItems[nextPolled + 1].revents;
+				++nextPolled;
+			}
+			// clients can be removed from callbacks of other clients
+			if (clients[c]) {
+				clients[c]->workerService(revents, now);
+			}
+		}
+	}
+
+	runTasks();
+}
+
+
+inline ZmqClient::ZmqClient(bool isHeartbeat, std::shared_ptr<ZmqClientRuntime> runtime)
+    : clientType(isHeartbeat ? ClientType::Heartbeat : ClientType::Exporter)
+    , queueLowWater(-1)
+    , receiveBurst(MAX_CONSEQ_MESSAGES)
+    , nextRequestId(1)
+    , nextChunkedId(0)
+    , runtime(runtime ? runtime : std::make_shared<ZmqClientRuntime>(1))
+    , sendingMessage(false)
+    , transactionDepth(0)
+    , sendingTransaction(false)
+    , state(WorkerState::Idle)
+    , rttVariance(0)
+    , smoothedRtt(0)
+    , pingInterval(CLIENT_PING_INTERVAL)
+    , livenessTimeout(isHeartbeat ? HEARBEAT_TIMEOUT : 0)
+    , identity(0)
+    , unackedBytes(0)
+    , streamSequence(0)
+    , sentSequence(0)
+    , ackedSequence(0)
+    , pingSequence(0)
+    , pingBytes(0)
+    , failedAttempts(0)
+    , reconnectBackoff(RECONNECT_BACKOFF_MIN)
+    , reconnectAttempts(0)
+    , reconnectCount(0)
+    , shmGeneration(0)
+    , shmMessages(0)
+    , registered(true)
+    , startServing(false)
+    , serving(false)
+    , isWorking(true)
+    , errorConnect(false)
+    , flushOnExit(false)
+    , serverStop(false)
+{
+	// tasks run in order, so the client is registered before ::connect's task runs
+	this->runtime->post([this]() {
+		this->runtime->addClient(this);
 	});
+}
 
-	if (this->errorConnect) {
+inline void ZmqClient::workerConnect(const std::string & addr) {
+	if (state != WorkerState::Idle && state != WorkerState::Reconnecting) {
 		return;
 	}
 
-	zmq::message_t emptyFrame(0);
+	if (!identity) {
+		std::random_device device;
+		std::mt19937_64 generator(device());
+		identity = generator();
+	}
+	address = addr;
+
+	std::string endpoint = addr;
+	std::string shmPrefix;
+	if (addr.compare(0, 6, "shm://") == 0) {
+		const size_t at = addr.find('@');
+		shmPrefix = addr.substr(6, at == std::string::npos ? std::string::npos : at - 6);
+		endpoint = at == std::string::npos ? "ipc://" + shmPrefix : addr.substr(at + 1);
+	}
 
-	// send handshake
+	// new transport for each connection, the previous one is closed
+	transport.reset();
 	try {
-		if (clientType == ClientType::Exporter) {
-			frontend->send(ControlFrame::make(clientType, ControlMessage::EXPORTER_CONNECT_MSG), ZMQ_SNDMORE);
-		} else {
-			frontend->send(ControlFrame::make(clientType, ControlMessage::HEARTBEAT_CONNECT_MSG), ZMQ_SNDMORE);
+		transport = transportFactory
+			? transportFactory(runtime->context)
+			: std::unique_ptr<ZmqTransport>(new ZmqSocketTransport(runtime->context));
+	} catch (zmq::error_t & e) {
+		printf("ZMQ failed to create transport: %s\n", e.what());
+	}
+	if (!transport) {
+		this->errorConnect = true;
+		workerClose();
+		return;
+	}
+
+	try {
+		ZmqClientRuntime * clientRuntime = runtime.get();
+		transport->setWake([clientRuntime]() {
+			clientRuntime->wake();
+		});
+		transport->connect(endpoint, identity);
+	} catch (zmq::error_t & e) {
+		printf("ZMQ transport connect(%s) exception: %s\n", endpoint.c_str(), e.what());
+		this->errorConnect = true;
+		workerClose();
+		return;
+	}
+
+	const time_point now = std::chrono::high_resolution_clock::now();
+
+	// new ring for each connection, the server might still read blocks from the previous one
+	shmRing.reset();
+	if (!shmPrefix.empty() && clientType == ClientType::Exporter) {
+		char name[256];
+		snprintf(name, sizeof(name), "%s-%016llx-%d", shmPrefix.c_str(), static_cast<unsigned long long>(identity), shmGeneration++);
+		shmRing = std::unique_ptr<ZmqShmRing>(new ZmqShmRing());
+		if (!shmRing->create(name, SHM_RING_SIZE)) {
+			puts("ZMQ failed to create shared memory, sending all messages over the socket");
+			shmRing.reset();
+		}
+	}
+
+	// send handshake, the pipe to the server exists after connect so this does not block
+	try {
+		// the server opens the ring named in the handshake and sends the name back to accept it
+		zmq::message_t handshakePayload = shmRing
+			? zmq::message_t(shmRing->getName().data(), shmRing->getName().size())
+			: zmq::message_t(0);
+		// the unconfirmed messages are sent again first, the server skips those it already has
+		const uint64_t resumeSequence = streamSequence - unackedMessages.size();
+		zmq::message_t handshake = ControlFrame::make(clientType, clientType == ClientType::Exporter
+		                                              ? ControlMessage::EXPORTER_CONNECT_MSG
+		                                              : ControlMessage::HEARTBEAT_CONNECT_MSG,
+		                                              static_cast<int>(static_cast<uint32_t>(resumeSequence)));
+		traceFrames(ZmqTraceDirection::Outgoing, handshake, handshakePayload);
+		if (!transport->send(handshake, handshakePayload)) {
+			puts("ZMQ failed to send handshake");
+			workerConnectionLost(now);
+			return;
 		}
-		this->frontend->send(emptyFrame);
 	} catch (zmq::error_t & ex) {
 		printf("ZMQ failed to send handshake [%s]\n", ex.what());
+		workerConnectionLost(now);
 		return;
 	}
 
+	state = WorkerState::Handshake;
+	stateDeadline = now + std::chrono::milliseconds(EXPORTER_TIMEOUT);
+}
 
-	// recv handshake
-	try {
-		int wait = EXPORTER_TIMEOUT;
-		this->frontend->setsockopt(ZMQ_RCVTIMEO, &wait, sizeof(wait));
+inline void ZmqClient::workerConnectionLost(time_point now) {
+	const int attempts = reconnectAttempts;
+	if (!isWorking || attempts == 0 || (attempts > 0 && failedAttempts >= attempts)) {
+		workerClose();
+		return;
+	}
 
-		zmq::message_t controlMsg, emptyMsg;
-		bool recv = frontend->recv(&controlMsg);
-		if (!recv) {
-			puts("ZMQ server did not respond in expected timeout, stopping client!");
-			return;
+	++failedAttempts;
+	++reconnectCount;
+	printf("ZMQ connection lost, reconnecting in %d ms\n", reconnectBackoff);
+
+	transport->close();
+	// messages not confirmed by pong stay in @unackedMessages and are resent after the handshake
+	pendingPings.clear();
+	sentSequence = ackedSequence = pingSequence = 0;
+	pingBytes = 0;
+
+	serving = false;
+	state = WorkerState::Reconnecting;
+	stateDeadline = now + std::chrono::milliseconds(reconnectBackoff);
+	reconnectBackoff = std::min(reconnectBackoff * 2, RECONNECT_BACKOFF_MAX);
+}
+
+inline void ZmqClient::workerReconnect() {
+	workerConnect(address);
+}
+
+inline bool ZmqClient::workerAckBlocked() const {
+	return reconnectAttempts != 0 && unackedBytes >= RESUME_BUFFER_MAX;
+}
+
+inline bool ZmqClient::workerPollItem(zmq::pollitem_t & item, short & ready) {
+	if (state != WorkerState::Handshake && state != WorkerState::Serving && state != WorkerState::Stopping) {
+		return false;
+	}
+
+	short events = ZMQ_POLLIN;
+	if (state != WorkerState::Handshake && !workerAckBlocked()) {
+		std::lock_guard<std::mutex> lock(messageMutex);
+		if (!messageQue.empty()) {
+			events |= ZMQ_POLLOUT;
 		}
-		frontend->recv(&emptyMsg);
+	}
 
-		ControlFrame frame(controlMsg);
+	ready = transport->getReadyEvents(events);
+	return transport->getPollItem(item, events);
+}
 
-		if (!frame) {
-			printf("ZMQ expected protocol version [%d], server speaks [%d]\n", ZMQ_PROTOCOL_VERSION, frame.version);
-			return;
+inline long ZmqClient::workerTimeout(time_point now) {
+	using namespace std::chrono;
+
+	if (!isWorking && state != WorkerState::Stopped && state != WorkerState::Handshake) {
+		return 0;
+	}
+
+	time_point deadline;
+	switch (state) {
+	case WorkerState::Handshake:
+	case WorkerState::Reconnecting:
+	case WorkerState::Stopping:
+		deadline = stateDeadline;
+		break;
+	case WorkerState::Serving: {
+		const milliseconds interval(pingInterval);
+		const bool pingPending = !pendingPings.empty() && now - pendingPings.back().sent < interval;
+		deadline = pingPending ? pendingPings.back().sent + interval : lastHBSend + interval;
+		const int liveness = workerLivenessTimeout();
+		if (liveness) {
+			if (!pingPending) {
+				deadline = std::min(deadline, lastHBRecv + interval);
+			}
+			deadline = std::min(deadline, lastHBRecv + milliseconds(liveness));
+		}
+		// buffered log lines are delivered even if no more messages arrive
+		const std::shared_ptr<VRayLogSink> sink = getLogSink();
+		const long logTimeout = sink ? sink->getTimeout(now) : -1;
+		if (logTimeout >= 0) {
+			deadline = std::min(deadline, now + milliseconds(logTimeout));
 		}
+		break;
+	}
+	default:
+		return -1;
+	}
 
-		if (frame.type != clientType) {
-			puts("ZMQ server created mismatching type of worker for us!");
+	if (deadline <= now) {
+		return 0;
+	}
+
+	// round up so the deadline has passed when the loop wakes
+	return static_cast<long>(duration_cast<milliseconds>(deadline - now).count()) + 1;
+}
+
+inline void ZmqClient::workerService(short revents, time_point now) {
+	using namespace std::chrono;
+
+	if (state == WorkerState::Stopped || (state == WorkerState::Idle && isWorking)) {
+		return;
+	}
+
+	if (!isWorking && state != WorkerState::Stopping) {
+		if (state == WorkerState::Serving) {
+			state = WorkerState::Stopping;
+			stateDeadline = now + milliseconds(200);
+		} else if (state == WorkerState::Handshake && (flushOnExit || serverStop)) {
+			// let the handshake finish or time out, so queued messages or the stop command can be sent
+		} else {
+			workerClose();
 			return;
 		}
+	}
 
-		if (clientType == ClientType::Exporter) {
-			if (frame.control != ControlMessage::RENDERER_CREATE_MSG) {
-				puts("ZMQ server responded with different than renderer created!");
-				return;
-			}
-		} else {
-			if (frame.control != ControlMessage::HEARTBEAT_CREATE_MSG) {
-				puts("ZMQ server responded with different than heartbeat created!");
-				return;
-			}
+	if (state == WorkerState::Stopping) {
+		workerStop(now);
+		return;
+	}
+
+	if (state == WorkerState::Reconnecting) {
+		if (now >= stateDeadline) {
+			workerReconnect();
 		}
-	} catch (zmq::error_t & ex) {
-		printf("ZMQ failed to receive handshake [%s]\n", ex.what());
 		return;
 	}
 
-	puts("ZMQ connected to server.");
+	if (revents & ZMQ_POLLIN) {
+		const bool handshake = state == WorkerState::Handshake;
+		if (!workerReceiveMessages(now)) {
+			return;
+		}
+		// flush what was queued during the handshake without waiting for the next poll
+		if (handshake && state == WorkerState::Serving) {
+			revents |= ZMQ_POLLOUT;
+		}
+	}
 
-	auto lastHBRecv = std::chrono::high_resolution_clock::now();
-	// ensure we send one HB immediately
-	auto lastHBSend = lastHBRecv - std::chrono::milliseconds(HEARBEAT_TIMEOUT * 2);
+	if (state == WorkerState::Handshake) {
+		if (now > stateDeadline) {
+			puts("ZMQ server did not respond in expected timeout!");
+			workerConnectionLost(now);
+		}
+		return;
+	}
 
-	zmq::pollitem_t pollContext = {*this->frontend, 0, ZMQ_POLLIN | ZMQ_POLLOUT, 0};
+	try {
+		if (revents & ZMQ_POLLOUT) {
+			workerSendoutMessages();
+		}
+		workerPing(now);
+		if (const std::shared_ptr<VRayLogSink> sink = getLogSink()) {
+			sink->deliver(now);
+		}
+	} catch (zmq::error_t & ex) {
+		printf("ZMQ failed [%s] to send message\n", ex.what());
+		workerConnectionLost(now);
+		return;
+	}
 
-	while (isWorking) {
-		bool didWork = false;
-		auto now = std::chrono::high_resolution_clock::now();
+	const int liveness = workerLivenessTimeout();
+	if (liveness && duration_cast<milliseconds>(now - lastHBRecv).count() > liveness) {
+		puts("ZMQ server unresponsive");
+		workerConnectionLost(now);
+	}
+}
 
+inline bool ZmqClient::workerReceiveMessages(time_point now) {
+	const int burst = receiveBurst;
+	const std::shared_ptr<VRayLogSink> sink = getLogSink();
+	for (int c = 0; c < burst && state != WorkerState::Stopped; ++c) {
+		zmq::message_t controlMsg, payloadMsg;
 		try {
-			zmq::poll(&pollContext, 1, 10);
+			if (!transport->recv(controlMsg, payloadMsg)) {
+				break;
+			}
 		} catch (zmq::error_t & ex) {
-			printf("ZMQ failed [%s] zmq::poll - stopping client.\n", ex.what());
-			return;
+			printf("ZMQ failed [%s] to receive message\n", ex.what());
+			workerDispatchReceived();
+			workerConnectionLost(now);
+			return false;
 		}
-
-		if (pollContext.revents & ZMQ_POLLIN) {
-			didWork = true;
-
-			for (int c = 0; c < MAX_CONSEQ_MESSAGES && isWorking; ++c) {
-				zmq::message_t controlMsg, payloadMsg;
-				try {
-					this->frontend->recv(&controlMsg);
-					this->frontend->recv(&payloadMsg);
-				} catch (zmq::error_t & ex) {
-					printf("ZMQ failed [%s] zmq::socket_t::recv - stopping client.\n", ex.what());
-					return;
-				}
-
-				ControlFrame frame(controlMsg);
-
-				if (!frame) {
-					printf("ZMQ expected protocol version [%d], server speaks [%d], dropping message.\n", ZMQ_PROTOCOL_VERSION, frame.version);
-					continue;
-				}
-
-				if (frame.type != clientType) {
-					puts("ZMQ server sent mismatching msg type of worker for us!");
-					continue;
-				}
-
-				lastHBRecv = std::chrono::high_resolution_clock::now();
-
-				if (frame.control == ControlMessage::DATA_MSG) {
-					std::lock_guard<std::mutex> cbLock(callbackMutex);
-					if (this->callback) {
-						this->callback(VRayMessage::fromZmqMessage(payloadMsg), this);
-					}
-				} else if (frame.control == ControlMessage::PING_MSG) {
-					if (payloadMsg.size() != 0) {
-						puts("ZMQ missing empty frame after ping");
-					}
-				} else if (frame.control == ControlMessage::PONG_MSG) {
-					if (payloadMsg.size() != 0) {
-						puts("ZMQ missing empty frame after pong");
-					}
-				}
-
-				int more = 0;
-				size_t more_size = sizeof (more);
-				try {
-					frontend->getsockopt(ZMQ_RCVMORE, &more, &more_size);
-				} catch (zmq::error_t & ex) {
-					printf("ZMQ failed [%s] zmq::socket_t::getsockopt.\n", ex.what());
-				}
-				if (!more) {
-					break;
-				}
+		traceFrames(ZmqTraceDirection::Incoming, controlMsg, payloadMsg);
+		// any message from the server proves it is alive, pings are needed only when there is no traffic
+		const time_point received = std::chrono::high_resolution_clock::now();
+		lastHBRecv = received;
+
+		if (state == WorkerState::Handshake) {
+			if (!workerHandshake(controlMsg, payloadMsg)) {
+				workerClose();
+				return false;
 			}
+			continue;
 		}
 
-		if (pollContext.revents & ZMQ_POLLOUT) {
-			try {
-				now = std::chrono::high_resolution_clock::now();
-				// we havent sent messages in a while - ping server
-				if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastHBSend).count() > CLIENT_PING_INTERVAL) {
-					bool sent = frontend->send(ControlFrame::make(clientType, ControlMessage::PING_MSG), ZMQ_SNDMORE);
-					if (sent) {
-						sent = frontend->send(emptyFrame);
-						lastHBSend = now;
-						didWork = true;
-					}
-				}
-
-				didWork = didWork || !messageQue.empty();
-				workerSendoutMessages(lastHBSend);
-			} catch (zmq::error_t & ex) {
-				printf("ZMQ failed [%s] zmq::socket_t::send - stopping client.\n", ex.what());
-				return;
+		ControlFrame frame(controlMsg);
+
+		if (!frame) {
+			printf("ZMQ expected protocol version [%d], server speaks [%d], dropping message.\n", ZMQ_PROTOCOL_VERSION, frame.version);
+			continue;
+		}
+
+		if (frame.type != clientType) {
+			puts("ZMQ server sent mismatching msg type of worker for us!");
+			continue;
+		}
+
+		if (frame.control == ControlMessage::DATA_MSG && frame.requestId != 0) {
+			// keep the order of messages and responses
+			workerDispatchReceived();
+		}
+
+		if (frame.control == ControlMessage::DATA_MSG && frame.requestId != 0 && dispatchResponse(frame.requestId, payloadMsg)) {
+			// handled by the request's handler
+		} else if (frame.control == ControlMessage::DATA_MSG) {
+			if (!sink || !sink->consume(payloadMsg)) {
+				receivedPayloads.push_back(std::move(payloadMsg));
+			}
+		} else if (frame.control == ControlMessage::PING_MSG) {
+			if (payloadMsg.size() != 0) {
+				puts("ZMQ missing empty frame after ping");
+			}
+		} else if (frame.control == ControlMessage::PONG_MSG) {
+			if (payloadMsg.size() != 0) {
+				puts("ZMQ missing empty frame after pong");
 			}
+			workerPong(received);
 		}
+	}
 
-		if (clientType == ClientType::Heartbeat && std::chrono::duration_cast<std::chrono::milliseconds>(now - lastHBRecv).count() > HEARBEAT_TIMEOUT) {
-			puts("ZMQ server unresponsive, stopping client");
-			return;
+	workerDispatchReceived();
+	if (sink) {
+		sink->deliver(now);
+	}
+	return true;
+}
+
+inline void ZmqClient::workerDispatchReceived() {
+	if (receivedPayloads.empty()) {
+		return;
+	}
+
+	// one lock and one call per burst instead of per message
+	std::lock_guard<std::mutex> cbLock(callbackMutex);
+	if (this->rawCallback) {
+		for (auto & payload : receivedPayloads) {
+			this->rawCallback(payload, this);
+		}
+	} else if (this->batchCallback) {
+		for (auto & payload : receivedPayloads) {
+			receivedMessages.push_back(VRayMessage::fromZmqMessage(payload));
+		}
+		this->batchCallback(receivedMessages.data(), receivedMessages.size(), this);
+		receivedMessages.clear();
+	} else if (this->callback) {
+		for (auto & payload : receivedPayloads) {
+			this->callback(VRayMessage::fromZmqMessage(payload), this);
 		}
+	}
+	receivedPayloads.clear();
+}
+
+inline bool ZmqClient::workerHandshake(const zmq::message_t & controlMsg, const zmq::message_t & payloadMsg) {
+	ControlFrame frame(controlMsg);
 
-		if (!didWork && isWorking) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	if (!frame) {
+		printf("ZMQ expected protocol version [%d], server speaks [%d]\n", ZMQ_PROTOCOL_VERSION, frame.version);
+		return false;
+	}
+
+	if (frame.type != clientType) {
+		puts("ZMQ server created mismatching type of worker for us!");
+		return false;
+	}
+
+	if (clientType == ClientType::Exporter) {
+		if (frame.control != ControlMessage::RENDERER_CREATE_MSG) {
+			puts("ZMQ server responded with different than renderer created!");
+			return false;
+		}
+	} else {
+		if (frame.control != ControlMessage::HEARTBEAT_CREATE_MSG) {
+			puts("ZMQ server responded with different than heartbeat created!");
+			return false;
 		}
 	}
 
-	if (serverStop) {
-		try {
-			int wait = 200;
-			frontend->setsockopt(ZMQ_SNDTIMEO, &wait, sizeof(wait));
-			frontend->send(ControlFrame::make(clientType, ControlMessage::STOP_MSG), ZMQ_SNDMORE);
-			frontend->send(emptyFrame);
-			serverStop = false;
-		} catch (zmq::error_t & ex) {
-			printf("ZMQ exception while stopping server: %s\n", ex.what());
+	if (shmRing) {
+		const std::string & name = shmRing->getName();
+		if (payloadMsg.size() != name.size() || memcmp(payloadMsg.data(), name.data(), name.size())) {
+			puts("ZMQ server did not accept shared memory, sending all messages over the socket");
+			shmRing.reset();
 		}
-	} else if (flushOnExit) {
-		try {
-			int wait = 200;
-			this->frontend->setsockopt(ZMQ_SNDTIMEO, &wait, sizeof(wait));
-			std::lock_guard<std::mutex> lock(this->messageMutex);
-
-			for (int c = 0; c < this->messageQue.size(); ++c) {
-				auto & msg = this->messageQue[c];
-				bool sent = frontend->send(ControlFrame::make(), ZMQ_SNDMORE);
-				sent = sent && this->frontend->send(msg);
-				if (!sent) {
-					break;
-				}
-			}
+	}
 
-			this->frontend->close();
-		} catch (zmq::error_t & ex) {
-			printf("ZMQ exception while flushing on exit: %s\n", ex.what());
+	puts("ZMQ connected to server.");
+	state = WorkerState::Serving;
+	serving = true;
+	// ensure we send one HB immediately, it also gives the first round trip time
+	lastHBSend = lastHBRecv - std::chrono::milliseconds(CLIENT_PING_INTERVAL_MAX * 2);
+	failedAttempts = 0;
+	reconnectBackoff = RECONNECT_BACKOFF_MIN;
+
+	// resend what the server might not have received before the connection was lost, before any new message
+	if (!unackedMessages.empty()) {
+		printf("ZMQ resending %d messages\n", static_cast<int>(unackedMessages.size()));
+		std::lock_guard<std::mutex> lock(messageMutex);
+		for (auto iter = unackedMessages.rbegin(); iter != unackedMessages.rend(); ++iter) {
+			messageQue.push_front(std::move(*iter));
+		}
+		streamSequence -= unackedMessages.size();
+		unackedMessages.clear();
+		unackedBytes = 0;
+	}
+	return true;
+}
+
+inline int ZmqClient::workerLivenessTimeout() const {
+	const int timeout = livenessTimeout;
+	if (!timeout) {
+		return 0;
+	}
+	// a ping and it's response must have time to arrive before we give up on the server
+	return std::max(timeout, pingInterval * 2 + smoothedRtt / 1000);
+}
+
+inline void ZmqClient::workerPing(time_point now) {
+	using namespace std::chrono;
+
+	const milliseconds interval(pingInterval);
+	// late response does not prevent next ping, liveness timeout decides if the server is gone
+	const bool pingPending = !pendingPings.empty() && now - pendingPings.back().sent < interval;
+	// any sent message keeps the server alive, ping only when we have been quiet
+	const bool sendIdle = now - lastHBSend >= interval;
+	// nothing received recently, check if server is still there
+	const bool recvIdle = workerLivenessTimeout() && now - lastHBRecv >= interval;
+	// server answers pings in order, so the pong confirms all messages sent before the ping
+	const bool ackDue = reconnectAttempts != 0 && sentSequence != pingSequence &&
+		(sentSequence - pingSequence >= static_cast<uint64_t>(RESUME_ACK_MESSAGES) || pingBytes >= RESUME_ACK_BYTES ||
+		 getOutstandingMessages() == 0);
+	if (!ackDue && (pingPending || (!sendIdle && !recvIdle))) {
+		return;
+	}
+
+	zmq::message_t emptyFrame(0);
+	zmq::message_t ping = ControlFrame::make(clientType, ControlMessage::PING_MSG);
+	traceFrames(ZmqTraceDirection::Outgoing, ping, emptyFrame);
+	if (transport->send(ping, emptyFrame)) {
+		lastHBSend = now;
+		PendingPing pending = {now, sentSequence};
+		pendingPings.push_back(pending);
+		pingSequence = sentSequence;
+		pingBytes = 0;
+	}
+}
+
+inline void ZmqClient::workerPong(time_point now) {
+	if (pendingPings.empty()) {
+		return;
+	}
+	const PendingPing ping = pendingPings.front();
+	pendingPings.pop_front();
+
+	for (; ackedSequence < ping.sequence && !unackedMessages.empty(); ++ackedSequence) {
+		unackedBytes -= unackedMessages.front().payload.size();
+		unackedMessages.pop_front();
+	}
+
+	// smoothing as in TCP retransmit timer (RFC 6298)
+	const int64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(now - ping.sent).count();
+	int64_t rtt = smoothedRtt;
+	if (rtt == 0) {
+		rtt = std::max<int64_t>(sample, 1);
+		rttVariance = sample / 2;
+	} else {
+		rttVariance = (3 * rttVariance + std::abs(rtt - sample)) / 4;
+		rtt = std::max<int64_t>((7 * rtt + sample) / 8, 1);
+	}
+	smoothedRtt = static_cast<int>(std::min<int64_t>(rtt, std::numeric_limits<int>::max()));
+
+	const int64_t interval = (rtt + 4 * rttVariance) * CLIENT_PING_RTT_FACTOR / 1000;
+	pingInterval = static_cast<int>(std::max<int64_t>(CLIENT_PING_INTERVAL, std::min<int64_t>(interval, CLIENT_PING_INTERVAL_MAX)));
+}
+
+inline void ZmqClient::workerStop(time_point now) {
+	try {
+		if (serverStop) {
+			zmq::message_t emptyFrame(0);
+			zmq::message_t stop = ControlFrame::make(clientType, ControlMessage::STOP_MSG);
+			traceFrames(ZmqTraceDirection::Outgoing, stop, emptyFrame);
+			if (transport->send(stop, emptyFrame)) {
+				serverStop = false;
+				workerClose();
+				return;
+			}
+		} else if (flushOnExit) {
+			workerSendoutMessages();
+			if (getOutstandingMessages() == 0) {
+				workerClose();
+				return;
+			}
+		} else {
+			workerClose();
+			return;
 		}
+	} catch (zmq::error_t & ex) {
+		printf("ZMQ exception while stopping client: %s\n", ex.what());
+		workerClose();
+		return;
+	}
+
+	if (now > stateDeadline) {
+		workerClose();
+	}
+}
+
+inline void ZmqClient::workerClose() {
+	if (transport) {
+		transport->close();
+	}
+	isWorking = false;
+	serving = false;
+
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		state = WorkerState::Stopped;
 	}
+	stateCond.notify_all();
+
+	{
+		std::lock_guard<std::mutex> lock(messageMutex);
+	}
+	messageQueCond.notify_all();
 }
 
-inline bool ZmqClient::workerSendoutMessages(time_point & lastHBSend) {
+inline bool ZmqClient::workerSendoutMessages() {
 	bool didWork = false;
-	for (int c = 0; c < MAX_CONSEQ_MESSAGES && !this->messageQue.empty() && isWorking; ++c) {
+	const int lowWater = queueLowWater;
+	bool reachedLowWater = false;
+	// once the transaction begin is sent, keep sending until commit so the server is not left waiting on us
+	const bool retain = reconnectAttempts != 0;
+	for (int c = 0; (c < MAX_CONSEQ_MESSAGES || sendingTransaction || state == WorkerState::Stopping); ++c) {
+		if (workerAckBlocked()) {
+			break;
+		}
+		std::unique_lock<std::mutex> lock(this->messageMutex);
+		if (this->messageQue.empty()) {
+			break;
+		}
+		QueuedMessage msg(std::move(this->messageQue.front()));
+		this->messageQue.pop_front();
+		sendingMessage = true;
+		const int left = static_cast<int>(this->messageQue.size());
+		// producers should not wait on the socket
+		lock.unlock();
+
 		didWork = true;
-		std::lock_guard<std::mutex> lock(this->messageMutex);
-		auto & msg = this->messageQue.front();
-
-		bool sent = frontend->send(ControlFrame::make(ClientType::Exporter, ControlMessage::DATA_MSG), ZMQ_SNDMORE);
-		if (sent) {
-			sent = frontend->send(msg);
-			// update hb send since we sent a message
-			lastHBSend = std::chrono::high_resolution_clock::now();
-			this->messageQue.pop_front();
-
-			int more = 0;
-			size_t more_size = sizeof (more);
-			frontend->getsockopt(ZMQ_RCVMORE, &more, &more_size);
-			if (!more) {
-				break;
+		zmq::message_t control = ControlFrame::make(ClientType::Exporter, msg.control, msg.requestId);
+		// trace has the message as if it was sent inline, so it can be replayed without the ring
+		// the send consumes the frames, so they are copied to trace them once the send succeeds
+		zmq::message_t traceControl, tracePayload;
+		const bool tracing = isTracing();
+		if (tracing) {
+			traceControl.copy(&control);
+			tracePayload.copy(&msg.payload);
+		}
+
+		zmq::message_t * payload = &msg.payload;
+		zmq::message_t shmPayload;
+		ZmqShmDescriptor descriptor;
+		if (shmRing && msg.control == ControlMessage::DATA_MSG && msg.payload.size() >= SHM_MIN_PAYLOAD &&
+		    shmRing->write(msg.payload.data(), msg.payload.size(), descriptor)) {
+			// when the ring is full the message goes inline, order is kept since both go through the socket
+			control = ControlFrame::make(ClientType::Exporter, ControlMessage::SHM_DATA_MSG, msg.requestId);
+			shmPayload.rebuild(&descriptor, sizeof(descriptor));
+			payload = &shmPayload;
+		}
+
+		zmq::message_t retained;
+		if (retain) {
+			// large messages are reference counted, this does not copy the data
+			retained.copy(&msg.payload);
+		}
+
+		bool sent = false;
+		try {
+			sent = transport->send(control, *payload);
+		} catch (zmq::error_t &) {
+			// the connection is lost, the message is sent again after reconnect or dropped with the rest of the queue
+			if (payload == &shmPayload) {
+				shmRing->unwrite(descriptor);
 			}
-		} else {
+			lock.lock();
+			this->messageQue.push_front(std::move(msg));
+			sendingMessage = false;
+			throw;
+		}
+		if (!sent) {
+			// the message is written again on the next try, the block in the ring must not be left behind
+			if (payload == &shmPayload) {
+				shmRing->unwrite(descriptor);
+			}
+			lock.lock();
+			this->messageQue.push_front(std::move(msg));
+			sendingMessage = false;
 			break;
 		}
+		if (tracing) {
+			traceFrames(ZmqTraceDirection::Outgoing, traceControl, tracePayload);
+		}
+		++sentSequence;
+		++streamSequence;
+		if (payload == &shmPayload) {
+			++shmMessages;
+		}
+		if (retain) {
+			pingBytes += retained.size();
+			unackedBytes += retained.size();
+			unackedMessages.push_back(QueuedMessage(msg.control, std::move(retained), msg.requestId));
+		}
+		// update hb send since we sent a message
+		lastHBSend = std::chrono::high_resolution_clock::now();
+
+		if (msg.control == ControlMessage::TRANSACTION_BEGIN_MSG) {
+			sendingTransaction = true;
+		} else if (msg.control == ControlMessage::TRANSACTION_COMMIT_MSG) {
+			sendingTransaction = false;
+		}
 
+		// waiters are woken only once the last message is really sent, producers might have added more meanwhile
+		lock.lock();
+		sendingMessage = false;
+		const bool drained = this->messageQue.empty();
+		lock.unlock();
+		if (drained) {
+			messageQueCond.notify_all();
+		}
+		if (left == lowWater) {
+			reachedLowWater = true;
+		}
+	}
+
+	if (reachedLowWater) {
+		std::lock_guard<std::mutex> cbLock(callbackMutex);
+		if (this->queueCallback) {
+			this->queueCallback(this);
+		}
 	}
 
 	return didWork;
 }
 
 inline void ZmqClient::connect(const char * addr) {
-	std::random_device device;
-	std::mt19937_64 generator(device());
-	uint64_t id = generator();
+	const std::string address(addr);
+	runtime->post([this, address]() {
+		workerConnect(address);
+	});
+	this->startServing = true;
+}
 
-	this->frontend->setsockopt(ZMQ_IDENTITY, &id, sizeof(id));
+inline void ZmqClient::enqueue(QueuedMessage && message) {
+	bool wasEmpty;
+	{
+		std::lock_guard<std::mutex> lock(this->messageMutex);
+		wasEmpty = this->messageQue.empty();
+		this->messageQue.push_back(std::move(message));
+	}
+	// loop polls for POLLOUT only while there are messages, wake it so it starts
+	if (wasEmpty) {
+		runtime->wake();
+	}
+}
 
-	try {
-		this->frontend->connect(addr);
-	} catch (zmq::error_t & e) {
-		printf("ZMQ zmq::socket_t::connect(%s) exception: %s\n", addr, e.what());
-		this->errorConnect = true;
+inline std::future<VRayMessage> ZmqClient::request(zmq::message_t && message) {
+	// std::function must be copyable so the promise is shared
+	std::shared_ptr<std::promise<VRayMessage>> promise(new std::promise<VRayMessage>());
+	std::future<VRayMessage> result = promise->get_future();
+	sendRequest(std::move(message), [promise](VRayMessage && response) {
+		promise->set_value(std::move(response));
+	});
+	return result;
+}
+
+inline void ZmqClient::request(zmq::message_t && message, ZmqOnMessageCallback cb) {
+	sendRequest(std::move(message), [this, cb](VRayMessage && response) {
+		cb(response, this);
+	});
+}
+
+inline void ZmqClient::sendRequest(zmq::message_t && message, ResponseHandler handler) {
+	int requestId = nextRequestId++;
+	if (requestId == 0) {
+		requestId = nextRequestId++;
 	}
 
 	{
-		std::lock_guard<std::mutex> lock(startServingMutex);
-		this->startServing = true;
+		std::lock_guard<std::mutex> lock(requestsMutex);
+		pendingRequests[requestId] = std::move(handler);
+	}
+
+	enqueue(QueuedMessage(ControlMessage::DATA_MSG, std::move(message), requestId));
+}
+
+inline bool ZmqClient::dispatchResponse(int requestId, zmq::message_t & payload) {
+	ResponseHandler handler;
+	{
+		std::lock_guard<std::mutex> lock(requestsMutex);
+		auto iter = pendingRequests.find(requestId);
+		if (iter == pendingRequests.end()) {
+			return false;
+		}
+		handler = std::move(iter->second);
+		pendingRequests.erase(iter);
+	}
+	handler(VRayMessage::fromZmqMessage(payload));
+	return true;
+}
+
+inline void ZmqClient::beginTransaction() {
+	std::unique_lock<std::mutex> lock(this->messageMutex);
+	if (transactionDepth++ == 0) {
+		lock.unlock();
+		enqueue(QueuedMessage(ControlMessage::TRANSACTION_BEGIN_MSG, zmq::message_t(0)));
+	}
+}
+
+inline void ZmqClient::commitTransaction(VRayBaseTypes::CommitAction action) {
+	std::unique_lock<std::mutex> lock(this->messageMutex);
+	assert(transactionDepth > 0 && "ZmqClient::commitTransaction called without beginTransaction");
+	if (transactionDepth > 0 && --transactionDepth == 0) {
+		lock.unlock();
+		const int value = action;
+		enqueue(QueuedMessage(ControlMessage::TRANSACTION_COMMIT_MSG, zmq::message_t(&value, sizeof(value))));
 	}
-	startServingCond.notify_one();
+}
+
+inline void ZmqClient::setLivenessTimeout(int timeout) {
+	livenessTimeout = std::max(timeout, 0);
+	runtime->wake();
+}
+
+inline int ZmqClient::getRoundTripTime() const {
+	return smoothedRtt;
+}
+
+inline int ZmqClient::getPingInterval() const {
+	return pingInterval;
+}
+
+inline void ZmqClient::setReconnect(int attempts) {
+	reconnectAttempts = std::max(attempts, -1);
+}
+
+inline int ZmqClient::getReconnectCount() const {
+	return reconnectCount;
+}
+
+inline uint64_t ZmqClient::getSharedMemoryMessages() const {
+	return shmMessages;
+}
+
+inline void ZmqClient::setTransportFactory(ZmqTransportFactory factory) {
+	// tasks run in order, so the factory is set before ::connect's task runs
+	runtime->post([this, factory]() {
+		transportFactory = factory;
+	});
 }
 
 inline int ZmqClient::getOutstandingMessages() const {
-	return this->messageQue.size();
+	std::lock_guard<std::mutex> lock(this->messageMutex);
+	return static_cast<int>(this->messageQue.size()) + sendingMessage;
 }
 
 inline bool ZmqClient::connected() const {
 	return this->startServing && !this->errorConnect;
 }
 
+inline bool ZmqClient::isServing() const {
+	return this->serving;
+}
+
 inline bool ZmqClient::good() const {
 	return this->isWorking;
 }
@@ -498,63 +1608,50 @@ inline bool ZmqClient::good() const {
 inline void ZmqClient::stopServer() {
 	serverStop = true;
 	isWorking = false;
+	runtime->wake();
 }
 
 inline bool ZmqClient::waitForMessages(int timeout) {
 	timeout = std::min(timeout, 10000);
-	using namespace std::chrono;
-	{
-		std::lock_guard<std::mutex> lock(this->messageMutex);
-		if (this->messageQue.empty()) {
-			return true;
-		}
-	}
-
-	const auto waitBegin = high_resolution_clock::now();
-
-	while (isWorking) {
-		std::lock_guard<std::mutex> lock(this->messageMutex);
-		if (this->messageQue.empty()) {
-			return true;
-		}
-		const auto timePassed = duration_cast<milliseconds>(high_resolution_clock::now() - waitBegin).count();
-		if (timePassed >= timeout) {
-			return false;
-		}
-	}
-
-	return false;
+	std::unique_lock<std::mutex> lock(this->messageMutex);
+	messageQueCond.wait_for(lock, std::chrono::milliseconds(timeout), [this]() {
+		return (this->messageQue.empty() && !sendingMessage) || !this->isWorking;
+	});
+	return this->messageQue.empty() && !sendingMessage;
 }
 
 inline void ZmqClient::syncStop() {
-	using namespace std::chrono;
-	if (serverStop) {
-		// give chance for worker to send stop message
-		auto stopBegin = high_resolution_clock::now();
-		while (serverStop) {
-			if (duration_cast<milliseconds>(high_resolution_clock::now() - stopBegin).count() > 200) {
-				break;
-			}
-			std::this_thread::sleep_for(milliseconds(1));
-		}
+	if (!registered) {
+		return;
 	}
+	registered = false;
 
-	{
-		std::lock_guard<std::mutex> lock(startServingMutex);
-		isWorking = false;
-		startServing = true;
-		startServingCond.notify_all();
+	isWorking = false;
+	if (runtime->inLoopThread()) {
+		// our init and connect tasks might still be queued, they must not run after we are gone
+		runtime->runTasks();
+		// the loop can't make progress while we wait on it, give up on flushing
+		if (state != WorkerState::Stopped) {
+			workerClose();
+		}
+	} else {
+		runtime->wake();
+		std::unique_lock<std::mutex> lock(stateMutex);
+		stateCond.wait(lock, [this]() { return state == WorkerState::Stopped; });
 	}
 
-	context.close();
-	if (worker.joinable()) {
-		worker.join();
-	}
-	worker = std::thread();
+	runtime->post([this]() {
+		this->runtime->removeClient(this);
+	}, true);
+
+	// responses can't arrive anymore, this breaks all pending futures
+	std::lock_guard<std::mutex> lock(requestsMutex);
+	pendingRequests.clear();
 }
 
 inline ZmqClient::~ZmqClient() {
 	this->syncStop();
+	transport.reset();
 }
 
 inline void ZmqClient::setFlushOnExit(bool flag) {
@@ -570,16 +1667,105 @@ inline void ZmqClient::setCallback(ZmqOnMessageCallback cb) {
 	this->callback = cb;
 }
 
+inline void ZmqClient::setRawCallback(ZmqOnRawMessageCallback cb) {
+	std::lock_guard<std::mutex> cbLock(callbackMutex);
+	this->rawCallback = cb;
+}
+
+inline void ZmqClient::setBatchCallback(ZmqOnBatchMessageCallback cb) {
+	std::lock_guard<std::mutex> cbLock(callbackMutex);
+	this->batchCallback = cb;
+}
+
+inline void ZmqClient::setQueueCallback(int lowWater, ZmqOnQueueCallback cb) {
+	std::lock_guard<std::mutex> cbLock(callbackMutex);
+	this->queueCallback = cb;
+	queueLowWater = cb ? std::max(lowWater, 0) : -1;
+}
+
+inline void ZmqClient::setReceiveBurst(int count) {
+	receiveBurst = std::max(count, 1);
+}
+
+inline void ZmqClient::setLatencyMode(ZmqLatencyMode mode, int spinMicroseconds) {
+	runtime->setLatencyMode(mode, spinMicroseconds);
+}
+
+inline void ZmqClient::setTrace(std::shared_ptr<ZmqTraceWriter> trace) {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	this->trace = trace;
+}
+
+inline bool ZmqClient::isTracing() {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	return this->trace != nullptr;
+}
+
+inline void ZmqClient::traceFrames(ZmqTraceDirection direction, const zmq::message_t & control, const zmq::message_t & payload) {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	if (this->trace) {
+		this->trace->record(direction, control, payload);
+	}
+}
+
+inline void ZmqClient::setLogSink(std::shared_ptr<VRayLogSink> sink) {
+	std::lock_guard<std::mutex> lock(logSinkMutex);
+	this->logSink = sink;
+}
+
+inline std::shared_ptr<VRayLogSink> ZmqClient::getLogSink() {
+	std::lock_guard<std::mutex> lock(logSinkMutex);
+	return this->logSink;
+}
+
+inline void ZmqClient::setPropertyCache(std::shared_ptr<VRayPropertyCache> cache) {
+	std::lock_guard<std::mutex> lock(propertyCacheMutex);
+	this->propertyCache = cache;
+}
+
+inline bool ZmqClient::filterMessage(const void * data, size_t size) {
+	std::shared_ptr<VRayPropertyCache> cache;
+	{
+		std::lock_guard<std::mutex> lock(propertyCacheMutex);
+		cache = this->propertyCache;
+	}
+	return !cache || cache->filter(reinterpret_cast<const char *>(data), size);
+}
+
 inline void ZmqClient::send(zmq::message_t && message) {
-	std::lock_guard<std::mutex> lock(this->messageMutex);
-	this->messageQue.push_back(std::move(message));
+	if (!filterMessage(message.data(), message.size())) {
+		return;
+	}
+	enqueue(QueuedMessage(ControlMessage::DATA_MSG, std::move(message)));
 }
 
-inline void ZmqClient::send(const void * data, int size) {
+inline void ZmqClient::send(const void * data, size_t size) {
+	if (!filterMessage(data, size)) {
+		return;
+	}
 	zmq::message_t msg(data, size);
+	enqueue(QueuedMessage(ControlMessage::DATA_MSG, std::move(msg)));
+}
 
-	std::lock_guard<std::mutex> lock(this->messageMutex);
-	this->messageQue.push_back(std::move(msg));
+inline void ZmqClient::sendChunked(std::function<void(SerializerStream &)> write, size_t chunkSize) {
+	{
+		// the cache can't see the whole message, a property it sets must not be filtered later
+		std::lock_guard<std::mutex> lock(propertyCacheMutex);
+		if (this->propertyCache) {
+			this->propertyCache->clear();
+		}
+	}
+
+	const int chunkedId = nextChunkedId++;
+	SerializerStream stream(std::max<size_t>(chunkSize, 1), [this, chunkedId](const char * data, size_t size) {
+		while (good() && getOutstandingMessages() >= CHUNK_QUEUE_MAX) {
+			waitForMessages(SOCKET_IO_TIMEOUT);
+		}
+		enqueue(QueuedMessage(ControlMessage::CHUNK_MSG, zmq::message_t(data, size), chunkedId));
+	});
+	write(stream);
+	// sent even when empty, it tells the server the message is complete
+	enqueue(QueuedMessage(ControlMessage::CHUNK_END_MSG, zmq::message_t(stream.getData(), stream.getSize()), chunkedId));
 }
 
 
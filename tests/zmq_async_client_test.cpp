@@ -0,0 +1,113 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "zmq_async_client.hpp"
+#include "zmq_server.hpp"
+#include "zmq_test_utils.hpp"
+
+/// State shared by the test coroutines and main
+struct AsyncTestState {
+	std::atomic<int> sent{0}; ///< Messages admitted by ::send
+	std::thread::id mainThread; ///< Thread starting the coroutine
+	std::atomic<bool> scheduled{false}; ///< Set if ::schedule moved the coroutine off the main thread
+	std::atomic<int> width{0}; ///< Width from the response to the request
+	std::atomic<bool> echoReceived{false}; ///< Set when the echoed message was received
+	std::atomic<bool> done{false}; ///< Set when the coroutine got to it's end
+};
+
+/// Send values in order, then request and receive
+static ZmqTask upload(ZmqAsyncClient & async, int count, AsyncTestState & state) {
+	co_await async.schedule();
+	state.scheduled = std::this_thread::get_id() != state.mainThread;
+
+	for (int c = 0; c < count; ++c) {
+		co_await async.send(VRayMessage::msgPluginSetProperty("value", "value", VRayBaseTypes::AttrValue(c)));
+		++state.sent;
+	}
+
+	VRayMessage response = co_await async.request(VRayMessage::msgRendererResize(320, 240));
+	int width = 0, height = 0;
+	response.getRendererSize(width, height);
+	state.width = width;
+
+	co_await async.send(VRayMessage::msgPluginSetProperty("echo", "value", VRayBaseTypes::AttrValue(1)));
+	VRayMessage echo = co_await async.receive();
+	state.echoReceived = echo.getType() == VRayMessage::Type::ChangePlugin && echo.getPlugin() == "echo";
+	state.done = true;
+}
+
+/// Wait for a response and a message that never come, record how the stop resumed the coroutine
+static ZmqTask waitForever(ZmqAsyncClient & async, std::atomic<int> & endedOnMain, std::thread::id mainThread) {
+	// the server does not reply to plugin updates
+	VRayMessage response = co_await async.request(
+		VRayMessage::msgPluginSetProperty("ignored", "value", VRayBaseTypes::AttrValue(0)));
+	VRayMessage message = co_await async.receive();
+	// awaiting after the stop must not suspend again
+	co_await async.schedule();
+	co_await async.send(VRayMessage::msgPluginSetProperty("late", "value", VRayBaseTypes::AttrValue(0)));
+	if (response.getType() == VRayMessage::Type::None && message.getType() == VRayMessage::Type::None &&
+	    std::this_thread::get_id() == mainThread) {
+		++endedOnMain;
+	}
+}
+
+/// Coroutines must send in order, get responses and received messages and continue on the loop thread, and stopping
+/// the async client must resume every suspended coroutine with empty results before it returns
+/// Usage: zmq_async_client_test [address]
+int main(int argc, char * argv[]) {
+	const std::string address = argc > 1 ? argv[1] : "ipc://zmq-async-client-test";
+	const int count = 200;
+
+	std::atomic<int> nextValue(0);
+	std::atomic<int> outOfOrder(0);
+	ZmqServer server(1);
+	server.setCallback([&](const VRayMessage & message, ZmqServerSession & session) {
+		if (message.getType() == VRayMessage::Type::ChangeRenderer) {
+			int width = 0, height = 0;
+			message.getRendererSize(width, height);
+			session.reply(VRayMessage::msgRendererResize(width * 2, height * 2));
+			return;
+		}
+		if (message.getPlugin() == "echo") {
+			session.send(VRayMessage::msgPluginSetProperty("echo", "value", VRayBaseTypes::AttrValue(1)));
+		} else if (message.getPlugin() == "value") {
+			if (message.getAttrValue().as<int>() != nextValue) {
+				++outOfOrder;
+			}
+			++nextValue;
+		}
+	});
+	if (!check(server.bind(address.c_str()), "bind")) {
+		return testResult();
+	}
+
+	{
+		ZmqClient client;
+		client.connect(address.c_str());
+		// small queue, so the sends suspend
+		ZmqAsyncClient async(client, 8);
+		AsyncTestState state;
+		state.mainThread = std::this_thread::get_id();
+		upload(async, count, state);
+		check(waitFor([&]() { return state.done.load(); }), "coroutine finished");
+		check(state.scheduled, "scheduled on the loop thread");
+		check(state.sent == count && nextValue == count && outOfOrder == 0, "messages sent in order");
+		check(state.width == 640, "response to request");
+		check(state.echoReceived, "message received");
+
+		std::atomic<int> endedOnMain(0);
+		waitForever(async, endedOnMain, std::this_thread::get_id());
+		waitForever(async, endedOnMain, std::this_thread::get_id());
+		check(waitFor([&]() { return server.getReceivedMessages() == static_cast<uint64_t>(count + 4); }), "requests sent");
+		check(endedOnMain == 0, "coroutines suspended");
+		async.stop();
+		check(endedOnMain == 2, "stop resumed the coroutines on it's thread");
+		check(!client.good(), "stop stopped the client");
+	}
+
+	server.stop();
+	return testResult();
+}
@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zmq_wrapper.hpp"
+#include "zmq_server.hpp"
+#include "zmq_fanout_client.hpp"
+#include "zmq_test_utils.hpp"
+
+/// Render host counting the bytes it receives
+struct TestHost {
+	explicit TestHost(const std::string & address)
+	    : address(address)
+	    , received(0)
+	    , bytes(0)
+	    , commits(0)
+	{
+		server.setRawCallback([this](zmq::message_t & payload, ZmqServerSession &) {
+			++received;
+			bytes += payload.size();
+		});
+		server.setCommitCallback([this](VRayBaseTypes::CommitAction, ZmqServerSession &) {
+			++commits;
+		});
+	}
+
+	const std::string address;
+	ZmqServer server;
+	std::atomic<int> received;
+	std::atomic<uint64_t> bytes;
+	std::atomic<int> commits;
+};
+
+/// Every live host must get the whole stream, a host that can't keep up must be detached without holding the others
+/// Usage: zmq_fanout_test [address-prefix]
+int main(int argc, char * argv[]) {
+	const std::string prefix = argc > 1 ? argv[1] : "ipc://zmq-fanout-test";
+	const int hostCount = 3;
+	const int messageCount = 500;
+	const int messageSize = 64 << 10;
+
+	std::vector<std::unique_ptr<TestHost>> hosts;
+	for (int c = 0; c < hostCount; ++c) {
+		hosts.push_back(std::unique_ptr<TestHost>(new TestHost(prefix + "-" + std::to_string(c))));
+		if (!check(hosts.back()->server.bind(hosts.back()->address.c_str()), "bind")) {
+			return 1;
+		}
+	}
+
+	const std::vector<char> data(messageSize, 'x');
+
+	{
+		ZmqFanoutClient client;
+		client.setQueueLimit(64, ZmqFanoutPolicy::Block);
+		for (auto & host : hosts) {
+			client.addHost(host->address.c_str());
+		}
+
+		client.beginTransaction();
+		for (int m = 0; m < messageCount; ++m) {
+			client.send(data.data(), messageSize);
+			check(client.getOutstandingMessages() <= 64, "queue limit kept");
+		}
+		client.commitTransaction();
+		check(client.waitForMessages(5000), "all messages sent");
+
+		for (auto & host : hosts) {
+			check(waitFor([&]() { return host->commits == 1; }), "transaction committed on every host");
+			check(host->received == messageCount && host->bytes == static_cast<uint64_t>(messageCount) * messageSize,
+			      "every host got the whole stream");
+		}
+		client.syncStop();
+	}
+
+	{
+		// the last host never answers the handshake, it is detached when the handshake times out
+		std::vector<int> detached;
+		ZmqFanoutClient client;
+		client.setQueueLimit(32, ZmqFanoutPolicy::Detach);
+		client.setDetachCallback([&detached](int host, ZmqClient *) {
+			detached.push_back(host);
+		});
+		for (auto & host : hosts) {
+			client.addHost(host->address.c_str());
+		}
+		const int deadHost = client.addHost((prefix + "-dead").c_str());
+
+		for (int m = 0; m < messageCount; ++m) {
+			client.send(data.data(), messageSize);
+		}
+		check(client.waitForMessages(EXPORTER_TIMEOUT + 5000), "live hosts got all messages");
+		check(detached.size() == 1 && detached[0] == deadHost && client.isDetached(deadHost), "host behind is detached");
+		for (auto & host : hosts) {
+			check(waitFor([&]() { return host->received == 2 * messageCount; }), "live hosts not held by the one behind");
+		}
+		client.syncStop();
+	}
+
+	for (auto & host : hosts) {
+		host->server.stop();
+	}
+
+	return testResult();
+}
@@ -0,0 +1,108 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zmq_log_sink.hpp"
+#include "zmq_test_utils.hpp"
+
+/// Log lines above the max level must be dropped, identical consecutive lines merged, the oldest lines overwritten
+/// when the buffer is full and buffered lines delivered at most once per interval, also when delivered from the loop
+/// threads of two clients sharing the sink
+/// Usage: zmq_log_sink_test
+int main() {
+	using namespace std::chrono;
+
+	VRayLogSink sink(2, 3);
+	auto consume = [&sink](int level, const char * text) {
+		return sink.consume(VRayMessage::msgVRayLog(level, text));
+	};
+
+	check(!sink.consume(VRayMessage::msgRendererResize(640, 480)), "other messages passed on");
+	check(consume(3, "verbose") && sink.getFiltered() == 1, "line above max level dropped");
+	check(consume(1, "first") && consume(1, "first") && consume(2, "first"), "lines consumed");
+	check(consume(1, "second") && consume(1, "second") && consume(1, "second"), "repeated lines consumed");
+	check(sink.getReceived() == 7, "received count");
+
+	std::vector<VRayLogEntry> entries;
+	check(sink.drain(entries) == 3, "identical consecutive lines merged");
+	if (check(entries.size() == 3, "drained lines")) {
+		check(entries[0].text == "first" && entries[0].level == 1 && entries[0].repeat == 2, "first line repeated");
+		check(entries[1].text == "first" && entries[1].level == 2 && entries[1].repeat == 1, "other level not merged");
+		check(entries[2].text == "second" && entries[2].repeat == 3, "last line repeated");
+	}
+	entries.clear();
+	check(sink.drain(entries) == 0, "nothing left after drain");
+
+	// the oldest lines are overwritten
+	for (int c = 0; c < 5; ++c) {
+		consume(0, std::to_string(c).c_str());
+	}
+	check(sink.getOverwritten() == 2, "overwritten count");
+	sink.drain(entries);
+	check(entries.size() == 3 && entries[0].text == "2" && entries[2].text == "4", "newest lines kept in order");
+
+	// delivery at most once per interval
+	int calls = 0;
+	size_t delivered = 0;
+	sink.setCallback([&](const VRayLogEntry *, size_t count) {
+		++calls;
+		delivered += count;
+	}, 100);
+	const VRayLogSink::time_point start = high_resolution_clock::now();
+	check(sink.getTimeout(start) == -1, "no timeout without lines");
+	consume(1, "a");
+	consume(1, "b");
+	check(sink.getTimeout(start) == 0, "first delivery due at once");
+	sink.deliver(start);
+	check(calls == 1 && delivered == 2, "lines delivered");
+
+	consume(1, "c");
+	const long timeout = sink.getTimeout(start + milliseconds(50));
+	check(timeout > 0 && timeout <= 51, "next delivery after the interval");
+	sink.deliver(start + milliseconds(50));
+	check(calls == 1, "no delivery within the interval");
+	sink.deliver(start + milliseconds(100));
+	check(calls == 2 && delivered == 3, "delivery after the interval");
+
+	sink.setMaxLevel(0);
+	check(consume(1, "d") && sink.getFiltered() == 2, "max level changed");
+
+	// each thread consumes and delivers as a client's loop does, every line must be delivered once and intact
+	{
+		const int lines = 20000;
+		VRayLogSink shared(2, 64);
+		std::atomic<int> deliveredLines(0);
+		std::atomic<int> corrupted(0);
+		shared.setCallback([&](const VRayLogEntry * entries, size_t count) {
+			for (size_t c = 0; c < count; ++c) {
+				if (entries[c].text.compare(0, 5, "line ") || entries[c].repeat != 1) {
+					++corrupted;
+				}
+				// give the other thread time to deliver while these entries are in use
+				std::this_thread::yield();
+				deliveredLines += entries[c].repeat;
+			}
+		}, 0);
+
+		auto loop = [&shared](int id) {
+			for (int c = 0; c < lines; ++c) {
+				shared.consume(VRayMessage::msgVRayLog(1, ("line " + std::to_string(id) + " " + std::to_string(c)).c_str()));
+				shared.deliver(high_resolution_clock::now());
+			}
+		};
+		std::thread first(loop, 0);
+		std::thread second(loop, 1);
+		first.join();
+		second.join();
+		shared.deliver(high_resolution_clock::now());
+
+		check(corrupted == 0, "lines intact when delivered from two threads");
+		check(deliveredLines + static_cast<int>(shared.getOverwritten()) == 2 * lines, "every line delivered once");
+	}
+
+	return testResult();
+}
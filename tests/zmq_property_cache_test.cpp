@@ -0,0 +1,66 @@
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "zmq_wrapper.hpp"
+#include "zmq_property_cache.hpp"
+#include "zmq_test_utils.hpp"
+
+/// Updates setting the value a property already has must be filtered, other messages must always pass, plugin remove
+/// must forget the plugin's values and scene resets must forget all of them
+/// Usage: zmq_property_cache_test
+int main() {
+	using namespace VRayBaseTypes;
+	typedef VRayMessage::PluginAction PluginAction;
+	typedef VRayMessage::RendererAction RendererAction;
+
+	VRayPropertyCache cache;
+	auto update = [](const char * plugin, int value) {
+		return VRayMessage::msgPluginSetProperty(plugin, "value", AttrValue(value));
+	};
+
+	check(cache.filter(update("a", 1)), "first update sent");
+	check(!cache.filter(update("a", 1)), "same value filtered");
+	check(cache.filter(update("a", 2)), "changed value sent");
+	check(cache.filter(update("b", 2)), "same value of other plugin sent");
+	check(cache.filter(VRayMessage::msgPluginSetProperty("a", "other", AttrValue(2))), "other property sent");
+	check(cache.filter(VRayMessage::msgPluginSetPropertyString("s", "value", "2")), "string value sent");
+	check(!cache.filter(VRayMessage::msgPluginSetPropertyString("s", "value", "2")), "same string value filtered");
+	check(cache.getHits() == 2 && cache.getMisses() == 5, "hit and miss counts");
+
+	// create does not change values, remove forgets them
+	check(cache.filter(VRayMessage::msgPluginCreate("b", "Node")), "create sent");
+	check(cache.filter(VRayMessage::msgPluginCreate("b", "Node")), "repeated create sent");
+	check(!cache.filter(update("b", 2)), "create keeps values");
+	check(cache.filter(VRayMessage::msgPluginAction("b", PluginAction::Remove)), "remove sent");
+	check(cache.filter(update("b", 2)), "value sent after remove");
+	check(!cache.filter(update("a", 2)), "remove keeps other plugins");
+
+	// renderer actions pass, the ones resetting the scene clear the cache
+	check(cache.filter(VRayMessage::msgRendererResize(640, 480)), "renderer action sent");
+	check(!cache.filter(update("a", 2)), "resize keeps values");
+	check(cache.filter(VRayMessage::msgRendererAction(RendererAction::ClearFrameValues, 0.f)), "clear frame values sent");
+	check(cache.filter(update("a", 2)), "value sent after clear frame values");
+	check(cache.filter(VRayMessage::msgRendererAction(RendererAction::Free)), "free sent");
+	check(cache.filter(update("a", 2)), "value sent after free");
+
+	const char garbage[] = {127, 1, 2};
+	check(cache.filter(garbage, sizeof(garbage)) && cache.filter(garbage, sizeof(garbage)), "malformed messages sent");
+
+	cache.resetCounters();
+	check(cache.getHits() == 0 && cache.getMisses() == 0, "counters reset");
+
+	// the client drops filtered messages before they are queued
+	{
+		ZmqClient client;
+		client.setPropertyCache(std::make_shared<VRayPropertyCache>());
+		for (int c = 0; c < 10; ++c) {
+			client.send(update("a", c / 5));
+		}
+		check(client.getOutstandingMessages() == 2, "client queues only changed values");
+		client.syncStop();
+	}
+
+	return testResult();
+}
@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "zmq_router.hpp"
+#include "zmq_test_utils.hpp"
+
+/// Messages without handler must be dropped without being parsed, the most specific handler must get the message:
+/// renderer state before renderer action before message type before the default, and image source before type
+/// Usage: zmq_router_test
+int main() {
+	using namespace VRayBaseTypes;
+	typedef VRayMessage::RendererAction RendererAction;
+	typedef VRayMessage::RendererState RendererState;
+
+	VRayMessageRouter router;
+	{
+		zmq::message_t payload = VRayMessage::msgRendererResize(640, 480);
+		const size_t size = payload.size();
+		check(!router.route(payload, nullptr), "no handler");
+		check(payload.size() == size && router.getDroppedCount() == 1 && router.getRoutedCount() == 0,
+		      "message without handler dropped unparsed");
+	}
+
+	std::vector<std::string> handled;
+	auto handler = [&handled](const char * name) {
+		return [&handled, name](const VRayMessage &, ZmqClient *) {
+			handled.push_back(name);
+		};
+	};
+	router.onType(VRayMessage::Type::ChangeRenderer, handler("renderer"));
+	router.onRendererAction(RendererAction::SetRendererState, handler("state action"));
+	router.onRendererState(RendererState::Progress, [&handled](const VRayMessage & message, ZmqClient *) {
+		handled.push_back(message.getRendererState() == RendererState::Progress ? "progress" : "parsed wrong");
+	});
+	router.onType(VRayMessage::Type::Image, handler("image"));
+	router.onImage(RtImageUpdate, handler("rt image"));
+
+	auto route = [&router](zmq::message_t && payload) {
+		return router.route(payload, nullptr);
+	};
+	check(route(VRayMessage::msgRendererState(RendererState::Progress, 0.5f)), "state routed");
+	check(route(VRayMessage::msgRendererState(RendererState::Abort, 0)), "state without own handler routed");
+	check(route(VRayMessage::msgRendererResize(640, 480)), "renderer action routed");
+	check(route(VRayMessage::msgImageSet(AttrImageSet(RtImageUpdate))), "image source routed");
+	check(route(VRayMessage::msgImageSet(AttrImageSet(ImageReady))), "image without own handler routed");
+	check(!route(VRayMessage::msgVRayLog(1, "line")), "type without handler dropped");
+
+	// malformed messages go only to the default handler
+	const char garbage[] = {127, 1, 2};
+	check(!route(zmq::message_t(garbage, sizeof(garbage))), "malformed message dropped");
+	router.onDefault(handler("default"));
+	check(route(VRayMessage::msgVRayLog(1, "line")), "default routed");
+	check(route(zmq::message_t(garbage, sizeof(garbage))), "malformed message to default");
+
+	const std::vector<std::string> expected = {"progress", "state action", "renderer", "rt image", "image", "default",
+	                                           "default"};
+	if (!check(handled == expected, "most specific handler")) {
+		for (const std::string & name : handled) {
+			printf("%s, ", name.c_str());
+		}
+		puts("");
+	}
+	check(router.getRoutedCount() == 7 && router.getDroppedCount() == 3, "routed and dropped counts");
+
+	return testResult();
+}
@@ -0,0 +1,161 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "zmq_scene_file.hpp"
+#include "zmq_test_utils.hpp"
+
+/// Read the whole file
+static std::vector<char> readFile(const std::string & path) {
+	std::vector<char> data;
+	if (FILE * file = fopen(path.c_str(), "rb")) {
+		char buffer[4096];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+			data.insert(data.end(), buffer, buffer + read);
+		}
+		fclose(file);
+	}
+	return data;
+}
+
+/// Write the bytes as the whole file
+static bool writeFile(const std::string & path, const std::vector<char> & data) {
+	FILE * file = fopen(path.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+	return written;
+}
+
+/// Get object of type T at offset in the file bytes
+template <typename T>
+static T & at(std::vector<char> & data, uint64_t offset) {
+	return *reinterpret_cast<T *>(data.data() + offset);
+}
+
+/// Write copy of the file changed by @corrupt and check that it can't be opened
+static void checkRejected(const std::string & path, const std::vector<char> & original, const char * what,
+                          std::function<void(std::vector<char> & data, VRaySceneFileHeader & header)> corrupt) {
+	std::vector<char> data = original;
+	VRaySceneFileHeader header;
+	memcpy(&header, data.data(), sizeof(header));
+	corrupt(data, header);
+	memcpy(data.data(), &header, sizeof(header));
+
+	VRaySceneFile scene;
+	if (!writeFile(path, data) || scene.open(path.c_str())) {
+		printf("FAILED: rejects %s\n", what);
+		++failures;
+	}
+}
+
+/// Scene written by VRaySceneWriter must read back with the same messages and index, and files with any table entry
+/// pointing outside of it's table or the file must be rejected by VRaySceneFile::open
+/// Usage: zmq_scene_file_test [path]
+int main(int argc, char * argv[]) {
+	using namespace VRayBaseTypes;
+	const std::string path = argc > 1 ? argv[1] : "zmq-scene-file-test.vrscene";
+	const std::string corruptPath = path + ".corrupt";
+
+	const std::vector<AttrVector> vertices(1000, AttrVector(1.f, 2.f, 3.f));
+	std::vector<zmq::message_t> messages;
+	messages.push_back(VRayMessage::msgRendererResize(640, 480));
+	messages.push_back(VRayMessage::msgPluginCreate("node", "Node"));
+	messages.push_back(VRayMessage::msgPluginCreate("mesh", "GeomStaticMesh"));
+	messages.push_back(VRayMessage::msgPluginSetProperty("mesh", "vertices", vertices.data(), vertices.size()));
+	messages.push_back(VRayMessage::msgPluginSetProperty("node", "geometry", AttrValue(AttrPlugin("mesh"))));
+
+	{
+		VRaySceneWriter writer;
+		check(writer.open(path.c_str()), "open writer");
+		for (const zmq::message_t & message : messages) {
+			check(writer.append(message), "append");
+		}
+		check(writer.close(), "write index");
+	}
+
+	{
+		VRaySceneFile scene;
+		if (!check(scene.open(path.c_str()), "open scene")) {
+			return testResult();
+		}
+		check(scene.getMessageCount() == messages.size(), "message count");
+		for (size_t c = 0; c < messages.size() && c < scene.getMessageCount(); ++c) {
+			const zmq::message_t payload = scene.getPayload(c);
+			check(payload.size() == messages[c].size() && !memcmp(payload.data(), messages[c].data(), payload.size()),
+			      "payload read back");
+		}
+		check(scene.getMessage(3).getPlugin() == "mesh", "parsed message");
+
+		// plugins are sorted by name
+		check(scene.getPluginCount() == 2, "plugin count");
+		check(scene.getPluginName(0) == "mesh" && scene.getPluginType(0) == "GeomStaticMesh", "first plugin");
+		check(scene.getPluginName(1) == "node" && scene.getPluginType(1) == "Node", "second plugin");
+
+		std::vector<size_t> indices;
+		check(scene.getPluginMessages("node", indices) && indices == std::vector<size_t>({1, 4}), "messages of plugin");
+		indices.clear();
+		check(!scene.getPluginMessages("light", indices) && indices.empty(), "missing plugin");
+		scene.getPluginTypeMessages("GeomStaticMesh", indices);
+		check(indices == std::vector<size_t>({2, 3}), "messages of type");
+	}
+
+	const std::vector<char> original = readFile(path);
+	check(original.size() > sizeof(VRaySceneFileHeader), "read scene");
+	if (original.size() > sizeof(VRaySceneFileHeader)) {
+		typedef VRaySceneFileHeader Header;
+		const uint64_t huge = UINT64_MAX - 4;
+
+		checkRejected(corruptPath, original, "truncated file", [](std::vector<char> & data, Header &) {
+			data.pop_back();
+		});
+		checkRejected(corruptPath, original, "message count overflow", [](std::vector<char> &, Header & header) {
+			header.messageCount = UINT64_MAX / sizeof(VRaySceneMessageEntry) + 2;
+		});
+		checkRejected(corruptPath, original, "unaligned message table", [](std::vector<char> &, Header & header) {
+			header.messageTableOffset += 1;
+		});
+		checkRejected(corruptPath, original, "message offset overflow", [huge](std::vector<char> & data, Header & header) {
+			at<VRaySceneMessageEntry>(data, header.messageTableOffset).offset = huge;
+		});
+		checkRejected(corruptPath, original, "message past payloads", [](std::vector<char> & data, Header & header) {
+			at<VRaySceneMessageEntry>(data, header.messageTableOffset).size = header.messageTableOffset;
+		});
+		checkRejected(corruptPath, original, "message plugin", [](std::vector<char> & data, Header & header) {
+			at<VRaySceneMessageEntry>(data, header.messageTableOffset).plugin = 2;
+		});
+		checkRejected(corruptPath, original, "plugin name overflow", [huge](std::vector<char> & data, Header & header) {
+			at<VRayScenePluginEntry>(data, header.pluginTableOffset).nameOffset = huge;
+		});
+		checkRejected(corruptPath, original, "plugin type size", [](std::vector<char> & data, Header & header) {
+			at<VRayScenePluginEntry>(data, header.pluginTableOffset).typeSize = header.stringsSize + 1;
+		});
+		checkRejected(corruptPath, original, "plugin index overflow", [huge](std::vector<char> & data, Header & header) {
+			at<VRayScenePluginEntry>(data, header.pluginTableOffset).firstIndex = huge;
+		});
+		checkRejected(corruptPath, original, "plugin index count", [](std::vector<char> & data, Header & header) {
+			at<VRayScenePluginEntry>(data, header.pluginTableOffset).indexCount = 5;
+		});
+		checkRejected(corruptPath, original, "message index", [](std::vector<char> & data, Header & header) {
+			at<uint32_t>(data, header.indexOffset) = static_cast<uint32_t>(header.messageCount);
+		});
+		checkRejected(corruptPath, original, "plugin order", [](std::vector<char> & data, Header & header) {
+			std::swap(at<VRayScenePluginEntry>(data, header.pluginTableOffset),
+			          at<VRayScenePluginEntry>(data, header.pluginTableOffset + sizeof(VRayScenePluginEntry)));
+		});
+
+		VRaySceneFile copy;
+		check(writeFile(corruptPath, original) && copy.open(corruptPath.c_str()), "open unchanged copy");
+	}
+
+	remove(path.c_str());
+	remove(corruptPath.c_str());
+	return testResult();
+}
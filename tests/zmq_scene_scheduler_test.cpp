@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zmq_wrapper.hpp"
+#include "zmq_server.hpp"
+#include "zmq_scene_scheduler.hpp"
+#include "zmq_test_utils.hpp"
+
+/// Plugins must arrive by class with their references first, heavy geometry and the node using it after the start,
+/// plugins must not be moved over renderer actions they depend on, and the time to the image the server sends on
+/// start must be measured
+/// Usage: zmq_scene_scheduler_test [address]
+int main(int argc, char * argv[]) {
+	using namespace VRayBaseTypes;
+	const std::string address = argc > 1 ? argv[1] : "ipc://zmq-scene-scheduler-test";
+
+	std::mutex orderMutex;
+	std::vector<std::string> order;
+	ZmqServer server;
+	server.setCallback([&](const VRayMessage & message, ZmqServerSession & session) {
+		std::lock_guard<std::mutex> lock(orderMutex);
+		if (message.getType() == VRayMessage::Type::ChangeRenderer) {
+			if (message.getRendererAction() == VRayMessage::RendererAction::Start) {
+				order.push_back("start");
+				session.send(VRayMessage::msgImageSet(AttrImageSet()));
+			} else if (message.getRendererAction() == VRayMessage::RendererAction::SetCurrentTime) {
+				order.push_back("time");
+			} else {
+				order.push_back("renderer");
+			}
+		} else if (message.getType() == VRayMessage::Type::ChangePlugin &&
+		           std::find(order.begin(), order.end(), message.getPlugin()) == order.end()) {
+			order.push_back(message.getPlugin());
+		}
+	});
+	if (!check(server.bind(address.c_str()), "bind")) {
+		return 1;
+	}
+
+	ZmqClient client;
+	std::atomic<int> images(0);
+	{
+		ZmqSceneScheduler scheduler(client);
+		scheduler.setCallback([&images](const VRayMessage & message, ZmqClient *) {
+			images += message.getType() == VRayMessage::Type::Image;
+		});
+		client.connect(address.c_str());
+
+		// plugins before a barrier are sent in their class order, and none of them is deferred
+		const std::vector<AttrVector> vertices(SCHEDULER_HEAVY_PLUGIN_SIZE / sizeof(AttrVector) + 1);
+		scheduler.send(VRayMessage::msgPluginCreate("frameMesh", "GeomStaticMesh"));
+		scheduler.send(VRayMessage::msgPluginSetProperty("frameMesh", "vertices", vertices.data(), vertices.size()));
+		scheduler.send(VRayMessage::msgPluginCreate("frameLight", "LightOmni"));
+		scheduler.send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetCurrentTime, 1.0f));
+
+		// traversal order, the large mesh and it's node come first
+		scheduler.send(VRayMessage::msgPluginCreate("bigMesh", "GeomStaticMesh"));
+		scheduler.send(VRayMessage::msgPluginSetProperty("bigMesh", "vertices", vertices.data(), vertices.size()));
+		scheduler.send(VRayMessage::msgPluginCreate("bigNode", "Node"));
+		scheduler.send(VRayMessage::msgPluginSetProperty("bigNode", "geometry", AttrValue(AttrPlugin("bigMesh"))));
+		scheduler.send(VRayMessage::msgPluginCreate("smallMesh", "GeomStaticMesh"));
+		scheduler.send(VRayMessage::msgPluginSetProperty("smallMesh", "vertices", vertices.data(), 3));
+		scheduler.send(VRayMessage::msgPluginCreate("smallNode", "Node"));
+		scheduler.send(VRayMessage::msgPluginSetProperty("smallNode", "geometry", AttrValue(AttrPlugin("smallMesh"))));
+		scheduler.send(VRayMessage::msgPluginSetProperty("smallNode", "material", AttrValue(AttrPlugin("material"))));
+		scheduler.send(VRayMessage::msgPluginCreate("material", "MtlSingleBRDF"));
+		scheduler.send(VRayMessage::msgPluginSetProperty("material", "brdf", AttrValue(AttrPlugin("brdf"))));
+		scheduler.send(VRayMessage::msgPluginCreate("brdf", "BRDFVRayMtl"));
+		scheduler.send(VRayMessage::msgPluginCreate("light", "LightRectangle"));
+		scheduler.send(VRayMessage::msgPluginCreate("view", "RenderView"));
+		scheduler.send(VRayMessage::msgPluginCreate("output", "SettingsOutput"));
+		scheduler.send(VRayMessage::msgRendererResize(640, 480));
+		check(waitFor([&]() {
+			std::lock_guard<std::mutex> lock(orderMutex);
+			return order.size() == 3 && client.getOutstandingMessages() == 0;
+		}), "messages before the barrier sent");
+		check(!scheduler.isStarted() && client.getOutstandingMessages() == 0, "messages after the barrier kept until start");
+
+		scheduler.send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::Start));
+		check(scheduler.isStarted() && scheduler.getDeferredPlugins() == 2, "large mesh and it's node deferred");
+		scheduler.send(VRayMessage::msgPluginSetProperty("light", "intensity", AttrValue(2)));
+		scheduler.send(VRayMessage::msgPluginCreate("late", "GeomStaticMesh"));
+
+		check(waitFor([&]() {
+			std::lock_guard<std::mutex> lock(orderMutex);
+			return order.size() == 15;
+		}), "all plugins received");
+		check(waitFor([&]() { return scheduler.getTimeToFirstImage() >= 0 && images == 1; }),
+		      "time to first image measured");
+		client.syncStop();
+	}
+	server.stop();
+
+	// references go first, so the brdf comes before the material listed first in the material class
+	std::lock_guard<std::mutex> lock(orderMutex);
+	const std::vector<std::string> expected = {"frameLight", "frameMesh", "time", "renderer", "output", "view", "light",
+	                                           "brdf", "material", "smallMesh", "smallNode", "start", "bigMesh", "bigNode",
+	                                           "late"};
+	if (!check(order == expected, "scheduled order")) {
+		for (const std::string & name : order) {
+			printf("%s ", name.c_str());
+		}
+		puts("");
+	}
+
+	return testResult();
+}
@@ -0,0 +1,304 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "zmq_message.hpp"
+#include "zmq_test_values.hpp"
+
+static int failures = 0;
+
+/// Report failed check, with the seed that reproduces it
+static bool check(bool condition, const char * what, uint32_t seed) {
+	if (!condition) {
+		printf("FAILED: %s (seed %u)\n", what, seed);
+		++failures;
+	}
+	return condition;
+}
+
+/// Serialize value and read it back
+static bool roundTrip(const VRayBaseTypes::AttrValue & value, VRayBaseTypes::AttrValue & result) {
+	SerializerStream out;
+	out << value;
+	DeserializerStream in(out.getData(), out.getSize());
+	in >> result;
+	return in.good() && !in.hasMore();
+}
+
+/// Random values of every type must read back equal to the written ones
+static void testValues(int iterations, uint32_t seed) {
+	for (VRayBaseTypes::ValueType type : TEST_VALUE_TYPES) {
+		ZmqTestValueGenerator generator(seed + type);
+		const VRayBaseTypes::AttrValue value = generator.value(type);
+		VRayBaseTypes::AttrValue result;
+		check(value.type == type && roundTrip(value, result) && zmqTestEqual(value, result), value.getTypeAsString(), seed + type);
+	}
+
+	for (int c = 0; c < iterations; ++c) {
+		ZmqTestValueGenerator generator(seed + c);
+		const VRayBaseTypes::AttrValue value = generator.value();
+		VRayBaseTypes::AttrValue result;
+		if (!check(roundTrip(value, result) && zmqTestEqual(value, result), "value round trip", seed + c)) {
+			return;
+		}
+	}
+}
+
+/// Every shorter prefix of a message must parse as Type::None
+static void testTruncated(const zmq::message_t & message, const char * what, uint32_t seed) {
+	const size_t size = message.size();
+	// long messages are cut at some offsets only, the cost grows with the square of the size
+	const size_t step = size > 512 ? size / 256 : 1;
+	for (size_t prefix = 0; prefix < size; prefix += step) {
+		zmq::message_t truncated(message.data(), prefix);
+		const VRayMessage parsed = VRayMessage::fromZmqMessage(truncated);
+		if (!check(parsed.getType() == VRayMessage::Type::None, what, seed)) {
+			printf("  prefix %d of %d bytes parsed\n", static_cast<int>(prefix), static_cast<int>(size));
+			return;
+		}
+	}
+}
+
+/// Messages built by VRayMessage must parse to the same fields, and their truncated data must be rejected
+static void testMessages(int iterations, uint32_t seed) {
+	for (int c = 0; c < iterations; ++c) {
+		ZmqTestValueGenerator generator(seed + c);
+		const std::string plugin = generator.string();
+		const std::string property = generator.string();
+		const VRayBaseTypes::AttrValue value = generator.value();
+
+		zmq::message_t message = VRayMessage::msgPluginSetProperty(plugin, property, value);
+		VRayMessage::Header header;
+		check(VRayMessage::peekHeader(reinterpret_cast<const char *>(message.data()), message.size(), header) &&
+		      header.type == VRayMessage::Type::ChangePlugin && header.pluginAction == VRayMessage::PluginAction::Update &&
+		      std::string(header.plugin, header.pluginSize) == plugin &&
+		      std::string(header.property, header.propertySize) == property, "peek header", seed + c);
+		testTruncated(message, "truncated set property", seed + c);
+
+		const VRayMessage parsed = VRayMessage::fromZmqMessage(message);
+		if (!check(parsed.getType() == VRayMessage::Type::ChangePlugin &&
+		           parsed.getPluginAction() == VRayMessage::PluginAction::Update && parsed.getPlugin() == plugin &&
+		           parsed.getProperty() == property && zmqTestEqual(parsed.getAttrValue(), value), "set property", seed + c)) {
+			return;
+		}
+	}
+
+	ZmqTestValueGenerator generator(seed);
+	zmq::message_t create = VRayMessage::msgPluginCreate("node", "Node");
+	const VRayMessage parsedCreate = VRayMessage::fromZmqMessage(create);
+	check(parsedCreate.getType() == VRayMessage::Type::ChangePlugin && parsedCreate.getPlugin() == "node" &&
+	      parsedCreate.getPluginType() == "Node", "create plugin", seed);
+
+	zmq::message_t replace = VRayMessage::msgPluginReplace("old", "new");
+	testTruncated(replace, "truncated replace", seed);
+	const VRayMessage parsedReplace = VRayMessage::fromZmqMessage(replace);
+	check(parsedReplace.getPluginAction() == VRayMessage::PluginAction::Replace && parsedReplace.getPluginNew() == "new",
+	      "replace plugin", seed);
+
+	zmq::message_t log = VRayMessage::msgVRayLog(3, "log line");
+	testTruncated(log, "truncated log", seed);
+	const VRayMessage parsedLog = VRayMessage::fromZmqMessage(log);
+	check(parsedLog.getType() == VRayMessage::Type::VRayLog && parsedLog.getLogLevel() == 3 &&
+	      parsedLog.getAttrValue().as<VRayBaseTypes::AttrString>().value == "log line", "log", seed);
+
+	const VRayBaseTypes::AttrValue images = generator.value(VRayBaseTypes::ValueTypeImageSet);
+	zmq::message_t image = VRayMessage::msgImageSet(images.as<VRayBaseTypes::AttrImageSet>());
+	testTruncated(image, "truncated image", seed);
+	const VRayMessage parsedImage = VRayMessage::fromZmqMessage(image);
+	check(parsedImage.getType() == VRayMessage::Type::Image && zmqTestEqual(parsedImage.getAttrValue(), images), "image", seed);
+
+	zmq::message_t resize = VRayMessage::msgRendererResize(640, 480);
+	const VRayMessage parsedResize = VRayMessage::fromZmqMessage(resize);
+	int width = 0, height = 0;
+	parsedResize.getRendererSize(width, height);
+	check(parsedResize.getRendererAction() == VRayMessage::RendererAction::Resize && width == 640 && height == 480,
+	      "resize", seed);
+
+	zmq::message_t init = VRayMessage::msgRendererActionInit(VRayMessage::RendererType::Animation,
+	                                                         VRayMessage::DRFlags::EnableDr);
+	const VRayMessage parsedInit = VRayMessage::fromZmqMessage(init);
+	check(parsedInit.getRendererAction() == VRayMessage::RendererAction::Init &&
+	      parsedInit.getRendererType() == VRayMessage::RendererType::Animation, "init", seed);
+	// init with other value type must be rejected without reading the value as int
+	zmq::message_t badInit = VRayMessage::msgRendererAction(VRayMessage::RendererAction::Init, std::string("init"));
+	check(VRayMessage::fromZmqMessage(badInit).getType() == VRayMessage::Type::None, "init with string value", seed);
+}
+
+/// Corrupted data must not crash the parser, run with address sanitizer to catch reads out of the message
+static void testCorrupted(int iterations, uint32_t seed) {
+	for (int c = 0; c < iterations; ++c) {
+		ZmqTestValueGenerator generator(seed + c);
+		zmq::message_t message = VRayMessage::msgPluginSetProperty(generator.string(), generator.string(), generator.value());
+		char * data = reinterpret_cast<char *>(message.data());
+		const int flips = generator.integer(1, 8);
+		for (int f = 0; f < flips; ++f) {
+			data[generator.integer(0, static_cast<int>(message.size()) - 1)] ^= static_cast<char>(generator.integer(1, 255));
+		}
+		VRayMessage::fromZmqMessage(message);
+	}
+}
+
+/// Nested lists deeper than DeserializerStream::MAX_VALUE_DEPTH and counts larger than the data must fail the stream
+static void testLimits(uint32_t seed) {
+	using namespace VRayBaseTypes;
+	for (int depth = DeserializerStream::MAX_VALUE_DEPTH; depth <= DeserializerStream::MAX_VALUE_DEPTH + 1; ++depth) {
+		AttrValue value(1);
+		for (int c = 0; c < depth; ++c) {
+			AttrListValue list;
+			list.append(value);
+			value = AttrValue(list);
+		}
+		AttrValue result;
+		const bool read = roundTrip(value, result);
+		check(read == (depth <= DeserializerStream::MAX_VALUE_DEPTH), "nesting limit", seed);
+		check(read ? zmqTestEqual(value, result) : result.type == ValueTypeUnknown, "nested value", seed);
+	}
+
+	const ValueType listTypes[] = {ValueTypeListInt, ValueTypeListString, ValueTypeListValue, ValueTypeMapChannels,
+	                               ValueTypeInstancer, ValueTypeImageSet, ValueTypeString};
+	for (ValueType type : listTypes) {
+		SerializerStream out;
+		out << type;
+		if (type == ValueTypeInstancer) {
+			out << 1.0f;
+		} else if (type == ValueTypeImageSet) {
+			out << RtImageUpdate;
+		}
+		out << INT_MAX << 0 << 0;
+		DeserializerStream in(out.getData(), out.getSize());
+		AttrValue result;
+		in >> result;
+		check(!in.good(), "count larger than data", seed + type);
+	}
+
+	SerializerStream out;
+	out << VRayMessage::Type::ChangePlugin << std::string("node") << VRayMessage::PluginAction::Update
+	    << std::string("property") << VRayMessage::ValueSetter::Default << ValueTypeList << 0;
+	zmq::message_t message(out.getData(), out.getSize());
+	check(VRayMessage::fromZmqMessage(message).getType() == VRayMessage::Type::None, "unknown value type", seed);
+}
+
+/// Counts written as SERIALIZER_COUNT_64 followed by int64_t must read back, negative ones must fail the stream
+static void testCounts64(uint32_t seed) {
+	using namespace VRayBaseTypes;
+	const int items[] = {1, 2, 3};
+	SerializerStream out;
+	out << ValueTypeListInt << SERIALIZER_COUNT_64 << static_cast<int64_t>(3) << items;
+	DeserializerStream in(out.getData(), out.getSize());
+	AttrValue result;
+	in >> result;
+	check(in.good() && !in.hasMore() && zmqTestEqual(result, AttrValue(AttrListInt({1, 2, 3}))), "64 bit count", seed);
+
+	const int64_t badCounts[] = {-1, INT64_MIN, INT64_MAX};
+	for (int64_t count : badCounts) {
+		SerializerStream bad;
+		bad << ValueTypeListInt << SERIALIZER_COUNT_64 << count << items;
+		DeserializerStream badIn(bad.getData(), bad.getSize());
+		badIn >> result;
+		check(!badIn.good() && result.type == ValueTypeUnknown, "invalid 64 bit count", seed);
+	}
+
+	SerializerStream marker;
+	marker << ValueTypeListInt << -2 << items;
+	DeserializerStream markerIn(marker.getData(), marker.getSize());
+	markerIn >> result;
+	check(!markerIn.good(), "unknown count marker", seed);
+}
+
+/// Chunks of a stream with a chunk sink must join to the data of a stream without one, whatever the chunk size
+static void testChunks(int iterations, uint32_t seed) {
+	const size_t chunkSizes[] = {1, 7, 4096};
+	for (int c = 0; c < iterations; ++c) {
+		ZmqTestValueGenerator generator(seed + c);
+		const VRayBaseTypes::AttrValue value = generator.value();
+		SerializerStream whole;
+		whole << value;
+
+		for (size_t chunkSize : chunkSizes) {
+			std::vector<char> joined;
+			bool bounded = true;
+			SerializerStream chunked(chunkSize, [&](const char * data, size_t size) {
+				bounded = bounded && size <= chunkSize;
+				joined.insert(joined.end(), data, data + size);
+			});
+			chunked << value;
+			check(chunked.getSize() < chunkSize && chunked.getWritten() == whole.getSize(), "chunk buffered", seed + c);
+			chunked.flush();
+			if (!check(bounded && joined.size() == whole.getSize() && !memcmp(joined.data(), whole.getData(), joined.size()),
+			           "chunks join to the whole stream", seed + c)) {
+				return;
+			}
+		}
+	}
+}
+
+/// Check if two messages have the same bytes
+static bool sameBytes(const zmq::message_t & left, const zmq::message_t & right) {
+	return left.size() == right.size() && !memcmp(left.data(), right.data(), left.size());
+}
+
+/// Spans must serialize the same as AttrList of their items, whether packed or gathered from interleaved data
+static void testSpans(uint32_t seed) {
+	using namespace VRayBaseTypes;
+	struct Vertex {
+		AttrVector position;
+		AttrVector normal;
+		AttrVector2 uv;
+	};
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+
+	// more vertices than fit in one gather batch
+	std::vector<Vertex> vertices(3 * SERIALIZER_GATHER_SIZE / sizeof(AttrVector) + 5);
+	AttrListVector positions;
+	for (Vertex & vertex : vertices) {
+		vertex.position = AttrVector(coordinate(random), coordinate(random), coordinate(random));
+		vertex.normal = AttrVector(0.0f, 0.0f, 1.0f);
+		positions.append(vertex.position);
+	}
+
+	const zmq::message_t expected = VRayMessage::msgPluginSetProperty("mesh", "vertices", positions);
+	zmq::message_t gathered = VRayMessage::msgPluginSetProperty("mesh", "vertices", &vertices[0].position, vertices.size(), sizeof(Vertex));
+	check(sameBytes(gathered, expected), "strided span", seed);
+	const zmq::message_t packed = VRayMessage::msgPluginSetProperty("mesh", "vertices", positions.getData()->data(), positions.getCount());
+	check(sameBytes(packed, expected), "packed span", seed);
+	const VRayMessage parsed = VRayMessage::fromZmqMessage(gathered);
+	check(parsed.getValueType() == ValueTypeListVector && zmqTestEqual(parsed.getAttrValue(), AttrValue(positions)),
+	      "span parses as list", seed);
+
+	const std::vector<int> faces = {0, 1, 2, 2, 1, 3};
+	check(sameBytes(VRayMessage::msgPluginSetProperty("mesh", "faces", faces.data(), faces.size()),
+	                VRayMessage::msgPluginSetProperty("mesh", "faces", AttrListInt(std::vector<int>(faces)))), "int span", seed);
+	check(sameBytes(VRayMessage::msgPluginSetProperty("mesh", "faces", static_cast<const int *>(nullptr), 0),
+	                VRayMessage::msgPluginSetProperty("mesh", "faces", AttrListInt())), "empty span", seed);
+}
+
+/// Round trip random values and messages through SerializerStream and DeserializerStream, and check that truncated
+/// and corrupted data is rejected without reading outside of it
+/// Usage: zmq_serializer_test [iterations] [seed]
+int main(int argc, char * argv[]) {
+	const int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+	const uint32_t seed = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : 1;
+	if (iterations <= 0) {
+		printf("Usage: %s [iterations] [seed]\n", argv[0]);
+		return 1;
+	}
+
+	testValues(iterations, seed);
+	testMessages(iterations / 10 + 1, seed);
+	testCorrupted(iterations, seed);
+	testLimits(seed);
+	testCounts64(seed);
+	testChunks(iterations / 10 + 1, seed);
+	testSpans(seed);
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed, %d iterations from seed %u\n", iterations, seed);
+	return 0;
+}
@@ -0,0 +1,439 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zmq_wrapper.hpp"
+#include "zmq_server.hpp"
+#include "zmq_uring_transport.hpp"
+#include "zmq_test_utils.hpp"
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif // __linux__
+
+/// Socket transport that can lose the server's responses and then the whole connection
+class LossyTransport: public ZmqTransport {
+public:
+	enum Mode {
+		Normal, ///< Pass everything
+		DropIncoming, ///< Messages reach the server, but pongs and responses are lost
+		Broken, ///< Sent messages are lost and the next receive fails, the socket is kept open when closed
+	};
+
+	/// @abandoned - receives the sockets of broken connections, so the server still sees them open
+	LossyTransport(zmq::context_t & context, std::atomic<int> & mode, std::vector<std::unique_ptr<ZmqTransport>> & abandoned)
+	    : inner(new ZmqSocketTransport(context))
+	    , mode(mode)
+	    , abandoned(abandoned)
+	{}
+
+	void connect(const std::string & endpoint, uint64_t identity) override {
+		inner->connect(endpoint, identity);
+	}
+
+	void close() override {
+		// like a half open connection, the client gave up on it but the server did not notice
+		if (mode == Broken) {
+			abandoned.push_back(std::move(inner));
+		} else {
+			inner->close();
+		}
+	}
+
+	bool send(zmq::message_t & control, zmq::message_t & payload) override {
+		return mode == Broken || inner->send(control, payload);
+	}
+
+	bool recv(zmq::message_t & control, zmq::message_t & payload) override {
+		if (mode == Broken) {
+			errno = ECONNRESET;
+			throw zmq::error_t();
+		}
+		while (inner->recv(control, payload)) {
+			if (mode == Normal) {
+				return true;
+			}
+			payload.rebuild(0);
+		}
+		return false;
+	}
+
+	bool getPollItem(zmq::pollitem_t & item, short events) override {
+		return inner->getPollItem(item, events);
+	}
+
+	short getReadyEvents(short events) override {
+		// the broken connection is noticed on the next receive
+		return mode == Broken ? (events & ZMQ_POLLIN) : inner->getReadyEvents(events);
+	}
+
+private:
+	std::unique_ptr<ZmqTransport> inner; ///< The real connection
+	std::atomic<int> & mode; ///< Mode shared with the test
+	std::vector<std::unique_ptr<ZmqTransport>> & abandoned; ///< Where the socket goes when a broken connection closes
+};
+
+/// Client reconnecting in the middle of a transaction must not lose the open transaction on the server, and the
+/// messages it resends that the server already got must not be applied twice, also while the server still has the
+/// old connection with the same identity open
+static void testReconnect(const std::string & address) {
+	std::mutex valuesMutex;
+	std::vector<int> values;
+	std::atomic<int> commits(0);
+	std::atomic<int> appliedBeforeCommit(0);
+	ZmqServer server;
+	server.setCallback([&](const VRayMessage & message, ZmqServerSession &) {
+		if (message.getType() != VRayMessage::Type::ChangePlugin) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(valuesMutex);
+		values.push_back(message.getAttrValue().as<int>());
+		appliedBeforeCommit += commits == 0;
+	});
+	server.setCommitCallback([&](VRayBaseTypes::CommitAction, ZmqServerSession &) {
+		++commits;
+	});
+	if (!check(server.bind(address.c_str()), "bind for reconnect")) {
+		return;
+	}
+
+	std::atomic<int> mode(LossyTransport::Normal);
+	ZmqClient client;
+	// closed before the client, while it's context is alive
+	std::vector<std::unique_ptr<ZmqTransport>> abandoned;
+	client.setReconnect(-1);
+	client.setTransportFactory([&mode, &abandoned](zmq::context_t & context) {
+		// each reconnect gets a working connection
+		mode = LossyTransport::Normal;
+		return std::unique_ptr<ZmqTransport>(new LossyTransport(context, mode, abandoned));
+	});
+	client.connect(address.c_str());
+
+	auto sendValue = [&client](int value) {
+		client.send(VRayMessage::msgPluginSetProperty("reconnect", "value", VRayBaseTypes::AttrValue(value)));
+	};
+
+	// the begin and first messages are confirmed, so they are not resent
+	client.beginTransaction();
+	sendValue(0);
+	sendValue(1);
+	check(waitFor([&]() { return server.getReceivedMessages() == 2; }), "first part of the transaction received");
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	// these reach the server, but it's confirmation does not reach the client, so they are resent as duplicates
+	mode = LossyTransport::DropIncoming;
+	sendValue(2);
+	sendValue(3);
+	check(waitFor([&]() { return server.getReceivedMessages() == 4; }), "unconfirmed messages received");
+
+	mode = LossyTransport::Broken;
+	sendValue(4);
+	client.commitTransaction();
+
+	check(waitFor([&]() { return commits == 1; }), "transaction committed after reconnect");
+	check(client.getReconnectCount() >= 1, "client reconnected");
+	client.syncStop();
+	check(!abandoned.empty(), "old connection left open");
+	server.stop();
+	for (auto & transport : abandoned) {
+		transport->close();
+	}
+
+	std::lock_guard<std::mutex> lock(valuesMutex);
+	check(values == std::vector<int>({0, 1, 2, 3, 4}), "transaction applied once and in order");
+	check(appliedBeforeCommit == 5 && commits == 1, "transaction kept open over the reconnect");
+}
+
+#ifdef __linux__
+
+/// Connect plain TCP socket to the port on loopback
+/// @return - the socket, -1 on error
+static int connectLoopback(int port) {
+	const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16_t>(port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (fd != -1 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/// Client sending with the stream framing must get the same service as zmq clients, and a malformed stream must be
+/// closed without affecting the other connections
+static void testStream(int port) {
+	const std::string address = "tcp://127.0.0.1:" + std::to_string(port);
+	const std::string streamAddress = "tcp://127.0.0.1:" + std::to_string(port + 1);
+	const int messageCount = 1000;
+	std::atomic<int> received(0);
+	std::atomic<int> outOfOrder(0);
+	std::atomic<int> largeReceived(0);
+	std::atomic<int> commits(0);
+
+	ZmqServer server(2);
+	server.setCallback([&](const VRayMessage & message, ZmqServerSession & session) {
+		if (message.getType() == VRayMessage::Type::ChangeRenderer) {
+			int width = 0, height = 0;
+			message.getRendererSize(width, height);
+			session.reply(VRayMessage::msgRendererResize(width * 2, height * 2));
+			return;
+		}
+		if (message.getPlugin() == "large") {
+			++largeReceived;
+			return;
+		}
+		if (message.getAttrValue().as<int>() != received) {
+			++outOfOrder;
+		}
+		++received;
+	});
+	server.setCommitCallback([&](VRayBaseTypes::CommitAction, ZmqServerSession &) {
+		++commits;
+	});
+	{
+		ZmqServer invalid;
+		invalid.setStreamAddress("tcp://127.0.0.1");
+		check(!invalid.bind(address.c_str()) && !invalid.good(), "invalid stream address fails the bind");
+	}
+	server.setStreamAddress(streamAddress);
+	if (!check(server.bind(address.c_str()), "bind with stream address")) {
+		return;
+	}
+
+	ZmqClient client;
+	client.setTransportFactory(ZmqUringTransport::factory());
+	client.connect(streamAddress.c_str());
+	for (int m = 0; m < messageCount; ++m) {
+		client.send(VRayMessage::msgPluginSetProperty("stream", "value", VRayBaseTypes::AttrValue(m)));
+	}
+	// sent in place instead of through the staging buffers
+	const VRayBaseTypes::AttrListInt list(std::vector<int>(URING_ZC_MIN_PAYLOAD, 7));
+	client.send(VRayMessage::msgPluginSetProperty("large", "list", list));
+	check(waitFor([&]() { return received == messageCount && largeReceived == 1; }), "stream messages received");
+	check(outOfOrder == 0, "stream messages in order");
+	check(server.getSessionCount() == 1, "stream client has a session");
+
+	std::future<VRayMessage> response = client.request(VRayMessage::msgRendererResize(320, 240));
+	if (check(response.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "response over the stream")) {
+		int width = 0, height = 0;
+		response.get().getRendererSize(width, height);
+		check(width == 640 && height == 480, "stream response content");
+	}
+
+	client.beginTransaction();
+	client.send(VRayMessage::msgPluginSetProperty("stream", "value", VRayBaseTypes::AttrValue(messageCount)));
+	client.commitTransaction();
+	check(waitFor([&]() { return commits == 1 && received == messageCount + 1; }), "stream transaction committed");
+
+	// a frame over the size limit closes the connection before anything is allocated for it
+	const int fd = connectLoopback(port + 1);
+	if (check(fd != -1, "raw stream connection")) {
+		const ZmqStreamPreamble preamble = {ZmqStreamPreamble::MAGIC, ZmqStreamPreamble::FORMAT_VERSION, 1};
+		const ZmqStreamFrameHeader header = {0, 0, ZmqStreamFrameHeader::MAX_PAYLOAD_SIZE + 1};
+		char bytes[sizeof(preamble) + sizeof(header)];
+		memcpy(bytes, &preamble, sizeof(preamble));
+		memcpy(bytes + sizeof(preamble), &header, sizeof(header));
+		timeval timeout = {5, 0};
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		char reply;
+		check(send(fd, bytes, sizeof(bytes), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(bytes)) &&
+		      recv(fd, &reply, 1, 0) == 0, "malformed stream closed");
+		close(fd);
+	}
+
+	client.send(VRayMessage::msgPluginSetProperty("stream", "value", VRayBaseTypes::AttrValue(messageCount + 1)));
+	check(waitFor([&]() { return received == messageCount + 2; }) && client.good(), "other stream unaffected");
+	client.syncStop();
+	server.stop();
+}
+
+#endif // __linux__
+
+/// Messages of each client must arrive in order, requests must get their responses, transactions must be applied at
+/// once on commit, large messages must come through shared memory when the client offers it, chunked messages must be
+/// joined back, reconnecting clients must resume where they left off and clients of the io_uring transport must be
+/// served through the stream listener, on port and port + 1
+/// Usage: zmq_server_test [address] [port]
+int main(int argc, char * argv[]) {
+	const std::string address = argc > 1 ? argv[1] : "ipc://zmq-server-test";
+	const int port = argc > 2 ? atoi(argv[2]) : 5596;
+	const std::string shmAddress = "shm://zmq-server-test-shm@" + address;
+	const int clientCount = 8;
+	const int messageCount = 2000;
+
+	std::mutex eventsMutex;
+	std::vector<std::string> events;
+	std::vector<int> nextValue(clientCount, 0);
+	std::atomic<int> outOfOrder(0);
+	std::atomic<int> received(0);
+	std::atomic<int> largeReceived(0);
+	std::atomic<int> sharedMemorySessions(0);
+	std::atomic<int> chunkedReceived(0);
+	std::vector<int> chunkedValues(1 << 20);
+	for (size_t c = 0; c < chunkedValues.size(); ++c) {
+		chunkedValues[c] = static_cast<int>(c * 2654435761u);
+	}
+	const VRayBaseTypes::AttrListInt chunkedList{std::vector<int>(chunkedValues)};
+
+	ZmqServer server(4);
+	server.setCallback([&](const VRayMessage & message, ZmqServerSession & session) {
+		if (message.getType() == VRayMessage::Type::ChangeRenderer) {
+			// echo requests back with the size of the renderer
+			int width = 0, height = 0;
+			message.getRendererSize(width, height);
+			session.reply(VRayMessage::msgRendererResize(width * 2, height * 2));
+			return;
+		}
+		if (message.getType() != VRayMessage::Type::ChangePlugin) {
+			return;
+		}
+		if (message.getPlugin() == "large") {
+			++largeReceived;
+			return;
+		}
+		if (message.getPlugin() == "chunked") {
+			if (message.getValueType() == VRayBaseTypes::ValueTypeListInt &&
+			    *message.getValue<VRayBaseTypes::AttrListInt>()->getData() == chunkedValues) {
+				++chunkedReceived;
+			}
+			return;
+		}
+		const int client = atoi(message.getPlugin().c_str());
+		const int value = message.getAttrValue().as<int>();
+		if (client < 0 || client >= clientCount || nextValue[client] != value) {
+			++outOfOrder;
+		} else {
+			++nextValue[client];
+		}
+		++received;
+	});
+	server.setCommitCallback([&](VRayBaseTypes::CommitAction action, ZmqServerSession &) {
+		std::lock_guard<std::mutex> lock(eventsMutex);
+		events.push_back("commit " + std::to_string(action) + " after " + std::to_string(received));
+	});
+	server.setSessionCallback([&](ZmqServerEvent event, ZmqServerSession & session) {
+		if (event == ZmqServerEvent::Connected && session.usesSharedMemory()) {
+			++sharedMemorySessions;
+		}
+		std::lock_guard<std::mutex> lock(eventsMutex);
+		events.push_back(event == ZmqServerEvent::Connected ? "connected" : event == ZmqServerEvent::Stop ? "stop" : "closed");
+	});
+	if (!check(server.bind(address.c_str()), "bind")) {
+		return 1;
+	}
+	check(!server.bind(address.c_str()), "second bind fails");
+
+	{
+		auto runtime = std::make_shared<ZmqClientRuntime>();
+		std::vector<std::unique_ptr<ZmqClient>> clients;
+		for (int c = 0; c < clientCount; ++c) {
+			clients.push_back(std::unique_ptr<ZmqClient>(new ZmqClient(false, runtime)));
+			clients.back()->connect(address.c_str());
+		}
+		for (int m = 0; m < messageCount; ++m) {
+			for (int c = 0; c < clientCount; ++c) {
+				clients[c]->send(VRayMessage::msgPluginSetProperty(std::to_string(c), "value", VRayBaseTypes::AttrValue(m)));
+			}
+		}
+		check(waitFor([&]() { return received == clientCount * messageCount; }), "all messages received");
+		check(outOfOrder == 0, "messages of each client in order");
+		check(server.getSessionCount() == clientCount, "session per client");
+		check(server.getReceivedMessages() == static_cast<uint64_t>(clientCount * messageCount), "received count");
+
+		std::future<VRayMessage> response = clients[0]->request(VRayMessage::msgRendererResize(320, 240));
+		if (check(response.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "response to request")) {
+			int width = 0, height = 0;
+			response.get().getRendererSize(width, height);
+			check(width == 640 && height == 480, "response content");
+		}
+
+		// messages of the transaction are held until the commit
+		const int before = received;
+		clients[1]->beginTransaction();
+		for (int m = 0; m < 10; ++m) {
+			clients[1]->send(VRayMessage::msgPluginSetProperty("1", "value", VRayBaseTypes::AttrValue(messageCount + m)));
+		}
+		clients[1]->waitForMessages(5000);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		check(received == before, "transaction held until commit");
+		clients[1]->commitTransaction(VRayBaseTypes::CommitNowForce);
+		check(waitFor([&]() { return received == before + 10; }), "transaction applied");
+		{
+			std::lock_guard<std::mutex> lock(eventsMutex);
+			check(!events.empty() && events.back() == "commit " + std::to_string(VRayBaseTypes::CommitNowForce) + " after " +
+			      std::to_string(before + 10), "commit after the messages of the transaction");
+		}
+
+		clients[2]->stopServer();
+		clients[2]->syncStop();
+		check(waitFor([&]() {
+			std::lock_guard<std::mutex> lock(eventsMutex);
+			return std::find(events.begin(), events.end(), "stop") != events.end();
+		}), "stop event");
+
+		for (auto & client : clients) {
+			client->syncStop();
+		}
+	}
+
+	{
+		ZmqClient client;
+		client.connect(shmAddress.c_str());
+		const VRayBaseTypes::AttrListInt list(std::vector<int>(SHM_MIN_PAYLOAD, 7));
+		for (int m = 0; m < 100; ++m) {
+			client.send(VRayMessage::msgPluginSetProperty("large", "list", list));
+		}
+		check(waitFor([&]() { return largeReceived == 100; }), "large messages received");
+		// the client counts the message after the send returns, which can be after the server got it
+		check(waitFor([&]() { return client.getSharedMemoryMessages() == 100; }) && sharedMemorySessions == 1,
+		      "large messages through shared memory");
+		client.syncStop();
+	}
+
+	{
+		// chunks from two threads at once, the server must keep the parts of each message apart
+		ZmqClient client;
+		client.connect(address.c_str());
+		auto sendChunked = [&]() {
+			client.sendChunked([&](SerializerStream & stream) {
+				VRayMessage::writePluginSetProperty(stream, "chunked", "list", chunkedList);
+			}, 64 << 10);
+		};
+		std::thread other(sendChunked);
+		sendChunked();
+		other.join();
+		check(waitFor([&]() { return chunkedReceived == 2; }), "chunked messages joined");
+		client.syncStop();
+	}
+
+	server.stop();
+	check(!server.good() && server.getSessionCount() == 0, "stopped");
+	{
+		std::lock_guard<std::mutex> lock(eventsMutex);
+		check(std::count(events.begin(), events.end(), "connected") == clientCount + 2, "connected events");
+		check(std::count(events.begin(), events.end(), "closed") == clientCount + 2, "closed events");
+	}
+
+	testReconnect(address);
+#ifdef __linux__
+	testStream(port);
+#endif // __linux__
+
+	return testResult();
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "zmq_stream.hpp"
+#include "zmq_test_utils.hpp"
+
+/// Append frame with the control and payload bytes to the stream
+static void appendFrame(std::vector<char> & stream, const std::string & control, const std::string & payload) {
+	const ZmqStreamFrameHeader header = {static_cast<uint32_t>(control.size()), 0, payload.size()};
+	const char * bytes = reinterpret_cast<const char *>(&header);
+	stream.insert(stream.end(), bytes, bytes + sizeof(header));
+	stream.insert(stream.end(), control.begin(), control.end());
+	stream.insert(stream.end(), payload.begin(), payload.end());
+}
+
+/// Parse the stream in pieces of @step bytes
+/// @return - false if the parser rejected it
+static bool parseInSteps(ZmqStreamParser & parser, const std::vector<char> & stream, size_t step) {
+	for (size_t offset = 0; offset < stream.size(); offset += step) {
+		if (!parser.parse(stream.data() + offset, std::min(step, stream.size() - offset))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Messages must be split out of the stream however it is received, frames over the size limits and streams with
+/// invalid preamble must be rejected
+/// Usage: zmq_stream_test
+int main() {
+	const ZmqStreamPreamble preamble = {ZmqStreamPreamble::MAGIC, ZmqStreamPreamble::FORMAT_VERSION, 42};
+	std::vector<char> stream(reinterpret_cast<const char *>(&preamble), reinterpret_cast<const char *>(&preamble + 1));
+	const std::vector<std::pair<std::string, std::string>> frames = {
+		{"control", "payload"},
+		{"empty", ""},
+		{"", "no control"},
+		{"", ""},
+		{"large", std::string(100000, 'x')},
+	};
+	for (const auto & frame : frames) {
+		appendFrame(stream, frame.first, frame.second);
+	}
+
+	for (size_t step : {size_t(1), size_t(7), size_t(4096), stream.size()}) {
+		ZmqStreamParser parser(true);
+		check(parseInSteps(parser, stream, step) && parser.hasPreamble(), "stream parsed");
+		check(parser.getPreamble().identity == 42, "identity from preamble");
+		size_t count = 0;
+		zmq::message_t control, payload;
+		while (parser.pop(control, payload)) {
+			if (count < frames.size()) {
+				check(std::string(reinterpret_cast<const char *>(control.data()), control.size()) == frames[count].first &&
+				      std::string(reinterpret_cast<const char *>(payload.data()), payload.size()) == frames[count].second,
+				      "message parsed");
+			}
+			++count;
+		}
+		check(count == frames.size() && parser.empty(), "all messages parsed");
+	}
+
+	{
+		ZmqStreamParser parser(false);
+		std::vector<char> bytes;
+		appendFrame(bytes, "control", "payload");
+		check(parser.parse(bytes.data(), bytes.size()) && !parser.empty(), "stream without preamble");
+		parser.reset();
+		check(parser.empty(), "reset forgets messages");
+	}
+
+	{
+		ZmqStreamParser parser(true);
+		ZmqStreamPreamble wrong = preamble;
+		wrong.magic = 0;
+		check(!parser.parse(reinterpret_cast<const char *>(&wrong), sizeof(wrong)) && !parser.hasPreamble(), "invalid magic");
+		parser.reset();
+		check(parser.parse(stream.data(), stream.size()) && !parser.empty(), "stream accepted after reset");
+	}
+
+	// invalid headers are rejected before their payload is allocated
+	const ZmqStreamFrameHeader invalid[] = {
+		{ZmqStreamFrameHeader::MAX_CONTROL_SIZE + 1, 0, 0},
+		{0, 1, 0},
+		{0, 0, ZmqStreamFrameHeader::MAX_PAYLOAD_SIZE + 1},
+		{0, 0, UINT64_MAX},
+	};
+	for (const ZmqStreamFrameHeader & header : invalid) {
+		ZmqStreamParser parser(false);
+		check(!parser.parse(reinterpret_cast<const char *>(&header), sizeof(header)), "invalid header rejected");
+		check(!parser.parse(stream.data(), stream.size()), "nothing parsed after invalid header");
+	}
+
+	return testResult();
+}
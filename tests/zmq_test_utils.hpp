@@ -0,0 +1,44 @@
+#ifndef _ZMQ_TEST_UTILS_H_
+#define _ZMQ_TEST_UTILS_H_
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+/// Number of failed checks, each test includes this header once
+static int failures = 0;
+
+/// Report failed check
+static bool check(bool condition, const char * what) {
+	if (!condition) {
+		printf("FAILED: %s\n", what);
+		++failures;
+	}
+	return condition;
+}
+
+/// Wait until condition is true or the timeout passes
+template <typename F>
+static bool waitFor(F condition, int timeout = 5000) {
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	while (!condition()) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+/// Print the summary of the checks
+/// @return - exit code of the test
+static int testResult() {
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	puts("All checks passed");
+	return 0;
+}
+
+#endif // _ZMQ_TEST_UTILS_H_
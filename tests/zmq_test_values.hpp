@@ -0,0 +1,316 @@
+#ifndef _ZMQ_TEST_VALUES_H_
+#define _ZMQ_TEST_VALUES_H_
+
+#include <climits>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "base_types.h"
+
+/// Value types that can be sent, in the order of ValueType
+static const VRayBaseTypes::ValueType TEST_VALUE_TYPES[] = {
+	VRayBaseTypes::ValueTypeInt,
+	VRayBaseTypes::ValueTypeFloat,
+	VRayBaseTypes::ValueTypeDouble,
+	VRayBaseTypes::ValueTypeColor,
+	VRayBaseTypes::ValueTypeAColor,
+	VRayBaseTypes::ValueTypeVector,
+	VRayBaseTypes::ValueTypeVector2,
+	VRayBaseTypes::ValueTypeMatrix,
+	VRayBaseTypes::ValueTypeTransform,
+	VRayBaseTypes::ValueTypeString,
+	VRayBaseTypes::ValueTypePlugin,
+	VRayBaseTypes::ValueTypeImageSet,
+	VRayBaseTypes::ValueTypeListInt,
+	VRayBaseTypes::ValueTypeListFloat,
+	VRayBaseTypes::ValueTypeListColor,
+	VRayBaseTypes::ValueTypeListVector,
+	VRayBaseTypes::ValueTypeListVector2,
+	VRayBaseTypes::ValueTypeListMatrix,
+	VRayBaseTypes::ValueTypeListTransform,
+	VRayBaseTypes::ValueTypeListString,
+	VRayBaseTypes::ValueTypeListPlugin,
+	VRayBaseTypes::ValueTypeListValue,
+	VRayBaseTypes::ValueTypeInstancer,
+	VRayBaseTypes::ValueTypeMapChannels,
+};
+
+/// Generator of random values for round trip tests
+class ZmqTestValueGenerator {
+public:
+	/// @seed - seed for the random engine, same seed generates same values
+	/// @maxDepth - max nesting of ValueTypeListValue
+	explicit ZmqTestValueGenerator(uint32_t seed, int maxDepth = 4)
+	    : engine(seed)
+	    , maxDepth(maxDepth)
+	{}
+
+	/// Get random value of random type
+	VRayBaseTypes::AttrValue value(int depth = 0) {
+		const int typeCount = sizeof(TEST_VALUE_TYPES) / sizeof(TEST_VALUE_TYPES[0]);
+		VRayBaseTypes::ValueType type = TEST_VALUE_TYPES[integer(0, typeCount - 1)];
+		if (type == VRayBaseTypes::ValueTypeListValue && depth >= maxDepth) {
+			type = VRayBaseTypes::ValueTypeInt;
+		}
+		return value(type, depth);
+	}
+
+	/// Get random value of given type
+	VRayBaseTypes::AttrValue value(VRayBaseTypes::ValueType type, int depth = 0) {
+		using namespace VRayBaseTypes;
+		switch (type) {
+		case ValueTypeInt: return AttrValue(integer(INT_MIN, INT_MAX));
+		case ValueTypeFloat: return AttrValue(real());
+		case ValueTypeDouble: return AttrValue(AttrDouble(std::uniform_real_distribution<double>(-1e300, 1e300)(engine)));
+		case ValueTypeColor: return AttrValue(color());
+		case ValueTypeAColor: return AttrValue(AttrAColor(color(), real()));
+		case ValueTypeVector: return AttrValue(vector());
+		case ValueTypeVector2: return AttrValue(vector2());
+		case ValueTypeMatrix: return AttrValue(matrix());
+		case ValueTypeTransform: return AttrValue(transform());
+		case ValueTypeString: return AttrValue(string());
+		case ValueTypePlugin: return AttrValue(plugin());
+		case ValueTypeImageSet: return AttrValue(imageSet());
+		case ValueTypeListInt: return AttrValue(list<int>([this]() { return integer(INT_MIN, INT_MAX); }));
+		case ValueTypeListFloat: return AttrValue(list<float>([this]() { return real(); }));
+		case ValueTypeListColor: return AttrValue(list<AttrColor>([this]() { return color(); }));
+		case ValueTypeListVector: return AttrValue(list<AttrVector>([this]() { return vector(); }));
+		case ValueTypeListVector2: return AttrValue(list<AttrVector2>([this]() { return vector2(); }));
+		case ValueTypeListMatrix: return AttrValue(list<AttrMatrix>([this]() { return matrix(); }));
+		case ValueTypeListTransform: return AttrValue(list<AttrTransform>([this]() { return transform(); }));
+		case ValueTypeListString: return AttrValue(list<std::string>([this]() { return string(); }));
+		case ValueTypeListPlugin: return AttrValue(list<AttrPlugin>([this]() { return plugin(); }));
+		case ValueTypeListValue: return AttrValue(list<AttrValue>([this, depth]() { return value(depth + 1); }));
+		case ValueTypeInstancer: return AttrValue(instancer());
+		case ValueTypeMapChannels: return AttrValue(mapChannels());
+		default: return AttrValue();
+		}
+	}
+
+	/// Get random string, including empty and binary ones
+	std::string string() {
+		std::string result(integer(0, 40), '\0');
+		for (char & c : result) {
+			c = static_cast<char>(integer(0, 255));
+		}
+		return result;
+	}
+
+	int integer(int min, int max) {
+		return std::uniform_int_distribution<int>(min, max)(engine);
+	}
+
+private:
+	float real() {
+		return std::uniform_real_distribution<float>(-1e6f, 1e6f)(engine);
+	}
+
+	VRayBaseTypes::AttrColor color() {
+		return VRayBaseTypes::AttrColor(real(), real(), real());
+	}
+
+	VRayBaseTypes::AttrVector vector() {
+		return VRayBaseTypes::AttrVector(real(), real(), real());
+	}
+
+	VRayBaseTypes::AttrVector2 vector2() {
+		VRayBaseTypes::AttrVector2 result;
+		result.x = real();
+		result.y = real();
+		return result;
+	}
+
+	VRayBaseTypes::AttrMatrix matrix() {
+		VRayBaseTypes::AttrMatrix result;
+		result.v0 = vector();
+		result.v1 = vector();
+		result.v2 = vector();
+		return result;
+	}
+
+	VRayBaseTypes::AttrTransform transform() {
+		VRayBaseTypes::AttrTransform result;
+		result.m = matrix();
+		result.offs = vector();
+		return result;
+	}
+
+	VRayBaseTypes::AttrPlugin plugin() {
+		VRayBaseTypes::AttrPlugin result(string());
+		result.output = string();
+		return result;
+	}
+
+	template <typename T, typename F>
+	VRayBaseTypes::AttrList<T> list(F item) {
+		VRayBaseTypes::AttrList<T> result;
+		const int count = integer(0, 8);
+		for (int c = 0; c < count; ++c) {
+			result.append(item());
+		}
+		return result;
+	}
+
+	VRayBaseTypes::AttrImageSet imageSet() {
+		VRayBaseTypes::AttrImageSet result(static_cast<VRayBaseTypes::ImageSourceType>(integer(0, 3)));
+		const int count = integer(0, 3);
+		for (int c = 0; c < count; ++c) {
+			const std::string data = string();
+			const VRayBaseTypes::AttrImage image(data.data(), data.size(),
+			                                     static_cast<VRayBaseTypes::AttrImage::ImageType>(integer(0, 4)),
+			                                     integer(0, 4096), integer(0, 4096), integer(-1, 4096), integer(-1, 4096));
+			result.images.emplace(static_cast<VRayBaseTypes::RenderChannelType>(integer(0, 100)), image);
+		}
+		return result;
+	}
+
+	VRayBaseTypes::AttrInstancer instancer() {
+		VRayBaseTypes::AttrInstancer result;
+		result.frameNumber = real();
+		result.data = list<VRayBaseTypes::AttrInstancer::Item>([this]() {
+			VRayBaseTypes::AttrInstancer::Item item;
+			item.index = integer(INT_MIN, INT_MAX);
+			item.tm = transform();
+			item.vel = transform();
+			item.node = plugin();
+			return item;
+		});
+		return result;
+	}
+
+	VRayBaseTypes::AttrMapChannels mapChannels() {
+		VRayBaseTypes::AttrMapChannels result;
+		const int count = integer(0, 3);
+		for (int c = 0; c < count; ++c) {
+			VRayBaseTypes::AttrMapChannels::AttrMapChannel channel;
+			channel.vertices = list<VRayBaseTypes::AttrVector>([this]() { return vector(); });
+			channel.faces = list<int>([this]() { return integer(0, 1000); });
+			channel.name = string();
+			result.data.emplace(string(), channel);
+		}
+		return result;
+	}
+
+	std::mt19937 engine; ///< Source of all random values
+	const int maxDepth; ///< Max nesting of lists of values
+};
+
+
+/// Compare POD values by their bytes, so NaN and negative zero must match too
+template <typename T>
+inline bool zmqTestEqualBytes(const T & left, const T & right) {
+	return !memcmp(&left, &right, sizeof(T));
+}
+
+inline bool zmqTestEqual(const VRayBaseTypes::AttrValue & left, const VRayBaseTypes::AttrValue & right);
+inline bool zmqTestEqual(const VRayBaseTypes::AttrInstancer::Item & left, const VRayBaseTypes::AttrInstancer::Item & right);
+
+inline bool zmqTestEqual(const VRayBaseTypes::AttrPlugin & left, const VRayBaseTypes::AttrPlugin & right) {
+	return left.plugin == right.plugin && left.output == right.output;
+}
+
+inline bool zmqTestEqual(const std::string & left, const std::string & right) {
+	return left == right;
+}
+
+/// Compare lists of POD items by their bytes
+template <typename T>
+inline bool zmqTestEqualList(const VRayBaseTypes::AttrList<T> & left, const VRayBaseTypes::AttrList<T> & right) {
+	return left.getCount() == right.getCount() &&
+	       (left.empty() || !memcmp(left.getData()->data(), right.getData()->data(), left.getCount() * sizeof(T)));
+}
+
+/// Compare lists of non POD items item by item
+template <typename T>
+inline bool zmqTestEqualItems(const VRayBaseTypes::AttrList<T> & left, const VRayBaseTypes::AttrList<T> & right) {
+	if (left.getCount() != right.getCount()) {
+		return false;
+	}
+	for (size_t c = 0; c < left.getCount(); ++c) {
+		if (!zmqTestEqual((*left.getData())[c], (*right.getData())[c])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool zmqTestEqual(const VRayBaseTypes::AttrImage & left, const VRayBaseTypes::AttrImage & right) {
+	return left.imageType == right.imageType && left.size == right.size && left.width == right.width &&
+	       left.height == right.height && left.x == right.x && left.y == right.y &&
+	       (!left.size || !memcmp(left.data.get(), right.data.get(), left.size));
+}
+
+inline bool zmqTestEqual(const VRayBaseTypes::AttrImageSet & left, const VRayBaseTypes::AttrImageSet & right) {
+	if (left.sourceType != right.sourceType || left.images.size() != right.images.size()) {
+		return false;
+	}
+	for (const auto & image : left.images) {
+		const auto other = right.images.find(image.first);
+		if (other == right.images.end() || !zmqTestEqual(image.second, other->second)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool zmqTestEqual(const VRayBaseTypes::AttrInstancer::Item & left, const VRayBaseTypes::AttrInstancer::Item & right) {
+	return left.index == right.index && zmqTestEqualBytes(left.tm, right.tm) && zmqTestEqualBytes(left.vel, right.vel) &&
+	       zmqTestEqual(left.node, right.node);
+}
+
+inline bool zmqTestEqual(const VRayBaseTypes::AttrInstancer & left, const VRayBaseTypes::AttrInstancer & right) {
+	return zmqTestEqualBytes(left.frameNumber, right.frameNumber) && zmqTestEqualItems(left.data, right.data);
+}
+
+inline bool zmqTestEqual(const VRayBaseTypes::AttrMapChannels & left, const VRayBaseTypes::AttrMapChannels & right) {
+	if (left.data.size() != right.data.size()) {
+		return false;
+	}
+	for (const auto & channel : left.data) {
+		const auto other = right.data.find(channel.first);
+		if (other == right.data.end() || channel.second.name != other->second.name ||
+		    !zmqTestEqualList(channel.second.vertices, other->second.vertices) ||
+		    !zmqTestEqualList(channel.second.faces, other->second.faces)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Deep compare values, lists and maps included
+inline bool zmqTestEqual(const VRayBaseTypes::AttrValue & left, const VRayBaseTypes::AttrValue & right) {
+	using namespace VRayBaseTypes;
+	if (left.type != right.type) {
+		return false;
+	}
+	switch (left.type) {
+	case ValueTypeInt: return zmqTestEqualBytes(left.as<AttrInt>(), right.as<AttrInt>());
+	case ValueTypeFloat: return zmqTestEqualBytes(left.as<AttrFloat>(), right.as<AttrFloat>());
+	case ValueTypeDouble: return zmqTestEqualBytes(left.as<AttrDouble>(), right.as<AttrDouble>());
+	case ValueTypeColor: return zmqTestEqualBytes(left.as<AttrColor>(), right.as<AttrColor>());
+	case ValueTypeAColor: return zmqTestEqualBytes(left.as<AttrAColor>(), right.as<AttrAColor>());
+	case ValueTypeVector: return zmqTestEqualBytes(left.as<AttrVector>(), right.as<AttrVector>());
+	case ValueTypeVector2: return zmqTestEqualBytes(left.as<AttrVector2>(), right.as<AttrVector2>());
+	case ValueTypeMatrix: return zmqTestEqualBytes(left.as<AttrMatrix>(), right.as<AttrMatrix>());
+	case ValueTypeTransform: return zmqTestEqualBytes(left.as<AttrTransform>(), right.as<AttrTransform>());
+	case ValueTypeString: return left.as<AttrString>().value == right.as<AttrString>().value;
+	case ValueTypePlugin: return zmqTestEqual(left.as<AttrPlugin>(), right.as<AttrPlugin>());
+	case ValueTypeImageSet: return zmqTestEqual(left.as<AttrImageSet>(), right.as<AttrImageSet>());
+	case ValueTypeListInt: return zmqTestEqualList(left.as<AttrListInt>(), right.as<AttrListInt>());
+	case ValueTypeListFloat: return zmqTestEqualList(left.as<AttrListFloat>(), right.as<AttrListFloat>());
+	case ValueTypeListColor: return zmqTestEqualList(left.as<AttrListColor>(), right.as<AttrListColor>());
+	case ValueTypeListVector: return zmqTestEqualList(left.as<AttrListVector>(), right.as<AttrListVector>());
+	case ValueTypeListVector2: return zmqTestEqualList(left.as<AttrListVector2>(), right.as<AttrListVector2>());
+	case ValueTypeListMatrix: return zmqTestEqualList(left.as<AttrListMatrix>(), right.as<AttrListMatrix>());
+	case ValueTypeListTransform: return zmqTestEqualList(left.as<AttrListTransform>(), right.as<AttrListTransform>());
+	case ValueTypeListString: return zmqTestEqualItems(left.as<AttrListString>(), right.as<AttrListString>());
+	case ValueTypeListPlugin: return zmqTestEqualItems(left.as<AttrListPlugin>(), right.as<AttrListPlugin>());
+	case ValueTypeListValue: return zmqTestEqualItems(left.as<AttrListValue>(), right.as<AttrListValue>());
+	case ValueTypeInstancer: return zmqTestEqual(left.as<AttrInstancer>(), right.as<AttrInstancer>());
+	case ValueTypeMapChannels: return zmqTestEqual(left.as<AttrMapChannels>(), right.as<AttrMapChannels>());
+	default: return false;
+	}
+}
+
+#endif // _ZMQ_TEST_VALUES_H_
@@ -0,0 +1,105 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zmq_trace.hpp"
+#include "zmq_test_utils.hpp"
+
+/// Get the size of the file
+/// @return - -1 if it can't be opened
+static long fileSize(const std::string & path) {
+	FILE * file = fopen(path.c_str(), "rb");
+	if (!file) {
+		return -1;
+	}
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+/// Check if the bytes of the frame are the same as @expected
+static bool sameBytes(const char * data, size_t size, const std::string & expected) {
+	return size == expected.size() && !memcmp(data, expected.data(), size);
+}
+
+/// Records written from two threads and one larger than the initial file size must be read back in the order written
+/// with growing timestamps, and closing the writer must truncate the file to the written records
+/// Usage: zmq_trace_test [path]
+int main(int argc, char * argv[]) {
+	const std::string path = argc > 1 ? argv[1] : "zmq-trace-test.trace";
+	const int perThread = 1000;
+	// larger than the initial size of the file, so it must grow
+	const std::string large(20 << 20, 'l');
+
+	{
+		ZmqTraceWriter writer;
+		writer.record(ZmqTraceDirection::Outgoing, zmq::message_t("c", 1), zmq::message_t("p", 1));
+		check(!writer.good() && writer.getRecordCount() == 0, "record before open ignored");
+		if (!check(writer.open(path.c_str()) && writer.good(), "open writer")) {
+			return testResult();
+		}
+
+		auto write = [&writer](ZmqTraceDirection direction, const char * prefix) {
+			for (int c = 0; c < perThread; ++c) {
+				const std::string payload = prefix + std::to_string(c);
+				writer.record(direction, zmq::message_t("control", 7), zmq::message_t(payload.data(), payload.size()));
+			}
+		};
+		std::thread other(write, ZmqTraceDirection::Incoming, "in ");
+		write(ZmqTraceDirection::Outgoing, "out ");
+		other.join();
+
+		writer.record(ZmqTraceDirection::Outgoing, zmq::message_t(), zmq::message_t(large.data(), large.size()));
+		writer.record(ZmqTraceDirection::Incoming, zmq::message_t("last", 4), zmq::message_t());
+		check(writer.getRecordCount() == 2 * perThread + 2, "records written");
+		writer.close();
+		check(!writer.good(), "writer closed");
+	}
+
+	ZmqTraceReader reader;
+	if (!check(reader.open(path.c_str()), "open reader")) {
+		return testResult();
+	}
+	check(reader.getRecordCount() == 2 * perThread + 2, "record count");
+
+	ZmqTraceFileHeader header;
+	FILE * file = fopen(path.c_str(), "rb");
+	check(file && fread(&header, sizeof(header), 1, file) == 1, "read header");
+	if (file) {
+		fclose(file);
+	}
+	check(fileSize(path) == static_cast<long>(sizeof(header) + header.dataSize), "file truncated to the records");
+
+	for (int pass = 0; pass < 2; ++pass) {
+		ZmqTraceRecord record;
+		uint64_t lastTimestamp = 0;
+		int nextIn = 0, nextOut = 0;
+		bool ordered = true, intact = true;
+		for (int c = 0; c < 2 * perThread && reader.next(record); ++c) {
+			ordered = ordered && record.timestamp >= lastTimestamp;
+			lastTimestamp = record.timestamp;
+			int & next = record.direction == ZmqTraceDirection::Incoming ? nextIn : nextOut;
+			const std::string expected = (record.direction == ZmqTraceDirection::Incoming ? "in " : "out ") + std::to_string(next++);
+			intact = intact && sameBytes(record.control, record.controlSize, "control") &&
+			         sameBytes(record.payload, record.payloadSize, expected);
+		}
+		check(ordered, "timestamps in the order written");
+		check(intact && nextIn == perThread && nextOut == perThread, "records of both threads in order");
+
+		check(reader.next(record) && record.direction == ZmqTraceDirection::Outgoing && record.controlSize == 0 &&
+		      sameBytes(record.payload, record.payloadSize, large), "record larger than the initial file");
+		check(reader.next(record) && record.direction == ZmqTraceDirection::Incoming &&
+		      sameBytes(record.control, record.controlSize, "last") && record.payloadSize == 0, "last record");
+		check(!reader.next(record), "no records after the last");
+		reader.rewind();
+	}
+
+	reader.close();
+	remove(path.c_str());
+	return testResult();
+}
@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "zmq_wrapper.hpp"
+#include "zmq_loopback_transport.hpp"
+
+/// Measure the cost of queueing, framing and dispatch in ZmqClient without sockets, using ZmqLoopbackTransport
+/// With --echo every data message is sent back to the client, so the receive path is measured too
+/// Usage: zmq_loopback_bench [message-count] [message-size] [--echo]
+int main(int argc, char * argv[]) {
+	const int count = argc > 1 ? atoi(argv[1]) : 1000000;
+	const int size = argc > 2 ? atoi(argv[2]) : 64;
+	const bool echo = argc > 3 && !strcmp(argv[3], "--echo");
+	if (count <= 0 || size < 0) {
+		printf("Usage: %s [message-count] [message-size] [--echo]\n", argv[0]);
+		return 1;
+	}
+
+	std::atomic<int> received(0);
+	ZmqClient client;
+	client.setRawCallback([&received](zmq::message_t &, ZmqClient *) {
+		++received;
+	});
+	client.setTransportFactory(ZmqLoopbackTransport::factory(
+		[echo](ZmqLoopbackTransport & transport, zmq::message_t & control, zmq::message_t & payload) {
+			if (!ZmqLoopbackTransport::serve(transport, control) && echo) {
+				transport.reply(std::move(control), std::move(payload));
+			}
+		}));
+	client.connect("loopback://bench");
+
+	std::vector<char> data(size, 'x');
+
+	using namespace std::chrono;
+	const auto start = high_resolution_clock::now();
+
+	for (int c = 0; c < count; ++c) {
+		client.send(data.data(), size);
+	}
+	while (client.good() && !client.waitForMessages(10000)) {}
+	while (echo && client.good() && received < count) {
+		std::this_thread::yield();
+	}
+
+	const auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+	const double seconds = std::max<double>(static_cast<double>(elapsed), 1.0) / 1e6;
+	printf("Sent %d messages of %d bytes in %.3f s, %.0f msg/s, %.1f MB/s\n", count, size, seconds,
+	       count / seconds, static_cast<double>(count) * size / seconds / (1 << 20));
+	if (echo) {
+		printf("Received %d echoed messages\n", static_cast<int>(received));
+	}
+
+	client.syncStop();
+	return !echo || received == count ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zmq_wrapper.hpp"
+#include "zmq_server.hpp"
+
+/// Send count messages of size bytes spread over clients exporter clients to a ZmqServer on loopback
+/// @return - received messages per second, 0 if not all messages arrived
+static double run(int port, int clients, int count, int size) {
+	std::atomic<int> received(0);
+	ZmqServer server;
+	server.setRawCallback([&received](zmq::message_t &, ZmqServerSession &) {
+		++received;
+	});
+	const std::string address = "tcp://127.0.0.1:" + std::to_string(port);
+	if (!server.bind(address.c_str())) {
+		return 0;
+	}
+
+	// exporters of one process share a runtime, a few runtimes give the clients several loop threads
+	const int runtimeCount = std::min<int>(clients, std::max<int>(std::thread::hardware_concurrency() / 2, 1));
+	std::vector<std::shared_ptr<ZmqClientRuntime>> runtimes;
+	for (int c = 0; c < runtimeCount; ++c) {
+		runtimes.push_back(std::make_shared<ZmqClientRuntime>());
+	}
+	std::vector<std::unique_ptr<ZmqClient>> exporters;
+	for (int c = 0; c < clients; ++c) {
+		exporters.push_back(std::unique_ptr<ZmqClient>(new ZmqClient(false, runtimes[c % runtimeCount])));
+		exporters.back()->connect(address.c_str());
+	}
+
+	std::vector<char> data(size, 'x');
+
+	using namespace std::chrono;
+	const auto start = high_resolution_clock::now();
+
+	// one producer thread per runtime, each sending round robin to the clients of it's runtime
+	std::vector<std::thread> producers;
+	for (int r = 0; r < runtimeCount; ++r) {
+		producers.push_back(std::thread([&, r]() {
+			std::vector<ZmqClient *> own;
+			for (int c = r; c < clients; c += runtimeCount) {
+				own.push_back(exporters[c].get());
+			}
+			const int messages = count / runtimeCount + (r < count % runtimeCount ? 1 : 0);
+			for (int c = 0; c < messages; ++c) {
+				own[c % own.size()]->send(data.data(), size);
+			}
+		}));
+	}
+	for (auto & producer : producers) {
+		producer.join();
+	}
+
+	const auto deadline = high_resolution_clock::now() + seconds(30);
+	while (received < count && high_resolution_clock::now() < deadline) {
+		std::this_thread::sleep_for(microseconds(100));
+	}
+
+	const auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+	const double secs = std::max<double>(static_cast<double>(elapsed), 1.0) / 1e6;
+	printf("%3d clients, %d sessions on %d workers: %d of %d messages of %d bytes in %.3f s, %.0f msg/s, %.1f MB/s\n",
+	       clients, server.getSessionCount(), server.getWorkerCount(), static_cast<int>(received), count, size, secs,
+	       received / secs, static_cast<double>(received) * size / secs / (1 << 20));
+
+	for (auto & exporter : exporters) {
+		exporter->syncStop();
+	}
+	server.stop();
+	return received == count ? count / secs : 0;
+}
+
+/// Measure throughput of ZmqServer with exporter clients connected over loopback TCP
+/// The messages are spread evenly over the clients, so the runs differ only in the number of sessions
+/// Usage: zmq_server_bench [message-count] [message-size] [port] [client-count...]
+int main(int argc, char * argv[]) {
+	const int count = argc > 1 ? atoi(argv[1]) : 1000000;
+	const int size = argc > 2 ? atoi(argv[2]) : 64;
+	const int port = argc > 3 ? atoi(argv[3]) : 5590;
+	std::vector<int> clientCounts;
+	for (int c = 4; c < argc; ++c) {
+		clientCounts.push_back(atoi(argv[c]));
+	}
+	if (clientCounts.empty()) {
+		clientCounts = {1, 10, 100};
+	}
+	if (count <= 0 || size < 0 || port <= 0 ||
+	    std::any_of(clientCounts.begin(), clientCounts.end(), [](int clients) { return clients <= 0; })) {
+		printf("Usage: %s [message-count] [message-size] [port] [client-count...]\n", argv[0]);
+		return 1;
+	}
+
+	bool ok = true;
+	for (size_t c = 0; c < clientCounts.size(); ++c) {
+		// new port for each run, so no client of the previous one reaches the new server
+		ok = run(port + static_cast<int>(c), clientCounts[c], count, size) > 0 && ok;
+	}
+	return ok ? 0 : 1;
+}
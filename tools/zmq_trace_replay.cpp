@@ -0,0 +1,40 @@
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+
+#include "zmq_wrapper.hpp"
+#include "zmq_trace_replay.hpp"
+
+/// Re-send the exporter traffic recorded with ZmqClient::setTrace to a server
+/// Usage: zmq_trace_replay <trace-file> <address> [--max-speed]
+int main(int argc, char * argv[]) {
+	if (argc < 3) {
+		printf("Usage: %s <trace-file> <address> [--max-speed]\n", argv[0]);
+		return 1;
+	}
+
+	const char * tracePath = argv[1];
+	const char * address = argv[2];
+	const ZmqReplaySpeed speed = argc > 3 && !strcmp(argv[3], "--max-speed") ? ZmqReplaySpeed::Maximum : ZmqReplaySpeed::Original;
+
+	ZmqTraceReader reader;
+	if (!reader.open(tracePath)) {
+		return 1;
+	}
+	printf("Replaying %llu records from [%s] to [%s]\n", static_cast<unsigned long long>(reader.getRecordCount()), tracePath, address);
+
+	ZmqClient client;
+	client.setFlushOnExit(true);
+	client.connect(address);
+
+	using namespace std::chrono;
+	const auto start = high_resolution_clock::now();
+
+	const uint64_t replayed = zmqReplayTrace(client, reader, speed);
+	while (client.good() && !client.waitForMessages(10000)) {}
+
+	const auto elapsed = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+	printf("Replayed %llu messages in %lld ms\n", static_cast<unsigned long long>(replayed), static_cast<long long>(elapsed));
+
+	return client.good() ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zmq_wrapper.hpp"
+#include "zmq_uring_transport.hpp"
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+
+/// Get the server's response to a control message
+/// @return - false if the message does not need response
+static bool getResponse(const ControlFrame & frame, ControlMessage & response) {
+	switch (frame.control) {
+	case ControlMessage::EXPORTER_CONNECT_MSG:
+		response = ControlMessage::RENDERER_CREATE_MSG;
+		return true;
+	case ControlMessage::PING_MSG:
+		response = ControlMessage::PONG_MSG;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/// Receive messages on ROUTER socket until @count data messages arrived
+static void serveZmq(zmq::context_t & context, int port, int count, std::atomic<bool> & done) {
+	zmq::socket_t socket(context, ZMQ_ROUTER);
+	socket.bind(("tcp://127.0.0.1:" + std::to_string(port)).c_str());
+
+	int received = 0;
+	while (received < count) {
+		zmq::pollitem_t item = {socket, 0, ZMQ_POLLIN, 0};
+		if (zmq::poll(&item, 1, 5000) == 0) {
+			puts("zmq server timed out");
+			break;
+		}
+		zmq::message_t identity, control, payload;
+		socket.recv(&identity);
+		socket.recv(&control);
+		if (control.more()) {
+			socket.recv(&payload);
+		}
+
+		const ControlFrame frame(control);
+		ControlMessage response;
+		if (frame.control == ControlMessage::DATA_MSG) {
+			++received;
+		} else if (getResponse(frame, response)) {
+			zmq::message_t reply = ControlFrame::make(frame.type, response);
+			zmq::message_t empty(0);
+			socket.send(identity, ZMQ_SNDMORE);
+			socket.send(reply, ZMQ_SNDMORE);
+			socket.send(empty);
+		}
+	}
+	done = true;
+	// keep the socket until the client is done with it
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+/// Buffered reader for the stream server, so small messages don't cost a syscall per frame
+struct StreamReader {
+	explicit StreamReader(int fd)
+	    : fd(fd)
+	    , buffer(1 << 20)
+	    , start(0)
+	    , end(0)
+	{}
+
+	/// Read exactly size bytes
+	/// @data - destination, if null the bytes are skipped
+	bool read(void * data, size_t size) {
+		char * dest = reinterpret_cast<char *>(data);
+		while (size) {
+			if (start == end) {
+				const ssize_t result = ::recv(fd, buffer.data(), buffer.size(), 0);
+				if (result <= 0) {
+					return false;
+				}
+				start = 0;
+				end = static_cast<size_t>(result);
+			}
+			const size_t chunk = std::min(size, end - start);
+			if (dest) {
+				memcpy(dest, buffer.data() + start, chunk);
+				dest += chunk;
+			}
+			start += chunk;
+			size -= chunk;
+		}
+		return true;
+	}
+
+	int fd; ///< The connected socket
+	std::vector<char> buffer; ///< Received bytes
+	size_t start; ///< First unread byte in @buffer
+	size_t end; ///< End of received bytes in @buffer
+};
+
+/// Receive messages with stream framing until @count data messages arrived
+static void serveStream(int listener, int count, std::atomic<bool> & done) {
+	const int fd = accept(listener, nullptr, nullptr);
+	StreamReader reader(fd);
+	ZmqStreamPreamble preamble;
+	if (fd == -1 || !reader.read(&preamble, sizeof(preamble)) || preamble.magic != ZmqStreamPreamble::MAGIC) {
+		puts("stream server failed to accept client");
+		done = true;
+		return;
+	}
+
+	int received = 0;
+	while (received < count) {
+		ZmqStreamFrameHeader header;
+		char control[ZmqStreamFrameHeader::MAX_CONTROL_SIZE];
+		if (!reader.read(&header, sizeof(header)) || header.controlSize > sizeof(control) ||
+		    header.payloadSize > ZmqStreamFrameHeader::MAX_PAYLOAD_SIZE || !reader.read(control, header.controlSize)) {
+			puts("stream server lost the client");
+			break;
+		}
+		// payloads are only counted, like the zmq server does
+		if (!reader.read(nullptr, static_cast<size_t>(header.payloadSize))) {
+			puts("stream server lost the client");
+			break;
+		}
+
+		const ControlFrame frame(zmq::message_t(control, header.controlSize));
+		ControlMessage response;
+		if (frame.control == ControlMessage::DATA_MSG) {
+			++received;
+		} else if (getResponse(frame, response)) {
+			const ControlFrame reply(frame.type, response);
+			const ZmqStreamFrameHeader replyHeader = {sizeof(reply), 0, 0};
+			char out[sizeof(replyHeader) + sizeof(reply)];
+			memcpy(out, &replyHeader, sizeof(replyHeader));
+			memcpy(out + sizeof(replyHeader), &reply, sizeof(reply));
+			if (::send(fd, out, sizeof(out), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(out))) {
+				break;
+			}
+		}
+	}
+	done = true;
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	::close(fd);
+}
+
+/// Send count messages pointing to the same data and wait until the server received all of them
+/// @report - if set, called once the server received everything, before the client stops
+/// @return - throughput in MB/s, 0 on failure
+static double upload(ZmqTransportFactory factory, const std::string & address, const std::vector<char> & data, int count,
+                     std::atomic<bool> & done, std::function<void()> report = nullptr) {
+	ZmqClient client;
+	client.setTransportFactory(factory);
+	client.connect(address.c_str());
+
+	using namespace std::chrono;
+	const auto start = high_resolution_clock::now();
+	for (int c = 0; c < count; ++c) {
+		// the payload references the data, so both transports start from the same memory
+		client.send(zmq::message_t(const_cast<char *>(data.data()), data.size(), nullptr));
+	}
+	while (!done && client.good()) {
+		std::this_thread::sleep_for(microseconds(200));
+	}
+	const double seconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1e6;
+	if (report && done) {
+		report();
+	}
+	client.syncStop();
+
+	if (!done) {
+		return 0;
+	}
+	return static_cast<double>(data.size()) * count / seconds / (1 << 20);
+}
+
+/// Compare throughput of the zmq socket and the io_uring transport when uploading large messages over loopback TCP
+/// The transport does not use zero copy send to loopback, with --zero-copy it is forced so the zero copy path with
+/// registered buffers is measured too, the kernel still copies the data so this shows the cost of the notifications
+/// Usage: zmq_uring_bench [message-count] [message-size] [port] [--zero-copy]
+int main(int argc, char * argv[]) {
+	const int count = argc > 1 ? atoi(argv[1]) : 256;
+	const int size = argc > 2 ? atoi(argv[2]) : 4 << 20;
+	const int port = argc > 3 ? atoi(argv[3]) : 5599;
+	const bool forceZeroCopy = argc > 4 && !strcmp(argv[4], "--zero-copy");
+	if (count <= 0 || size <= 0 || port <= 0 || (argc > 4 && !forceZeroCopy)) {
+		printf("Usage: %s [message-count] [message-size] [port] [--zero-copy]\n", argv[0]);
+		return 1;
+	}
+	const std::vector<char> data(size, 'x');
+	printf("Uploading %d messages of %d bytes\n", count, size);
+
+	zmq::context_t context(1);
+	std::atomic<bool> zmqDone(false);
+	std::thread zmqServer(serveZmq, std::ref(context), port, count, std::ref(zmqDone));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	const double zmqSpeed = upload(nullptr, "tcp://127.0.0.1:" + std::to_string(port), data, count, zmqDone);
+	zmqServer.join();
+	printf("zmq:      %.1f MB/s\n", zmqSpeed);
+
+	const int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	const int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16_t>(port + 1));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 1) != 0) {
+		printf("Failed to listen on port %d\n", port + 1);
+		return 1;
+	}
+	std::atomic<bool> streamDone(false);
+	std::thread streamServer(serveStream, listener, count, std::ref(streamDone));
+	// the client owns the transport, so it is kept only to read the zero copy counter before the client stops
+	std::atomic<ZmqUringTransport *> transport(nullptr);
+	const ZmqTransportFactory factory = [&transport, forceZeroCopy](zmq::context_t &) {
+		ZmqUringTransport * created = new ZmqUringTransport(forceZeroCopy);
+		transport = created;
+		return std::unique_ptr<ZmqTransport>(created);
+	};
+	uint64_t zeroCopyBytes = 0;
+	const double uringSpeed = upload(factory, "tcp://127.0.0.1:" + std::to_string(port + 1), data, count, streamDone,
+	                                 [&transport, &zeroCopyBytes]() {
+		zeroCopyBytes = transport.load()->getZeroCopyBytes();
+	});
+	streamServer.join();
+	::close(listener);
+	printf("io_uring: %.1f MB/s, %.1f%% of the payload sent with zero copy\n", uringSpeed,
+	       100.0 * static_cast<double>(zeroCopyBytes) / (static_cast<double>(data.size()) * count));
+
+	// forced zero copy that silently fell back to copying would measure the wrong thing
+	const bool zeroCopyUsed = !forceZeroCopy || zeroCopyBytes > 0;
+	if (!zeroCopyUsed) {
+		puts("Zero copy send was forced but not used");
+	}
+	return zmqSpeed > 0 && uringSpeed > 0 && zeroCopyUsed ? 0 : 1;
+}
+
+#else
+
+int main() {
+	puts("io_uring is available only on Linux");
+	return 1;
+}
+
+#endif // __linux__